@@ -0,0 +1,51 @@
+#ifndef PHEENO_ROS_ADAPTIVE_RATE_H
+#define PHEENO_ROS_ADAPTIVE_RATE_H
+
+/*
+ * Control loop rate that follows how urgent the situation is.
+ *
+ * Two urgencies are computed in [0, 1]: one from the closest IR range and
+ * one from the time to collision, each ramping linearly from their "far"
+ * to their "near" value. The larger one maps the rate between min_rate and
+ * max_rate. The rate jumps up immediately when urgency rises but decays
+ * gradually back down, so the loop does not oscillate at the boundary.
+ */
+class AdaptiveRate
+{
+
+public:
+  struct Bounds
+  {
+    Bounds()
+      : min_rate(5.0), max_rate(20.0), near_range(10.0), far_range(50.0),
+        near_ttc(0.5), far_ttc(3.0), decay(0.1) {}
+
+    double min_rate;    // Hz, in open space
+    double max_rate;    // Hz, right next to an obstacle
+    double near_range;  // cm, range at which max_rate is reached
+    double far_range;   // cm, range beyond which range does not matter
+    double near_ttc;    // s, time to collision at which max_rate is reached
+    double far_ttc;     // s, time to collision beyond which it does not matter
+    double decay;       // Fraction of the gap closed per update when slowing down
+  };
+
+  // Constructor
+  explicit AdaptiveRate(const Bounds& bounds = Bounds());
+
+  void setBounds(const Bounds& bounds);
+  const Bounds& bounds() const { return bounds_; }
+
+  // Feeds the closest range (cm) and time to collision (s, negative when
+  // not approaching anything) and returns the new rate.
+  double update(double min_range, double time_to_collision);
+
+  double rate() const { return rate_; }
+  double urgency() const { return urgency_; }
+
+private:
+  Bounds bounds_;
+  double rate_;
+  double urgency_;
+};
+
+#endif // PHEENO_ROS_ADAPTIVE_RATE_H
@@ -0,0 +1,157 @@
+#ifndef PHEENO_ROS_AVOIDANCE_KERNELS_H
+#define PHEENO_ROS_AVOIDANCE_KERNELS_H
+
+#include "pheeno_ros/pheeno_hardware.h"
+#include <cmath>
+
+/*
+ * ROS-free obstacle avoidance kernels, instantiated per hardware variant.
+ *
+ * PheenoRobot runs them on its own IR readings; a simulator can run them on
+ * any variant's readings. Sensors are addressed by role through std::get,
+ * so a variant missing a role fails to compile instead of reading garbage.
+ * random_turn is any callable returning a signed turn rate.
+ */
+namespace Pheeno
+{
+  /*
+   * True if any forward facing IR sensor reads below limit.
+   */
+  template <class HW>
+  bool irTriggered(const IrRanges<HW>& ir, double limit)
+  {
+    return IrCountBelow<HW>::apply(ir, limit, HW::IR_FORWARD_MASK) > 0;
+  }
+
+  /*
+   * Obstacle avoidance for a robot moving in a linear motion. Sets linear
+   * and angular to stop and turn away from the nearest obstacle, or to drive
+   * straight if nothing is within range_to_avoid.
+   */
+  template <class HW, class RandomTurn>
+  void avoidObstaclesLinear(const IrRanges<HW>& ir, double& linear, double& angular,
+                            double angular_velocity, double linear_velocity,
+                            double range_to_avoid, RandomTurn random_turn)
+  {
+    const double center = std::get<HW::IR_CENTER>(ir);
+    const double right = std::get<HW::IR_RIGHT>(ir);
+    const double left = std::get<HW::IR_LEFT>(ir);
+    const double c_right = std::get<HW::IR_CRIGHT>(ir);
+    const double c_left = std::get<HW::IR_CLEFT>(ir);
+
+    if (center < range_to_avoid)
+    {
+      if (std::abs(right - left) < 5.0 || (right > range_to_avoid && left > range_to_avoid))
+      {
+        linear = 0.0;
+        angular = random_turn();
+      }
+
+      if (right < left)
+      {
+        linear = 0.0;
+        angular = -1 * angular_velocity;  // Turn Left
+      }
+      else
+      {
+        linear = 0.0;
+        angular = angular_velocity;  // Turn Right
+      }
+    }
+    else if (c_right < range_to_avoid && c_left < range_to_avoid)
+    {
+      linear = 0.0;
+      angular = random_turn();
+    }
+    else if (c_right < range_to_avoid)
+    {
+      linear = 0.0;
+      angular = -1 * angular_velocity;  // Turn Left
+    }
+    else if (c_left < range_to_avoid)
+    {
+      linear = 0.0;
+      angular = angular_velocity;  // Turn Right
+    }
+    else if (right < range_to_avoid)
+    {
+      linear = 0.0;
+      angular = -1 * angular_velocity;  // Turn Left
+    }
+    else if (left < range_to_avoid)
+    {
+      linear = 0.0;
+      angular = angular_velocity;  // Turn Right
+    }
+    else
+    {
+      linear = linear_velocity;  // Move Straight
+      angular = 0.0;
+    }
+  }
+
+  /*
+   * Obstacle avoidance for a robot moving in an angular (turning) motion.
+   * Only angular is modified; without an obstacle the robot keeps turning
+   * at random_turn_value, which tracks the last commanded turn.
+   */
+  template <class HW, class RandomTurn>
+  void avoidObstaclesAngular(const IrRanges<HW>& ir, double& angular, double& random_turn_value,
+                             double angular_velocity, double range_to_avoid,
+                             RandomTurn random_turn)
+  {
+    const double center = std::get<HW::IR_CENTER>(ir);
+    const double right = std::get<HW::IR_RIGHT>(ir);
+    const double left = std::get<HW::IR_LEFT>(ir);
+    const double c_right = std::get<HW::IR_CRIGHT>(ir);
+    const double c_left = std::get<HW::IR_CLEFT>(ir);
+
+    if (center < range_to_avoid)
+    {
+      if (std::abs(right - left) < 5.0 || (right > range_to_avoid && left > range_to_avoid))
+      {
+        angular = random_turn();
+      }
+
+      if (right < left)
+      {
+        angular = -1 * angular_velocity;  // Turn Left
+      }
+      else
+      {
+        angular = angular_velocity;  // Turn Right
+      }
+    }
+    else if (c_right < range_to_avoid && c_left < range_to_avoid)
+    {
+      angular = random_turn();
+    }
+    else if (c_right < range_to_avoid)
+    {
+      angular = -1 * angular_velocity;  // Turn Left
+    }
+    else if (c_left < range_to_avoid)
+    {
+      angular = angular_velocity;  // Turn Right
+    }
+    else if (right < range_to_avoid)
+    {
+      angular = -1 * angular_velocity;  // Turn Left
+    }
+    else if (left < range_to_avoid)
+    {
+      angular = angular_velocity;  // Turn Right
+    }
+    else
+    {
+      angular = random_turn_value;
+    }
+
+    if (angular != random_turn_value)
+    {
+      random_turn_value = angular;
+    }
+  }
+}
+
+#endif // PHEENO_ROS_AVOIDANCE_KERNELS_H
@@ -0,0 +1,181 @@
+#ifndef PHEENO_ROS_BEHAVIORS_H
+#define PHEENO_ROS_BEHAVIORS_H
+
+#include "pheeno_ros/avoidance_kernels.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include <stdint.h>
+#include <cstddef>
+#include <random>
+#include <string>
+
+namespace Pheeno
+{
+  // Behaviors available to the simulator and its tools
+  enum BEHAVIOR
+  {
+    BEHAVIOR_OBSTACLE_AVOIDANCE,  // src/obstacle_avoidance.cpp
+    BEHAVIOR_RANDOM_WALK          // src/random_walk.cpp
+  };
+
+  /*
+   * Tunables of the obstacle_avoidance and random_walk nodes, which read
+   * them from ~behavior/<name> (see behaviorParamName).
+   */
+  struct BehaviorParams
+  {
+    BehaviorParams()
+      : range_to_avoid(20.0), angular_velocity(1.2), linear_velocity(0.08), random_turn(0.07),
+        straight_time(2.0), turn_time(5.0), walk_turn_time(10.0), walk_time(20.0), walk_linear(0.05) {}
+
+    double range_to_avoid;    // cm, IR trigger range of avoidObstaclesLinear/Angular
+    double angular_velocity;  // rad/s, avoidObstaclesAngular turn rate
+    double linear_velocity;   // m/s, avoidObstaclesLinear straight speed
+    double random_turn;       // rad/s, randomTurn magnitude
+    double straight_time;     // s, obstacle avoidance: end of the straight window
+    double turn_time;         // s, obstacle avoidance: end of the turning window
+    double walk_turn_time;    // s, random walk: end of the turn in place
+    double walk_time;         // s, random walk: end of the straight run
+    double walk_linear;       // m/s, random walk straight speed
+  };
+
+  /*
+   * Names of the BehaviorParams fields, for tools that set them by name.
+   */
+  inline const char* behaviorParamName(std::size_t i)
+  {
+    static const char* const names[] = {
+      "range_to_avoid", "angular_velocity", "linear_velocity", "random_turn", "straight_time",
+      "turn_time", "walk_turn_time", "walk_time", "walk_linear"
+    };
+    return i < sizeof(names) / sizeof(names[0]) ? names[i] : NULL;
+  }
+
+  /*
+   * The field called name, or NULL if there is none.
+   */
+  inline double* behaviorParam(BehaviorParams& params, const std::string& name)
+  {
+    double* fields[] = {
+      &params.range_to_avoid, &params.angular_velocity, &params.linear_velocity, &params.random_turn,
+      &params.straight_time, &params.turn_time, &params.walk_turn_time, &params.walk_time,
+      &params.walk_linear
+    };
+    for (std::size_t i = 0; behaviorParamName(i) != NULL; i++)
+    {
+      if (name == behaviorParamName(i))
+      {
+        return fields[i];
+      }
+    }
+    return NULL;
+  }
+
+  inline bool parseBehavior(const std::string& name, BEHAVIOR& behavior)
+  {
+    if (name == "obstacle_avoidance" || name == "avoidance")
+    {
+      behavior = BEHAVIOR_OBSTACLE_AVOIDANCE;
+    }
+    else if (name == "random_walk" || name == "walk")
+    {
+      behavior = BEHAVIOR_RANDOM_WALK;
+    }
+    else
+    {
+      return false;
+    }
+    return true;
+  }
+
+  /*
+   * The control loops of the obstacle_avoidance and random_walk nodes
+   * without ROS, for the simulator. update() is called once per control
+   * period with the time and (for obstacle avoidance) the IR ranges. Each
+   * instance has its own random number generator, so a seeded run repeats
+   * exactly.
+   */
+  template <class HW>
+  class Behavior
+  {
+
+  public:
+    // Constructor
+    Behavior(BEHAVIOR behavior = BEHAVIOR_OBSTACLE_AVOIDANCE, const BehaviorParams& params = BehaviorParams(),
+             uint32_t seed = 1)
+      : behavior_(behavior), params_(params), rng_(seed), saved_time_(0.0), turn_direction_(0.0),
+        linear_(0.0), angular_(0.0)
+    {
+      turn_direction_ = randomTurn(params_.random_turn);
+    }
+
+    const BehaviorParams& params() const { return params_; }
+
+    /*
+     * Sets the command for time now (s).
+     */
+    void update(double now, const IrRanges<HW>& ir, double& linear, double& angular)
+    {
+      double current_duration = now - saved_time_;
+      auto random_turn = [this]() { return randomTurn(); };
+
+      if (behavior_ == BEHAVIOR_RANDOM_WALK)
+      {
+        if (current_duration <= params_.walk_turn_time)
+        {
+          linear_ = 0.0;
+          angular_ = turn_direction_;
+        }
+        else if (current_duration < params_.walk_time)
+        {
+          linear_ = params_.walk_linear;
+          angular_ = 0.0;
+        }
+        else
+        {
+          saved_time_ = now;
+          turn_direction_ = randomTurn(params_.random_turn);
+        }
+      }
+      else
+      {
+        // As in the node, the straight window turns away at the random
+        // turn rate and the turning window at angular_velocity.
+        if (current_duration <= params_.straight_time)
+        {
+          avoidObstaclesLinear<HW>(ir, linear_, angular_, turn_direction_, params_.linear_velocity,
+                                   params_.range_to_avoid, random_turn);
+        }
+        else if (current_duration < params_.turn_time)
+        {
+          avoidObstaclesAngular<HW>(ir, angular_, turn_direction_, params_.angular_velocity,
+                                    params_.range_to_avoid, random_turn);
+        }
+        else
+        {
+          saved_time_ = now;
+          turn_direction_ = randomTurn(params_.random_turn);
+        }
+      }
+
+      linear = linear_;
+      angular = angular_;
+    }
+
+  private:
+    BEHAVIOR behavior_;
+    BehaviorParams params_;
+    std::mt19937 rng_;
+    double saved_time_;
+    double turn_direction_;
+    double linear_;
+    double angular_;
+
+    // PheenoRobot::randomTurn with this behavior's generator
+    double randomTurn(double angular = 0.06)
+    {
+      return rng_() % 10 + 1 <= 5 ? (-1 * angular) : angular;
+    }
+  };
+}
+
+#endif // PHEENO_ROS_BEHAVIORS_H
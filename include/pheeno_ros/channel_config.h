@@ -0,0 +1,99 @@
+#ifndef PHEENO_ROS_CHANNEL_CONFIG_H
+#define PHEENO_ROS_CHANNEL_CONFIG_H
+
+#include "ros/ros.h"
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+
+namespace Pheeno
+{
+  // Transport channels of PheenoRobot. Each one groups topics that share a
+  // transport configuration and latency statistics.
+  enum CHANNEL
+  {
+    IR_CHANNEL,
+    IR_BOTTOM_CHANNEL,
+    ODOM_CHANNEL,
+    ENCODER_CHANNEL,
+    IMU_CHANNEL,
+    SENSOR_SWEEP_CHANNEL,
+    CMD_VEL_CHANNEL,
+    CHANNEL_COUNT
+  };
+}
+
+/*
+ * Transport settings for one channel.
+ *
+ * The defaults favor latency over completeness: a queue of one so callbacks
+ * always see the newest sample, TCP_NODELAY so small sensor messages are not
+ * held back by Nagle's algorithm, and for high-rate sensors a preference for
+ * UDPROS that falls back to TCPROS when the publisher does not offer it.
+ */
+struct ChannelTransport
+{
+  ChannelTransport(uint32_t queue = 1, bool no_delay = true, bool udp = false)
+    : queue_size(queue), tcp_no_delay(no_delay), unreliable(udp) {}
+
+  uint32_t queue_size;
+  bool tcp_no_delay;
+  bool unreliable;
+
+  ros::TransportHints hints() const
+  {
+    ros::TransportHints transport_hints;
+    if (unreliable)
+    {
+      transport_hints.unreliable();
+    }
+    transport_hints.reliable().tcpNoDelay(tcp_no_delay);
+    return transport_hints;
+  }
+};
+
+/*
+ * Running statistics of message delays on one channel. PheenoRobot keeps
+ * two per channel:
+ *
+ *   queue:      receipt at the subscriber until the callback runs (time in
+ *               the callback queue until the node spins)
+ *   end-to-end: the sensor stamp until the callback runs, which includes
+ *               the transport (serial link, Nagle batching, queue sizes).
+ *               Only channels carrying a stamp have it: odom (header) and
+ *               the sensor sweep (Teensy millis()).
+ *
+ * A stamp taken on another clock (the sweep's) adds an unknown constant
+ * offset; min is the fastest message, so mean() - min and max - min are
+ * the delay above it. Messages a full queue drops are not counted. Reset
+ * after every report.
+ */
+struct LatencyStats
+{
+  LatencyStats() { reset(); }
+
+  unsigned long count;
+  double sum;
+  double min;
+  double max;
+
+  void record(double delay)
+  {
+    count++;
+    sum += delay;
+    min = std::min(min, delay);
+    max = std::max(max, delay);
+  }
+
+  double mean() const { return count > 0 ? sum / count : 0.0; }
+
+  void reset()
+  {
+    count = 0;
+    sum = 0.0;
+    min = std::numeric_limits<double>::max();
+    max = -std::numeric_limits<double>::max();
+  }
+};
+
+#endif // PHEENO_ROS_CHANNEL_CONFIG_H
@@ -0,0 +1,78 @@
+#ifndef PHEENO_ROS_CMA_ES_H
+#define PHEENO_ROS_CMA_ES_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+/*
+ * Covariance matrix adaptation evolution strategy (CMA-ES) for minimizing
+ * a noisy cost over a few real parameters.
+ *
+ * Each generation ask() samples population candidates from a multivariate
+ * normal around the mean; the caller evaluates them (in any order, on any
+ * threads) and hands the costs to tell(), which moves the mean towards the
+ * best half and adapts the step size and covariance. The samples come from
+ * the seeded generator only, so a run with the same seed and costs repeats
+ * exactly.
+ *
+ * The search is unbounded; callers with box constraints clamp candidates
+ * before evaluating them and add a penalty for the distance clamped.
+ */
+class CmaEs
+{
+
+public:
+  // Constructor (population == 0: 4 + 3 ln(dimension))
+  CmaEs(const std::vector<double>& mean, double sigma, uint32_t seed = 1, std::size_t population = 0);
+
+  std::size_t dimension() const { return mean_.size(); }
+  std::size_t population() const { return population_; }
+  unsigned long generation() const { return generation_; }
+
+  const std::vector<std::vector<double> >& ask();
+  void tell(const std::vector<double>& costs);
+
+  const std::vector<double>& mean() const { return mean_; }
+  double sigma() const { return sigma_; }
+  const std::vector<double>& best() const { return best_; }
+  double bestCost() const { return best_cost_; }
+
+  // Largest standard deviation of the search distribution
+  double spread() const;
+
+private:
+  std::size_t population_;
+  std::size_t parents_;
+  std::vector<double> weights_;
+  double mu_eff_;
+  double c_c_;
+  double c_sigma_;
+  double c_1_;
+  double c_mu_;
+  double damping_;
+  double chi_n_;
+
+  std::vector<double> mean_;
+  double sigma_;
+  std::vector<double> covariance_;    // Row major
+  std::vector<double> eigenvectors_;  // Row major, columns are the eigenvectors
+  std::vector<double> scales_;        // Square roots of the eigenvalues
+  std::vector<double> path_c_;
+  std::vector<double> path_sigma_;
+  unsigned long eigen_generation_;
+
+  std::mt19937 rng_;
+  std::normal_distribution<double> normal_;
+  std::vector<std::vector<double> > candidates_;
+  std::vector<std::vector<double> > steps_;  // (candidate - mean) / sigma
+  unsigned long generation_;
+
+  std::vector<double> best_;
+  double best_cost_;
+
+  void decompose();
+};
+
+#endif // PHEENO_ROS_CMA_ES_H
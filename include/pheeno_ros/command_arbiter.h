@@ -0,0 +1,82 @@
+#ifndef PHEENO_ROS_COMMAND_ARBITER_H
+#define PHEENO_ROS_COMMAND_ARBITER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+/*
+ * A velocity command as seen by the arbiter.
+ */
+struct VelocityCommand
+{
+  VelocityCommand(double _linear = 0.0, double _angular = 0.0)
+    : linear(_linear), angular(_angular) {}
+
+  double linear;
+  double angular;
+};
+
+/*
+ * In-process twist mux for PheenoRobot.
+ *
+ * Controllers submit into their own slot, each with a priority and a
+ * timeout. Once per control period arbitrate() picks the highest priority
+ * slot whose last command is younger than its timeout, so exactly one
+ * coherent command leaves the robot no matter how many controllers run.
+ *
+ * Slot writes are lock-free: every slot is a seqlock with a single writer,
+ * so controllers on different threads never contend as long as each one
+ * owns its slot. The safety stop overrides every slot until released.
+ */
+class CommandArbiter
+{
+
+public:
+  static const int MAX_SLOTS = 8;
+
+  // Constructor
+  CommandArbiter();
+
+  // Setup (not thread-safe, call before controllers start submitting)
+  int addSlot(const std::string& name, int priority, double timeout);
+  int findSlot(const std::string& name) const;
+  const std::string& slotName(int slot) const { return slots_[slot].name; }
+
+  // Lock-free write path (one writer per slot)
+  void submit(int slot, const VelocityCommand& command, double now);
+  void engageSafetyStop() { safety_stop_.store(true, std::memory_order_release); }
+  void releaseSafetyStop() { safety_stop_.store(false, std::memory_order_release); }
+  bool safetyStopEngaged() const { return safety_stop_.load(std::memory_order_acquire); }
+
+  // Control period
+  int arbitrate(double now, VelocityCommand& command) const;
+
+  // Return values of arbitrate() besides a slot index.
+  static const int NO_COMMAND = -1;
+  static const int SAFETY_STOP = -2;
+
+private:
+  struct Slot
+  {
+    Slot() : sequence(0), linear(0.0), angular(0.0), stamp(-1.0), priority(0), timeout(0.0) {}
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<double> linear;
+    std::atomic<double> angular;
+    std::atomic<double> stamp;
+
+    std::string name;
+    int priority;
+    double timeout;
+  };
+
+  Slot slots_[MAX_SLOTS];
+  int order_[MAX_SLOTS];  // Slot indices, highest priority first
+  int slot_count_;
+  std::atomic<bool> safety_stop_;
+
+  bool read(int slot, VelocityCommand& command, double& stamp) const;
+};
+
+#endif // PHEENO_ROS_COMMAND_ARBITER_H
@@ -0,0 +1,143 @@
+#ifndef PHEENO_ROS_FLOCK_RULES_H
+#define PHEENO_ROS_FLOCK_RULES_H
+
+#include "pheeno_ros/spatial_hash.h"
+#include "pheeno_ros/worker_team.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Pheeno
+{
+  // Swarm behaviors built from the same three rules with different weights.
+  enum FLOCK_MODE
+  {
+    FLOCK_AGGREGATE,  // Gather into clusters (cohesion and separation)
+    FLOCK_DISPERSE,   // Spread out evenly (separation only)
+    FLOCK_FLOCK       // Move together (separation, alignment and cohesion)
+  };
+}
+
+struct FlockMember
+{
+  double x;   // m
+  double y;
+  double vx;  // m/s
+  double vy;
+};
+
+/*
+ * Boids rules: separation from neighbors closer than separation_distance,
+ * alignment with the neighbors' mean velocity, and cohesion toward their
+ * centroid, all within neighbor_distance.
+ *
+ * Neighbors are fed one at a time with add(), so a robot can pass the
+ * neighbors it heard of and a simulator can pass them straight out of a
+ * spatial hash query, both through the same code. velocity() then gives
+ * the desired velocity, with its speed kept between min_speed and
+ * max_speed.
+ */
+class FlockRules
+{
+
+public:
+  struct Config
+  {
+    Config()
+      : separation(1.0), alignment(0.5), cohesion(0.02), separation_distance(0.2),
+        neighbor_distance(0.8), inertia(1.0), min_speed(0.04), max_speed(0.1) {}
+
+    // Weights are gains per call: alignment 0.5 closes half the velocity
+    // gap each control period.
+    double separation;
+    double alignment;
+    double cohesion;
+    double separation_distance;  // m
+    double neighbor_distance;    // m
+    double inertia;              // Share of the current velocity kept
+    double min_speed;            // m/s, unless the velocity is zero
+    double max_speed;            // m/s
+  };
+
+  static Config preset(Pheeno::FLOCK_MODE mode);
+  static bool parseMode(const std::string& name, Pheeno::FLOCK_MODE& mode);
+
+  // Constructor
+  explicit FlockRules(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+
+  void begin(const FlockMember& self);
+
+  // Neighbor at offset (dx, dy) from the agent begin() was called with.
+  void add(const FlockMember& neighbor, double dx, double dy, double distance_squared)
+  {
+    if (distance_squared > neighbor_range_squared_)
+    {
+      return;
+    }
+
+    count_++;
+    sum_x_ += dx;
+    sum_y_ += dy;
+    sum_vx_ += neighbor.vx;
+    sum_vy_ += neighbor.vy;
+    if (distance_squared < separation_range_squared_ && distance_squared > 0.0)
+    {
+      // Inverse distance push: 1/d in the direction away from the neighbor
+      push_x_ -= dx / distance_squared;
+      push_y_ -= dy / distance_squared;
+    }
+  }
+
+  std::size_t neighborCount() const { return count_; }
+  void velocity(double& vx, double& vy) const;
+
+  void steer(const FlockMember& self, const FlockMember* neighbors, std::size_t count, double& vx, double& vy);
+
+private:
+  Config config_;
+  double neighbor_range_squared_;
+  double separation_range_squared_;
+
+  FlockMember self_;
+  std::size_t count_;
+  double sum_x_;
+  double sum_y_;
+  double sum_vx_;
+  double sum_vy_;
+  double push_x_;
+  double push_y_;
+};
+
+/*
+ * FlockRules for a whole swarm at once, with neighbors from a spatial hash
+ * rebuilt in O(N) per call and blocks of agents spread over a WorkerTeam
+ * kept between calls.
+ * Every agent reads the same input snapshot, so results do not depend on
+ * the thread count.
+ */
+class FlockBatch
+{
+
+public:
+  // Constructor (threads 0 uses every hardware thread)
+  explicit FlockBatch(const FlockRules::Config& config = FlockRules::Config(), unsigned int threads = 0);
+
+  unsigned int threadCount() const { return team_.threadCount(); }
+
+  void step(const std::vector<FlockMember>& members, std::vector<double>& vx, std::vector<double>& vy);
+
+private:
+  // Agents per block handed to a thread
+  static const std::size_t BLOCK_SIZE = 1024;
+
+  FlockRules::Config config_;
+  SpatialHash hash_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<FlockRules> rules_;  // Per thread
+  WorkerTeam team_;
+};
+
+#endif // PHEENO_ROS_FLOCK_RULES_H
@@ -0,0 +1,72 @@
+#ifndef PHEENO_ROS_FRONTIER_TRACKER_H
+#define PHEENO_ROS_FRONTIER_TRACKER_H
+
+#include "pheeno_ros/occupancy_grid.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Frontier cells of a TiledOccupancyGrid: free cells with an unknown
+ * 4-neighbor.
+ *
+ * Whether a cell is a frontier depends only on its own class and its
+ * neighbors', so update() re-examines each changed cell and its four
+ * neighbors. Maintenance is proportional to the grid's class change
+ * journal, not to the map size. Cells leaving the frontier are only
+ * flagged and their list entries are compacted away in bulk.
+ *
+ * cluster() groups 8-connected frontier cells with union-find over the
+ * sorted frontier list, so clustering costs O(F log F) in the number of
+ * frontier cells F.
+ */
+class FrontierTracker
+{
+
+public:
+  struct Cluster
+  {
+    std::size_t size;   // Frontier cells
+    double centroid_x;  // m
+    double centroid_y;
+    double target_x;    // m, the cluster's cell closest to its centroid
+    double target_y;
+  };
+
+  // Constructor
+  FrontierTracker();
+
+  // Adopts the map's geometry and scans it once.
+  void reset(const TiledOccupancyGrid& map);
+  void update(const TiledOccupancyGrid& map, const std::vector<uint32_t>& cells);
+
+  std::size_t frontierCount() const { return count_; }
+  bool isFrontier(int x, int y) const { return frontier_[static_cast<std::size_t>(y) * width_ + x] != 0; }
+  bool isFrontierAt(double wx, double wy) const;
+
+  void cluster(std::size_t min_size, std::vector<Cluster>& clusters);
+
+private:
+  int width_;
+  int height_;
+  double resolution_;
+  double origin_x_;
+  double origin_y_;
+
+  std::vector<uint8_t> frontier_;  // Per map cell
+  std::vector<uint32_t> cells_;    // Frontier cells, may hold stale entries
+  std::size_t count_;
+
+  // Clustering scratch space
+  std::vector<uint32_t> parent_;
+  std::vector<int32_t> cluster_of_;  // Per root
+  std::vector<Cluster> sums_;
+  std::vector<uint32_t> best_cell_;
+  std::vector<double> best_distance_;
+
+  void evaluate(const TiledOccupancyGrid& map, int x, int y);
+  void compact();
+  uint32_t find(uint32_t i);
+};
+
+#endif // PHEENO_ROS_FRONTIER_TRACKER_H
@@ -0,0 +1,148 @@
+#ifndef PHEENO_ROS_GRID_PLANNER_H
+#define PHEENO_ROS_GRID_PLANNER_H
+
+#include "pheeno_ros/occupancy_grid.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace Pheeno
+{
+  // Planner edge costs (straight and diagonal moves between planner cells).
+  const int32_t PLAN_STRAIGHT_COST = 10;
+  const int32_t PLAN_DIAGONAL_COST = 14;
+  const int32_t PLAN_INFINITY = 0x3FFFFFFF;
+}
+
+/*
+ * Incremental 8-connected grid planner (D* Lite) over a TiledOccupancyGrid.
+ *
+ * Planner cells are cell_factor x cell_factor blocks of map cells. A planner
+ * cell is blocked while any occupied map cell lies within inflation map
+ * cells of its block, so the robot's footprint is accounted for. Unknown
+ * cells are treated as free. Moving into a blocked cell, or diagonally past
+ * one, costs Pheeno::PLAN_INFINITY; moving out of one is allowed so a robot
+ * that drifted close to a wall can still leave.
+ *
+ * The search runs backward from the goal, so after the robot moves or cells
+ * change only the vertices whose costs changed are repaired instead of
+ * restarting the search. mapChanged() takes the grid's class change journal
+ * and keeps per-cell occupied counts, making an update proportional to the
+ * number of changed map cells.
+ *
+ * Search nodes come from a pool and are only created for cells the search
+ * touches. Costs are integers, so the open list is a bucket queue indexed by
+ * the first key with lazy deletion; pushes are O(1) and a pop scans one
+ * small bucket.
+ */
+class GridPlanner
+{
+
+public:
+  struct Config
+  {
+    Config() : cell_factor(4), inflation(3), max_expansions(200000) {}
+
+    int cell_factor;     // Map cells per planner cell side
+    int inflation;       // Map cells kept clear around the block
+    int max_expansions;  // Per plan() call
+  };
+
+  struct Waypoint
+  {
+    double x;  // m, planner cell center
+    double y;
+  };
+
+  // Constructor
+  explicit GridPlanner(const Config& config = Config());
+
+  // Adopts the map's geometry and obstacles and drops the search.
+  void reset(const TiledOccupancyGrid& map);
+  void mapChanged(const TiledOccupancyGrid& map, const std::vector<uint32_t>& cells);
+
+  bool setGoal(double wx, double wy);
+  bool setStart(double wx, double wy);
+  bool hasGoal() const { return goal_ >= 0; }
+
+  bool plan();
+  bool path(std::vector<Waypoint>& waypoints, std::size_t max_waypoints = 0) const;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  bool blocked(int x, int y) const { return blocked_[y * width_ + x] != 0; }
+  int32_t startCost() const;
+  int lastExpansions() const { return expansions_; }
+  std::size_t nodeCount() const { return nodes_.size(); }
+  std::size_t memoryBytes() const;
+
+private:
+  // Key units per queue bucket (log2).
+  static const int BUCKET_SHIFT = 3;
+
+  struct Node
+  {
+    int32_t g;
+    int32_t rhs;
+    int32_t k1;
+    int32_t k2;
+    int32_t cell;
+    uint32_t stamp;  // Matches the live queue entry
+    bool queued;
+  };
+
+  struct Entry
+  {
+    int32_t node;
+    uint32_t stamp;
+  };
+
+  Config config_;
+  int width_;
+  int height_;
+  int map_width_;
+  int map_height_;
+  double origin_x_;
+  double origin_y_;
+  double cell_size_;
+
+  std::vector<uint16_t> occupied_count_;  // Per planner cell
+  std::vector<uint8_t> blocked_;          // Per planner cell
+  std::vector<bool> map_occupied_;        // Per map cell, as last seen
+
+  std::vector<int32_t> node_of_cell_;  // -1 until the search touches a cell
+  std::vector<Node> nodes_;
+
+  std::vector<std::vector<Entry> > buckets_;
+  std::size_t min_bucket_;
+  std::size_t queued_;
+
+  int32_t start_;
+  int32_t goal_;
+  int32_t last_start_;
+  int32_t km_;
+  int expansions_;
+  std::vector<int32_t> flipped_;  // Planner cells whose blocked state changed
+
+  bool worldToPlanner(double wx, double wy, int32_t& cell) const;
+  void resetSearch();
+
+  int32_t heuristic(int32_t a, int32_t b) const;
+  int32_t cost(int32_t from, int32_t to) const;
+  int neighbors(int32_t cell, int32_t* out) const;
+
+  int32_t node(int32_t cell);
+  int32_t g(int32_t cell) const;
+  int32_t rhs(int32_t cell) const;
+  int32_t bestSuccessor(int32_t cell, int32_t* successor) const;
+
+  void calculateKey(int32_t cell, int32_t& k1, int32_t& k2) const;
+  void push(int32_t index);
+  bool top(int32_t& index);
+  void remove(int32_t index);
+  void updateVertex(int32_t cell);
+
+  void setMapOccupied(int x, int y, bool occupied);
+};
+
+#endif // PHEENO_ROS_GRID_PLANNER_H
@@ -0,0 +1,66 @@
+#ifndef PHEENO_ROS_IR_QUERY_H
+#define PHEENO_ROS_IR_QUERY_H
+
+#include "pheeno_ros/pheeno_hardware.h"
+#include <stdint.h>
+#include <cstddef>
+
+/*
+ * Multi-threshold IR trigger queries.
+ *
+ * A query asks "which of these sensors read below this range?". Behaviors
+ * ask several of them every tick (front sector blocked, sides clear,
+ * anything within emergency distance), so all queries are answered in one
+ * pass: the IR ranges are compared against each threshold with SSE2 or NEON
+ * four sensors at a time, and each answer is a bitmask of sensor indices
+ * plus its population count.
+ */
+namespace Pheeno
+{
+  // Sensors a single query can cover (bit i of a mask is IR index i).
+  const std::size_t IR_QUERY_MAX_SENSORS = 8;
+}
+
+struct IrQuery
+{
+  IrQuery(float _threshold = 0.0f, uint32_t _sensor_mask = 0xFF)
+    : threshold(_threshold), sensor_mask(_sensor_mask) {}
+
+  float threshold;       // cm
+  uint32_t sensor_mask;  // Sensors the query looks at
+};
+
+struct IrQueryResult
+{
+  IrQueryResult() : below(0), count(0) {}
+
+  uint32_t below;  // Sensors in the query mask reading below the threshold
+  int count;       // Number of bits set in below
+
+  bool any() const { return below != 0; }
+};
+
+// Answers query_count queries over one robot's ranges (at most 8 sensors).
+void evaluateIrQueries(const float* ir, std::size_t ir_count,
+                       const IrQuery* queries, std::size_t query_count,
+                       IrQueryResult* results);
+
+/*
+ * Convenience overload for a robot's descriptor-sized IR array.
+ */
+template <class HW>
+void evaluateIrQueries(const Pheeno::IrRanges<HW>& ir,
+                       const IrQuery* queries, std::size_t query_count,
+                       IrQueryResult* results)
+{
+  static_assert(HW::IR_COUNT <= Pheeno::IR_QUERY_MAX_SENSORS, "Too many IR sensors for IrQuery.");
+
+  float ranges[HW::IR_COUNT];
+  for (std::size_t i = 0; i < HW::IR_COUNT; i++)
+  {
+    ranges[i] = static_cast<float>(ir[i]);
+  }
+  evaluateIrQueries(ranges, HW::IR_COUNT, queries, query_count, results);
+}
+
+#endif // PHEENO_ROS_IR_QUERY_H
@@ -0,0 +1,94 @@
+#ifndef PHEENO_ROS_MAP_MERGER_H
+#define PHEENO_ROS_MAP_MERGER_H
+
+#include "pheeno_ros/occupancy_grid.h"
+#include "pheeno_ros/pose2d.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Merges occupancy grid deltas from several sources (robots, usually this
+ * one included) into one grid.
+ *
+ * Every source keeps the latest version of each tile it sent, identified by
+ * the sequence number of the delta that carried it. Older or repeated
+ * tiles are ignored, so deltas may arrive late, twice, or interleaved with
+ * other sources. A delta from a new session (the sender restarted) drops
+ * what the source sent before; late deltas from the session it replaced
+ * are ignored. A merged cell is the saturated sum of the sources'
+ * log-odds at that point, sampled through each source's transform. Because
+ * it only depends on the latest tiles, the result does not depend on the
+ * order deltas arrive in.
+ *
+ * Merging is incremental: a received tile only marks the merged tiles its
+ * transformed footprint overlaps, and update() recomputes just those.
+ * Merged cells are written through TiledOccupancyGrid::setLogOdds, so the
+ * merged grid's dirty tiles and class change journal work as usual.
+ *
+ * The class is ROS-free, so any number of simulated robots can exchange
+ * deltas in one process.
+ */
+class MapMerger
+{
+
+public:
+  // Constructor
+  explicit MapMerger(const TiledOccupancyGrid::Config& config = TiledOccupancyGrid::Config());
+
+  // Drops all sources and resizes the merged grid.
+  bool configure(const TiledOccupancyGrid::Config& config);
+
+  // transform takes the source's map frame into the merged frame.
+  int addSource(const Pose2D& transform = Pose2D());
+  void setTransform(int source, const Pose2D& transform);
+  const Pose2D& transform(int source) const { return sources_[source].transform; }
+  std::size_t sourceCount() const { return sources_.size(); }
+
+  bool applyDelta(int source, const uint8_t* data, std::size_t size);
+  std::size_t update(std::size_t max_tiles = 0);
+  std::size_t pendingTiles() const { return pending_.size(); }
+
+  TiledOccupancyGrid& map() { return merged_; }
+  const TiledOccupancyGrid& map() const { return merged_; }
+  std::size_t memoryBytes() const;
+
+private:
+  struct Source
+  {
+    Pose2D transform;
+    double cos_theta;
+    double sin_theta;
+    bool has_geometry;
+    bool has_sequence;
+    uint32_t session;
+    uint32_t retired_session;  // The session before the last restart
+    bool has_retired_session;
+    uint32_t last_sequence;
+    float resolution;
+    float origin_x;
+    float origin_y;
+    int tiles_x;
+    int tiles_y;
+    std::vector<int32_t> slot_of_tile;  // -1 until the tile is received
+    std::vector<uint32_t> tile_of_slot;
+    std::vector<uint32_t> version;      // Per slot
+    std::vector<int8_t> cells;          // Per slot, 256 cells each
+  };
+
+  TiledOccupancyGrid merged_;
+  int merged_tiles_x_;
+  int merged_tiles_y_;
+  std::vector<Source> sources_;
+  std::vector<uint8_t> pending_flag_;  // Per merged tile
+  std::vector<uint32_t> pending_;
+  std::vector<int> active_;            // Sources overlapping the tile being merged
+
+  void resetSource(Source& source);
+  void markFootprint(const Source& source, int tile_x, int tile_y);
+  void mergeTile(uint32_t tile);
+  bool overlaps(const Source& source, double min_x, double min_y, double max_x, double max_y) const;
+  int sample(const Source& source, double wx, double wy) const;
+};
+
+#endif // PHEENO_ROS_MAP_MERGER_H
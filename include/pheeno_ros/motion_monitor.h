@@ -0,0 +1,119 @@
+#ifndef PHEENO_ROS_MOTION_MONITOR_H
+#define PHEENO_ROS_MOTION_MONITOR_H
+
+namespace Pheeno
+{
+  // Events raised by MotionMonitor (bitmask).
+  enum MOTION_EVENT
+  {
+    MOTION_NONE = 0,
+    MOTION_SLIP = 1 << 0,    // Wheels and IMU disagree (spinning against an obstacle, pushed)
+    MOTION_STALL = 1 << 1,   // Motion commanded, wheels not turning
+    MOTION_IMPACT = 1 << 2,  // Horizontal acceleration spike
+    MOTION_EVENT_KINDS = 3
+  };
+}
+
+/*
+ * Wheel slip, stall and impact detection from encoder and IMU disagreement.
+ *
+ * Every input is folded in as it arrives, at constant cost, from the sensor
+ * callbacks:
+ *
+ * - Slip: the gyroscope yaw rate minus the wheel yaw rate, low-pass
+ *   filtered over filter_time, exceeds slip_yaw_rate; or the change of
+ *   the wheel speed minus the integrated acceleration exceeds slip_speed.
+ *   That residual leaks away over residual_time, so what is left of the
+ *   accelerometer bias cannot build up, while the sudden stop against a
+ *   wall the IR sensors missed shows up within a few samples.
+ * - Stall: motion has been commanded for stall_time while the wheels stand
+ *   still.
+ * - Impact: the bias-corrected horizontal acceleration exceeds
+ *   impact_acceleration.
+ *
+ * The gyroscope bias is tracked while the robot is commanded to stand
+ * still and does; the accelerometer bias is the long-run difference
+ * between the measured and the wheel acceleration. An event stays active for hold_time
+ * and carries the direction (robot frame) the obstacle is likely in.
+ */
+class MotionMonitor
+{
+
+public:
+  struct Config
+  {
+    Config()
+      : slip_yaw_rate(0.6), slip_speed(0.04), stall_speed(0.005), stall_yaw_rate(0.1),
+        stall_command(0.02), stall_command_yaw_rate(0.3), stall_time(0.1), impact_acceleration(3.0),
+        filter_time(0.03), residual_time(0.25), bias_time(2.0), hold_time(1.0), max_gap(0.5) {}
+
+    double slip_yaw_rate;           // rad/s
+    double slip_speed;              // m/s
+    double stall_speed;             // m/s, wheels below this (and stall_yaw_rate) stand still
+    double stall_yaw_rate;          // rad/s
+    double stall_command;           // m/s, commands above this (or stall_command_yaw_rate) move
+    double stall_command_yaw_rate;  // rad/s
+    double stall_time;              // s
+    double impact_acceleration;     // m/s^2
+    double filter_time;             // s, yaw rate residual filter
+    double residual_time;           // s, leak of the speed residual
+    double bias_time;               // s, IMU bias tracking
+    double hold_time;               // s, an event stays active this long
+    double max_gap;                 // s, longer input gaps restart an integration
+  };
+
+  // Constructor
+  explicit MotionMonitor(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+  void setConfig(const Config& config) { config_ = config; }
+  void reset();
+
+  // Inputs (stamps in seconds on one clock). The last three return the
+  // events they raised that were not already active.
+  void command(double stamp, double linear, double angular);
+  unsigned int wheels(double stamp, double linear, double angular);
+  unsigned int gyroscope(double stamp, double yaw_rate);
+  unsigned int accelerometer(double stamp, double ax, double ay);
+
+  unsigned int events(double now) const;
+  bool obstacle(double now, double& direction) const;
+  unsigned long eventCount(Pheeno::MOTION_EVENT event) const;
+
+  double yawRateResidual() const { return yaw_residual_; }
+  double speedResidual() const { return speed_residual_; }
+
+private:
+  Config config_;
+
+  // Latest inputs
+  double command_linear_;
+  double command_angular_;
+  double command_since_;  // Stamp the current motion command started (< 0 when still)
+  double wheel_linear_;
+  double wheel_angular_;
+  double still_since_;    // Stamp the wheels stopped turning (< 0 while turning)
+
+  // Residuals and biases
+  double gyro_stamp_;
+  double gyro_bias_;
+  double yaw_residual_;
+  double accel_stamp_;
+  double accel_bias_x_;
+  double accel_bias_y_;
+  double accel_wheel_linear_;  // Wheel speed at the previous accelerometer sample
+  double speed_residual_;
+  double accel_settling_;      // s until the speed residual is checked
+
+  // Events
+  double raised_[Pheeno::MOTION_EVENT_KINDS];
+  unsigned long counts_[Pheeno::MOTION_EVENT_KINDS];
+  double direction_;
+
+  bool commandedStill() const;
+  bool wheelsStill() const;
+  double travelDirection(double speed) const;
+  unsigned int raise(Pheeno::MOTION_EVENT event, double stamp, double direction);
+};
+
+#endif // PHEENO_ROS_MOTION_MONITOR_H
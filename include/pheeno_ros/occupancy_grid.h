@@ -0,0 +1,194 @@
+#ifndef PHEENO_ROS_OCCUPANCY_GRID_H
+#define PHEENO_ROS_OCCUPANCY_GRID_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace Pheeno
+{
+  // Cells per tile side. A tile row is 16 int8 cells, one SIMD register.
+  const int MAP_TILE_SIZE = 16;
+  const int MAP_TILE_CELLS = MAP_TILE_SIZE * MAP_TILE_SIZE;
+
+  // Upper bound on the memory a grid may use (cells and bookkeeping).
+  const std::size_t MAP_MAX_BYTES = 2 * 1024 * 1024;
+
+  const uint8_t MAP_DELTA_VERSION = 2;
+
+  enum MAP_TILE_ENCODING
+  {
+    TILE_RAW = 0,
+    TILE_RLE = 1
+  };
+
+  // What planners and exploration consider a cell to be.
+  enum CELL_CLASS
+  {
+    CELL_UNKNOWN,
+    CELL_FREE,
+    CELL_OCCUPIED
+  };
+
+  // Log-odds at or beyond which a cell counts as free / occupied.
+  const int8_t FREE_LOG_ODDS = -20;
+  const int8_t OCCUPIED_LOG_ODDS = 20;
+}
+
+/*
+ * Occupancy grid with int8 log-odds cells stored in 16x16 tiles.
+ *
+ * Cells of a tile are contiguous (256 bytes, four cache lines), so a beam
+ * touches few cache lines, and a tile row is a single SSE2/NEON register.
+ * A beam is traced with Bresenham; consecutive free cells in one tile row
+ * are merged into runs and updated with one masked saturating add. The hit
+ * cell at the end of the beam gets the occupied update.
+ *
+ * Log-odds units are LOG_ODDS_SCALE nats. 0 means unknown, and cells
+ * saturate at the int8 limits.
+ *
+ * Tiles touched since the last delta are tracked. encodeDelta() serializes
+ * just those tiles (run-length encoded when that is smaller), and
+ * applyDelta() lets another grid replay them.
+ *
+ * With change tracking on, every cell whose class (unknown, free,
+ * occupied) changes is journaled by row-major index, so planners and
+ * frontier tracking can update in proportion to what changed.
+ */
+class TiledOccupancyGrid
+{
+
+public:
+  static const double LOG_ODDS_SCALE;
+
+  struct Config
+  {
+    Config()
+      : resolution(0.02), width(512), height(512), origin_x(-5.12), origin_y(-5.12),
+        hit(24), miss(-6) {}
+
+    double resolution;  // m per cell
+    int width;          // cells, rounded up to whole tiles
+    int height;         // cells, rounded up to whole tiles
+    double origin_x;    // m, world position of cell (0, 0)
+    double origin_y;
+    int8_t hit;         // Log-odds added to the cell a beam ends in
+    int8_t miss;        // Log-odds added to cells a beam passes through
+  };
+
+  // Constructor
+  explicit TiledOccupancyGrid(const Config& config = Config());
+
+  bool configure(const Config& config);
+  const Config& config() const { return config_; }
+  void clear();
+
+  int width() const { return config_.width; }
+  int height() const { return config_.height; }
+  std::size_t memoryBytes() const;
+
+  bool worldToCell(double wx, double wy, int& x, int& y) const;
+  int8_t logOdds(int x, int y) const { return cells_[cellIndex(x, y)]; }
+  void setLogOdds(int x, int y, int8_t value);
+
+  static Pheeno::CELL_CLASS classify(int8_t log_odds)
+  {
+    return log_odds <= Pheeno::FREE_LOG_ODDS ? Pheeno::CELL_FREE
+         : (log_odds >= Pheeno::OCCUPIED_LOG_ODDS ? Pheeno::CELL_OCCUPIED : Pheeno::CELL_UNKNOWN);
+  }
+  Pheeno::CELL_CLASS cellClass(int x, int y) const { return classify(logOdds(x, y)); }
+
+  // Class change journal (row-major cell indices, y * width + x)
+  void setChangeTracking(bool enable);
+  void takeClassChanges(std::vector<uint32_t>& cells);
+
+  // Beam updates (world coordinates, meters)
+  void insertBeam(double sx, double sy, double ex, double ey, bool hit);
+
+  // Deltas. The session is random per grid, so receivers can tell a
+  // restarted sender from late deltas.
+  std::size_t dirtyTileCount() const { return dirty_tiles_.size(); }
+  uint32_t deltaSession() const { return delta_session_; }
+  void setDeltaSession(uint32_t session) { delta_session_ = session; }
+  void encodeDelta(std::vector<uint8_t>& out, std::size_t max_bytes = 0);
+  bool applyDelta(const uint8_t* data, std::size_t size);
+  void refreshTiles(std::size_t count);
+
+  // Row-major occupancy in nav_msgs/OccupancyGrid convention (-1, 0-100).
+  void fillOccupancy(std::vector<int8_t>& out) const;
+
+private:
+  Config config_;
+  int tiles_x_;
+  int tiles_y_;
+  std::vector<int8_t> cells_;           // Tile-major, row-major within a tile
+  std::vector<uint8_t> tile_dirty_;
+  std::vector<uint32_t> dirty_tiles_;
+  uint32_t delta_session_;
+  uint32_t delta_sequence_;
+  uint32_t refresh_cursor_;
+  bool track_changes_;
+  std::vector<uint32_t> class_changes_;
+
+  std::size_t cellIndex(int x, int y) const
+  {
+    std::size_t tile = static_cast<std::size_t>(y / Pheeno::MAP_TILE_SIZE) * tiles_x_ + x / Pheeno::MAP_TILE_SIZE;
+    return tile * Pheeno::MAP_TILE_CELLS + (y % Pheeno::MAP_TILE_SIZE) * Pheeno::MAP_TILE_SIZE +
+           x % Pheeno::MAP_TILE_SIZE;
+  }
+
+  void markDirty(int x, int y);
+  void recordChange(int x, int y, int8_t before, int8_t after)
+  {
+    if (track_changes_ && classify(before) != classify(after))
+    {
+      class_changes_.push_back(static_cast<uint32_t>(y) * config_.width + x);
+    }
+  }
+  void addRun(int y, int x_begin, int x_end, int8_t delta);
+  void addCell(int x, int y, int8_t delta);
+};
+
+/*
+ * Walks the tiles of a delta from TiledOccupancyGrid::encodeDelta(),
+ * decoding each into 256 cells. Used by grids replaying their own kind of
+ * delta and by map merging, which keeps tiles per sender.
+ */
+class MapDeltaReader
+{
+
+public:
+  // Constructor
+  MapDeltaReader(const uint8_t* data, std::size_t size);
+
+  bool valid() const { return valid_; }
+  bool failed() const { return failed_; }
+
+  uint32_t session() const { return session_; }
+  uint32_t sequence() const { return sequence_; }
+  float resolution() const { return resolution_; }
+  float originX() const { return origin_x_; }
+  float originY() const { return origin_y_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int tileCount() const { return tile_count_; }
+
+  bool next(int& tile_x, int& tile_y, int8_t* cells);
+
+private:
+  const uint8_t* cursor_;
+  const uint8_t* end_;
+  bool valid_;
+  bool failed_;
+  uint32_t session_;
+  uint32_t sequence_;
+  float resolution_;
+  float origin_x_;
+  float origin_y_;
+  int width_;
+  int height_;
+  int tile_count_;
+  int tiles_read_;
+};
+
+#endif // PHEENO_ROS_OCCUPANCY_GRID_H
@@ -0,0 +1,112 @@
+#ifndef PHEENO_ROS_ORCA_H
+#define PHEENO_ROS_ORCA_H
+
+#include "pheeno_ros/spatial_hash.h"
+#include "pheeno_ros/worker_team.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+ * Optimal reciprocal collision avoidance (ORCA) for disc-shaped robots.
+ *
+ * Each neighbor contributes a half-plane of velocities that avoid it for
+ * time_horizon seconds, assuming it takes half the responsibility. The
+ * chosen velocity is the one closest to the preferred velocity inside all
+ * half-planes and the max_speed disc, found with an incremental 2D linear
+ * program. When the half-planes leave nothing feasible, the velocity that
+ * least violates them is used instead.
+ *
+ * Unlike IR thresholds, this tells a robot moving away from a robot moving
+ * closer, so two robots pass each other instead of both stopping.
+ */
+struct OrcaAgent
+{
+  double x;          // m
+  double y;
+  double vx;         // m/s, current velocity
+  double vy;
+  double pref_vx;    // m/s, velocity the behavior would like
+  double pref_vy;
+  double radius;     // m
+  double max_speed;  // m/s
+};
+
+class OrcaSolver
+{
+
+public:
+  struct Config
+  {
+    Config() : time_horizon(1.5), neighbor_distance(0.6), max_neighbors(10) {}
+
+    double time_horizon;       // s
+    double neighbor_distance;  // m, center to center
+    std::size_t max_neighbors; // Closest ones are kept
+  };
+
+  // Constructor
+  explicit OrcaSolver(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+
+  bool solve(const OrcaAgent& agent, const OrcaAgent* neighbors, std::size_t count, double dt,
+             double& vx, double& vy);
+
+private:
+  struct Line
+  {
+    double point_x;
+    double point_y;
+    double direction_x;  // Unit; feasible velocities lie to the left
+    double direction_y;
+  };
+
+  Config config_;
+
+  // Scratch space, reused between calls
+  std::vector<std::pair<double, std::size_t> > nearest_;
+  std::vector<Line> lines_;
+  std::vector<Line> projected_;
+
+  bool linearProgram1(const std::vector<Line>& lines, std::size_t line, double radius,
+                      double opt_x, double opt_y, bool direction_opt, double& x, double& y) const;
+  std::size_t linearProgram2(const std::vector<Line>& lines, double radius, double opt_x, double opt_y,
+                             bool direction_opt, double& x, double& y) const;
+  void linearProgram3(std::size_t begin_line, double radius, double& x, double& y);
+};
+
+/*
+ * ORCA for a whole swarm at once. Neighbors come from a spatial hash built
+ * once per call, and agents are split in blocks over a WorkerTeam kept
+ * between calls. Each agent's velocity depends only on the input snapshot,
+ * so results are the same for any thread count.
+ */
+class OrcaBatch
+{
+
+public:
+  // Constructor (threads 0 uses every hardware thread)
+  explicit OrcaBatch(const OrcaSolver::Config& config = OrcaSolver::Config(), unsigned int threads = 0);
+
+  unsigned int threadCount() const { return team_.threadCount(); }
+
+  void solve(const std::vector<OrcaAgent>& agents, double dt, std::vector<double>& vx, std::vector<double>& vy);
+
+private:
+  // Agents per block handed to a thread
+  static const std::size_t BLOCK_SIZE = 256;
+
+  OrcaSolver::Config config_;
+  SpatialHash hash_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<OrcaSolver> solvers_;                  // Per thread
+  std::vector<std::vector<OrcaAgent> > neighbors_;   // Per thread
+  WorkerTeam team_;
+
+  void solveRange(unsigned int thread, const std::vector<OrcaAgent>& agents, std::size_t begin, std::size_t end,
+                  double dt, std::vector<double>& vx, std::vector<double>& vy);
+};
+
+#endif // PHEENO_ROS_ORCA_H
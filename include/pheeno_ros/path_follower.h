@@ -0,0 +1,90 @@
+#ifndef PHEENO_ROS_PATH_FOLLOWER_H
+#define PHEENO_ROS_PATH_FOLLOWER_H
+
+#include "pheeno_ros/pose2d.h"
+#include <cstddef>
+#include <vector>
+
+namespace Pheeno
+{
+  enum FOLLOW_MODE
+  {
+    FOLLOW_PURE_PURSUIT,  // Arc through a point lookahead meters along the path
+    FOLLOW_STANLEY        // Heading error plus cross track correction
+  };
+}
+
+/*
+ * Path tracking for a differential drive robot.
+ *
+ * A path is a polyline (from nav_msgs/Path poses, or sampled from a
+ * Catmull-Rom spline through control points) with its cumulative arc
+ * length precomputed. The closest point and the lookahead point are kept
+ * as segment indices that only move forward: each update() searches the
+ * segments within search_window meters ahead of the last closest point,
+ * so a tick costs the same on a long path as on a short one, and a path
+ * crossing itself is followed in order.
+ */
+class PathFollower
+{
+
+public:
+  struct Config
+  {
+    Config()
+      : mode(Pheeno::FOLLOW_PURE_PURSUIT), lookahead(0.15), linear_velocity(0.08), max_angular(1.2),
+        goal_tolerance(0.03), search_window(0.5), stanley_gain(2.0), heading_gain(2.0) {}
+
+    Pheeno::FOLLOW_MODE mode;
+    double lookahead;        // m, pure pursuit
+    double linear_velocity;  // m/s, slowed down near the end of the path
+    double max_angular;      // rad/s
+    double goal_tolerance;   // m, distance to the last point that ends the path
+    double search_window;    // m of path searched ahead for the closest point
+    double stanley_gain;     // 1/s, cross track gain
+    double heading_gain;     // 1/s, Stanley steering angle to turn rate
+  };
+
+  // Constructor
+  explicit PathFollower(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+  void setConfig(const Config& config) { config_ = config; }
+
+  void setPath(const std::vector<Pose2D>& points);
+  void setSpline(const std::vector<Pose2D>& control_points, int samples_per_segment = 10);
+  void clear();
+
+  bool update(const Pose2D& pose, double& linear, double& angular);
+
+  bool hasPath() const { return !x_.empty(); }
+  bool done() const { return done_; }
+  std::size_t pointCount() const { return x_.size(); }
+  double length() const { return s_.empty() ? 0.0 : s_.back(); }
+  double progress() const { return progress_; }                   // m along the path
+  double crossTrackError() const { return cross_track_error_; }   // m, positive left of the path
+  std::size_t closestSegment() const { return closest_; }
+
+private:
+  Config config_;
+
+  // Polyline and its precomputed lookups (per point; segment i runs from
+  // point i to point i + 1)
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> s_;          // Arc length at each point
+  std::vector<double> heading_;    // Direction of segment i
+  std::vector<double> inverse_length_;
+
+  std::size_t closest_;    // Segment holding the closest point
+  std::size_t lookahead_;  // Segment holding the lookahead point
+  double progress_;
+  double cross_track_error_;
+  bool done_;
+
+  void finishPath();
+  void advanceClosest(double px, double py);
+  void pointAt(double s, double& px, double& py);
+};
+
+#endif // PHEENO_ROS_PATH_FOLLOWER_H
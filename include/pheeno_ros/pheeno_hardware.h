@@ -0,0 +1,169 @@
+#ifndef PHEENO_ROS_PHEENO_HARDWARE_H
+#define PHEENO_ROS_PHEENO_HARDWARE_H
+
+#include <array>
+#include <cstddef>
+
+/*
+ * Compile-time descriptions of the Pheeno hardware variants in the fleet.
+ *
+ * A descriptor defines how many IR sensors and encoders a variant has, the
+ * topic each one publishes on, where each IR sensor is mounted and which
+ * index plays each role used by the avoidance kernels. Everything sized or
+ * indexed by these constants is checked by the compiler, so a kernel cannot
+ * read past the IR array of the variant it was built for.
+ *
+ * PheenoRobot is built for Pheeno::Hardware, chosen with the PHEENO_HARDWARE
+ * CMake option. Simulation code can instantiate the kernels for any variant.
+ */
+namespace Pheeno
+{
+  // Where an IR sensor sits on the chassis (meters, radians, robot frame).
+  struct IrMount
+  {
+    double x;
+    double y;
+    double angle;
+  };
+
+  /*
+   * The standard Pheeno: six IR sensors (center, back, right, left,
+   * center-right, center-left) and four encoder channels.
+   */
+  struct StandardHardware
+  {
+    static const std::size_t IR_COUNT = 6;
+    static const std::size_t ENCODER_COUNT = 4;
+
+    // Roles used by the avoidance kernels. Values match Pheeno::IR.
+    static const std::size_t IR_CENTER = 0;
+    static const std::size_t IR_BACK = 1;
+    static const std::size_t IR_RIGHT = 2;
+    static const std::size_t IR_LEFT = 3;
+    static const std::size_t IR_CRIGHT = 4;
+    static const std::size_t IR_CLEFT = 5;
+
+    // Sensors considered for obstacle triggering (the back sensor is not).
+    static const unsigned int IR_FORWARD_MASK = 0x3D;
+
+    // Sectors for IR queries (bit i is IR index i).
+    static const unsigned int IR_FRONT_MASK = 0x31;  // center, center-right, center-left
+    static const unsigned int IR_SIDE_MASK = 0x0C;   // right, left
+    static const unsigned int IR_REAR_MASK = 0x02;   // back
+
+    // Encoder channels of each wheel (bit i is encoder index i).
+    static const unsigned int LEFT_ENCODER_MASK = 0x03;   // LL, LR
+    static const unsigned int RIGHT_ENCODER_MASK = 0x0C;  // RL, RR
+
+    static const char* irTopic(std::size_t i)
+    {
+      static const char* const topics[IR_COUNT] = {
+        "scan_center", "scan_back", "scan_right", "scan_left", "scan_cr", "scan_cl"
+      };
+      return topics[i];
+    }
+
+    static const char* encoderTopic(std::size_t i)
+    {
+      static const char* const topics[ENCODER_COUNT] = {
+        "encoder_LL", "encoder_LR", "encoder_RL", "encoder_RR"
+      };
+      return topics[i];
+    }
+
+    static const IrMount& irMount(std::size_t i)
+    {
+      static const IrMount mounts[IR_COUNT] = {
+        {0.060, 0.000, 0.0},            // center
+        {-0.060, 0.000, 3.14159265},    // back
+        {0.000, -0.055, -1.57079633},   // right
+        {0.000, 0.055, 1.57079633},     // left
+        {0.045, -0.040, -0.78539816},   // center-right
+        {0.045, 0.040, 0.78539816}      // center-left
+      };
+      return mounts[i];
+    }
+
+    // Drive train
+    static double wheelRadius() { return 0.016; }         // m
+    static double wheelBase() { return 0.100; }           // m
+    static double encoderTicksPerRev() { return 1200.0; }
+    static double irMaxRange() { return 80.0; }           // cm
+  };
+
+  /*
+   * Extended Pheeno with two additional rear-quarter IR sensors. The first
+   * six sensors keep the standard layout.
+   */
+  struct ExtendedHardware : public StandardHardware
+  {
+    static const std::size_t IR_COUNT = 8;
+    static const std::size_t IR_BRIGHT = 6;
+    static const std::size_t IR_BLEFT = 7;
+
+    static const unsigned int IR_REAR_MASK = 0xC2;   // back, back-right, back-left
+
+    static const char* irTopic(std::size_t i)
+    {
+      static const char* const topics[IR_COUNT] = {
+        "scan_center", "scan_back", "scan_right", "scan_left", "scan_cr", "scan_cl",
+        "scan_br", "scan_bl"
+      };
+      return topics[i];
+    }
+
+    static const IrMount& irMount(std::size_t i)
+    {
+      static const IrMount mounts[IR_COUNT] = {
+        {0.060, 0.000, 0.0},
+        {-0.060, 0.000, 3.14159265},
+        {0.000, -0.055, -1.57079633},
+        {0.000, 0.055, 1.57079633},
+        {0.045, -0.040, -0.78539816},
+        {0.045, 0.040, 0.78539816},
+        {-0.045, -0.040, -2.35619449},  // back-right
+        {-0.045, 0.040, 2.35619449}     // back-left
+      };
+      return mounts[i];
+    }
+  };
+
+#ifndef PHEENO_HARDWARE
+#define PHEENO_HARDWARE StandardHardware
+#endif
+
+  // The variant this build of PheenoRobot targets.
+  typedef PHEENO_HARDWARE Hardware;
+
+  // Fixed-size sensor arrays of a variant.
+  template <class HW>
+  using IrRanges = std::array<double, HW::IR_COUNT>;
+
+  template <class HW>
+  using EncoderCounts = std::array<int, HW::ENCODER_COUNT>;
+
+  /*
+   * Counts the sensors in mask that read below limit. The recursion is
+   * resolved at compile time, so the loop is fully unrolled per variant.
+   */
+  template <class HW, std::size_t I = 0, std::size_t N = HW::IR_COUNT>
+  struct IrCountBelow
+  {
+    static int apply(const IrRanges<HW>& ir, double limit, unsigned int mask)
+    {
+      return ((((mask >> I) & 1u) != 0 && std::get<I>(ir) < limit) ? 1 : 0) +
+             IrCountBelow<HW, I + 1, N>::apply(ir, limit, mask);
+    }
+  };
+
+  template <class HW, std::size_t N>
+  struct IrCountBelow<HW, N, N>
+  {
+    static int apply(const IrRanges<HW>&, double, unsigned int)
+    {
+      return 0;
+    }
+  };
+}
+
+#endif // PHEENO_ROS_PHEENO_HARDWARE_H
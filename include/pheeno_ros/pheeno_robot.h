@@ -4,15 +4,39 @@
 #include "ros/ros.h"
 #include "std_msgs/Float32.h"
 #include "std_msgs/Int16.h"
+#include "std_msgs/UInt8MultiArray.h"
+#include "geometry_msgs/PoseArray.h"
+#include "geometry_msgs/PoseWithCovarianceStamped.h"
 #include "geometry_msgs/Twist.h"
 #include "geometry_msgs/Vector3.h"
 #include "nav_msgs/Odometry.h"
+#include "nav_msgs/OccupancyGrid.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "pheeno_ros/adaptive_rate.h"
+#include "pheeno_ros/behaviors.h"
+#include "pheeno_ros/channel_config.h"
+#include "pheeno_ros/command_arbiter.h"
+#include "pheeno_ros/flock_rules.h"
+#include "pheeno_ros/ir_query.h"
+#include "pheeno_ros/map_merger.h"
+#include "pheeno_ros/motion_monitor.h"
+#include "pheeno_ros/occupancy_grid.h"
+#include "pheeno_ros/orca.h"
+#include "pheeno_ros/particle_filter.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/pose_ekf.h"
+#include "pheeno_ros/range_rate.h"
+#include "pheeno_ros/sensor_frame.h"
+#include "pheeno_ros/wheel_speed_controller.h"
+#include <array>
 #include <vector>
 #include <complex>
 #include <cstdlib>
 
 namespace Pheeno
 {
+  // Sensor indices of the standard hardware. Other variants describe their
+  // layout in pheeno_hardware.h.
   enum IR
   {
     CENTER,
@@ -30,6 +54,22 @@ namespace Pheeno
     RL,
     RR
   };
+
+  // Sensor groups a behavior can ask PheenoRobot to subscribe to.
+  enum SENSOR
+  {
+    NO_SENSORS = 0,
+    IR_SENSORS = 1 << 0,
+    IR_BOTTOM = 1 << 1,
+    ODOM = 1 << 2,
+    ENCODERS = 1 << 3,
+    MAGNETOMETER = 1 << 4,
+    GYROSCOPE = 1 << 5,
+    ACCELEROMETER = 1 << 6,
+    SENSOR_SWEEP = 1 << 7,
+    IMU = MAGNETOMETER | GYROSCOPE | ACCELEROMETER,
+    ALL_SENSORS = (1 << 8) - 1
+  };
 }
 
 class PheenoRobot
@@ -37,7 +77,7 @@ class PheenoRobot
 
 public:
   // Constructor
-  PheenoRobot(std::string pheeno_name);
+  PheenoRobot(std::string pheeno_name, unsigned int sensors = Pheeno::ALL_SENSORS);
 
   // Pheeno name
   std::string pheeno_namespace_id_;
@@ -50,8 +90,11 @@ public:
   std_msgs::Float32 ir_sensor_c_right_;
   std_msgs::Float32 ir_sensor_c_left_;
   std_msgs::Int16 ir_sensor_bottom_;
-  std::vector<double> ir_sensor_vals_;
-  std::vector<int> encoder_vals_;
+  // std::arrays sized by the Pheeno::Hardware descriptor (these were
+  // std::vectors before the descriptor; index them the same way, but they
+  // cannot be resized)
+  Pheeno::IrRanges<Pheeno::Hardware> ir_sensor_vals_;
+  Pheeno::EncoderCounts<Pheeno::Hardware> encoder_vals_;
   std::vector<double> magnetometer_vals_;
   std::vector<double> gyroscope_vals_;
   std::vector<double> accelerometer_vals_;
@@ -63,23 +106,102 @@ public:
   std::vector<double> odom_twist_linear_;
   std::vector<double> odom_twist_angular_;
 
+  bool odomReceived() const { return odom_received_; }
+  double odomYaw() const;
+
+  // Pose Fusion (encoders, gyroscope, magnetometer and visual odometry)
+  void setPoseEkf(bool enable);
+  bool poseEkfEnabled() const { return ekf_enabled_; }
+  const PoseEkf& poseEkf() const { return pose_ekf_; }
+
+  // Slip, Stall and Impact Detection (encoders against the IMU)
+  void setMotionMonitor(bool enable);
+  const MotionMonitor& motionMonitor() const { return motion_monitor_; }
+  unsigned int motionEvents() const;
+
+  // Occupancy Grid Mapping
+  void setMapping(bool enable);
+  const TiledOccupancyGrid& map() const { return map_; }
+  void setMapChangeTracking(bool enable) { map_.setChangeTracking(enable); }
+  void takeMapChanges(std::vector<uint32_t>& cells) { map_.takeClassChanges(cells); }
+  const TiledOccupancyGrid& mergedMap() const { return map_merger_.map(); }
+  bool mapSharing() const { return map_sharing_enabled_; }
+
+  // Monte Carlo Localization (against a static arena map)
+  void setLocalization(bool enable);
+  bool localized() const { return localized_; }
+  const ParticleFilter& localization() const { return particle_filter_; }
+
+  // ORCA Collision Avoidance (between robots sharing the fleet topic). ORCA
+  // and flocking need ~fleet/shared_odom_frame or localization.
+  void setOrca(bool enable);
+  bool orcaEnabled() const { return orca_enabled_; }
+  geometry_msgs::Twist orcaVelocity(const geometry_msgs::Twist& preferred);
+
+  // Flocking, Aggregation and Dispersion (among robots sharing the fleet topic)
+  void setFlocking(bool enable);
+  void setFlockRules(const FlockRules::Config& config) { flock_rules_ = FlockRules(config); }
+  const FlockRules::Config& flockRules() const { return flock_rules_.config(); }
+  bool flock(double &linear, double &angular);
+
   // Camera Messages
   std::vector<bool> color_state_facing_;
 
+  // Packed Sensor Sweeps
+  unsigned long sensor_sweep_count_;
+  unsigned long sensor_sweep_dropped_;
+  void applySensorSweep(const SensorSweep& sweep);
+
   // Public Sensor Methods
+  void enableSensors(unsigned int sensors);
+  void disableSensors(unsigned int sensors);
+  unsigned int enabledSensors() const { return enabled_sensors_; }
+  // True if any forward IR (the descriptor's IR_FORWARD_MASK) reads below
+  // sensor_limits. It used to need two hits among all IR values instead.
   bool irSensorTriggered(float sensor_limits);
+  const RangeRateEstimator<Pheeno::Hardware>& irRangeRate() const { return ir_range_rate_; }
+  void queryIr(const IrQuery* queries, std::size_t query_count, IrQueryResult* results);
 
   // Public Movement Methods
+  const Pheeno::BehaviorParams& behaviorParams() const { return behavior_params_; }
   double randomTurn(float angular = 0.06);
   void avoidObstaclesLinear(double &linear, double &angular,
                             float angular_velocity = 1.2, float linear_velocity = 0.08,
                             double range_to_avoid = 20.0);
   void avoidObstaclesAngular(double &angular, double &random_turn_value,
                              float angular_velocity = 1.2, double range_to_avoid = 20.0);
+  void avoidObstaclesPredictive(double &linear, double &angular,
+                                float angular_velocity = 1.2, float linear_velocity = 0.08,
+                                double range_to_avoid = 20.0, double stop_ttc = 0.5,
+                                double slow_ttc = 2.0);
 
   // Public Publishers
   void publish(geometry_msgs::Twist velocity);
 
+  // Public Command Arbitration Methods
+  int addCommandSlot(const std::string& name, int priority, double timeout);
+  void submitCommand(int slot, const geometry_msgs::Twist& velocity);
+  void safetyStop(bool engage);
+  void setControlRate(double rate);
+
+  // Public Control Loop Methods
+  void sleep();
+  void setAdaptiveRate(bool enable, const AdaptiveRate::Bounds& bounds = AdaptiveRate::Bounds());
+  double controlRate() const { return control_rate_; }
+  double timeToCollision() const { return time_to_collision_; }
+
+  // Public Wheel Speed Control Methods
+  typedef WheelSpeedController<Pheeno::Hardware> WheelController;
+  void setWheelControl(bool enable, const WheelController::Gains& gains = WheelController::Gains());
+  const WheelController& wheelController() const { return wheel_controller_; }
+
+  // Public Transport Methods
+  void setChannelTransport(Pheeno::CHANNEL channel, const ChannelTransport& transport);
+  const ChannelTransport& channelTransport(Pheeno::CHANNEL channel) const { return channel_transport_[channel]; }
+  const LatencyStats& channelLatency(Pheeno::CHANNEL channel) const { return channel_latency_[channel]; }
+  const LatencyStats& channelEndToEnd(Pheeno::CHANNEL channel) const { return channel_end_to_end_[channel]; }
+  void logLatency();
+
   // Public camera methods
   bool checkFrontColor(int color);
 
@@ -87,49 +209,224 @@ private:
   // ROS Node handle
   ros::NodeHandle nh_;
 
+  // Subscribed sensor groups (Pheeno::SENSOR bitmask)
+  unsigned int enabled_sensors_;
+  void requireSensors(unsigned int sensors, const char* user);
+
+  // Per-channel transport configuration and latency instrumentation
+  ChannelTransport channel_transport_[Pheeno::CHANNEL_COUNT];
+  LatencyStats channel_latency_[Pheeno::CHANNEL_COUNT];
+  LatencyStats channel_end_to_end_[Pheeno::CHANNEL_COUNT];
+  ros::Timer latency_report_timer_;
+  void loadChannelTransport();
+  void recordLatency(Pheeno::CHANNEL channel, const ros::Time& receipt_time, double stamp = 0.0);
+  void latencyReportCallback(const ros::TimerEvent& event);
+
+  // Subscription to one of several same-typed topics (an IR sensor, an
+  // encoder channel) that forwards its index to a shared callback.
+  template <class M>
+  struct IndexedSubscription
+  {
+    PheenoRobot* robot;
+    std::size_t index;
+    void (PheenoRobot::*method)(std::size_t, const ros::MessageEvent<M const>&);
+    ros::Subscriber subscriber;
+
+    void callback(const ros::MessageEvent<M const>& event) { (robot->*method)(index, event); }
+  };
+
   // Private Subscribers
-  ros::Subscriber sub_ir_center_;
-  ros::Subscriber sub_ir_right_;
-  ros::Subscriber sub_ir_left_;
-  ros::Subscriber sub_ir_cr_;
-  ros::Subscriber sub_ir_cl_;
-  ros::Subscriber sub_ir_back_;
+  std::array<IndexedSubscription<std_msgs::Float32>, Pheeno::Hardware::IR_COUNT> sub_ir_;
+  std::array<IndexedSubscription<std_msgs::Int16>, Pheeno::Hardware::ENCODER_COUNT> sub_encoder_;
   ros::Subscriber sub_ir_bottom_;
   ros::Subscriber sub_pheeno_cam_;
   ros::Subscriber sub_odom_;
-  ros::Subscriber sub_encoder_LL_;
-  ros::Subscriber sub_encoder_LR_;
-  ros::Subscriber sub_encoder_RL_;
-  ros::Subscriber sub_encoder_RR_;
   ros::Subscriber sub_magnetometer_;
   ros::Subscriber sub_gyroscope_;
   ros::Subscriber sub_accelerometer_;
+  ros::Subscriber sub_sensor_sweep_;
 
   // Private Publishers
   ros::Publisher pub_cmd_vel_;
 
+  // Behavior tunables (~behavior/<name>), read by the behavior nodes
+  Pheeno::BehaviorParams behavior_params_;
+
+  // Command arbitration (one cmd_vel per control period)
+  CommandArbiter command_arbiter_;
+  int behavior_slot_;
+  int last_command_slot_;
+  geometry_msgs::Twist cmd_vel_msg_;
+  ros::Timer command_timer_;
+  void commandTimerCallback(const ros::TimerEvent& event);
+  void sendCommand(bool behavior_only);
+
+  // Closed-loop wheel speed control (runs at the encoder rate)
+  WheelController wheel_controller_;
+  bool wheel_control_enabled_;
+  bool wheel_control_idle_;
+  unsigned int fresh_encoders_;
+  ros::Time last_encoder_update_;
+  void updateWheelControl(double stamp);
+
+  // Wheel velocities from consecutive encoder counts (EKF and motion monitor)
+  bool wheel_odometry_reference_;
+  double wheel_odometry_stamp_;
+  Pheeno::EncoderCounts<Pheeno::Hardware> wheel_odometry_counts_;
+  void updateWheelOdometry(double sensor_stamp, double stamp);
+
+  // Pose EKF. While enabled it is the source of the odometry pose and twist.
+  PoseEkf pose_ekf_;
+  bool ekf_enabled_;
+  bool ekf_magnetometer_;
+  bool ekf_odom_twist_;
+  std::string ekf_frame_id_;
+  ros::Subscriber sub_visual_odom_;
+  ros::Publisher pub_fused_odom_;
+  ros::Timer ekf_timer_;
+  nav_msgs::Odometry fused_odom_msg_;
+  unsigned int ekfSensors() const;
+  void ekfPoseChanged();
+  void ekfTimerCallback(const ros::TimerEvent& event);
+
+  // Slip, stall and impact detection. Active events become virtual
+  // obstacles in the IR ranges the avoidance methods see.
+  MotionMonitor motion_monitor_;
+  bool motion_monitor_enabled_;
+  double virtual_obstacle_range_;
+  Pheeno::IrRanges<Pheeno::Hardware> avoidance_ranges_;
+  const Pheeno::IrRanges<Pheeno::Hardware>& avoidanceRanges();
+  void motionEventsRaised(unsigned int events);
+
+  // Occupancy grid built from the IR beams and the odometry pose
+  TiledOccupancyGrid map_;
+  bool mapping_enabled_;
+  bool odom_received_;
+  std::string map_frame_id_;
+  ros::Publisher pub_map_delta_;
+  ros::Publisher pub_map_;
+  ros::Timer map_delta_timer_;
+  ros::Timer map_timer_;
+  std_msgs::UInt8MultiArray map_delta_msg_;
+  nav_msgs::OccupancyGrid map_msg_;
+  void insertIrBeam(std::size_t index);
+  void mapDeltaTimerCallback(const ros::TimerEvent& event);
+  void mapTimerCallback(const ros::TimerEvent& event);
+
+  // Map sharing: this robot's deltas and its peers' merged into one grid
+  MapMerger map_merger_;
+  bool map_sharing_enabled_;
+  std::size_t map_delta_budget_;
+  std::size_t map_refresh_tiles_;
+  std::vector<IndexedSubscription<std_msgs::UInt8MultiArray> > sub_peer_map_delta_;
+  ros::Publisher pub_merged_map_;
+  nav_msgs::OccupancyGrid merged_map_msg_;
+  void peerMapDeltaCallback(std::size_t index, const ros::MessageEvent<std_msgs::UInt8MultiArray const>& event);
+
+  // Monte Carlo localization from the IR beams and the odometry motion
+  ParticleFilter particle_filter_;
+  bool localization_enabled_;
+  bool localized_;
+  bool localization_odom_valid_;
+  Pose2D localization_odom_;
+  Pose2D initial_pose_;
+  double initial_spread_;
+  double initial_spread_yaw_;
+  bool global_localization_;
+  double localization_update_distance_;
+  double localization_update_angle_;
+  std::string localization_frame_id_;
+  ros::Subscriber sub_arena_map_;
+  ros::Subscriber sub_initial_pose_;
+  ros::Publisher pub_localized_pose_;
+  ros::Publisher pub_particles_;
+  ros::Timer localization_timer_;
+  geometry_msgs::PoseWithCovarianceStamped localized_pose_msg_;
+  geometry_msgs::PoseArray particles_msg_;
+  Pose2D odomPose() const;
+  void arenaMapCallback(const nav_msgs::OccupancyGrid::ConstPtr& msg);
+  void initialPoseCallback(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr& msg);
+  void localizationTimerCallback(const ros::TimerEvent& event);
+
+  // Fleet: every robot shares its pose and velocity on the fleet topic
+  struct FleetNeighbor
+  {
+    std::string name;
+    std::string frame_id;
+    double received;
+    double x;
+    double y;
+    double vx;
+    double vy;
+  };
+  bool fleet_joined_;
+  std::string fleet_topic_;
+  double fleet_rate_;
+  double fleet_timeout_;
+  double fleet_heading_gain_;
+  double fleet_max_angular_;
+  bool fleet_shared_odom_frame_;
+  std::string fleet_odom_frame_id_;
+  std::vector<FleetNeighbor> fleet_;
+  ros::Subscriber sub_fleet_state_;
+  ros::Publisher pub_fleet_state_;
+  ros::Timer fleet_state_timer_;
+  nav_msgs::Odometry fleet_state_msg_;
+  void joinFleet();
+  Pose2D fleetPose(std::string& frame_id) const;
+  bool fleetNeighborActive(const FleetNeighbor& neighbor, const std::string& frame_id, double now) const;
+  void headingCommand(double vx, double vy, double yaw, double &linear, double &angular) const;
+  void fleetStateCallback(const nav_msgs::Odometry::ConstPtr& msg);
+  void fleetStateTimerCallback(const ros::TimerEvent& event);
+
+  // ORCA velocity selection among the fleet
+  OrcaSolver orca_solver_;
+  bool orca_enabled_;
+  double orca_radius_;
+  double orca_max_speed_;
+  std::vector<OrcaAgent> orca_neighbors_;
+
+  // Boids rules among the fleet
+  FlockRules flock_rules_;
+  bool flocking_enabled_;
+  std::vector<FlockMember> flock_neighbors_;
+
+  // Adaptive control rate (behavior loop and command timer)
+  AdaptiveRate adaptive_rate_;
+  bool adaptive_rate_enabled_;
+  double control_rate_;
+  double closest_range_;
+  double time_to_collision_;
+  ros::Time loop_deadline_;
+  RangeRateEstimator<Pheeno::Hardware> ir_range_rate_;
+  void updateControlRate();
+  void estimateTimeToCollision();
+
+  // Diagnostics
+  ros::Publisher pub_diagnostics_;
+  ros::Timer diagnostics_timer_;
+  diagnostic_msgs::DiagnosticArray diagnostics_msg_;
+  void diagnosticsTimerCallback(const ros::TimerEvent& event);
+
   // IR Callback Methods
-  void irSensorCenterCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorBackCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorRightCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorLeftCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorCRightCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorCLeftCallback(const std_msgs::Float32::ConstPtr& msg);
-  void irSensorBottomCallback(const std_msgs::Int16::ConstPtr& msg);
+  void irSensorCallback(std::size_t index, const ros::MessageEvent<std_msgs::Float32 const>& event);
+  void irSensorBottomCallback(const ros::MessageEvent<std_msgs::Int16 const>& event);
 
   // Odom Callback Methods
-  void odomCallback(const nav_msgs::Odometry::ConstPtr& msg);
+  void odomCallback(const ros::MessageEvent<nav_msgs::Odometry const>& event);
+  void visualOdomCallback(const ros::MessageEvent<nav_msgs::Odometry const>& event);
 
   // Encoder Callback Methods
-  void encoderLLCallback(const std_msgs::Int16::ConstPtr& msg);
-  void encoderLRCallback(const std_msgs::Int16::ConstPtr& msg);
-  void encoderRLCallback(const std_msgs::Int16::ConstPtr& msg);
-  void encoderRRCallback(const std_msgs::Int16::ConstPtr& msg);
+  void encoderCallback(std::size_t index, const ros::MessageEvent<std_msgs::Int16 const>& event);
 
   // Other Sensor Callback Methods
-  void magnetometerCallback(const geometry_msgs::Vector3::ConstPtr& msg);
-  void gyroscopeCallback(const geometry_msgs::Vector3::ConstPtr& msg);
-  void accelerometerCallback(const geometry_msgs::Vector3::ConstPtr& msg);
+  void magnetometerCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event);
+  void gyroscopeCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event);
+  void accelerometerCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event);
+
+  // Packed Sensor Frame Callback Methods
+  void sensorSweepCallback(const ros::MessageEvent<std_msgs::UInt8MultiArray const>& event);
+  uint16_t last_sweep_sequence_;
 
   // Camera Callback Modules
   void piCamCallback();
@@ -0,0 +1,13 @@
+#ifndef PHEENO_ROS_POSE2D_H
+#define PHEENO_ROS_POSE2D_H
+
+struct Pose2D
+{
+  Pose2D(double x = 0.0, double y = 0.0, double theta = 0.0) : x(x), y(y), theta(theta) {}
+
+  double x;      // m
+  double y;      // m
+  double theta;  // rad
+};
+
+#endif // PHEENO_ROS_POSE2D_H
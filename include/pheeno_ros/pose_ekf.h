@@ -0,0 +1,154 @@
+#ifndef PHEENO_ROS_POSE_EKF_H
+#define PHEENO_ROS_POSE_EKF_H
+
+#include "pheeno_ros/pose2d.h"
+#include <cstddef>
+
+namespace Pheeno
+{
+  // Measurement sources fused by PoseEkf.
+  enum EKF_SOURCE
+  {
+    EKF_WHEEL_ODOMETRY,   // Body linear and angular velocity from the encoders
+    EKF_GYROSCOPE,        // Yaw rate (plus the estimated bias)
+    EKF_MAGNETOMETER,     // Absolute heading
+    EKF_VISUAL_ODOMETRY,  // Body linear and angular velocity from the camera
+    EKF_SOURCE_COUNT
+  };
+}
+
+/*
+ * Extended Kalman filter for the planar pose of a differential drive robot.
+ *
+ * The state is x, y, yaw, linear velocity, angular velocity and the
+ * gyroscope bias, predicted with a constant velocity unicycle model. Every
+ * measurement is a scalar or a pair of independent scalars, so updates are
+ * sequential scalar updates with no matrix inverse. Each scalar innovation
+ * is gated by its Mahalanobis distance, which keeps magnetometer heading
+ * disturbances near steel furniture out of the estimate.
+ *
+ * Measurements may arrive late (camera ego-motion is stamped at capture but
+ * delivered after processing). Every measurement is kept in a fixed ring
+ * with the state after it; a late one is inserted in stamp order and the
+ * measurements after it are replayed. Measurements older than the ring or
+ * older than max_delay behind the newest are dropped.
+ *
+ * All storage is inside the object, so updates never allocate.
+ */
+class PoseEkf
+{
+
+public:
+  enum STATE
+  {
+    X,
+    Y,
+    YAW,
+    V,
+    W,
+    GYRO_BIAS,
+    STATE_SIZE
+  };
+
+  // Measurements kept for replaying late arrivals
+  static const std::size_t HISTORY_SIZE = 128;
+
+  struct Config
+  {
+    Config()
+      : acceleration_noise(0.5), angular_acceleration_noise(4.0), gyro_bias_noise(0.005),
+        wheel_linear_noise(0.01), wheel_angular_noise(0.15), gyro_noise(0.02),
+        magnetometer_noise(0.15), magnetometer_offset(0.0), visual_linear_noise(0.02),
+        visual_angular_noise(0.05), initial_yaw_noise(0.0), initial_gyro_bias_noise(0.05),
+        gate(5.0), max_delay(0.5) {}
+
+    double acceleration_noise;          // m/s^2 per sqrt(Hz)
+    double angular_acceleration_noise;  // rad/s^2 per sqrt(Hz)
+    double gyro_bias_noise;             // rad/s per sqrt(s)
+    double wheel_linear_noise;          // m/s
+    double wheel_angular_noise;         // rad/s (wheel slip makes this the weak axis)
+    double gyro_noise;                  // rad/s
+    double magnetometer_noise;          // rad
+    double magnetometer_offset;         // rad, magnetic heading of the yaw = 0 direction
+    double visual_linear_noise;         // m/s
+    double visual_angular_noise;        // rad/s
+    double initial_yaw_noise;           // rad (0 pins the odometry frame to the start heading)
+    double initial_gyro_bias_noise;     // rad/s
+    double gate;                        // Standard deviations; 0 accepts everything
+    double max_delay;                   // s
+  };
+
+  // Constructor
+  explicit PoseEkf(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+  void setConfig(const Config& config) { config_ = config; }
+
+  void reset(const Pose2D& pose = Pose2D());
+
+  // Measurement updates. stamp is in seconds on one clock for all sources.
+  // Each returns false when the measurement was dropped as too late.
+  bool wheelOdometry(double stamp, double linear, double angular);
+  bool gyroscope(double stamp, double yaw_rate);
+  bool magnetometer(double stamp, double heading);
+  bool visualOdometry(double stamp, double linear, double angular);
+
+  bool initialized() const { return initialized_; }
+  double stamp() const { return current_.stamp; }
+  Pose2D pose() const { return Pose2D(current_.x[X], current_.x[Y], current_.x[YAW]); }
+  Pose2D predictPose(double stamp) const;
+  double state(STATE i) const { return current_.x[i]; }
+  double covariance(STATE i, STATE j) const { return current_.p[i][j]; }
+
+  // Counters
+  unsigned long measurements() const { return measurements_; }
+  unsigned long rejected(Pheeno::EKF_SOURCE source) const { return rejected_[source]; }
+  unsigned long late() const { return late_; }
+  unsigned long replayed() const { return replayed_; }
+
+private:
+  struct Measurement
+  {
+    Pheeno::EKF_SOURCE source;
+    double stamp;
+    double z[2];
+  };
+
+  struct Estimate
+  {
+    double stamp;
+    double x[STATE_SIZE];
+    double p[STATE_SIZE][STATE_SIZE];
+  };
+
+  // A measurement and the estimate right after it
+  struct Entry
+  {
+    Measurement measurement;
+    Estimate estimate;
+  };
+
+  Config config_;
+  bool initialized_;
+  Estimate initial_;
+  Estimate current_;
+
+  Estimate base_;  // The estimate the oldest entry was applied to
+  Entry history_[HISTORY_SIZE];
+  std::size_t history_first_;
+  std::size_t history_count_;
+
+  unsigned long measurements_;
+  unsigned long rejected_[Pheeno::EKF_SOURCE_COUNT];
+  unsigned long late_;
+  unsigned long replayed_;
+
+  Entry& entry(std::size_t i) { return history_[(history_first_ + i) % HISTORY_SIZE]; }
+
+  bool add(Pheeno::EKF_SOURCE source, double stamp, double z0, double z1);
+  bool apply(const Measurement& measurement, Estimate& estimate) const;
+  void predict(Estimate& estimate, double stamp) const;
+  bool update(Estimate& estimate, const double* h, double innovation, double variance) const;
+};
+
+#endif // PHEENO_ROS_POSE_EKF_H
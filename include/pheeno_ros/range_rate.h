@@ -0,0 +1,154 @@
+#ifndef PHEENO_ROS_RANGE_RATE_H
+#define PHEENO_ROS_RANGE_RATE_H
+
+#include "pheeno_ros/pheeno_hardware.h"
+#include <array>
+#include <cstddef>
+
+/*
+ * Per-channel IR range rate and time-to-collision estimation.
+ *
+ * Each IR channel runs an alpha-beta tracker: the range is predicted
+ * forward with the current rate, and the prediction error corrects both the
+ * range (by alpha) and the rate (by beta / dt). An update is constant time
+ * and needs no sample history, and irregular sample spacing is handled
+ * because dt comes from the sample stamps.
+ *
+ * Readings at or beyond the sensor's maximum range mean "nothing in view"
+ * and drop the channel's track; so does a gap longer than max_gap.
+ */
+template <class HW>
+class RangeRateEstimator
+{
+
+public:
+  // Constructor
+  RangeRateEstimator(double alpha = 0.5, double beta = 0.2, double max_gap = 0.5)
+    : alpha_(alpha), beta_(beta), max_gap_(max_gap)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (std::size_t i = 0; i < HW::IR_COUNT; i++)
+    {
+      tracks_[i] = Track();
+    }
+  }
+
+  /*
+   * Adds a range sample (cm) taken at stamp (s) to a channel.
+   */
+  void update(std::size_t channel, double range, double stamp)
+  {
+    Track& track = tracks_[channel];
+
+    if (range >= HW::irMaxRange())
+    {
+      track.samples = 0;
+      return;
+    }
+
+    double dt = stamp - track.stamp;
+    if (track.samples == 0 || dt > max_gap_ || dt < 0.0)
+    {
+      track.range = range;
+      track.rate = 0.0;
+      track.stamp = stamp;
+      track.samples = 1;
+      return;
+    }
+
+    if (dt == 0.0)
+    {
+      return;
+    }
+
+    double predicted = track.range + track.rate * dt;
+    double residual = range - predicted;
+    track.range = predicted + alpha_ * residual;
+    track.rate += (beta_ / dt) * residual;
+    track.stamp = stamp;
+    if (track.samples < 2)
+    {
+      track.samples++;
+    }
+  }
+
+  double range(std::size_t channel) const { return tracks_[channel].range; }
+
+  // cm/s, negative while the range is closing. Zero until two samples.
+  double rate(std::size_t channel) const
+  {
+    return tracks_[channel].samples >= 2 ? tracks_[channel].rate : 0.0;
+  }
+
+  /*
+   * Seconds until the range reaches zero at the current closing rate, or
+   * -1 if the channel is not closing (or has no track).
+   */
+  double timeToCollision(std::size_t channel) const
+  {
+    double closing = -rate(channel);
+    return closing > MIN_CLOSING_RATE ? tracks_[channel].range / closing : -1.0;
+  }
+
+  /*
+   * Smallest time to collision over the channels in mask, or -1.
+   */
+  double minTimeToCollision(unsigned int mask) const
+  {
+    double result = -1.0;
+    for (std::size_t i = 0; i < HW::IR_COUNT; i++)
+    {
+      double ttc = ((mask >> i) & 1u) ? timeToCollision(i) : -1.0;
+      if (ttc >= 0.0 && (result < 0.0 || ttc < result))
+      {
+        result = ttc;
+      }
+    }
+    return result;
+  }
+
+private:
+  // Closing rates below this (cm/s) are treated as noise.
+  static constexpr double MIN_CLOSING_RATE = 1.0;
+
+  struct Track
+  {
+    Track() : range(0.0), rate(0.0), stamp(0.0), samples(0) {}
+
+    double range;
+    double rate;
+    double stamp;
+    int samples;
+  };
+
+  double alpha_;
+  double beta_;
+  double max_gap_;
+  std::array<Track, HW::IR_COUNT> tracks_;
+};
+
+namespace Pheeno
+{
+  /*
+   * Speed scale for a time to collision: 1 when not closing or at least
+   * slow_ttc away, 0 at stop_ttc or closer, linear in between.
+   */
+  inline double predictiveSpeedScale(double time_to_collision, double stop_ttc, double slow_ttc)
+  {
+    if (time_to_collision < 0.0 || time_to_collision >= slow_ttc)
+    {
+      return 1.0;
+    }
+    if (time_to_collision <= stop_ttc || slow_ttc <= stop_ttc)
+    {
+      return 0.0;
+    }
+    return (time_to_collision - stop_ttc) / (slow_ttc - stop_ttc);
+  }
+}
+
+#endif // PHEENO_ROS_RANGE_RATE_H
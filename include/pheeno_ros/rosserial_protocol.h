@@ -0,0 +1,112 @@
+#ifndef PHEENO_ROS_ROSSERIAL_PROTOCOL_H
+#define PHEENO_ROS_ROSSERIAL_PROTOCOL_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Pheeno
+{
+  // Reserved rosserial topic ids. Anything at or above USER_TOPIC_START is a
+  // topic negotiated through a TopicInfo message.
+  enum ROSSERIAL_TOPIC
+  {
+    ID_PUBLISHER = 0,
+    ID_SUBSCRIBER = 1,
+    ID_SERVICE_SERVER = 2,
+    ID_SERVICE_CLIENT = 4,
+    ID_PARAMETER_REQUEST = 6,
+    ID_LOG = 7,
+    ID_TIME = 10,
+    ID_TX_STOP = 11,
+    USER_TOPIC_START = 100
+  };
+}
+
+/*
+ * Contents of a rosserial_msgs/TopicInfo message, sent by the Teensy for
+ * every publisher and subscriber it declares.
+ */
+struct RosserialTopicInfo
+{
+  uint16_t topic_id;
+  std::string topic_name;
+  std::string message_type;
+  std::string md5sum;
+  int32_t buffer_size;
+};
+
+/*
+ * Incremental parser for the rosserial (Hydro and newer) wire format:
+ *
+ *   0xFF 0xFE len_L len_H len_chk topic_L topic_H data[len] msg_chk
+ *
+ * Bytes are fed one at a time straight from the serial read buffer. The
+ * payload is written into a buffer that is allocated once at construction,
+ * so a completed frame can be deserialized in place without another copy.
+ */
+class RosserialFrameParser
+{
+
+public:
+  enum Result
+  {
+    NEED_MORE,
+    FRAME_READY,
+    LENGTH_ERROR,
+    CHECKSUM_ERROR
+  };
+
+  // Constructor
+  RosserialFrameParser(std::size_t max_payload = 1024);
+
+  // Modules
+  Result feed(uint8_t byte);
+  void reset();
+
+  // Completed frame accessors (valid after feed() returns FRAME_READY)
+  uint16_t topicId() const { return topic_id_; }
+  const uint8_t* data() const { return &payload_[0]; }
+  std::size_t size() const { return length_; }
+
+  // Counters
+  unsigned long frameCount() const { return frame_count_; }
+  unsigned long lengthErrorCount() const { return length_error_count_; }
+  unsigned long checksumErrorCount() const { return checksum_error_count_; }
+
+private:
+  enum State
+  {
+    SYNC,
+    PROTOCOL,
+    LENGTH_LOW,
+    LENGTH_HIGH,
+    LENGTH_CHECKSUM,
+    TOPIC_LOW,
+    TOPIC_HIGH,
+    PAYLOAD,
+    MESSAGE_CHECKSUM
+  };
+
+  State state_;
+  std::vector<uint8_t> payload_;
+  std::size_t length_;
+  std::size_t index_;
+  uint16_t topic_id_;
+  unsigned int checksum_;
+
+  unsigned long frame_count_;
+  unsigned long length_error_count_;
+  unsigned long checksum_error_count_;
+};
+
+// Frame encoding helpers
+std::size_t encodeRosserialFrame(uint16_t topic_id, const uint8_t* data,
+                                 std::size_t length, std::vector<uint8_t>& out);
+bool decodeRosserialTopicInfo(const uint8_t* data, std::size_t length,
+                              RosserialTopicInfo& info);
+std::size_t encodeRosserialTopicInfo(const RosserialTopicInfo& info,
+                                     std::vector<uint8_t>& out);
+
+#endif // PHEENO_ROS_ROSSERIAL_PROTOCOL_H
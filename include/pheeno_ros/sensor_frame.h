@@ -0,0 +1,120 @@
+#ifndef PHEENO_ROS_SENSOR_FRAME_H
+#define PHEENO_ROS_SENSOR_FRAME_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Packed sensor frame format shared by the Teensy firmware and the host.
+ *
+ * A frame carries one complete sensor sweep (or one command) instead of one
+ * rosserial message per value:
+ *
+ *   COBS( version type body[] crc16_L crc16_H ) 0x00
+ *
+ * The CRC is CRC-16/CCITT-FALSE over version, type and body. COBS removes
+ * every zero byte from the encoded frame so 0x00 is an unambiguous frame
+ * delimiter and the reader resynchronizes after a single corrupted byte.
+ */
+namespace Pheeno
+{
+  const uint8_t SENSOR_FRAME_VERSION = 1;
+
+  enum SENSOR_FRAME_TYPE
+  {
+    FRAME_SENSOR_SWEEP = 1,
+    FRAME_COMMAND = 2
+  };
+
+  // Sensors carried by a version 1 sweep (the standard hardware layout).
+  const std::size_t SENSOR_SWEEP_IR_COUNT = 6;
+  const std::size_t SENSOR_SWEEP_ENCODER_COUNT = 4;
+
+  // Body sizes for version 1.
+  const std::size_t SENSOR_SWEEP_BODY_SIZE = 64;
+  const std::size_t COMMAND_BODY_SIZE = 8;
+
+  // version + type + body + crc, plus COBS overhead and the delimiter.
+  const std::size_t SENSOR_FRAME_MAX_PAYLOAD = 2 + SENSOR_SWEEP_BODY_SIZE + 2;
+  const std::size_t SENSOR_FRAME_MAX_ENCODED = SENSOR_FRAME_MAX_PAYLOAD + SENSOR_FRAME_MAX_PAYLOAD / 254 + 2;
+}
+
+/*
+ * One atomic sweep of every Pheeno sensor as sampled by the Teensy.
+ *
+ * IR ranges travel as uint16 hundredths of a centimeter, encoders and the
+ * bottom IR as int16 and the IMU axes as float32, so a sweep is 70 bytes on
+ * the wire compared to roughly 220 bytes as individual rosserial messages.
+ */
+struct SensorSweep
+{
+  uint16_t sequence;
+  uint32_t stamp_ms;                                     // Teensy millis() when the sweep started
+  float ir[Pheeno::SENSOR_SWEEP_IR_COUNT];               // cm, indexed by Pheeno::IR
+  int16_t ir_bottom;                                     // Raw bottom IR reading
+  int16_t encoders[Pheeno::SENSOR_SWEEP_ENCODER_COUNT];  // Indexed by Pheeno::ENCODER
+  float magnetometer[3];
+  float gyroscope[3];
+  float accelerometer[3];
+};
+
+// COBS and CRC primitives
+std::size_t cobsEncode(const uint8_t* data, std::size_t length, uint8_t* out);
+std::size_t cobsDecode(const uint8_t* data, std::size_t length, uint8_t* out);
+uint16_t crc16Ccitt(const uint8_t* data, std::size_t length, uint16_t crc = 0xFFFF);
+
+// Reference encoders (used by the firmware, the bridge and teensy_emulator)
+std::size_t encodeSensorFrame(uint8_t type, const uint8_t* body, std::size_t length, uint8_t* out);
+std::size_t encodeSensorSweep(const SensorSweep& sweep, uint8_t* out);
+std::size_t encodeCommandFrame(float linear, float angular, uint8_t* out);
+
+// Payload decoders. The payload is a reader frame: version, type and body.
+bool decodeSensorSweep(const uint8_t* payload, std::size_t length, SensorSweep& sweep);
+bool decodeCommandFrame(const uint8_t* payload, std::size_t length, float& linear, float& angular);
+
+/*
+ * Splits a byte stream into sensor frames. Bytes are accumulated until the
+ * 0x00 delimiter, then COBS decoded and CRC checked in one pass over a
+ * buffer allocated at construction.
+ */
+class SensorFrameReader
+{
+
+public:
+  enum Result
+  {
+    NEED_MORE,
+    FRAME_READY,
+    FRAME_ERROR
+  };
+
+  // Constructor
+  SensorFrameReader(std::size_t max_encoded = Pheeno::SENSOR_FRAME_MAX_ENCODED);
+
+  // Modules
+  Result feed(uint8_t byte);
+
+  // Completed frame accessors (valid after feed() returns FRAME_READY)
+  const uint8_t* data() const { return &decoded_[0]; }
+  std::size_t size() const { return decoded_length_; }
+  uint8_t type() const { return decoded_length_ > 1 ? decoded_[1] : 0; }
+
+  // Counters
+  unsigned long frameCount() const { return frame_count_; }
+  unsigned long crcErrorCount() const { return crc_error_count_; }
+  unsigned long framingErrorCount() const { return framing_error_count_; }
+
+private:
+  std::vector<uint8_t> encoded_;
+  std::vector<uint8_t> decoded_;
+  std::size_t encoded_length_;
+  std::size_t decoded_length_;
+  bool overflow_;
+
+  unsigned long frame_count_;
+  unsigned long crc_error_count_;
+  unsigned long framing_error_count_;
+};
+
+#endif // PHEENO_ROS_SENSOR_FRAME_H
@@ -0,0 +1,130 @@
+#ifndef PHEENO_ROS_SERIAL_BRIDGE_H
+#define PHEENO_ROS_SERIAL_BRIDGE_H
+
+#include "ros/ros.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "pheeno_ros/rosserial_protocol.h"
+#include "pheeno_ros/sensor_frame.h"
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Per-topic counters kept by the serial bridge and reported on /diagnostics.
+ */
+struct BridgedTopicStats
+{
+  BridgedTopicStats() : messages(0), bytes(0), checksum_errors(0),
+                        decode_errors(0), last_messages(0), last_bytes(0) {}
+
+  unsigned long messages;
+  unsigned long bytes;
+  unsigned long checksum_errors;
+  unsigned long decode_errors;
+
+  // Snapshot at the previous diagnostics report, used to compute rates.
+  unsigned long last_messages;
+  unsigned long last_bytes;
+};
+
+/*
+ * Base class for a topic negotiated with the Teensy. Concrete message types
+ * are handled by templates in serial_bridge.cpp.
+ */
+class BridgedTopic
+{
+
+public:
+  BridgedTopic(const RosserialTopicInfo& info) : info_(info) {}
+  virtual ~BridgedTopic() {}
+
+  // Device -> ROS. Deserializes a frame payload and publishes it.
+  virtual bool publish(const uint8_t*, std::size_t) { return false; }
+
+  const RosserialTopicInfo& info() const { return info_; }
+  BridgedTopicStats stats_;
+
+protected:
+  RosserialTopicInfo info_;
+};
+
+/*
+ * Native replacement for rosserial_python's serial_node.py.
+ *
+ * Speaks the rosserial wire protocol with the Teensy over a serial device
+ * (or any pseudo-terminal, see teensy_emulator). Device publications are
+ * deserialized directly from the receive buffer into message objects that
+ * are allocated once when the topic is negotiated, and ROS messages bound
+ * for the device are serialized straight into the transmit buffer.
+ *
+ * In packed mode the link instead carries COBS framed sensor sweeps (see
+ * sensor_frame.h). Each verified sweep is forwarded on the sensor_sweep
+ * topic and cmd_vel is sent back as a command frame.
+ */
+class SerialBridge
+{
+
+public:
+  // Constructor
+  SerialBridge(std::string port, int baud = 57600, bool packed = false);
+  ~SerialBridge();
+
+  // Modules
+  bool open();
+  void close();
+  void spinOnce(int timeout_ms = 5);
+  bool isConnected() const { return fd_ >= 0; }
+
+  // Used by subscribers to send ROS messages to the Teensy.
+  bool sendFrame(uint16_t topic_id, const uint8_t* data, std::size_t length);
+  bool sendPackedFrame(const uint8_t* frame, std::size_t length);
+
+private:
+  // ROS Node handle
+  ros::NodeHandle nh_;
+
+  // Serial device
+  std::string port_;
+  int baud_;
+  int fd_;
+
+  // Protocol state
+  bool packed_;
+  RosserialFrameParser parser_;
+  SensorFrameReader frame_reader_;
+  std::vector<uint8_t> read_buffer_;
+  std::vector<uint8_t> write_buffer_;
+  std::vector<boost::shared_ptr<BridgedTopic> > publishers_;
+  std::vector<boost::shared_ptr<BridgedTopic> > subscribers_;
+  bool configured_;
+  ros::WallTime last_frame_time_;
+  ros::WallTime last_topic_request_;
+  ros::WallTime last_open_attempt_;
+
+  // Link counters
+  unsigned long bytes_read_;
+  unsigned long bytes_written_;
+  unsigned long unknown_topic_frames_;
+
+  // Diagnostics
+  ros::Publisher pub_diagnostics_;
+  diagnostic_msgs::DiagnosticArray diagnostics_msg_;
+  ros::WallTime last_diagnostics_time_;
+
+  // Frame handling
+  bool writeBytes(const uint8_t* data, std::size_t length);
+  void handleFrame();
+  void handlePackedFrame();
+  void requestTopics();
+  void setupPublisher(const RosserialTopicInfo& info);
+  void setupSubscriber(const RosserialTopicInfo& info);
+  void handleTimeRequest();
+  void handleParameterRequest();
+  void handleLog(const uint8_t* data, std::size_t length);
+
+  // Diagnostics
+  void publishDiagnostics();
+};
+
+#endif // PHEENO_ROS_SERIAL_BRIDGE_H
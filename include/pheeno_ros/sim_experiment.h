@@ -0,0 +1,64 @@
+#ifndef PHEENO_ROS_SIM_EXPERIMENT_H
+#define PHEENO_ROS_SIM_EXPERIMENT_H
+
+#include "pheeno_ros/behaviors.h"
+#include "pheeno_ros/sim_world.h"
+#include <stdint.h>
+#include <cstddef>
+
+/*
+ * Outcome of one simulated experiment.
+ */
+struct SimResult
+{
+  double coverage;           // Fraction of the free arena covered at the end
+  double coverage_rate;      // coverage per minute
+  unsigned long collisions;  // Contact onsets, all robots
+  double contact_time;       // s spent in contact, all robots
+  double stall_time;         // s commanded to move while standing still, all robots
+  double time_to_goal;       // s until goal_coverage was reached, -1 if never
+};
+
+/*
+ * One experiment: a swarm running a behavior in a SimWorld arena for a
+ * fixed time. Everything random (the start poses, each robot's turns)
+ * derives from the seed, so a run repeats exactly and independent runs can
+ * execute on any thread.
+ */
+class SimExperiment
+{
+
+public:
+  struct Config
+  {
+    Config()
+      : behavior(Pheeno::BEHAVIOR_OBSTACLE_AVOIDANCE), robots(4), duration(120.0), goal_coverage(0.5),
+        obstacles(0), threads(1), sensor_errors(false) {}
+
+    SimWorld::Config world;
+    Pheeno::BEHAVIOR behavior;
+    Pheeno::BehaviorParams params;
+    std::size_t robots;
+    double duration;        // s
+    double goal_coverage;   // Coverage time_to_goal waits for
+    std::size_t obstacles;  // Random boxes placed in the arena
+    unsigned int threads;   // SimWorld step threads (results do not depend on it)
+    bool sensor_errors;     // Run the readings through a SimSensorModel of sensors
+    SimSensorModel::Config sensors;
+  };
+
+  // Constructor
+  explicit SimExperiment(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+
+  SimResult run(uint32_t seed) const;
+
+  // Seed of run index of an experiment series seeded with seed
+  static uint32_t runSeed(uint32_t seed, uint64_t index);
+
+private:
+  Config config_;
+};
+
+#endif // PHEENO_ROS_SIM_EXPERIMENT_H
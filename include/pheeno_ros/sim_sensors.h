@@ -0,0 +1,155 @@
+#ifndef PHEENO_ROS_SIM_SENSORS_H
+#define PHEENO_ROS_SIM_SENSORS_H
+
+#include "pheeno_ros/pheeno_hardware.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+struct SimRobot;
+
+namespace Pheeno
+{
+  // Serial channels the simulated sensor readings arrive on
+  enum SIM_CHANNEL
+  {
+    SIM_IR_CHANNEL,
+    SIM_ENCODER_CHANNEL,
+    SIM_IMU_CHANNEL,
+    SIM_CHANNEL_COUNT
+  };
+}
+
+/*
+ * When samples of one channel are taken and how late they arrive (s).
+ */
+struct SimChannelTiming
+{
+  SimChannelTiming(double sample_period = 0.02, double base_latency = 0.01, double latency_jitter = 0.005)
+    : period(sample_period), latency(base_latency), jitter(latency_jitter) {}
+
+  double period;
+  double latency;  // Minimum delay from sampling to delivery
+  double jitter;   // Extra delay, uniform in [0, jitter)
+};
+
+/*
+ * Sensor error and delivery models for SimWorld, turning the exact
+ * readings of a step into what the Teensy would have delivered by then.
+ *
+ * IR (Sharp GP2Y0A21): the range becomes an output voltage a / (d + b) + c
+ * that folds back below peak_range, plus a share of what the adjacent
+ * sensors' reflections add (crosstalk) and Gaussian noise. The voltage is
+ * quantized by the 10 bit ADC and converted back with slightly wrong
+ * calibration coefficients, like the firmware does, so noise grows with
+ * the range and the reading has a range dependent bias. Samples drop out
+ * (max range) or spike to a random range with small probabilities.
+ *
+ * IMU: each axis gets a random initial bias that drifts as a random walk,
+ * plus white noise. Encoder counts are exact.
+ *
+ * Every channel is sampled at its own period and delivered in order after
+ * its latency plus jitter, so controllers see stale, irregular data as
+ * over rosserial.
+ *
+ * The voltage curve, the ADC-code-to-range conversion and a table of
+ * normal deviates are precomputed; a reading costs a few table lookups.
+ * Random numbers come from a counter hashed per robot, so readings do not
+ * depend on which thread senses which robot.
+ */
+class SimSensorModel
+{
+
+public:
+  static const std::size_t MAX_VALUES = Pheeno::Hardware::IR_COUNT > 6 ? Pheeno::Hardware::IR_COUNT : 6;
+  static const std::size_t QUEUE_SIZE = 32;
+
+  struct Config
+  {
+    Config()
+      : ir_voltage_scale(25.0), ir_voltage_offset(0.42), ir_voltage_floor(0.1), ir_peak_range(7.0),
+        ir_voltage_noise(0.015), ir_calibration_error(0.03), ir_crosstalk(0.05), ir_dropout(0.01),
+        ir_spike(0.005), gyro_noise(0.01), gyro_bias(0.02), gyro_bias_walk(0.002), accel_noise(0.05),
+        accel_bias(0.1), accel_bias_walk(0.01)
+    {
+      timing[Pheeno::SIM_IR_CHANNEL] = SimChannelTiming(0.05, 0.012, 0.008);
+      timing[Pheeno::SIM_ENCODER_CHANNEL] = SimChannelTiming(0.02, 0.008, 0.004);
+      timing[Pheeno::SIM_IMU_CHANNEL] = SimChannelTiming(0.02, 0.01, 0.005);
+    }
+
+    double ir_voltage_scale;      // V cm, a in a / (d + b) + c
+    double ir_voltage_offset;     // cm, b
+    double ir_voltage_floor;      // V, c
+    double ir_peak_range;         // cm, the voltage falls off closer than this
+    double ir_voltage_noise;      // V, standard deviation
+    double ir_calibration_error;  // Relative error of the firmware's a
+    double ir_crosstalk;          // Share of an adjacent sensor's reflection voltage
+    double ir_dropout;            // Probability a sample reads max range
+    double ir_spike;              // Probability a sample reads a random range
+    double gyro_noise;            // rad/s, standard deviation
+    double gyro_bias;             // rad/s, standard deviation of the initial bias
+    double gyro_bias_walk;        // rad/s/sqrt(s)
+    double accel_noise;           // m/s^2
+    double accel_bias;            // m/s^2
+    double accel_bias_walk;       // m/s^2/sqrt(s)
+    SimChannelTiming timing[Pheeno::SIM_CHANNEL_COUNT];
+  };
+
+  // Per robot state: biases, random stream and samples in flight
+  struct State
+  {
+    struct Sample
+    {
+      double deliver_at;
+      double values[MAX_VALUES];
+    };
+
+    struct Channel
+    {
+      double next_sample;
+      double last_delivery;
+      std::size_t head;   // Oldest sample in flight
+      std::size_t count;
+      Sample queue[QUEUE_SIZE];
+      double delivered[MAX_VALUES];
+    };
+
+    uint64_t stream;
+    uint64_t counter;
+    bool started;
+    double gyro_bias[3];
+    double accel_bias[3];
+    double bias_stamp;
+    Channel channels[Pheeno::SIM_CHANNEL_COUNT];
+  };
+
+  // Constructor
+  explicit SimSensorModel(const Config& config = Config());
+
+  const Config& config() const { return config_; }
+
+  void reset(State& state, uint64_t seed) const;
+  void apply(State& state, double now, SimRobot& robot) const;
+
+private:
+  static const std::size_t ADC_CODES = 1024;
+  static const std::size_t NORMAL_TABLE_SIZE = 4096;
+
+  Config config_;
+  double ir_bin_;                     // cm per voltage table entry
+  std::vector<double> ir_voltage_;    // By true range
+  std::vector<double> ir_range_;      // By ADC code, as the firmware converts
+  std::vector<double> normal_;        // Standard normal deviates
+  std::vector<std::vector<std::size_t> > ir_adjacent_;
+
+  uint64_t next(State& state) const;
+  double uniform(State& state) const;
+  double gaussian(State& state) const;
+  double irVoltage(double range) const;
+
+  void sampleIr(State& state, const SimRobot& robot, double* values) const;
+  void sampleImu(State& state, const SimRobot& robot, double* values) const;
+  void driftBiases(State& state, double now) const;
+};
+
+#endif // PHEENO_ROS_SIM_SENSORS_H
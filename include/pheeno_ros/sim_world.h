@@ -0,0 +1,190 @@
+#ifndef PHEENO_ROS_SIM_WORLD_H
+#define PHEENO_ROS_SIM_WORLD_H
+
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/pose2d.h"
+#include "pheeno_ros/sim_sensors.h"
+#include "pheeno_ros/spatial_hash.h"
+#include "pheeno_ros/worker_team.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/*
+ * State of one simulated Pheeno. Sensor fields hold the readings of the
+ * last sense phase in the units of the real topics (IR in cm, encoder
+ * ticks as wrapping int16 counters, gyroscope in rad/s, accelerometer in
+ * m/s^2).
+ */
+struct SimRobot
+{
+  Pose2D pose;
+  double linear;           // m/s, actual
+  double angular;          // rad/s, actual
+  double command_linear;   // m/s
+  double command_angular;  // rad/s
+  double wheel_linear;     // m/s the wheels drive at (the command after the motor lag)
+  double wheel_angular;    // rad/s
+  double left_travel;      // m, cumulative wheel travel
+  double right_travel;     // m
+
+  Pheeno::IrRanges<Pheeno::Hardware> ir;
+  Pheeno::EncoderCounts<Pheeno::Hardware> encoders;
+  double gyroscope[3];
+  double accelerometer[3];
+
+  bool in_contact;
+  unsigned long collisions;  // Contact onsets
+  double contact_time;       // s spent in contact
+  double stall_time;         // s commanded to move while standing still
+};
+
+/*
+ * Axis aligned box obstacle (m).
+ */
+struct SimBox
+{
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+};
+
+/*
+ * Lightweight headless simulator for a swarm of Pheenos in a walled
+ * rectangular arena with box obstacles.
+ *
+ * Robots are discs driven as unicycles whose velocity follows the command
+ * with a first order motor lag. Wheels turn at the commanded speeds even
+ * when a contact stops the robot, so the encoders slip against walls as
+ * they do on hardware. Contacts are resolved by pushing discs out of the
+ * walls, the boxes and each other. IR sensors are rays cast from their
+ * mounts in the hardware descriptor. The readings are exact unless a
+ * SimSensorModel is set, which adds noise and delivery latency.
+ *
+ * Controllers decide a robot's command once per control period. Robots
+ * without one keep the command last set with setCommand().
+ *
+ * A step runs in phases (sense, decide, integrate, resolve contacts), each
+ * split over worker threads in blocks of robots. Other robots are found
+ * through uniform grid hashes of the positions at the start of a phase.
+ * Within a phase every robot reads that snapshot and writes only its own
+ * state; contacts are resolved Jacobi style, each robot summing its own
+ * push-outs in the hash's fixed order. Runs are therefore bit-identical
+ * for any thread count. Controllers are called concurrently and must not
+ * share mutable state.
+ *
+ * Coverage is tracked on a grid of coverage_cell cells: the fraction of
+ * arena cells whose center has been under a robot.
+ */
+class SimWorld
+{
+
+public:
+  struct Config
+  {
+    Config()
+      : arena_width(2.0), arena_height(2.0), robot_radius(0.06), dt(0.02), control_period(0.1),
+        motor_time_constant(0.1), max_linear(0.3), max_angular(4.0), coverage_cell(0.05),
+        stall_speed(0.005), stall_yaw_rate(0.1) {}
+
+    double arena_width;          // m, the arena spans [0, width] x [0, height]
+    double arena_height;         // m
+    double robot_radius;         // m
+    double dt;                   // s, physics step
+    double control_period;       // s
+    double motor_time_constant;  // s
+    double max_linear;           // m/s
+    double max_angular;          // rad/s
+    double coverage_cell;        // m
+    double stall_speed;          // m/s, stalled: commanded to move but slower than this
+    double stall_yaw_rate;       // rad/s, and turning slower than this
+  };
+
+  /*
+   * Decides the commands of one robot from its sensors.
+   */
+  class Controller
+  {
+  public:
+    virtual ~Controller() {}
+    virtual void decide(double now, const SimRobot& robot, double& linear, double& angular) = 0;
+  };
+
+  // Constructor (threads 0 uses every hardware thread)
+  explicit SimWorld(const Config& config = Config(), unsigned int threads = 1);
+
+  const Config& config() const { return config_; }
+
+  std::size_t addRobot(const Pose2D& pose, Controller* controller = NULL);
+  void addBox(const SimBox& box);
+  bool placeRandomly(std::size_t count, uint32_t seed, std::vector<Pose2D>& poses) const;
+
+  void setController(std::size_t robot, Controller* controller) { controllers_[robot] = controller; }
+  void setCommand(std::size_t robot, double linear, double angular);
+  void setSensorModel(const SimSensorModel* model, uint64_t seed = 1);
+
+  void step();
+
+  unsigned int threadCount() const { return team_.threadCount(); }
+  void setThreads(unsigned int threads);
+
+  // Robots per block handed to a thread
+  static const std::size_t BLOCK_SIZE = 64;
+
+  double time() const { return time_; }
+  std::size_t robotCount() const { return robots_.size(); }
+  const SimRobot& robot(std::size_t i) const { return robots_[i]; }
+  const std::vector<SimBox>& boxes() const { return boxes_; }
+  double coverage() const;
+  unsigned long collisions() const;
+
+private:
+  Config config_;
+  double time_;
+  double next_control_;
+  std::vector<SimRobot> robots_;
+  std::vector<Controller*> controllers_;
+  std::vector<SimBox> boxes_;
+  std::vector<Pose2D> previous_poses_;
+
+  const SimSensorModel* sensor_model_;  // Not owned, NULL for exact readings
+  uint64_t sensor_seed_;
+  std::vector<SimSensorModel::State> sensor_states_;
+
+  int coverage_columns_;
+  int coverage_rows_;
+  std::vector<uint8_t> covered_;
+  std::size_t covered_count_;
+  std::size_t free_cells_;
+
+  SpatialHash sense_hash_;                         // Cell size half the IR reach
+  SpatialHash contact_hash_;                       // Cell size one robot diameter
+  std::vector<double> x_;                          // Positions the hashes are built from
+  std::vector<double> y_;
+  std::vector<double> push_x_;                     // Per robot, contact resolution
+  std::vector<double> push_y_;
+  std::vector<uint8_t> touching_;
+  std::vector<std::vector<uint32_t> > neighbors_;  // Per thread
+  WorkerTeam team_;                                // Kept across steps
+
+  template <class Fn>
+  void forEachRobot(Fn fn);
+  void hashPositions(SpatialHash& hash);
+
+  void sense(unsigned int thread, std::size_t i);
+  void decide(std::size_t i);
+  void integrate(std::size_t i);
+  void resolveContacts();
+  void push(std::size_t i);
+  void pushOutOfObstacles(std::size_t i);
+  void finishStep(std::size_t i);
+  void cover(std::size_t i);
+  uint64_t sensorSeed(std::size_t i) const { return sensor_seed_ ^ (i * 0x9E3779B97F4A7C15ull); }
+  double irReach() const;
+  double castRay(const std::vector<uint32_t>& robots, double x, double y, double dx, double dy,
+                 double max_range) const;
+  bool freeAt(double x, double y, double clearance) const;
+};
+
+#endif // PHEENO_ROS_SIM_WORLD_H
@@ -0,0 +1,96 @@
+#ifndef PHEENO_ROS_SPATIAL_HASH_H
+#define PHEENO_ROS_SPATIAL_HASH_H
+
+#include <stdint.h>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Uniform grid over the plane for fixed-radius neighbor queries, hashed so
+ * the world needs no bounds.
+ *
+ * build() counting-sorts the points by bucket in O(N), copying their
+ * positions and cells next to each other so a query walks contiguous
+ * memory. Points from different cells that share a bucket are told apart
+ * by their stored cell. Queries are const, so any number of threads may
+ * run them on one build.
+ *
+ * Points are visited in a fixed order for a given input, which batch
+ * solvers rely on for results that do not depend on the thread count.
+ */
+class SpatialHash
+{
+
+public:
+  // Constructor
+  explicit SpatialHash(double cell_size = 1.0);
+
+  void setCellSize(double cell_size);
+  double cellSize() const { return cell_size_; }
+
+  void build(const double* x, const double* y, std::size_t count);
+  std::size_t size() const { return index_.size(); }
+
+  /*
+   * Calls visit(index, dx, dy, distance_squared) for every point within
+   * radius of (x, y), where (dx, dy) is the offset from (x, y) to the point.
+   */
+  template <class Visitor>
+  void forEachNear(double x, double y, double radius, Visitor visit) const
+  {
+    if (index_.empty())
+    {
+      return;
+    }
+
+    double radius_squared = radius * radius;
+    int32_t x_begin = cellOf(x - radius);
+    int32_t x_end = cellOf(x + radius);
+    int32_t y_begin = cellOf(y - radius);
+    int32_t y_end = cellOf(y + radius);
+    for (int32_t cy = y_begin; cy <= y_end; cy++)
+    {
+      for (int32_t cx = x_begin; cx <= x_end; cx++)
+      {
+        uint32_t bucket = bucketOf(cx, cy);
+        for (uint32_t i = start_[bucket]; i < start_[bucket + 1]; i++)
+        {
+          if (cell_x_[i] != cx || cell_y_[i] != cy)
+          {
+            continue;
+          }
+
+          double dx = x_[i] - x;
+          double dy = y_[i] - y;
+          double distance_squared = dx * dx + dy * dy;
+          if (distance_squared <= radius_squared)
+          {
+            visit(index_[i], dx, dy, distance_squared);
+          }
+        }
+      }
+    }
+  }
+
+private:
+  double cell_size_;
+  double inverse_cell_size_;
+  uint32_t bucket_mask_;
+
+  std::vector<uint32_t> start_;   // Per bucket, plus one past the end
+  std::vector<uint32_t> bucket_;  // Per input point (scratch)
+  std::vector<uint32_t> index_;   // Sorted by bucket: input index
+  std::vector<int32_t> cell_x_;
+  std::vector<int32_t> cell_y_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+
+  int32_t cellOf(double v) const { return static_cast<int32_t>(std::floor(v * inverse_cell_size_)); }
+  uint32_t bucketOf(int32_t cx, int32_t cy) const
+  {
+    return (static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u) & bucket_mask_;
+  }
+};
+
+#endif // PHEENO_ROS_SPATIAL_HASH_H
@@ -0,0 +1,209 @@
+#ifndef PHEENO_ROS_WHEEL_SPEED_CONTROLLER_H
+#define PHEENO_ROS_WHEEL_SPEED_CONTROLLER_H
+
+#include "pheeno_ros/command_arbiter.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace Pheeno
+{
+  /*
+   * Travel (m) of the left and right wheels between two sets of encoder
+   * counts. Channels are int16 tick counters that wrap around; each belongs
+   * to the left or the right wheel according to the descriptor's encoder
+   * masks, and a wheel's travel is the mean over its channels.
+   */
+  template <class HW>
+  void wheelTravel(const EncoderCounts<HW>& counts, const EncoderCounts<HW>& previous, double& left, double& right)
+  {
+    const double meters_per_tick = 2.0 * 3.14159265358979 * HW::wheelRadius() / HW::encoderTicksPerRev();
+    const unsigned int masks[2] = {HW::LEFT_ENCODER_MASK, HW::RIGHT_ENCODER_MASK};
+    double travel[2];
+
+    for (int w = 0; w < 2; w++)
+    {
+      int ticks = 0;
+      int channels = 0;
+      for (std::size_t i = 0; i < HW::ENCODER_COUNT; i++)
+      {
+        if ((masks[w] >> i) & 1u)
+        {
+          ticks += static_cast<int16_t>(static_cast<uint16_t>(counts[i] - previous[i]));
+          channels++;
+        }
+      }
+      travel[w] = channels > 0 ? ticks * meters_per_tick / channels : 0.0;
+    }
+
+    left = travel[0];
+    right = travel[1];
+  }
+}
+
+/*
+ * Host-side closed-loop wheel speed control.
+ *
+ * The commanded twist is split into left and right wheel speeds. Encoder
+ * counts give the measured wheel speeds, and a PI controller with
+ * feedforward per wheel produces corrected wheel speeds. Those are turned
+ * back into a twist for the Teensy's open-loop drive, so battery sag and
+ * floor friction are compensated on the host.
+ *
+ * Anti-windup is done by conditional integration: the integrator only
+ * accumulates when the output is not saturated, or when the error would
+ * drive the output out of saturation.
+ *
+ * Encoder channels are int16 tick counters that wrap around. Each channel
+ * belongs to the left or the right wheel according to the descriptor's
+ * encoder masks, and a wheel's speed is the mean over its channels.
+ */
+template <class HW>
+class WheelSpeedController
+{
+
+public:
+  struct Gains
+  {
+    Gains() : kp(0.5), ki(4.0), kff(1.0), max_speed(0.3), filter(0.5) {}
+
+    double kp;         // Per m/s of wheel speed error
+    double ki;         // Per m of accumulated wheel travel error
+    double kff;        // Feedforward on the target wheel speed
+    double max_speed;  // m/s, output saturation per wheel
+    double filter;     // Weight of the newest speed measurement (0-1]
+  };
+
+  enum WHEEL
+  {
+    LEFT,
+    RIGHT,
+    WHEEL_COUNT
+  };
+
+  // Constructor
+  explicit WheelSpeedController(const Gains& gains = Gains())
+    : gains_(gains), has_reference_(false), stamp_(0.0)
+  {
+    previous_.fill(0);
+    reset();
+  }
+
+  void setGains(const Gains& gains) { gains_ = gains; }
+  const Gains& gains() const { return gains_; }
+
+  /*
+   * Sets the twist to track.
+   */
+  void setTarget(const VelocityCommand& command)
+  {
+    target_ = command;
+    double half_base = HW::wheelBase() / 2.0;
+    wheels_[LEFT].target = command.linear - command.angular * half_base;
+    wheels_[RIGHT].target = command.linear + command.angular * half_base;
+  }
+
+  const VelocityCommand& target() const { return target_; }
+  double measuredSpeed(WHEEL wheel) const { return wheels_[wheel].measured; }
+
+  /*
+   * Drops the integrators and the encoder reference. The next update only
+   * stores a new reference.
+   */
+  void reset()
+  {
+    has_reference_ = false;
+    for (int i = 0; i < WHEEL_COUNT; i++)
+    {
+      wheels_[i].measured = 0.0;
+      wheels_[i].integral = 0.0;
+    }
+  }
+
+  /*
+   * Feeds a complete set of encoder counts taken at stamp (s). Returns true
+   * and fills output with the corrected twist once a speed can be measured.
+   */
+  bool update(const Pheeno::EncoderCounts<HW>& counts, double stamp, VelocityCommand& output)
+  {
+    double dt = stamp - stamp_;
+    if (!has_reference_ || dt <= 0.0 || dt > MAX_GAP)
+    {
+      reset();
+      has_reference_ = true;
+      previous_ = counts;
+      stamp_ = stamp;
+      return false;
+    }
+
+    double travel[WHEEL_COUNT];
+    Pheeno::wheelTravel<HW>(counts, previous_, travel[LEFT], travel[RIGHT]);
+    for (int w = 0; w < WHEEL_COUNT; w++)
+    {
+      wheels_[w].measured += gains_.filter * (travel[w] / dt - wheels_[w].measured);
+    }
+
+    previous_ = counts;
+    stamp_ = stamp;
+
+    // A stop is a stop: no integrator leftovers pushing a stationary robot.
+    if (wheels_[LEFT].target == 0.0 && wheels_[RIGHT].target == 0.0)
+    {
+      wheels_[LEFT].integral = wheels_[RIGHT].integral = 0.0;
+      output = VelocityCommand();
+      return true;
+    }
+
+    double left = control(wheels_[LEFT], dt);
+    double right = control(wheels_[RIGHT], dt);
+    output.linear = (left + right) / 2.0;
+    output.angular = (right - left) / HW::wheelBase();
+    return true;
+  }
+
+private:
+  // Encoder gaps longer than this (s) restart the measurement.
+  static constexpr double MAX_GAP = 0.5;
+
+  struct Wheel
+  {
+    Wheel() : target(0.0), measured(0.0), integral(0.0) {}
+
+    double target;
+    double measured;
+    double integral;
+  };
+
+  double saturate(double speed) const
+  {
+    return std::min(gains_.max_speed, std::max(-gains_.max_speed, speed));
+  }
+
+  /*
+   * PI with feedforward and conditional integration for one wheel.
+   */
+  double control(Wheel& wheel, double dt) const
+  {
+    double error = wheel.target - wheel.measured;
+    double base = gains_.kff * wheel.target + gains_.kp * error;
+    double integral = wheel.integral + error * dt;
+    double unsaturated = base + gains_.ki * integral;
+
+    if (unsaturated == saturate(unsaturated) || (unsaturated > 0.0) != (error > 0.0))
+    {
+      wheel.integral = integral;
+    }
+
+    return saturate(base + gains_.ki * wheel.integral);
+  }
+
+  Gains gains_;
+  VelocityCommand target_;
+  Wheel wheels_[WHEEL_COUNT];
+  Pheeno::EncoderCounts<HW> previous_;
+  bool has_reference_;
+  double stamp_;
+};
+
+#endif // PHEENO_ROS_WHEEL_SPEED_CONTROLLER_H
@@ -0,0 +1,70 @@
+#ifndef PHEENO_ROS_WORK_STEALING_POOL_H
+#define PHEENO_ROS_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed pool of worker threads with one task deque per worker.
+ *
+ * A worker pops its own newest task first and, when its deque is empty,
+ * steals the oldest task of another worker, so long and short tasks (an
+ * experiment with 50 robots next to one with 2) balance without a central
+ * queue every thread contends on. Tasks submitted from outside the pool
+ * are dealt round robin; tasks submitted from a worker go to its own
+ * deque.
+ *
+ * For coarse tasks like whole simulated experiments; the deques are
+ * guarded by mutexes rather than lock-free.
+ */
+class WorkStealingPool
+{
+
+public:
+  typedef std::function<void()> Task;
+
+  // Constructor (threads == 0: one per hardware thread)
+  explicit WorkStealingPool(unsigned int threads = 0);
+  ~WorkStealingPool();
+
+  unsigned int threadCount() const { return static_cast<unsigned int>(workers_.size()); }
+
+  void submit(const Task& task);
+  void wait();
+
+  // Index of the calling worker thread, or -1 outside the pool
+  int currentWorker() const;
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::thread> workers_;
+  std::vector<Queue*> queues_;
+  std::atomic<std::size_t> next_queue_;
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable idle_;
+  std::size_t queued_;   // Submitted, not taken (guarded by mutex_)
+  std::size_t pending_;  // Submitted, not finished (guarded by mutex_)
+  bool stopping_;
+
+  WorkStealingPool(const WorkStealingPool&);
+  WorkStealingPool& operator=(const WorkStealingPool&);
+
+  void work(unsigned int index);
+  bool take(unsigned int index, Task& task);
+  void taken();
+};
+
+#endif // PHEENO_ROS_WORK_STEALING_POOL_H
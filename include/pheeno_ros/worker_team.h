@@ -0,0 +1,83 @@
+#ifndef PHEENO_ROS_WORKER_TEAM_H
+#define PHEENO_ROS_WORKER_TEAM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Worker threads kept alive across data-parallel phases.
+ *
+ * run() splits [0, count) into blocks of block_size, claimed from a shared
+ * counter by the workers and the calling thread, and returns once every
+ * block is done, so consecutive phases are separated by a barrier. A
+ * simulator step has several short phases; starting threads for each of
+ * them would cost more than the phase itself.
+ *
+ * Between phases the workers yield for a short while before sleeping, but
+ * only when every thread of the team has a core of its own; otherwise a
+ * spinning worker would take the core the others need.
+ */
+class WorkerTeam
+{
+
+public:
+  // Constructor (threads 0 uses every hardware thread)
+  explicit WorkerTeam(unsigned int threads = 0);
+  ~WorkerTeam();
+
+  unsigned int threadCount() const { return static_cast<unsigned int>(workers_.size()) + 1; }
+  void setThreads(unsigned int threads);
+
+  /*
+   * Calls fn(thread, begin, end) for every block. thread (0 .. threadCount()
+   * - 1, 0 being the caller) indexes per-thread scratch space; which thread
+   * runs a block varies between calls, so results must not depend on it.
+   */
+  template <class Fn>
+  void run(std::size_t count, std::size_t block_size, Fn fn)
+  {
+    runBlocks(count, block_size, &WorkerTeam::call<Fn>, &fn);
+  }
+
+private:
+  typedef void (*Call)(void* fn, unsigned int thread, std::size_t begin, std::size_t end);
+
+  std::vector<std::thread> workers_;
+  bool spin_;
+
+  // The current phase (written by run() before generation_ is advanced)
+  Call call_;
+  void* fn_;
+  std::size_t count_;
+  std::size_t block_size_;
+  std::size_t blocks_;
+  std::atomic<std::size_t> next_block_;
+  std::atomic<std::size_t> running_;  // Workers still in the phase
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::atomic<unsigned long> generation_;  // Advanced once per phase
+  unsigned int sleeping_;                  // Guarded by mutex_
+  bool stopping_;                          // Guarded by mutex_
+
+  WorkerTeam(const WorkerTeam&);
+  WorkerTeam& operator=(const WorkerTeam&);
+
+  template <class Fn>
+  static void call(void* fn, unsigned int thread, std::size_t begin, std::size_t end)
+  {
+    (*static_cast<Fn*>(fn))(thread, begin, end);
+  }
+
+  void runBlocks(std::size_t count, std::size_t block_size, Call call, void* fn);
+  void work(unsigned int thread, unsigned long seen);
+  void workBlocks(unsigned int thread);
+  void stop();
+};
+
+#endif // PHEENO_ROS_WORKER_TEAM_H
@@ -0,0 +1,65 @@
+#include "pheeno_ros/adaptive_rate.h"
+#include <algorithm>
+
+namespace
+{
+  /*
+   * 0 at or beyond far, 1 at or below near, linear in between.
+   */
+  double rampDown(double value, double near, double far)
+  {
+    if (far <= near)
+    {
+      return value <= near ? 1.0 : 0.0;
+    }
+    return std::min(1.0, std::max(0.0, (far - value) / (far - near)));
+  }
+}
+
+/*
+ * Contructor for the AdaptiveRate Class. Starts at the minimum rate.
+ */
+AdaptiveRate::AdaptiveRate(const Bounds& bounds)
+  : rate_(0.0), urgency_(0.0)
+{
+  setBounds(bounds);
+  rate_ = bounds_.min_rate;
+}
+
+/*
+ * Sets the rate bounds and ramps. The current rate is clamped into the new
+ * bounds.
+ */
+void AdaptiveRate::setBounds(const Bounds& bounds)
+{
+  bounds_ = bounds;
+  bounds_.min_rate = std::max(bounds_.min_rate, 0.1);
+  bounds_.max_rate = std::max(bounds_.max_rate, bounds_.min_rate);
+  bounds_.decay = std::min(1.0, std::max(0.0, bounds_.decay));
+  rate_ = std::min(bounds_.max_rate, std::max(bounds_.min_rate, rate_));
+}
+
+/*
+ * Computes the rate for the next period from the closest range and the
+ * time to collision.
+ */
+double AdaptiveRate::update(double min_range, double time_to_collision)
+{
+  double range_urgency = rampDown(min_range, bounds_.near_range, bounds_.far_range);
+  double ttc_urgency = (time_to_collision >= 0.0)
+                         ? rampDown(time_to_collision, bounds_.near_ttc, bounds_.far_ttc)
+                         : 0.0;
+  urgency_ = std::max(range_urgency, ttc_urgency);
+
+  double target = bounds_.min_rate + urgency_ * (bounds_.max_rate - bounds_.min_rate);
+  if (target >= rate_)
+  {
+    rate_ = target;
+  }
+  else
+  {
+    rate_ += (target - rate_) * bounds_.decay;
+  }
+
+  return rate_;
+}
@@ -0,0 +1,282 @@
+//
+// Evolves the tunables of the obstacle_avoidance or random_walk behavior
+// with CMA-ES (cma_es.h) over the headless simulator (sim_world.h).
+//
+//   rosrun pheeno_ros behavior_optimizer -b avoidance -n 4 -t 120 -k 8 -g 60
+//   rosrun pheeno_ros behavior_optimizer -b walk -p "walk_linear 0.02 0.2; walk_time 2 40"
+//
+// -p bounds the searched BehaviorParams fields ("<name> <low> <high>",
+// ';' separated); without it every field the behavior uses is searched
+// within default bounds. The search starts from the BehaviorParams
+// defaults. The evolved values are printed as ~behavior/<name> arguments
+// for the obstacle_avoidance and random_walk nodes.
+//
+// Fitness (maximized) is coverage per minute, minus -a times the fraction
+// of robot time spent stalled, minus -c times the collisions per robot
+// minute, averaged over -k runs. All candidates of a generation run with
+// the same -k seeds, fresh each generation, on all cores. With the same -s
+// the whole search repeats exactly, whatever the thread count. The best
+// mean is finally checked against the defaults on -v unseen seeds. -m
+// evolves against the IR/IMU noise and latency models (sim_sensors.h).
+//
+
+#include "pheeno_ros/behaviors.h"
+#include "pheeno_ros/cma_es.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/sim_experiment.h"
+#include "pheeno_ros/work_stealing_pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // One searched field and its bounds
+  struct Bound
+  {
+    std::string name;
+    double low;
+    double high;
+  };
+
+  struct Weights
+  {
+    double stall;
+    double collision;
+  };
+
+  // Default search space of each behavior
+  void defaultBounds(Pheeno::BEHAVIOR behavior, std::vector<Bound>& bounds)
+  {
+    if (behavior == Pheeno::BEHAVIOR_RANDOM_WALK)
+    {
+      const Bound walk[] = {
+        {"random_turn", 0.02, 2.0}, {"walk_turn_time", 0.5, 20.0}, {"walk_time", 1.0, 40.0},
+        {"walk_linear", 0.02, 0.25}
+      };
+      bounds.assign(walk, walk + sizeof(walk) / sizeof(walk[0]));
+    }
+    else
+    {
+      const Bound avoidance[] = {
+        {"range_to_avoid", 5.0, 60.0}, {"angular_velocity", 0.2, 3.0}, {"linear_velocity", 0.02, 0.25},
+        {"random_turn", 0.02, 2.0}, {"straight_time", 0.5, 10.0}, {"turn_time", 0.5, 15.0}
+      };
+      bounds.assign(avoidance, avoidance + sizeof(avoidance) / sizeof(avoidance[0]));
+    }
+  }
+
+  bool parseBounds(const std::string& spec, std::vector<Bound>& bounds)
+  {
+    std::istringstream entries(spec);
+    std::string entry;
+    while (std::getline(entries, entry, ';'))
+    {
+      std::istringstream words(entry);
+      Bound bound;
+      if (!(words >> bound.name))
+      {
+        continue;
+      }
+      Pheeno::BehaviorParams params;
+      if (!(words >> bound.low >> bound.high) || bound.high <= bound.low ||
+          Pheeno::behaviorParam(params, bound.name) == NULL)
+      {
+        std::fprintf(stderr, "Bad bound: %s\n", entry.c_str());
+        return false;
+      }
+      bounds.push_back(bound);
+    }
+    return true;
+  }
+
+  // Search coordinates are scaled to [0, 1] per field, so one step size
+  // suits all of them.
+  double toSearch(const Bound& bound, double value)
+  {
+    return (value - bound.low) / (bound.high - bound.low);
+  }
+
+  double fromSearch(const Bound& bound, double x)
+  {
+    return bound.low + std::max(0.0, std::min(1.0, x)) * (bound.high - bound.low);
+  }
+
+  // How far x lies outside [0, 1], squared
+  double boundViolation(const std::vector<double>& x)
+  {
+    double violation = 0.0;
+    for (std::size_t i = 0; i < x.size(); i++)
+    {
+      double outside = x[i] < 0.0 ? -x[i] : (x[i] > 1.0 ? x[i] - 1.0 : 0.0);
+      violation += outside * outside;
+    }
+    return violation;
+  }
+
+  double fitness(const SimResult& result, const SimExperiment::Config& config, const Weights& weights)
+  {
+    double robot_time = config.robots * config.duration;
+    return result.coverage_rate - weights.stall * result.stall_time / robot_time -
+           weights.collision * result.collisions / (robot_time / 60.0);
+  }
+
+  /*
+   * Mean fitness of each parameter set over runs seeds from the series
+   * (seed, first_run ...). Each (set, run) pair is one pool task with its
+   * own result slot.
+   */
+  void evaluate(WorkStealingPool& pool, const SimExperiment::Config& config, const Weights& weights,
+                const std::vector<Pheeno::BehaviorParams>& sets, uint32_t seed, uint64_t first_run,
+                std::size_t runs, std::vector<double>& means)
+  {
+    std::vector<double> fitnesses(sets.size() * runs);
+    for (std::size_t task = 0; task < fitnesses.size(); task++)
+    {
+      pool.submit([&, task]()
+      {
+        SimExperiment::Config run_config = config;
+        run_config.params = sets[task / runs];
+        SimResult result = SimExperiment(run_config).run(SimExperiment::runSeed(seed, first_run + task % runs));
+        fitnesses[task] = fitness(result, config, weights);
+      });
+    }
+    pool.wait();
+
+    means.assign(sets.size(), 0.0);
+    for (std::size_t task = 0; task < fitnesses.size(); task++)
+    {
+      means[task / runs] += fitnesses[task] / runs;
+    }
+  }
+
+  Pheeno::BehaviorParams paramsAt(const SimExperiment::Config& config, const std::vector<Bound>& bounds,
+                                  const std::vector<double>& x)
+  {
+    Pheeno::BehaviorParams params = config.params;
+    for (std::size_t i = 0; i < bounds.size(); i++)
+    {
+      *Pheeno::behaviorParam(params, bounds[i].name) = fromSearch(bounds[i], x[i]);
+    }
+    return params;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cml_parser(argc, argv);
+
+  SimExperiment::Config config;
+  if (!Pheeno::parseBehavior(cml_parser("-b", "obstacle_avoidance"), config.behavior))
+  {
+    std::fprintf(stderr, "Unknown behavior %s! Use obstacle_avoidance or random_walk.\n", cml_parser("-b").c_str());
+    return 1;
+  }
+  config.robots = std::max(1, std::atoi(cml_parser("-n", "4").c_str()));
+  config.duration = std::max(1.0, std::atof(cml_parser("-t", "120").c_str()));
+  config.obstacles = std::max(0, std::atoi(cml_parser("-x", "0").c_str()));
+  config.world.arena_width = config.world.arena_height = std::max(0.5, std::atof(cml_parser("-w", "2").c_str()));
+  config.sensor_errors = cml_parser["-m"];
+  std::size_t repeats = std::max(1, std::atoi(cml_parser("-k", "8").c_str()));
+  std::size_t validation = std::max(1, std::atoi(cml_parser("-v", "50").c_str()));
+  unsigned long generations = std::max(1, std::atoi(cml_parser("-g", "50").c_str()));
+  std::size_t population = std::max(0, std::atoi(cml_parser("-l", "0").c_str()));
+  unsigned int threads = std::max(0, std::atoi(cml_parser("-j", "0").c_str()));
+  uint32_t seed = static_cast<uint32_t>(std::strtoul(cml_parser("-s", "1").c_str(), NULL, 10));
+  Weights weights;
+  weights.stall = std::atof(cml_parser("-a", "0.05").c_str());
+  weights.collision = std::atof(cml_parser("-c", "0.01").c_str());
+
+  std::vector<Bound> bounds;
+  if (cml_parser["-p"])
+  {
+    if (!parseBounds(cml_parser("-p"), bounds))
+    {
+      return 1;
+    }
+  }
+  else
+  {
+    defaultBounds(config.behavior, bounds);
+  }
+  if (bounds.empty())
+  {
+    std::fprintf(stderr, "Nothing to optimize!\n");
+    return 1;
+  }
+
+  // Start from the node defaults
+  std::vector<double> start(bounds.size());
+  for (std::size_t i = 0; i < bounds.size(); i++)
+  {
+    start[i] = std::max(0.0, std::min(1.0, toSearch(bounds[i], *Pheeno::behaviorParam(config.params, bounds[i].name))));
+  }
+
+  CmaEs es(start, std::atof(cml_parser("-d", "0.3").c_str()), seed, population);
+  WorkStealingPool pool(threads);
+  std::printf("%lu parameters, population %lu, %lu runs per candidate on %u threads\n",
+              static_cast<unsigned long>(bounds.size()), static_cast<unsigned long>(es.population()),
+              static_cast<unsigned long>(repeats), pool.threadCount());
+  std::printf("%4s %10s %10s %8s\n", "gen", "best", "median", "sigma");
+
+  // Evaluation seeds: generation g uses runs g * repeats ..., validation
+  // runs come after all generations.
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  std::vector<Pheeno::BehaviorParams> sets(es.population());
+  std::vector<double> means;
+  std::vector<double> costs(es.population());
+  for (unsigned long generation = 0; generation < generations && es.spread() > 1e-4; generation++)
+  {
+    const std::vector<std::vector<double> >& candidates = es.ask();
+    for (std::size_t k = 0; k < candidates.size(); k++)
+    {
+      sets[k] = paramsAt(config, bounds, candidates[k]);
+    }
+    evaluate(pool, config, weights, sets, seed, generation * repeats, repeats, means);
+
+    // CMA-ES minimizes; out of bounds candidates ran clamped and pay for
+    // the distance.
+    for (std::size_t k = 0; k < candidates.size(); k++)
+    {
+      costs[k] = -means[k] + boundViolation(candidates[k]);
+    }
+    es.tell(costs);
+
+    std::vector<double> sorted(means);
+    std::sort(sorted.begin(), sorted.end());
+    std::printf("%4lu %10.5f %10.5f %8.4f\n", generation + 1, sorted.back(), sorted[sorted.size() / 2], es.sigma());
+    std::fflush(stdout);
+  }
+
+  // The final mean averages over many noisy generations; the best single
+  // candidate was likely lucky with its seeds.
+  std::vector<Pheeno::BehaviorParams> finalists(2);
+  finalists[0] = config.params;
+  finalists[1] = paramsAt(config, bounds, es.mean());
+  evaluate(pool, config, weights, finalists, seed, generations * repeats, validation, means);
+
+  std::printf("\n%-18s %10s %10s\n", "", "default", "evolved");
+  for (std::size_t i = 0; i < bounds.size(); i++)
+  {
+    std::printf("%-18s %10.4g %10.4g\n", bounds[i].name.c_str(), *Pheeno::behaviorParam(finalists[0], bounds[i].name),
+                *Pheeno::behaviorParam(finalists[1], bounds[i].name));
+  }
+  std::printf("%-18s %10.5f %10.5f  (%lu unseen runs)\n", "fitness", means[0], means[1],
+              static_cast<unsigned long>(validation));
+  std::printf("node args:");
+  for (std::size_t i = 0; i < bounds.size(); i++)
+  {
+    std::printf(" _behavior/%s:=%.6g", bounds[i].name.c_str(), *Pheeno::behaviorParam(finalists[1], bounds[i].name));
+  }
+  std::printf("\n");
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  std::printf("%lu generations in %.1f s\n", es.generation(), elapsed);
+  return 0;
+}
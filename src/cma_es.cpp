@@ -0,0 +1,283 @@
+#include "pheeno_ros/cma_es.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  // Orders candidate indices by cost, ties by index, so equal costs sort
+  // the same on every platform.
+  struct CostOrder
+  {
+    explicit CostOrder(const std::vector<double>& costs) : costs_(costs) {}
+
+    bool operator()(std::size_t a, std::size_t b) const
+    {
+      return costs_[a] != costs_[b] ? costs_[a] < costs_[b] : a < b;
+    }
+
+    const std::vector<double>& costs_;
+  };
+
+  /*
+   * Eigen decomposition of the symmetric n x n matrix a (destroyed) by
+   * cyclic Jacobi rotations. The eigenvectors are the columns of vectors.
+   */
+  void jacobiEigen(std::vector<double>& a, std::size_t n, std::vector<double>& values, std::vector<double>& vectors)
+  {
+    vectors.assign(n * n, 0.0);
+    for (std::size_t i = 0; i < n; i++)
+    {
+      vectors[i * n + i] = 1.0;
+    }
+
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+      double off = 0.0;
+      for (std::size_t p = 0; p < n; p++)
+      {
+        for (std::size_t q = p + 1; q < n; q++)
+        {
+          off += a[p * n + q] * a[p * n + q];
+        }
+      }
+      if (off < 1e-30)
+      {
+        break;
+      }
+
+      for (std::size_t p = 0; p < n; p++)
+      {
+        for (std::size_t q = p + 1; q < n; q++)
+        {
+          double apq = a[p * n + q];
+          if (std::abs(apq) < 1e-300)
+          {
+            continue;
+          }
+          double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+          double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+          double c = 1.0 / std::sqrt(t * t + 1.0);
+          double s = t * c;
+
+          for (std::size_t k = 0; k < n; k++)
+          {
+            double akp = a[k * n + p];
+            double akq = a[k * n + q];
+            a[k * n + p] = c * akp - s * akq;
+            a[k * n + q] = s * akp + c * akq;
+          }
+          for (std::size_t k = 0; k < n; k++)
+          {
+            double apk = a[p * n + k];
+            double aqk = a[q * n + k];
+            a[p * n + k] = c * apk - s * aqk;
+            a[q * n + k] = s * apk + c * aqk;
+          }
+          for (std::size_t k = 0; k < n; k++)
+          {
+            double vkp = vectors[k * n + p];
+            double vkq = vectors[k * n + q];
+            vectors[k * n + p] = c * vkp - s * vkq;
+            vectors[k * n + q] = s * vkp + c * vkq;
+          }
+        }
+      }
+    }
+
+    values.resize(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+      values[i] = a[i * n + i];
+    }
+  }
+}
+
+/*
+ * Contructor for the CmaEs Class. Sets the strategy parameters to the
+ * defaults recommended for the dimension (Hansen, "The CMA Evolution
+ * Strategy: A Tutorial").
+ */
+CmaEs::CmaEs(const std::vector<double>& mean, double sigma, uint32_t seed, std::size_t population)
+  : mean_(mean), sigma_(sigma), eigen_generation_(0), rng_(seed), normal_(0.0, 1.0), generation_(0),
+    best_(mean), best_cost_(std::numeric_limits<double>::infinity())
+{
+  double n = static_cast<double>(mean_.size());
+  population_ = population > 0 ? population : 4 + static_cast<std::size_t>(3.0 * std::log(n));
+  population_ = std::max<std::size_t>(population_, 2);
+  parents_ = population_ / 2;
+
+  double sum = 0.0;
+  double sum_squares = 0.0;
+  for (std::size_t i = 0; i < parents_; i++)
+  {
+    weights_.push_back(std::log(parents_ + 0.5) - std::log(i + 1.0));
+    sum += weights_.back();
+  }
+  for (std::size_t i = 0; i < parents_; i++)
+  {
+    weights_[i] /= sum;
+    sum_squares += weights_[i] * weights_[i];
+  }
+  mu_eff_ = 1.0 / sum_squares;
+
+  c_c_ = (4.0 + mu_eff_ / n) / (n + 4.0 + 2.0 * mu_eff_ / n);
+  c_sigma_ = (mu_eff_ + 2.0) / (n + mu_eff_ + 5.0);
+  c_1_ = 2.0 / ((n + 1.3) * (n + 1.3) + mu_eff_);
+  c_mu_ = std::min(1.0 - c_1_, 2.0 * (mu_eff_ - 2.0 + 1.0 / mu_eff_) / ((n + 2.0) * (n + 2.0) + mu_eff_));
+  damping_ = 1.0 + 2.0 * std::max(0.0, std::sqrt((mu_eff_ - 1.0) / (n + 1.0)) - 1.0) + c_sigma_;
+  chi_n_ = std::sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+  std::size_t size = mean_.size();
+  covariance_.assign(size * size, 0.0);
+  eigenvectors_.assign(size * size, 0.0);
+  for (std::size_t i = 0; i < size; i++)
+  {
+    covariance_[i * size + i] = 1.0;
+    eigenvectors_[i * size + i] = 1.0;
+  }
+  scales_.assign(size, 1.0);
+  path_c_.assign(size, 0.0);
+  path_sigma_.assign(size, 0.0);
+  candidates_.assign(population_, std::vector<double>(size));
+  steps_.assign(population_, std::vector<double>(size));
+}
+
+/*
+ * Samples the next generation.
+ */
+const std::vector<std::vector<double> >& CmaEs::ask()
+{
+  std::size_t n = mean_.size();
+  std::vector<double> z(n);
+  for (std::size_t k = 0; k < population_; k++)
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      z[i] = scales_[i] * normal_(rng_);
+    }
+    for (std::size_t i = 0; i < n; i++)
+    {
+      double step = 0.0;
+      for (std::size_t j = 0; j < n; j++)
+      {
+        step += eigenvectors_[i * n + j] * z[j];
+      }
+      steps_[k][i] = step;
+      candidates_[k][i] = mean_[i] + sigma_ * step;
+    }
+  }
+  return candidates_;
+}
+
+/*
+ * Updates the distribution from the costs of the candidates of the last
+ * ask(), lower is better.
+ */
+void CmaEs::tell(const std::vector<double>& costs)
+{
+  std::size_t n = mean_.size();
+  std::vector<std::size_t> order(population_);
+  for (std::size_t k = 0; k < population_; k++)
+  {
+    order[k] = k;
+  }
+  std::sort(order.begin(), order.end(), CostOrder(costs));
+  if (costs[order[0]] < best_cost_)
+  {
+    best_cost_ = costs[order[0]];
+    best_ = candidates_[order[0]];
+  }
+
+  // Weighted recombination of the best half
+  std::vector<double> step_mean(n, 0.0);
+  for (std::size_t k = 0; k < parents_; k++)
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      step_mean[i] += weights_[k] * steps_[order[k]][i];
+    }
+  }
+  for (std::size_t i = 0; i < n; i++)
+  {
+    mean_[i] += sigma_ * step_mean[i];
+  }
+
+  // Conjugate evolution path: C^-1/2 step_mean = B D^-1 B' step_mean
+  std::vector<double> rotated(n, 0.0);
+  for (std::size_t j = 0; j < n; j++)
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      rotated[j] += eigenvectors_[i * n + j] * step_mean[i];
+    }
+    rotated[j] /= scales_[j];
+  }
+  double path_sigma_norm = 0.0;
+  double sigma_rate = std::sqrt(c_sigma_ * (2.0 - c_sigma_) * mu_eff_);
+  for (std::size_t i = 0; i < n; i++)
+  {
+    double whitened = 0.0;
+    for (std::size_t j = 0; j < n; j++)
+    {
+      whitened += eigenvectors_[i * n + j] * rotated[j];
+    }
+    path_sigma_[i] = (1.0 - c_sigma_) * path_sigma_[i] + sigma_rate * whitened;
+    path_sigma_norm += path_sigma_[i] * path_sigma_[i];
+  }
+  path_sigma_norm = std::sqrt(path_sigma_norm);
+
+  // Evolution path, stalled while the step size grows fast
+  generation_++;
+  double correction = std::sqrt(1.0 - std::pow(1.0 - c_sigma_, 2.0 * generation_));
+  bool h_sigma = path_sigma_norm / correction / chi_n_ < 1.4 + 2.0 / (n + 1.0);
+  double c_rate = std::sqrt(c_c_ * (2.0 - c_c_) * mu_eff_);
+  for (std::size_t i = 0; i < n; i++)
+  {
+    path_c_[i] = (1.0 - c_c_) * path_c_[i] + (h_sigma ? c_rate * step_mean[i] : 0.0);
+  }
+
+  // Rank one and rank mu covariance update
+  double keep = 1.0 - c_1_ - c_mu_ + (h_sigma ? 0.0 : c_1_ * c_c_ * (2.0 - c_c_));
+  for (std::size_t i = 0; i < n; i++)
+  {
+    for (std::size_t j = 0; j <= i; j++)
+    {
+      double rank_mu = 0.0;
+      for (std::size_t k = 0; k < parents_; k++)
+      {
+        rank_mu += weights_[k] * steps_[order[k]][i] * steps_[order[k]][j];
+      }
+      double value = keep * covariance_[i * n + j] + c_1_ * path_c_[i] * path_c_[j] + c_mu_ * rank_mu;
+      covariance_[i * n + j] = covariance_[j * n + i] = value;
+    }
+  }
+
+  sigma_ *= std::exp((c_sigma_ / damping_) * (path_sigma_norm / chi_n_ - 1.0));
+
+  // The decomposition is O(n^3); the covariance changes slowly enough to
+  // refresh it every few generations.
+  if (generation_ - eigen_generation_ > population_ / (c_1_ + c_mu_) / n / 10.0)
+  {
+    decompose();
+  }
+}
+
+double CmaEs::spread() const
+{
+  return sigma_ * *std::max_element(scales_.begin(), scales_.end());
+}
+
+void CmaEs::decompose()
+{
+  std::size_t n = mean_.size();
+  eigen_generation_ = generation_;
+
+  std::vector<double> matrix = covariance_;
+  std::vector<double> values;
+  jacobiEigen(matrix, n, values, eigenvectors_);
+  for (std::size_t i = 0; i < n; i++)
+  {
+    scales_[i] = std::sqrt(std::max(values[i], 1e-20));
+  }
+}
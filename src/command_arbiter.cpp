@@ -0,0 +1,142 @@
+#include "pheeno_ros/command_arbiter.h"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+const int CommandArbiter::MAX_SLOTS;
+const int CommandArbiter::NO_COMMAND;
+const int CommandArbiter::SAFETY_STOP;
+
+/*
+ * Contructor for the CommandArbiter Class. Starts with no slots and the
+ * safety stop released.
+ */
+CommandArbiter::CommandArbiter()
+  : slot_count_(0), safety_stop_(false)
+{
+  for (int i = 0; i < MAX_SLOTS; i++)
+  {
+    order_[i] = i;
+  }
+}
+
+/*
+ * Registers a slot and returns its index, or -1 if all slots are taken.
+ * Slots are kept sorted by priority so arbitrate() stops at the first
+ * fresh command.
+ */
+int CommandArbiter::addSlot(const std::string& name, int priority, double timeout)
+{
+  if (slot_count_ >= MAX_SLOTS)
+  {
+    return -1;
+  }
+
+  int slot = slot_count_++;
+  slots_[slot].name = name;
+  slots_[slot].priority = priority;
+  slots_[slot].timeout = timeout;
+
+  // Insertion into the priority order. Equal priorities keep registration order.
+  int position = slot;
+  while (position > 0 && slots_[order_[position - 1]].priority < priority)
+  {
+    order_[position] = order_[position - 1];
+    position--;
+  }
+  order_[position] = slot;
+
+  return slot;
+}
+
+/*
+ * Returns the index of the slot with the given name, or -1.
+ */
+int CommandArbiter::findSlot(const std::string& name) const
+{
+  for (int i = 0; i < slot_count_; i++)
+  {
+    if (slots_[i].name == name)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Writes a command into a slot. The sequence counter is odd while the write
+ * is in progress so readers retry instead of seeing a torn command.
+ */
+void CommandArbiter::submit(int slot, const VelocityCommand& command, double now)
+{
+  if (slot < 0 || slot >= slot_count_)
+  {
+    return;
+  }
+
+  Slot& target = slots_[slot];
+  uint32_t sequence = target.sequence.load(std::memory_order_relaxed);
+  target.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  target.linear.store(command.linear, std::memory_order_relaxed);
+  target.angular.store(command.angular, std::memory_order_relaxed);
+  target.stamp.store(now, std::memory_order_relaxed);
+
+  target.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/*
+ * Reads a consistent snapshot of a slot. Returns false if the slot has
+ * never been written.
+ */
+bool CommandArbiter::read(int slot, VelocityCommand& command, double& stamp) const
+{
+  const Slot& source = slots_[slot];
+  uint32_t before;
+  uint32_t after;
+
+  do
+  {
+    before = source.sequence.load(std::memory_order_acquire);
+    command.linear = source.linear.load(std::memory_order_relaxed);
+    command.angular = source.angular.load(std::memory_order_relaxed);
+    stamp = source.stamp.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = source.sequence.load(std::memory_order_relaxed);
+  }
+  while ((before & 1) || before != after);
+
+  return stamp >= 0.0;
+}
+
+/*
+ * Picks the command for this control period: zero while the safety stop
+ * is engaged, otherwise the highest priority slot whose command has not
+ * timed out. Returns the chosen slot, SAFETY_STOP, or NO_COMMAND (in which
+ * case the command is zero).
+ */
+int CommandArbiter::arbitrate(double now, VelocityCommand& command) const
+{
+  command = VelocityCommand();
+  if (safetyStopEngaged())
+  {
+    return SAFETY_STOP;
+  }
+
+  for (int i = 0; i < slot_count_; i++)
+  {
+    int slot = order_[i];
+    VelocityCommand candidate;
+    double stamp;
+
+    if (read(slot, candidate, stamp) && now - stamp <= slots_[slot].timeout)
+    {
+      command = candidate;
+      return slot;
+    }
+  }
+
+  return NO_COMMAND;
+}
@@ -0,0 +1,183 @@
+#include "pheeno_ros/flock_rules.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+/*
+ * Weights for one of the swarm behaviors. The defaults are the flocking
+ * ones: strong alignment and weak cohesion, since a strong pull toward
+ * the centroid breaks the flock into jostling clusters.
+ */
+FlockRules::Config FlockRules::preset(Pheeno::FLOCK_MODE mode)
+{
+  Config config;
+  switch (mode)
+  {
+    case Pheeno::FLOCK_AGGREGATE:
+      config.separation = 0.5;
+      config.alignment = 0.0;
+      config.cohesion = 0.2;
+      config.separation_distance = 0.18;
+      config.inertia = 0.0;  // Settle instead of orbiting the cluster
+      config.min_speed = 0.0;
+      break;
+
+    case Pheeno::FLOCK_DISPERSE:
+      config.alignment = 0.0;
+      config.cohesion = 0.0;
+      config.separation_distance = config.neighbor_distance;
+      config.inertia = 0.0;
+      config.min_speed = 0.0;
+      break;
+
+    case Pheeno::FLOCK_FLOCK:
+      break;
+  }
+  return config;
+}
+
+/*
+ * Mode from its name ("aggregate", "disperse" or "flock").
+ */
+bool FlockRules::parseMode(const std::string& name, Pheeno::FLOCK_MODE& mode)
+{
+  if (name == "aggregate")
+  {
+    mode = Pheeno::FLOCK_AGGREGATE;
+  }
+  else if (name == "disperse")
+  {
+    mode = Pheeno::FLOCK_DISPERSE;
+  }
+  else if (name == "flock")
+  {
+    mode = Pheeno::FLOCK_FLOCK;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Contructor for the FlockRules Class.
+ */
+FlockRules::FlockRules(const Config& config)
+  : config_(config),
+    neighbor_range_squared_(config.neighbor_distance * config.neighbor_distance),
+    separation_range_squared_(config.separation_distance * config.separation_distance)
+{
+  FlockMember nobody = {0.0, 0.0, 0.0, 0.0};
+  begin(nobody);
+}
+
+/*
+ * Starts accumulating the neighbors of self.
+ */
+void FlockRules::begin(const FlockMember& self)
+{
+  self_ = self;
+  count_ = 0;
+  sum_x_ = 0.0;
+  sum_y_ = 0.0;
+  sum_vx_ = 0.0;
+  sum_vy_ = 0.0;
+  push_x_ = 0.0;
+  push_y_ = 0.0;
+}
+
+/*
+ * Desired velocity from the neighbors added since begin(). Without
+ * neighbors the agent keeps the inertia share of its velocity.
+ */
+void FlockRules::velocity(double& vx, double& vy) const
+{
+  vx = config_.inertia * self_.vx;
+  vy = config_.inertia * self_.vy;
+  if (count_ > 0)
+  {
+    double inverse_count = 1.0 / count_;
+    vx += config_.separation * push_x_ * config_.max_speed * config_.separation_distance +
+          config_.alignment * (sum_vx_ * inverse_count - self_.vx) +
+          config_.cohesion * sum_x_ * inverse_count;
+    vy += config_.separation * push_y_ * config_.max_speed * config_.separation_distance +
+          config_.alignment * (sum_vy_ * inverse_count - self_.vy) +
+          config_.cohesion * sum_y_ * inverse_count;
+  }
+
+  double speed = std::sqrt(vx * vx + vy * vy);
+  if (speed > config_.max_speed)
+  {
+    vx *= config_.max_speed / speed;
+    vy *= config_.max_speed / speed;
+  }
+  else if (speed < config_.min_speed && speed > 1e-9)
+  {
+    vx *= config_.min_speed / speed;
+    vy *= config_.min_speed / speed;
+  }
+}
+
+/*
+ * Desired velocity of self among count neighbors (self excluded).
+ */
+void FlockRules::steer(const FlockMember& self, const FlockMember* neighbors, std::size_t count,
+                       double& vx, double& vy)
+{
+  begin(self);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    double dx = neighbors[i].x - self.x;
+    double dy = neighbors[i].y - self.y;
+    add(neighbors[i], dx, dy, dx * dx + dy * dy);
+  }
+  velocity(vx, vy);
+}
+
+/*
+ * Contructor for the FlockBatch Class.
+ */
+FlockBatch::FlockBatch(const FlockRules::Config& config, unsigned int threads)
+  : config_(config), hash_(config.neighbor_distance), team_(threads)
+{
+  rules_.assign(team_.threadCount(), FlockRules(config));
+}
+
+/*
+ * Desired velocities (vx[i], vy[i]) of every member, all from the same
+ * snapshot.
+ */
+void FlockBatch::step(const std::vector<FlockMember>& members, std::vector<double>& vx, std::vector<double>& vy)
+{
+  std::size_t count = members.size();
+  vx.resize(count);
+  vy.resize(count);
+  x_.resize(count);
+  y_.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    x_[i] = members[i].x;
+    y_[i] = members[i].y;
+  }
+  hash_.build(count ? &x_[0] : NULL, count ? &y_[0] : NULL, count);
+
+  team_.run(count, BLOCK_SIZE,
+            [&](unsigned int thread, std::size_t begin, std::size_t end)
+            {
+              FlockRules& rules = rules_[thread];
+              for (std::size_t i = begin; i < end; i++)
+              {
+                rules.begin(members[i]);
+                hash_.forEachNear(members[i].x, members[i].y, config_.neighbor_distance,
+                                  [&](uint32_t index, double dx, double dy, double distance_squared)
+                                  {
+                                    if (index != i)
+                                    {
+                                      rules.add(members[index], dx, dy, distance_squared);
+                                    }
+                                  });
+                rules.velocity(vx[i], vy[i]);
+              }
+            });
+}
@@ -0,0 +1,81 @@
+#include "ros/ros.h"
+#include "geometry_msgs/Twist.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/flock_rules.h"
+#include "pheeno_ros/pheeno_robot.h"
+
+int main(int argc, char **argv)
+{
+  // Initial Variables
+  std::string pheeno_name;
+
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+
+  // Parse input arguments for Pheeno name.
+  if (cml_parser["-n"])
+  {
+    std::string pheeno_number = cml_parser("-n");
+    pheeno_name = "/pheeno_" + pheeno_number;
+  }
+  else
+  {
+    ROS_ERROR("Need to provide Pheeno number!");
+  }
+
+  // Swarm behavior (-m aggregate, disperse or flock). Without -m the
+  // ~flocking/ parameters decide.
+  Pheeno::FLOCK_MODE mode = Pheeno::FLOCK_FLOCK;
+  bool mode_given = cml_parser["-m"];
+  if (mode_given && !FlockRules::parseMode(cml_parser("-m"), mode))
+  {
+    ROS_ERROR("Unknown mode %s! Use aggregate, disperse or flock.", cml_parser("-m").c_str());
+    return 1;
+  }
+
+  // Initializing ROS node
+  ros::init(argc, argv, "flocking_node");
+
+  // Create PheenoRobot object (IR for walls, odometry for the fleet topic)
+  PheenoRobot pheeno(pheeno_name, Pheeno::IR_SENSORS | Pheeno::ODOM | Pheeno::SENSOR_SWEEP);
+  if (mode_given)
+  {
+    pheeno.setFlockRules(FlockRules::preset(mode));
+  }
+  // Needs the robots in one frame: ~fleet/shared_odom_frame (Gazebo,
+  // sim_bridge) or ~localization/enabled, or the node shuts down.
+  pheeno.setFlocking(true);
+
+  // Variables before loop
+  double range_to_avoid = 15.0;
+  double saved_time = ros::Time::now().toSec();
+  double turn_direction = pheeno.randomTurn(0.07);
+  double linear = 0.0;
+  double angular = 0.0;
+  geometry_msgs::Twist cmd_vel_msg;
+
+  while (ros::ok())
+  {
+    if (pheeno.irSensorTriggered(range_to_avoid)) {
+      // Walls (and robots) closer than the IR range come first.
+      pheeno.avoidObstaclesLinear(linear, angular, turn_direction, 0.08, range_to_avoid);
+
+    } else if (!pheeno.flock(linear, angular)) {
+      // Alone: wander, changing direction every few seconds, until
+      // neighbors are heard on the fleet topic.
+      if (ros::Time::now().toSec() - saved_time > 5.0) {
+        saved_time = ros::Time::now().toSec();
+        turn_direction = pheeno.randomTurn(0.07);
+      }
+      pheeno.avoidObstaclesLinear(linear, angular, turn_direction, 0.08, range_to_avoid);
+    }
+
+    cmd_vel_msg.linear.x = linear;
+    cmd_vel_msg.angular.z = angular;
+
+    // Publish, Spin, and Sleep (at the adaptive control rate)
+    pheeno.publish(cmd_vel_msg);
+    ros::spinOnce();
+    pheeno.sleep();
+  }
+}
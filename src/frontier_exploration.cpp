@@ -0,0 +1,180 @@
+#include "ros/ros.h"
+#include "geometry_msgs/Twist.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/frontier_tracker.h"
+#include "pheeno_ros/grid_planner.h"
+#include "pheeno_ros/pheeno_robot.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  struct Target
+  {
+    double x;
+    double y;
+  };
+
+  /*
+   * Picks the frontier cluster with the most frontier (m) per meter of
+   * travel. Clusters whose target is near an unreachable one are skipped.
+   */
+  bool selectTarget(const std::vector<FrontierTracker::Cluster>& clusters,
+                    const std::vector<Target>& unreachable, double x, double y,
+                    double resolution, Target& target)
+  {
+    double best_utility = -1.0;
+    for (std::size_t i = 0; i < clusters.size(); i++)
+    {
+      const FrontierTracker::Cluster& cluster = clusters[i];
+      bool skip = false;
+      for (std::size_t j = 0; j < unreachable.size() && !skip; j++)
+      {
+        skip = std::hypot(cluster.target_x - unreachable[j].x, cluster.target_y - unreachable[j].y) < 0.15;
+      }
+      if (skip)
+      {
+        continue;
+      }
+
+      double gain = cluster.size * resolution;
+      double travel = std::hypot(cluster.target_x - x, cluster.target_y - y);
+      double utility = gain / (travel + 0.1);
+      if (utility > best_utility)
+      {
+        best_utility = utility;
+        target.x = cluster.target_x;
+        target.y = cluster.target_y;
+      }
+    }
+    return best_utility >= 0.0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Initial Variables
+  std::string pheeno_name;
+
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+
+  // Parse input arguments for Pheeno name.
+  if (cml_parser["-n"])
+  {
+    std::string pheeno_number = cml_parser("-n");
+    pheeno_name = "/pheeno_" + pheeno_number;
+  }
+  else
+  {
+    ROS_ERROR("Need to provide Pheeno number!");
+  }
+
+  // Initializing ROS node
+  ros::init(argc, argv, "frontier_exploration_node");
+
+  // Create PheenoRobot object (mapping subscribes to the IR sensors and odometry)
+  PheenoRobot pheeno(pheeno_name, Pheeno::IR_SENSORS | Pheeno::ODOM | Pheeno::SENSOR_SWEEP);
+  pheeno.setMapping(true);
+  pheeno.setMapChangeTracking(true);
+
+  GridPlanner planner;
+  planner.reset(pheeno.map());
+  FrontierTracker frontiers;
+  frontiers.reset(pheeno.map());
+
+  // Variables before loop
+  double resolution = pheeno.map().config().resolution;
+  std::size_t min_cluster_size = 5;
+  double reselect_period = 5.0;
+  double target_tolerance = 0.08;
+  double linear_velocity = 0.08;
+  double angular_gain = 2.0;
+  double angular_limit = 1.2;
+  std::size_t lookahead = 3;
+  bool has_target = false;
+  double finish_timeout = 30.0;
+  bool seen_frontier = false;
+  bool finished = false;
+  double selected_time = 0.0;
+  double no_target_since = ros::Time::now().toSec();
+  double linear = 0.0;
+  double angular = 0.0;
+  Target target = {0.0, 0.0};
+  std::vector<Target> unreachable;
+  std::vector<uint32_t> map_changes;
+  std::vector<FrontierTracker::Cluster> clusters;
+  std::vector<GridPlanner::Waypoint> waypoints;
+  geometry_msgs::Twist cmd_vel_msg;
+
+  while (ros::ok())
+  {
+    // Both the planner and the frontier follow the map's class changes.
+    pheeno.takeMapChanges(map_changes);
+    planner.mapChanged(pheeno.map(), map_changes);
+    frontiers.update(pheeno.map(), map_changes);
+
+    double x = pheeno.odom_pose_position_[0];
+    double y = pheeno.odom_pose_position_[1];
+    double now = ros::Time::now().toSec();
+
+    // Choose a new frontier when there is none, it was reached or explored,
+    // or periodically in case a better one appeared.
+    if (pheeno.odomReceived() && !finished &&
+        (!has_target || now - selected_time > reselect_period ||
+         std::hypot(target.x - x, target.y - y) <= target_tolerance ||
+         !frontiers.isFrontierAt(target.x, target.y))) {
+      frontiers.cluster(min_cluster_size, clusters);
+      has_target = selectTarget(clusters, unreachable, x, y, resolution, target) &&
+                   planner.setGoal(target.x, target.y);
+      selected_time = now;
+
+      if (has_target || !seen_frontier) {
+        no_target_since = now;
+      }
+    }
+
+    // Once a frontier has been seen, going without a reachable one for a
+    // while means everything reachable is explored.
+    seen_frontier = seen_frontier || frontiers.frontierCount() > 0;
+    if (!finished && !has_target && seen_frontier && now - no_target_since > finish_timeout) {
+      ROS_INFO("Exploration complete.");
+      finished = true;
+    }
+
+    cmd_vel_msg.linear.x = 0.0;
+    cmd_vel_msg.angular.z = 0.0;
+
+    if (!pheeno.odomReceived() || finished) {
+      // Nothing to do without a pose, or after exploring everything.
+
+    } else if (pheeno.irSensorTriggered(10.0) || !has_target) {
+      // Too close to trust the map, or no frontier yet: wander reactively
+      // to seed the map.
+      pheeno.avoidObstaclesLinear(linear, angular);
+      cmd_vel_msg.linear.x = linear;
+      cmd_vel_msg.angular.z = angular;
+
+    } else if (!planner.setStart(x, y) || !planner.plan() || !planner.path(waypoints, lookahead)) {
+      ROS_WARN("Frontier at (%.2f, %.2f) is unreachable.", target.x, target.y);
+      unreachable.push_back(target);
+      has_target = false;
+
+    } else {
+      // Head for a waypoint a few cells along the path.
+      const GridPlanner::Waypoint& waypoint = waypoints.empty()
+        ? GridPlanner::Waypoint{target.x, target.y} : waypoints.back();
+      double heading_error = std::atan2(waypoint.y - y, waypoint.x - x) - pheeno.odomYaw();
+      heading_error = std::atan2(std::sin(heading_error), std::cos(heading_error));
+
+      cmd_vel_msg.angular.z = std::max(-angular_limit, std::min(angular_limit, angular_gain * heading_error));
+      cmd_vel_msg.linear.x = linear_velocity * std::max(0.0, std::cos(heading_error));
+    }
+
+    // Publish, Spin, and Sleep (at the adaptive control rate)
+    pheeno.publish(cmd_vel_msg);
+    ros::spinOnce();
+    pheeno.sleep();
+  }
+}
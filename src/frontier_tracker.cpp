@@ -0,0 +1,262 @@
+#include "pheeno_ros/frontier_tracker.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Contructor for the FrontierTracker Class. The tracker is empty until
+ * reset() gives it a map.
+ */
+FrontierTracker::FrontierTracker()
+  : width_(0), height_(0), resolution_(1.0), origin_x_(0.0), origin_y_(0.0), count_(0)
+{
+}
+
+/*
+ * Adopts the geometry of map and finds its frontier with one full scan.
+ */
+void FrontierTracker::reset(const TiledOccupancyGrid& map)
+{
+  const TiledOccupancyGrid::Config& config = map.config();
+  width_ = map.width();
+  height_ = map.height();
+  resolution_ = config.resolution;
+  origin_x_ = config.origin_x;
+  origin_y_ = config.origin_y;
+
+  frontier_.assign(static_cast<std::size_t>(width_) * height_, 0);
+  cells_.clear();
+  count_ = 0;
+  for (int y = 0; y < height_; y++)
+  {
+    for (int x = 0; x < width_; x++)
+    {
+      evaluate(map, x, y);
+    }
+  }
+}
+
+/*
+ * Applies a class change journal from map (see
+ * TiledOccupancyGrid::takeClassChanges).
+ */
+void FrontierTracker::update(const TiledOccupancyGrid& map, const std::vector<uint32_t>& cells)
+{
+  if (map.width() != width_ || map.height() != height_)
+  {
+    reset(map);
+    return;
+  }
+
+  for (std::size_t i = 0; i < cells.size(); i++)
+  {
+    int x = static_cast<int>(cells[i] % width_);
+    int y = static_cast<int>(cells[i] / width_);
+    if (y >= height_)
+    {
+      continue;
+    }
+
+    evaluate(map, x, y);
+    if (x > 0)
+    {
+      evaluate(map, x - 1, y);
+    }
+    if (x + 1 < width_)
+    {
+      evaluate(map, x + 1, y);
+    }
+    if (y > 0)
+    {
+      evaluate(map, x, y - 1);
+    }
+    if (y + 1 < height_)
+    {
+      evaluate(map, x, y + 1);
+    }
+  }
+
+  if (cells_.size() > 2 * count_ + 1024)
+  {
+    compact();
+  }
+}
+
+/*
+ * Whether the cell containing a world position is a frontier.
+ */
+bool FrontierTracker::isFrontierAt(double wx, double wy) const
+{
+  double fx = std::floor((wx - origin_x_) / resolution_);
+  double fy = std::floor((wy - origin_y_) / resolution_);
+  if (fx < 0 || fy < 0 || fx >= width_ || fy >= height_)
+  {
+    return false;
+  }
+  return isFrontier(static_cast<int>(fx), static_cast<int>(fy));
+}
+
+/*
+ * Groups 8-connected frontier cells. Clusters smaller than min_size cells
+ * are left out.
+ */
+void FrontierTracker::cluster(std::size_t min_size, std::vector<Cluster>& clusters)
+{
+  clusters.clear();
+  compact();
+  std::sort(cells_.begin(), cells_.end());
+
+  std::size_t count = cells_.size();
+  parent_.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    parent_[i] = static_cast<uint32_t>(i);
+  }
+
+  // Union with the neighbors ahead in row-major order; the ones behind
+  // already did the same with this cell.
+  const int offsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+  for (std::size_t i = 0; i < count; i++)
+  {
+    int x = static_cast<int>(cells_[i] % width_);
+    int y = static_cast<int>(cells_[i] / width_);
+    for (int k = 0; k < 4; k++)
+    {
+      int nx = x + offsets[k][0];
+      int ny = y + offsets[k][1];
+      if (nx < 0 || nx >= width_ || ny >= height_)
+      {
+        continue;
+      }
+
+      uint32_t neighbor = static_cast<uint32_t>(ny) * width_ + nx;
+      std::vector<uint32_t>::const_iterator it = std::lower_bound(cells_.begin(), cells_.end(), neighbor);
+      if (it != cells_.end() && *it == neighbor)
+      {
+        uint32_t a = find(static_cast<uint32_t>(i));
+        uint32_t b = find(static_cast<uint32_t>(it - cells_.begin()));
+        if (a != b)
+        {
+          parent_[std::max(a, b)] = std::min(a, b);
+        }
+      }
+    }
+  }
+
+  // Sums per cluster, numbered in order of their roots
+  sums_.clear();
+  cluster_of_.assign(count, -1);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    uint32_t root = find(static_cast<uint32_t>(i));
+    if (cluster_of_[root] < 0)
+    {
+      Cluster fresh = {0, 0.0, 0.0, 0.0, 0.0};
+      cluster_of_[root] = static_cast<int32_t>(sums_.size());
+      sums_.push_back(fresh);
+    }
+
+    Cluster& sum = sums_[cluster_of_[root]];
+    sum.size++;
+    sum.centroid_x += cells_[i] % width_;
+    sum.centroid_y += cells_[i] / width_;
+  }
+
+  for (std::size_t c = 0; c < sums_.size(); c++)
+  {
+    sums_[c].centroid_x /= sums_[c].size;
+    sums_[c].centroid_y /= sums_[c].size;
+  }
+
+  best_cell_.assign(sums_.size(), 0);
+  best_distance_.assign(sums_.size(), -1.0);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    std::size_t c = cluster_of_[find(static_cast<uint32_t>(i))];
+    double dx = cells_[i] % width_ - sums_[c].centroid_x;
+    double dy = cells_[i] / width_ - sums_[c].centroid_y;
+    double distance = dx * dx + dy * dy;
+    if (best_distance_[c] < 0.0 || distance < best_distance_[c])
+    {
+      best_distance_[c] = distance;
+      best_cell_[c] = cells_[i];
+    }
+  }
+
+  for (std::size_t c = 0; c < sums_.size(); c++)
+  {
+    if (sums_[c].size < min_size)
+    {
+      continue;
+    }
+
+    Cluster cluster = sums_[c];
+    cluster.centroid_x = origin_x_ + (cluster.centroid_x + 0.5) * resolution_;
+    cluster.centroid_y = origin_y_ + (cluster.centroid_y + 0.5) * resolution_;
+    cluster.target_x = origin_x_ + (best_cell_[c] % width_ + 0.5) * resolution_;
+    cluster.target_y = origin_y_ + (best_cell_[c] / width_ + 0.5) * resolution_;
+    clusters.push_back(cluster);
+  }
+}
+
+/*
+ * Re-examines one cell and lists it if it just became a frontier.
+ */
+void FrontierTracker::evaluate(const TiledOccupancyGrid& map, int x, int y)
+{
+  bool frontier = false;
+  if (map.cellClass(x, y) == Pheeno::CELL_FREE)
+  {
+    frontier = (x > 0 && map.cellClass(x - 1, y) == Pheeno::CELL_UNKNOWN) ||
+               (x + 1 < width_ && map.cellClass(x + 1, y) == Pheeno::CELL_UNKNOWN) ||
+               (y > 0 && map.cellClass(x, y - 1) == Pheeno::CELL_UNKNOWN) ||
+               (y + 1 < height_ && map.cellClass(x, y + 1) == Pheeno::CELL_UNKNOWN);
+  }
+
+  uint32_t cell = static_cast<uint32_t>(y) * width_ + x;
+  uint8_t& flag = frontier_[cell];
+  if (frontier && !flag)
+  {
+    flag = 1;
+    cells_.push_back(cell);
+    count_++;
+  }
+  else if (!frontier && flag)
+  {
+    flag = 0;
+    count_--;
+  }
+}
+
+/*
+ * Drops stale and duplicate entries from the frontier list.
+ */
+void FrontierTracker::compact()
+{
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < cells_.size(); i++)
+  {
+    uint8_t& flag = frontier_[cells_[i]];
+    if (flag == 1)
+    {
+      flag = 2;  // Seen; later duplicates are dropped
+      cells_[kept++] = cells_[i];
+    }
+  }
+  cells_.resize(kept);
+  for (std::size_t i = 0; i < kept; i++)
+  {
+    frontier_[cells_[i]] = 1;
+  }
+}
+
+uint32_t FrontierTracker::find(uint32_t i)
+{
+  while (parent_[i] != i)
+  {
+    parent_[i] = parent_[parent_[i]];
+    i = parent_[i];
+  }
+  return i;
+}
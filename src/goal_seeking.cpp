@@ -0,0 +1,168 @@
+#include "ros/ros.h"
+#include "geometry_msgs/PoseStamped.h"
+#include "geometry_msgs/Twist.h"
+#include "nav_msgs/Path.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/grid_planner.h"
+#include "pheeno_ros/pheeno_robot.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Holds the latest goal from the <pheeno>/goal topic.
+ */
+struct GoalListener
+{
+  GoalListener() : received(false), x(0.0), y(0.0) {}
+
+  void callback(const geometry_msgs::PoseStamped::ConstPtr& msg)
+  {
+    x = msg->pose.position.x;
+    y = msg->pose.position.y;
+    received = true;
+  }
+
+  bool received;
+  double x;
+  double y;
+};
+
+int main(int argc, char **argv)
+{
+  // Initial Variables
+  std::string pheeno_name;
+
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+
+  // Parse input arguments for Pheeno name.
+  if (cml_parser["-n"])
+  {
+    std::string pheeno_number = cml_parser("-n");
+    pheeno_name = "/pheeno_" + pheeno_number;
+  }
+  else
+  {
+    ROS_ERROR("Need to provide Pheeno number!");
+  }
+
+  // Goal in the map (odometry) frame, meters. Also settable on <pheeno>/goal.
+  GoalListener goal;
+  if (cml_parser["-x"] && cml_parser["-y"])
+  {
+    goal.x = std::atof(cml_parser("-x").c_str());
+    goal.y = std::atof(cml_parser("-y").c_str());
+    goal.received = true;
+  }
+
+  // Initializing ROS node
+  ros::init(argc, argv, "goal_seeking_node");
+  ros::NodeHandle nh;
+
+  // Create PheenoRobot object (mapping subscribes to the IR sensors and odometry)
+  PheenoRobot pheeno(pheeno_name, Pheeno::IR_SENSORS | Pheeno::ODOM | Pheeno::SENSOR_SWEEP);
+  pheeno.setMapping(true);
+  pheeno.setMapChangeTracking(true);
+
+  ros::Subscriber sub_goal = nh.subscribe(pheeno_name + "/goal", 1, &GoalListener::callback, &goal);
+  ros::Publisher pub_plan = nh.advertise<nav_msgs::Path>(pheeno_name + "/plan", 1);
+
+  GridPlanner planner;
+  planner.reset(pheeno.map());
+
+  // Variables before loop
+  double goal_tolerance = 0.08;
+  double linear_velocity = 0.08;
+  double angular_gain = 2.0;
+  double angular_limit = 1.2;
+  std::size_t lookahead = 3;
+  double goal_x = 0.0;
+  double goal_y = 0.0;
+  bool has_plan = false;
+  double linear = 0.0;
+  double angular = 0.0;
+  std::vector<uint32_t> map_changes;
+  std::vector<GridPlanner::Waypoint> waypoints;
+  geometry_msgs::Twist cmd_vel_msg;
+  nav_msgs::Path plan_msg;
+
+  while (ros::ok())
+  {
+    // Repair the plan with the map cells that changed since the last cycle.
+    pheeno.takeMapChanges(map_changes);
+    planner.mapChanged(pheeno.map(), map_changes);
+
+    double x = pheeno.odom_pose_position_[0];
+    double y = pheeno.odom_pose_position_[1];
+
+    if (goal.received && (goal.x != goal_x || goal.y != goal_y || !planner.hasGoal())) {
+      goal_x = goal.x;
+      goal_y = goal.y;
+      if (!planner.setGoal(goal_x, goal_y)) {
+        ROS_WARN("Goal (%.2f, %.2f) is outside the map.", goal_x, goal_y);
+        goal.received = false;
+      }
+    }
+
+    cmd_vel_msg.linear.x = 0.0;
+    cmd_vel_msg.angular.z = 0.0;
+
+    if (!pheeno.odomReceived() || !planner.hasGoal() || !goal.received) {
+      // Nothing to do until there is a pose and a goal.
+
+    } else if (std::hypot(goal_x - x, goal_y - y) <= goal_tolerance) {
+      ROS_INFO("Reached goal (%.2f, %.2f).", goal_x, goal_y);
+      goal.received = false;
+
+    } else if (pheeno.irSensorTriggered(10.0)) {
+      // Too close for the map to be trusted; fall back on reactive avoidance.
+      pheeno.avoidObstaclesLinear(linear, angular);
+      cmd_vel_msg.linear.x = linear;
+      cmd_vel_msg.angular.z = angular;
+
+    } else {
+      bool start_ok = planner.setStart(x, y);
+      bool planned = start_ok && planner.plan() && planner.path(waypoints, lookahead);
+      if (planned != has_plan) {
+        if (planned) {
+          ROS_INFO("Path to (%.2f, %.2f) found.", goal_x, goal_y);
+        } else {
+          ROS_WARN("No path to (%.2f, %.2f).", goal_x, goal_y);
+        }
+        has_plan = planned;
+      }
+
+      if (planned) {
+        // Head for a waypoint a few cells along the path.
+        const GridPlanner::Waypoint& target = waypoints.empty()
+          ? GridPlanner::Waypoint{goal_x, goal_y} : waypoints.back();
+        double heading_error = std::atan2(target.y - y, target.x - x) - pheeno.odomYaw();
+        heading_error = std::atan2(std::sin(heading_error), std::cos(heading_error));
+
+        cmd_vel_msg.angular.z = std::max(-angular_limit, std::min(angular_limit, angular_gain * heading_error));
+        cmd_vel_msg.linear.x = linear_velocity * std::max(0.0, std::cos(heading_error));
+
+        // Full path for RViz
+        planner.path(waypoints);
+        plan_msg.header.stamp = ros::Time::now();
+        plan_msg.header.frame_id = "odom";
+        plan_msg.poses.resize(waypoints.size());
+        for (std::size_t i = 0; i < waypoints.size(); i++)
+        {
+          plan_msg.poses[i].header = plan_msg.header;
+          plan_msg.poses[i].pose.position.x = waypoints[i].x;
+          plan_msg.poses[i].pose.position.y = waypoints[i].y;
+          plan_msg.poses[i].pose.orientation.w = 1.0;
+        }
+        pub_plan.publish(plan_msg);
+      }
+    }
+
+    // Publish, Spin, and Sleep (at the adaptive control rate)
+    pheeno.publish(cmd_vel_msg);
+    ros::spinOnce();
+    pheeno.sleep();
+  }
+}
@@ -0,0 +1,611 @@
+#include "pheeno_ros/grid_planner.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+  int32_t addCost(int32_t a, int32_t b)
+  {
+    return (a >= Pheeno::PLAN_INFINITY || b >= Pheeno::PLAN_INFINITY) ? Pheeno::PLAN_INFINITY : a + b;
+  }
+
+  bool keyLess(int32_t a1, int32_t a2, int32_t b1, int32_t b2)
+  {
+    return a1 < b1 || (a1 == b1 && a2 < b2);
+  }
+}
+
+/*
+ * Contructor for the GridPlanner Class. The planner is empty until reset()
+ * gives it a map.
+ */
+GridPlanner::GridPlanner(const Config& config)
+  : config_(config), width_(0), height_(0), map_width_(0), map_height_(0),
+    origin_x_(0.0), origin_y_(0.0), cell_size_(1.0), min_bucket_(0), queued_(0),
+    start_(-1), goal_(-1), last_start_(-1), km_(0), expansions_(0)
+{
+  config_.cell_factor = std::max(1, config_.cell_factor);
+  config_.inflation = std::max(0, config_.inflation);
+}
+
+/*
+ * Adopts the geometry and the occupied cells of map. Drops the goal and the
+ * search; this is the one full pass over the map.
+ */
+void GridPlanner::reset(const TiledOccupancyGrid& map)
+{
+  const TiledOccupancyGrid::Config& map_config = map.config();
+  int factor = config_.cell_factor;
+
+  map_width_ = map.width();
+  map_height_ = map.height();
+  width_ = (map_width_ + factor - 1) / factor;
+  height_ = (map_height_ + factor - 1) / factor;
+  origin_x_ = map_config.origin_x;
+  origin_y_ = map_config.origin_y;
+  cell_size_ = map_config.resolution * factor;
+
+  std::size_t cells = static_cast<std::size_t>(width_) * height_;
+  occupied_count_.assign(cells, 0);
+  blocked_.assign(cells, 0);
+  map_occupied_.assign(static_cast<std::size_t>(map_width_) * map_height_, false);
+  node_of_cell_.assign(cells, -1);
+  nodes_.clear();
+
+  for (int y = 0; y < map_height_; y++)
+  {
+    for (int x = 0; x < map_width_; x++)
+    {
+      if (map.cellClass(x, y) == Pheeno::CELL_OCCUPIED)
+      {
+        setMapOccupied(x, y, true);
+      }
+    }
+  }
+  flipped_.clear();
+
+  start_ = goal_ = -1;
+  resetSearch();
+}
+
+/*
+ * Applies a class change journal from map (see
+ * TiledOccupancyGrid::takeClassChanges). Vertices next to planner cells
+ * that became blocked or free are repaired; the next plan() propagates the
+ * change.
+ */
+void GridPlanner::mapChanged(const TiledOccupancyGrid& map, const std::vector<uint32_t>& cells)
+{
+  if (map.width() != map_width_ || map.height() != map_height_)
+  {
+    reset(map);
+    return;
+  }
+
+  flipped_.clear();
+  for (std::size_t i = 0; i < cells.size(); i++)
+  {
+    int x = static_cast<int>(cells[i] % map_width_);
+    int y = static_cast<int>(cells[i] / map_width_);
+    if (y >= map_height_)
+    {
+      continue;
+    }
+
+    bool occupied = map.cellClass(x, y) == Pheeno::CELL_OCCUPIED;
+    if (occupied != map_occupied_[cells[i]])
+    {
+      setMapOccupied(x, y, occupied);
+    }
+  }
+
+  if (goal_ < 0)
+  {
+    return;
+  }
+
+  // Edge costs into a flipped cell and diagonally past it changed, and all
+  // of those edges start at one of its neighbors.
+  int32_t around[8];
+  for (std::size_t i = 0; i < flipped_.size(); i++)
+  {
+    int count = neighbors(flipped_[i], around);
+    for (int j = 0; j < count; j++)
+    {
+      int32_t cell = around[j];
+      if (cell == goal_)
+      {
+        continue;
+      }
+
+      int32_t best = bestSuccessor(cell, NULL);
+      if (best < Pheeno::PLAN_INFINITY || node_of_cell_[cell] >= 0)
+      {
+        nodes_[node(cell)].rhs = best;
+        updateVertex(cell);
+      }
+    }
+  }
+}
+
+/*
+ * Sets the goal. A new goal restarts the search. Returns false outside the
+ * map.
+ */
+bool GridPlanner::setGoal(double wx, double wy)
+{
+  int32_t cell;
+  if (!worldToPlanner(wx, wy, cell))
+  {
+    return false;
+  }
+  if (cell == goal_)
+  {
+    return true;
+  }
+
+  resetSearch();
+  goal_ = cell;
+  int32_t index = node(goal_);
+  nodes_[index].rhs = 0;
+  updateVertex(goal_);
+  return true;
+}
+
+/*
+ * Moves the start to the robot's position. The key offset grows by the
+ * distance moved so queued keys stay valid lower bounds. Returns false
+ * outside the map.
+ */
+bool GridPlanner::setStart(double wx, double wy)
+{
+  int32_t cell;
+  if (!worldToPlanner(wx, wy, cell))
+  {
+    return false;
+  }
+
+  if (last_start_ >= 0 && cell != last_start_)
+  {
+    km_ += heuristic(last_start_, cell);
+  }
+  last_start_ = start_ = cell;
+  return true;
+}
+
+/*
+ * Repairs the search until the start is consistent. Returns true if the
+ * goal is reachable, false if it is not or the expansion limit was hit.
+ */
+bool GridPlanner::plan()
+{
+  expansions_ = 0;
+  if (start_ < 0 || goal_ < 0)
+  {
+    return false;
+  }
+
+  int32_t around[8];
+  int32_t index;
+  while (top(index))
+  {
+    int32_t start_k1, start_k2;
+    calculateKey(start_, start_k1, start_k2);
+    Node& top_node = nodes_[index];
+    if (!keyLess(top_node.k1, top_node.k2, start_k1, start_k2) && rhs(start_) <= g(start_))
+    {
+      break;
+    }
+
+    if (++expansions_ > config_.max_expansions)
+    {
+      return false;
+    }
+
+    int32_t cell = top_node.cell;
+    int32_t new_k1, new_k2;
+    calculateKey(cell, new_k1, new_k2);
+
+    if (keyLess(top_node.k1, top_node.k2, new_k1, new_k2))
+    {
+      // Stale key from before the start moved
+      top_node.k1 = new_k1;
+      top_node.k2 = new_k2;
+      push(index);
+    }
+    else if (top_node.g > top_node.rhs)
+    {
+      // Overconsistent: settle and relax the predecessors
+      top_node.g = top_node.rhs;
+      remove(index);
+      int32_t g_cell = top_node.g;
+      int count = neighbors(cell, around);
+      for (int i = 0; i < count; i++)
+      {
+        int32_t pred = around[i];
+        int32_t candidate = addCost(cost(pred, cell), g_cell);
+        if (pred != goal_ && candidate < rhs(pred))
+        {
+          nodes_[node(pred)].rhs = candidate;
+          updateVertex(pred);
+        }
+      }
+    }
+    else
+    {
+      // Underconsistent: raise and recompute whoever relied on this cell
+      int32_t g_old = top_node.g;
+      top_node.g = Pheeno::PLAN_INFINITY;
+      int count = neighbors(cell, around);
+      for (int i = 0; i < count; i++)
+      {
+        int32_t pred = around[i];
+        if (pred != goal_ && node_of_cell_[pred] >= 0 && rhs(pred) == addCost(cost(pred, cell), g_old))
+        {
+          nodes_[node_of_cell_[pred]].rhs = bestSuccessor(pred, NULL);
+        }
+        updateVertex(pred);
+      }
+      if (cell != goal_)
+      {
+        nodes_[index].rhs = bestSuccessor(cell, NULL);
+      }
+      updateVertex(cell);
+    }
+  }
+
+  return startCost() < Pheeno::PLAN_INFINITY;
+}
+
+/*
+ * Cost to go from the start, or Pheeno::PLAN_INFINITY.
+ */
+int32_t GridPlanner::startCost() const
+{
+  return start_ >= 0 ? rhs(start_) : Pheeno::PLAN_INFINITY;
+}
+
+/*
+ * Follows the cheapest successors from the start to the goal. Fills at
+ * most max_waypoints (0 for all) planner cell centers, starting with the
+ * first cell after the start. Returns false if there is no path.
+ */
+bool GridPlanner::path(std::vector<Waypoint>& waypoints, std::size_t max_waypoints) const
+{
+  waypoints.clear();
+  if (start_ < 0 || goal_ < 0 || startCost() >= Pheeno::PLAN_INFINITY)
+  {
+    return false;
+  }
+
+  int32_t cell = start_;
+  std::size_t steps = static_cast<std::size_t>(width_) * height_;
+  while (cell != goal_ && steps-- > 0)
+  {
+    int32_t next;
+    if (bestSuccessor(cell, &next) >= Pheeno::PLAN_INFINITY)
+    {
+      return false;
+    }
+    cell = next;
+
+    Waypoint waypoint;
+    waypoint.x = origin_x_ + (cell % width_ + 0.5) * cell_size_;
+    waypoint.y = origin_y_ + (cell / width_ + 0.5) * cell_size_;
+    waypoints.push_back(waypoint);
+    if (max_waypoints > 0 && waypoints.size() >= max_waypoints)
+    {
+      return true;
+    }
+  }
+
+  return cell == goal_;
+}
+
+/*
+ * Bytes held by the cell tables, the node pool and the queue.
+ */
+std::size_t GridPlanner::memoryBytes() const
+{
+  std::size_t bytes = occupied_count_.capacity() * sizeof(uint16_t) + blocked_.capacity() +
+                      map_occupied_.capacity() / 8 + node_of_cell_.capacity() * sizeof(int32_t) +
+                      nodes_.capacity() * sizeof(Node) + buckets_.capacity() * sizeof(std::vector<Entry>);
+  for (std::size_t i = 0; i < buckets_.size(); i++)
+  {
+    bytes += buckets_[i].capacity() * sizeof(Entry);
+  }
+  return bytes;
+}
+
+bool GridPlanner::worldToPlanner(double wx, double wy, int32_t& cell) const
+{
+  if (width_ == 0)
+  {
+    return false;
+  }
+
+  double fx = std::floor((wx - origin_x_) / cell_size_);
+  double fy = std::floor((wy - origin_y_) / cell_size_);
+  if (fx < 0 || fy < 0 || fx >= width_ || fy >= height_)
+  {
+    return false;
+  }
+  cell = static_cast<int32_t>(fy) * width_ + static_cast<int32_t>(fx);
+  return true;
+}
+
+/*
+ * Returns the touched cells to the pool and empties the queue. Only the
+ * cells the last search touched are visited.
+ */
+void GridPlanner::resetSearch()
+{
+  for (std::size_t i = 0; i < nodes_.size(); i++)
+  {
+    node_of_cell_[nodes_[i].cell] = -1;
+  }
+  nodes_.clear();
+
+  for (std::size_t i = 0; i < buckets_.size(); i++)
+  {
+    buckets_[i].clear();
+  }
+  min_bucket_ = 0;
+  queued_ = 0;
+  km_ = 0;
+  last_start_ = start_;
+}
+
+/*
+ * Octile distance, consistent with the edge costs.
+ */
+int32_t GridPlanner::heuristic(int32_t a, int32_t b) const
+{
+  int32_t dx = std::abs(a % width_ - b % width_);
+  int32_t dy = std::abs(a / width_ - b / width_);
+  int32_t diagonal = std::min(dx, dy);
+  return Pheeno::PLAN_DIAGONAL_COST * diagonal + Pheeno::PLAN_STRAIGHT_COST * (std::max(dx, dy) - diagonal);
+}
+
+/*
+ * Cost of moving between neighboring cells.
+ */
+int32_t GridPlanner::cost(int32_t from, int32_t to) const
+{
+  if (blocked_[to])
+  {
+    return Pheeno::PLAN_INFINITY;
+  }
+
+  int32_t from_x = from % width_;
+  int32_t from_y = from / width_;
+  int32_t to_x = to % width_;
+  int32_t to_y = to / width_;
+  if (from_x == to_x || from_y == to_y)
+  {
+    return Pheeno::PLAN_STRAIGHT_COST;
+  }
+
+  // No cutting corners
+  if (blocked_[from_y * width_ + to_x] || blocked_[to_y * width_ + from_x])
+  {
+    return Pheeno::PLAN_INFINITY;
+  }
+  return Pheeno::PLAN_DIAGONAL_COST;
+}
+
+/*
+ * Writes the up to eight neighbors of cell to out and returns how many.
+ */
+int GridPlanner::neighbors(int32_t cell, int32_t* out) const
+{
+  int x = cell % width_;
+  int y = cell / width_;
+  int count = 0;
+  for (int dy = -1; dy <= 1; dy++)
+  {
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      int nx = x + dx;
+      int ny = y + dy;
+      if ((dx != 0 || dy != 0) && nx >= 0 && ny >= 0 && nx < width_ && ny < height_)
+      {
+        out[count++] = ny * width_ + nx;
+      }
+    }
+  }
+  return count;
+}
+
+/*
+ * Pool index of cell's node, taking one from the pool on first touch.
+ */
+int32_t GridPlanner::node(int32_t cell)
+{
+  int32_t index = node_of_cell_[cell];
+  if (index < 0)
+  {
+    Node fresh;
+    fresh.g = fresh.rhs = Pheeno::PLAN_INFINITY;
+    fresh.k1 = fresh.k2 = 0;
+    fresh.cell = cell;
+    fresh.stamp = 0;
+    fresh.queued = false;
+    index = static_cast<int32_t>(nodes_.size());
+    nodes_.push_back(fresh);
+    node_of_cell_[cell] = index;
+  }
+  return index;
+}
+
+int32_t GridPlanner::g(int32_t cell) const
+{
+  int32_t index = node_of_cell_[cell];
+  return index >= 0 ? nodes_[index].g : Pheeno::PLAN_INFINITY;
+}
+
+int32_t GridPlanner::rhs(int32_t cell) const
+{
+  int32_t index = node_of_cell_[cell];
+  return index >= 0 ? nodes_[index].rhs : Pheeno::PLAN_INFINITY;
+}
+
+/*
+ * One-step lookahead cost min(cost(cell, s) + g(s)) over the neighbors s,
+ * optionally reporting the minimizing neighbor.
+ */
+int32_t GridPlanner::bestSuccessor(int32_t cell, int32_t* successor) const
+{
+  int32_t around[8];
+  int count = neighbors(cell, around);
+  int32_t best = Pheeno::PLAN_INFINITY;
+  for (int i = 0; i < count; i++)
+  {
+    int32_t candidate = addCost(cost(cell, around[i]), g(around[i]));
+    if (candidate < best)
+    {
+      best = candidate;
+      if (successor)
+      {
+        *successor = around[i];
+      }
+    }
+  }
+  return best;
+}
+
+void GridPlanner::calculateKey(int32_t cell, int32_t& k1, int32_t& k2) const
+{
+  k2 = std::min(g(cell), rhs(cell));
+  k1 = addCost(addCost(k2, heuristic(start_, cell)), km_);
+}
+
+/*
+ * Queues a node under its current key. Any older entry of the node goes
+ * stale and is dropped when a pop reaches it.
+ */
+void GridPlanner::push(int32_t index)
+{
+  Node& entry_node = nodes_[index];
+  if (!entry_node.queued)
+  {
+    entry_node.queued = true;
+    queued_++;
+  }
+  entry_node.stamp++;
+
+  std::size_t bucket = static_cast<std::size_t>(entry_node.k1) >> BUCKET_SHIFT;
+  if (bucket >= buckets_.size())
+  {
+    buckets_.resize(bucket + 1);
+  }
+  Entry entry = {index, entry_node.stamp};
+  buckets_[bucket].push_back(entry);
+  min_bucket_ = std::min(min_bucket_, bucket);
+}
+
+void GridPlanner::remove(int32_t index)
+{
+  if (nodes_[index].queued)
+  {
+    nodes_[index].queued = false;
+    queued_--;
+  }
+}
+
+/*
+ * Finds the queued node with the smallest key. Stale entries met on the way
+ * are dropped. Returns false when the queue is empty.
+ */
+bool GridPlanner::top(int32_t& index)
+{
+  while (queued_ > 0 && min_bucket_ < buckets_.size())
+  {
+    std::vector<Entry>& bucket = buckets_[min_bucket_];
+    int32_t best = -1;
+    std::size_t i = 0;
+    while (i < bucket.size())
+    {
+      const Node& candidate = nodes_[bucket[i].node];
+      if (!candidate.queued || candidate.stamp != bucket[i].stamp)
+      {
+        bucket[i] = bucket.back();
+        bucket.pop_back();
+        continue;
+      }
+      if (best < 0 || keyLess(candidate.k1, candidate.k2, nodes_[best].k1, nodes_[best].k2))
+      {
+        best = bucket[i].node;
+      }
+      i++;
+    }
+
+    if (best >= 0)
+    {
+      index = best;
+      return true;
+    }
+    min_bucket_++;
+  }
+  return false;
+}
+
+/*
+ * Queues the cell if it is inconsistent (g != rhs), dequeues it otherwise.
+ */
+void GridPlanner::updateVertex(int32_t cell)
+{
+  int32_t index = node_of_cell_[cell];
+  if (index < 0)
+  {
+    return;
+  }
+
+  Node& vertex = nodes_[index];
+  if (vertex.g != vertex.rhs)
+  {
+    calculateKey(cell, vertex.k1, vertex.k2);
+    push(index);
+  }
+  else
+  {
+    remove(index);
+  }
+}
+
+/*
+ * Records a map cell's occupancy and updates the counts of the planner
+ * cells whose inflated block contains it.
+ */
+void GridPlanner::setMapOccupied(int x, int y, bool occupied)
+{
+  map_occupied_[static_cast<std::size_t>(y) * map_width_ + x] = occupied;
+
+  int factor = config_.cell_factor;
+  int reach = config_.inflation;
+  int low_x = x - reach - factor + 1;
+  int low_y = y - reach - factor + 1;
+  int first_x = low_x <= 0 ? 0 : (low_x + factor - 1) / factor;
+  int first_y = low_y <= 0 ? 0 : (low_y + factor - 1) / factor;
+  int last_x = std::min(width_ - 1, (x + reach) / factor);
+  int last_y = std::min(height_ - 1, (y + reach) / factor);
+
+  for (int py = first_y; py <= last_y; py++)
+  {
+    for (int px = first_x; px <= last_x; px++)
+    {
+      int32_t cell = py * width_ + px;
+      uint16_t& count = occupied_count_[cell];
+      count = occupied ? count + 1 : count - 1;
+      uint8_t now_blocked = count > 0 ? 1 : 0;
+      if (now_blocked != blocked_[cell])
+      {
+        blocked_[cell] = now_blocked;
+        flipped_.push_back(cell);
+      }
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#include "pheeno_ros/ir_query.h"
+#include <stdint.h>
+#include <cstddef>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PHEENO_IR_QUERY_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PHEENO_IR_QUERY_NEON
+#endif
+
+namespace
+{
+  const float NO_READING = std::numeric_limits<float>::infinity();
+
+  int countBits(uint32_t mask)
+  {
+    return __builtin_popcount(mask);
+  }
+
+#if defined(PHEENO_IR_QUERY_NEON)
+  /*
+   * Collapses a NEON compare result into a 4-bit lane mask, like SSE's
+   * _mm_movemask_ps.
+   */
+  uint32_t laneMask(uint32x4_t compare)
+  {
+    static const uint32_t LANE_BITS[4] = {1, 2, 4, 8};
+    uint32x4_t bits = vandq_u32(compare, vld1q_u32(LANE_BITS));
+    uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    sum = vpadd_u32(sum, sum);
+    return vget_lane_u32(sum, 0);
+  }
+#endif
+}
+
+/*
+ * Answers every query for one robot. The (at most eight) ranges are padded
+ * to two vectors of four, so each query is two compares and a lane mask.
+ */
+void evaluateIrQueries(const float* ir, std::size_t ir_count,
+                       const IrQuery* queries, std::size_t query_count,
+                       IrQueryResult* results)
+{
+  float ranges[Pheeno::IR_QUERY_MAX_SENSORS];
+  for (std::size_t i = 0; i < Pheeno::IR_QUERY_MAX_SENSORS; i++)
+  {
+    ranges[i] = (i < ir_count) ? ir[i] : NO_READING;
+  }
+
+#if defined(PHEENO_IR_QUERY_SSE2)
+  __m128 low = _mm_loadu_ps(ranges);
+  __m128 high = _mm_loadu_ps(ranges + 4);
+#elif defined(PHEENO_IR_QUERY_NEON)
+  float32x4_t low = vld1q_f32(ranges);
+  float32x4_t high = vld1q_f32(ranges + 4);
+#endif
+
+  for (std::size_t q = 0; q < query_count; q++)
+  {
+    uint32_t below;
+
+#if defined(PHEENO_IR_QUERY_SSE2)
+    __m128 threshold = _mm_set1_ps(queries[q].threshold);
+    below = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(low, threshold))) |
+            (static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(high, threshold))) << 4);
+#elif defined(PHEENO_IR_QUERY_NEON)
+    float32x4_t threshold = vdupq_n_f32(queries[q].threshold);
+    below = laneMask(vcltq_f32(low, threshold)) | (laneMask(vcltq_f32(high, threshold)) << 4);
+#else
+    below = 0;
+    for (std::size_t i = 0; i < Pheeno::IR_QUERY_MAX_SENSORS; i++)
+    {
+      below |= (ranges[i] < queries[q].threshold) ? (1u << i) : 0u;
+    }
+#endif
+
+    results[q].below = below & queries[q].sensor_mask;
+    results[q].count = countBits(results[q].below);
+  }
+}
@@ -0,0 +1,426 @@
+#include "pheeno_ros/map_merger.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+/*
+ * Contructor for the MapMerger Class. The merged grid takes config's
+ * geometry; sources are added with addSource().
+ */
+MapMerger::MapMerger(const TiledOccupancyGrid::Config& config)
+  : merged_(config), merged_tiles_x_(0), merged_tiles_y_(0)
+{
+  configure(config);
+}
+
+/*
+ * Resizes the merged grid and drops every source.
+ */
+bool MapMerger::configure(const TiledOccupancyGrid::Config& config)
+{
+  bool ok = merged_.configure(config);
+  merged_tiles_x_ = merged_.width() / Pheeno::MAP_TILE_SIZE;
+  merged_tiles_y_ = merged_.height() / Pheeno::MAP_TILE_SIZE;
+  sources_.clear();
+  pending_flag_.assign(static_cast<std::size_t>(merged_tiles_x_) * merged_tiles_y_, 0);
+  pending_.clear();
+  return ok;
+}
+
+/*
+ * Adds a source whose map frame is placed in the merged frame by
+ * transform. Returns its index for applyDelta().
+ */
+int MapMerger::addSource(const Pose2D& transform)
+{
+  Source source;
+  source.has_geometry = false;
+  source.has_sequence = false;
+  source.session = 0;
+  source.retired_session = 0;
+  source.has_retired_session = false;
+  source.last_sequence = 0;
+  source.resolution = 0.0f;
+  source.origin_x = 0.0f;
+  source.origin_y = 0.0f;
+  source.tiles_x = 0;
+  source.tiles_y = 0;
+  sources_.push_back(source);
+
+  int index = static_cast<int>(sources_.size()) - 1;
+  setTransform(index, transform);
+  return index;
+}
+
+/*
+ * Moves a source, for example after its frame offset was re-estimated.
+ * Everything it covered before and after is merged again.
+ */
+void MapMerger::setTransform(int source, const Pose2D& transform)
+{
+  Source& s = sources_[source];
+  for (std::size_t slot = 0; slot < s.tile_of_slot.size(); slot++)
+  {
+    markFootprint(s, s.tile_of_slot[slot] % s.tiles_x, s.tile_of_slot[slot] / s.tiles_x);
+  }
+
+  s.transform = transform;
+  s.cos_theta = std::cos(transform.theta);
+  s.sin_theta = std::sin(transform.theta);
+
+  for (std::size_t slot = 0; slot < s.tile_of_slot.size(); slot++)
+  {
+    markFootprint(s, s.tile_of_slot[slot] % s.tiles_x, s.tile_of_slot[slot] / s.tiles_x);
+  }
+}
+
+/*
+ * Stores the tiles of a delta from source's TiledOccupancyGrid::encodeDelta()
+ * that are newer than what the source sent before. Returns false on
+ * malformed data; tiles decoded before the error are kept, since each tile
+ * is complete on its own.
+ */
+bool MapMerger::applyDelta(int source, const uint8_t* data, std::size_t size)
+{
+  if (source < 0 || source >= static_cast<int>(sources_.size()))
+  {
+    return false;
+  }
+
+  MapDeltaReader reader(data, size);
+  if (!reader.valid())
+  {
+    return false;
+  }
+
+  Source& s = sources_[source];
+  int tiles_x = (reader.width() + Pheeno::MAP_TILE_SIZE - 1) / Pheeno::MAP_TILE_SIZE;
+  int tiles_y = (reader.height() + Pheeno::MAP_TILE_SIZE - 1) / Pheeno::MAP_TILE_SIZE;
+  std::size_t tiles = static_cast<std::size_t>(tiles_x) * tiles_y;
+  if (tiles * sizeof(int32_t) > Pheeno::MAP_MAX_BYTES)
+  {
+    return false;
+  }
+
+  // Late deltas from before the sender's restart are stale.
+  uint32_t session = reader.session();
+  if (s.has_retired_session && session == s.retired_session)
+  {
+    return true;
+  }
+
+  // A new geometry or a new session invalidates what the source sent.
+  uint32_t sequence = reader.sequence();
+  bool geometry_changed = s.has_geometry &&
+    (s.resolution != reader.resolution() || s.origin_x != reader.originX() ||
+     s.origin_y != reader.originY() || s.tiles_x != tiles_x || s.tiles_y != tiles_y);
+  bool restarted = s.has_sequence && session != s.session;
+  if (restarted)
+  {
+    s.retired_session = s.session;
+    s.has_retired_session = true;
+  }
+  if (geometry_changed || restarted)
+  {
+    resetSource(s);
+  }
+
+  if (!s.has_geometry)
+  {
+    s.has_geometry = true;
+    s.resolution = reader.resolution();
+    s.origin_x = reader.originX();
+    s.origin_y = reader.originY();
+    s.tiles_x = tiles_x;
+    s.tiles_y = tiles_y;
+    s.slot_of_tile.assign(tiles, -1);
+  }
+
+  if (!s.has_sequence || static_cast<int32_t>(sequence - s.last_sequence) > 0)
+  {
+    s.has_sequence = true;
+    s.session = session;
+    s.last_sequence = sequence;
+  }
+
+  int tile_x;
+  int tile_y;
+  int8_t cells[Pheeno::MAP_TILE_CELLS];
+  while (reader.next(tile_x, tile_y, cells))
+  {
+    if (tile_x >= tiles_x || tile_y >= tiles_y)
+    {
+      continue;
+    }
+
+    std::size_t tile = static_cast<std::size_t>(tile_y) * tiles_x + tile_x;
+    int32_t slot = s.slot_of_tile[tile];
+    if (slot < 0)
+    {
+      slot = static_cast<int32_t>(s.tile_of_slot.size());
+      s.slot_of_tile[tile] = slot;
+      s.tile_of_slot.push_back(static_cast<uint32_t>(tile));
+      s.version.push_back(sequence);
+      s.cells.insert(s.cells.end(), cells, cells + Pheeno::MAP_TILE_CELLS);
+      markFootprint(s, tile_x, tile_y);
+      continue;
+    }
+
+    if (static_cast<int32_t>(sequence - s.version[slot]) <= 0)
+    {
+      continue;  // Late or repeated
+    }
+
+    s.version[slot] = sequence;
+    int8_t* stored = &s.cells[static_cast<std::size_t>(slot) * Pheeno::MAP_TILE_CELLS];
+    if (std::memcmp(stored, cells, Pheeno::MAP_TILE_CELLS) != 0)
+    {
+      std::memcpy(stored, cells, Pheeno::MAP_TILE_CELLS);
+      markFootprint(s, tile_x, tile_y);
+    }
+  }
+
+  return !reader.failed();
+}
+
+/*
+ * Recomputes up to max_tiles pending merged tiles (all of them when 0).
+ * Returns how many were recomputed.
+ */
+std::size_t MapMerger::update(std::size_t max_tiles)
+{
+  std::size_t count = pending_.size();
+  if (max_tiles > 0)
+  {
+    count = std::min(count, max_tiles);
+  }
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    uint32_t tile = pending_.back();
+    pending_.pop_back();
+    pending_flag_[tile] = 0;
+    mergeTile(tile);
+  }
+  return count;
+}
+
+/*
+ * Bytes used by the merged grid, the stored source tiles, and bookkeeping.
+ */
+std::size_t MapMerger::memoryBytes() const
+{
+  std::size_t bytes = merged_.memoryBytes() + pending_flag_.capacity() +
+                      pending_.capacity() * sizeof(uint32_t) + active_.capacity() * sizeof(int);
+  for (std::size_t i = 0; i < sources_.size(); i++)
+  {
+    const Source& s = sources_[i];
+    bytes += sizeof(Source) + s.slot_of_tile.capacity() * sizeof(int32_t) +
+             s.tile_of_slot.capacity() * sizeof(uint32_t) + s.version.capacity() * sizeof(uint32_t) +
+             s.cells.capacity();
+  }
+  return bytes;
+}
+
+/*
+ * Forgets every tile of a source (and its geometry) and remerges the area
+ * they covered.
+ */
+void MapMerger::resetSource(Source& source)
+{
+  for (std::size_t slot = 0; slot < source.tile_of_slot.size(); slot++)
+  {
+    markFootprint(source, source.tile_of_slot[slot] % source.tiles_x, source.tile_of_slot[slot] / source.tiles_x);
+  }
+
+  source.has_geometry = false;
+  source.has_sequence = false;
+  source.slot_of_tile.clear();
+  source.tile_of_slot.clear();
+  source.version.clear();
+  source.cells.clear();
+}
+
+/*
+ * Marks the merged tiles overlapped by the bounding box of a source tile
+ * once it is transformed into the merged frame.
+ */
+void MapMerger::markFootprint(const Source& source, int tile_x, int tile_y)
+{
+  double side = Pheeno::MAP_TILE_SIZE * source.resolution;
+  double x0 = source.origin_x + tile_x * side;
+  double y0 = source.origin_y + tile_y * side;
+  double min_x = 0.0;
+  double min_y = 0.0;
+  double max_x = 0.0;
+  double max_y = 0.0;
+  for (int corner = 0; corner < 4; corner++)
+  {
+    double sx = x0 + (corner & 1) * side;
+    double sy = y0 + (corner >> 1) * side;
+    double mx = source.transform.x + source.cos_theta * sx - source.sin_theta * sy;
+    double my = source.transform.y + source.sin_theta * sx + source.cos_theta * sy;
+    min_x = corner == 0 ? mx : std::min(min_x, mx);
+    min_y = corner == 0 ? my : std::min(min_y, my);
+    max_x = corner == 0 ? mx : std::max(max_x, mx);
+    max_y = corner == 0 ? my : std::max(max_y, my);
+  }
+
+  const TiledOccupancyGrid::Config& config = merged_.config();
+  double merged_side = Pheeno::MAP_TILE_SIZE * config.resolution;
+  double first_x = std::floor((min_x - config.origin_x) / merged_side);
+  double first_y = std::floor((min_y - config.origin_y) / merged_side);
+  double last_x = std::floor((max_x - config.origin_x) / merged_side);
+  double last_y = std::floor((max_y - config.origin_y) / merged_side);
+  if (last_x < 0 || last_y < 0 || first_x >= merged_tiles_x_ || first_y >= merged_tiles_y_)
+  {
+    return;
+  }
+
+  int begin_x = std::max(0, static_cast<int>(first_x));
+  int begin_y = std::max(0, static_cast<int>(first_y));
+  int end_x = std::min(merged_tiles_x_ - 1, static_cast<int>(last_x));
+  int end_y = std::min(merged_tiles_y_ - 1, static_cast<int>(last_y));
+  for (int ty = begin_y; ty <= end_y; ty++)
+  {
+    for (int tx = begin_x; tx <= end_x; tx++)
+    {
+      uint32_t tile = static_cast<uint32_t>(ty) * merged_tiles_x_ + tx;
+      if (!pending_flag_[tile])
+      {
+        pending_flag_[tile] = 1;
+        pending_.push_back(tile);
+      }
+    }
+  }
+}
+
+/*
+ * Sets every cell of a merged tile to the saturated sum of the sources'
+ * log-odds at its center. Only changed cells are written.
+ */
+void MapMerger::mergeTile(uint32_t tile)
+{
+  const TiledOccupancyGrid::Config& config = merged_.config();
+  int x0 = static_cast<int>(tile % merged_tiles_x_) * Pheeno::MAP_TILE_SIZE;
+  int y0 = static_cast<int>(tile / merged_tiles_x_) * Pheeno::MAP_TILE_SIZE;
+  double min_x = config.origin_x + x0 * config.resolution;
+  double min_y = config.origin_y + y0 * config.resolution;
+  double side = Pheeno::MAP_TILE_SIZE * config.resolution;
+
+  // Most sources are nowhere near a given tile.
+  active_.clear();
+  for (std::size_t i = 0; i < sources_.size(); i++)
+  {
+    if (overlaps(sources_[i], min_x, min_y, min_x + side, min_y + side))
+    {
+      active_.push_back(static_cast<int>(i));
+    }
+  }
+
+  for (int y = y0; y < y0 + Pheeno::MAP_TILE_SIZE; y++)
+  {
+    double wy = config.origin_y + (y + 0.5) * config.resolution;
+    for (int x = x0; x < x0 + Pheeno::MAP_TILE_SIZE; x++)
+    {
+      double wx = config.origin_x + (x + 0.5) * config.resolution;
+      int sum = 0;
+      for (std::size_t i = 0; i < active_.size(); i++)
+      {
+        sum += sample(sources_[active_[i]], wx, wy);
+      }
+
+      int8_t value = static_cast<int8_t>(std::max(-128, std::min(127, sum)));
+      if (merged_.logOdds(x, y) != value)
+      {
+        merged_.setLogOdds(x, y, value);
+      }
+    }
+  }
+}
+
+/*
+ * Whether a source holds any tile under a merged frame rectangle.
+ */
+bool MapMerger::overlaps(const Source& source, double min_x, double min_y, double max_x, double max_y) const
+{
+  if (source.tile_of_slot.empty())
+  {
+    return false;
+  }
+
+  // Bounding box of the rectangle in the source frame
+  double lo_x = 0.0;
+  double lo_y = 0.0;
+  double hi_x = 0.0;
+  double hi_y = 0.0;
+  for (int corner = 0; corner < 4; corner++)
+  {
+    double dx = ((corner & 1) ? max_x : min_x) - source.transform.x;
+    double dy = ((corner >> 1) ? max_y : min_y) - source.transform.y;
+    double sx = source.cos_theta * dx + source.sin_theta * dy;
+    double sy = -source.sin_theta * dx + source.cos_theta * dy;
+    lo_x = corner == 0 ? sx : std::min(lo_x, sx);
+    lo_y = corner == 0 ? sy : std::min(lo_y, sy);
+    hi_x = corner == 0 ? sx : std::max(hi_x, sx);
+    hi_y = corner == 0 ? sy : std::max(hi_y, sy);
+  }
+
+  double side = Pheeno::MAP_TILE_SIZE * source.resolution;
+  double first_x = std::floor((lo_x - source.origin_x) / side);
+  double first_y = std::floor((lo_y - source.origin_y) / side);
+  double last_x = std::floor((hi_x - source.origin_x) / side);
+  double last_y = std::floor((hi_y - source.origin_y) / side);
+  if (last_x < 0 || last_y < 0 || first_x >= source.tiles_x || first_y >= source.tiles_y)
+  {
+    return false;
+  }
+
+  int begin_x = std::max(0, static_cast<int>(first_x));
+  int begin_y = std::max(0, static_cast<int>(first_y));
+  int end_x = std::min(source.tiles_x - 1, static_cast<int>(last_x));
+  int end_y = std::min(source.tiles_y - 1, static_cast<int>(last_y));
+  for (int ty = begin_y; ty <= end_y; ty++)
+  {
+    for (int tx = begin_x; tx <= end_x; tx++)
+    {
+      if (source.slot_of_tile[static_cast<std::size_t>(ty) * source.tiles_x + tx] >= 0)
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Log-odds a source holds at a merged frame position; 0 (unknown) outside
+ * its map or in tiles it never sent.
+ */
+int MapMerger::sample(const Source& source, double wx, double wy) const
+{
+  double dx = wx - source.transform.x;
+  double dy = wy - source.transform.y;
+  double sx = source.cos_theta * dx + source.sin_theta * dy;
+  double sy = -source.sin_theta * dx + source.cos_theta * dy;
+  double fx = std::floor((sx - source.origin_x) / source.resolution);
+  double fy = std::floor((sy - source.origin_y) / source.resolution);
+  if (fx < 0 || fy < 0 ||
+      fx >= source.tiles_x * Pheeno::MAP_TILE_SIZE || fy >= source.tiles_y * Pheeno::MAP_TILE_SIZE)
+  {
+    return 0;
+  }
+
+  int x = static_cast<int>(fx);
+  int y = static_cast<int>(fy);
+  int32_t slot = source.slot_of_tile[static_cast<std::size_t>(y / Pheeno::MAP_TILE_SIZE) * source.tiles_x +
+                                     x / Pheeno::MAP_TILE_SIZE];
+  if (slot < 0)
+  {
+    return 0;
+  }
+  return source.cells[static_cast<std::size_t>(slot) * Pheeno::MAP_TILE_CELLS +
+                      (y % Pheeno::MAP_TILE_SIZE) * Pheeno::MAP_TILE_SIZE + x % Pheeno::MAP_TILE_SIZE];
+}
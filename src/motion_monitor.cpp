@@ -0,0 +1,247 @@
+#include "pheeno_ros/motion_monitor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const double PI = 3.14159265358979;
+
+  // Position of an event's bit
+  int eventIndex(Pheeno::MOTION_EVENT event)
+  {
+    int index = 0;
+    while (index < Pheeno::MOTION_EVENT_KINDS && !((event >> index) & 1))
+    {
+      index++;
+    }
+    return index;
+  }
+
+  // Weight of a new sample in a first order low-pass filter
+  double filterWeight(double dt, double time_constant)
+  {
+    return dt / (time_constant + dt);
+  }
+}
+
+/*
+ * Contructor for the MotionMonitor Class.
+ */
+MotionMonitor::MotionMonitor(const Config& config)
+  : config_(config)
+{
+  reset();
+}
+
+/*
+ * Forgets the inputs, biases and events.
+ */
+void MotionMonitor::reset()
+{
+  command_linear_ = 0.0;
+  command_angular_ = 0.0;
+  command_since_ = -1.0;
+  wheel_linear_ = 0.0;
+  wheel_angular_ = 0.0;
+  still_since_ = -1.0;
+  gyro_stamp_ = -1.0;
+  gyro_bias_ = 0.0;
+  yaw_residual_ = 0.0;
+  accel_stamp_ = -1.0;
+  accel_bias_x_ = 0.0;
+  accel_bias_y_ = 0.0;
+  accel_wheel_linear_ = 0.0;
+  speed_residual_ = 0.0;
+  accel_settling_ = config_.bias_time;
+  direction_ = 0.0;
+  for (int i = 0; i < Pheeno::MOTION_EVENT_KINDS; i++)
+  {
+    raised_[i] = -1e9;
+    counts_[i] = 0;
+  }
+}
+
+/*
+ * The velocity the robot is commanded to drive at.
+ */
+void MotionMonitor::command(double stamp, double linear, double angular)
+{
+  command_linear_ = linear;
+  command_angular_ = angular;
+  if (commandedStill())
+  {
+    command_since_ = -1.0;
+  }
+  else if (command_since_ < 0.0)
+  {
+    command_since_ = stamp;
+  }
+}
+
+/*
+ * Wheel velocities from the encoders. Checks for a stall.
+ */
+unsigned int MotionMonitor::wheels(double stamp, double linear, double angular)
+{
+  wheel_linear_ = linear;
+  wheel_angular_ = angular;
+
+  if (!wheelsStill())
+  {
+    still_since_ = -1.0;
+    return Pheeno::MOTION_NONE;
+  }
+  if (still_since_ < 0.0)
+  {
+    still_since_ = stamp;
+  }
+
+  // Both the command and the standstill must have lasted stall_time.
+  if (command_since_ >= 0.0 && stamp - std::max(command_since_, still_since_) >= config_.stall_time)
+  {
+    return raise(Pheeno::MOTION_STALL, stamp, travelDirection(command_linear_));
+  }
+  return Pheeno::MOTION_NONE;
+}
+
+/*
+ * Gyroscope yaw rate. Checks the yaw rate residual for slip.
+ */
+unsigned int MotionMonitor::gyroscope(double stamp, double yaw_rate)
+{
+  double dt = stamp - gyro_stamp_;
+  gyro_stamp_ = stamp;
+  if (dt <= 0.0 || dt > config_.max_gap)
+  {
+    yaw_residual_ = 0.0;
+    return Pheeno::MOTION_NONE;
+  }
+
+  if (commandedStill() && wheelsStill())
+  {
+    gyro_bias_ += filterWeight(dt, config_.bias_time) * (yaw_rate - gyro_bias_);
+  }
+
+  double residual = yaw_rate - gyro_bias_ - wheel_angular_;
+  yaw_residual_ += filterWeight(dt, config_.filter_time) * (residual - yaw_residual_);
+  if (std::abs(yaw_residual_) > config_.slip_yaw_rate)
+  {
+    return raise(Pheeno::MOTION_SLIP, stamp, travelDirection(wheel_linear_));
+  }
+  return Pheeno::MOTION_NONE;
+}
+
+/*
+ * Accelerometer x (forward) and y (left) readings. Checks for an impact
+ * and the speed residual for slip.
+ */
+unsigned int MotionMonitor::accelerometer(double stamp, double ax, double ay)
+{
+  double dt = stamp - accel_stamp_;
+  accel_stamp_ = stamp;
+  double wheel_change = wheel_linear_ - accel_wheel_linear_;
+  accel_wheel_linear_ = wheel_linear_;
+  if (dt <= 0.0 || dt > config_.max_gap)
+  {
+    speed_residual_ = 0.0;
+    return Pheeno::MOTION_NONE;
+  }
+
+  // Over bias_time the acceleration averages to the wheel acceleration.
+  double weight = filterWeight(dt, config_.bias_time);
+  accel_bias_x_ += weight * (ax - wheel_change / dt - accel_bias_x_);
+  accel_bias_y_ += weight * (ay - accel_bias_y_);
+  ax -= accel_bias_x_;
+  ay -= accel_bias_y_;
+
+  unsigned int raised = Pheeno::MOTION_NONE;
+  if (ax * ax + ay * ay > config_.impact_acceleration * config_.impact_acceleration)
+  {
+    // The obstacle is on the side the robot was pushed away from.
+    raised |= raise(Pheeno::MOTION_IMPACT, stamp, std::atan2(-ay, -ax));
+  }
+
+  // The residual is only trusted once the bias has had bias_time to settle.
+  speed_residual_ += wheel_change - ax * dt - filterWeight(dt, config_.residual_time) * speed_residual_;
+  accel_settling_ = std::max(accel_settling_ - dt, 0.0);
+  if (accel_settling_ == 0.0 && std::abs(speed_residual_) > config_.slip_speed)
+  {
+    raised |= raise(Pheeno::MOTION_SLIP, stamp, travelDirection(speed_residual_));
+  }
+  return raised;
+}
+
+/*
+ * Events raised within hold_time before now.
+ */
+unsigned int MotionMonitor::events(double now) const
+{
+  unsigned int active = Pheeno::MOTION_NONE;
+  for (int i = 0; i < Pheeno::MOTION_EVENT_KINDS; i++)
+  {
+    if (now - raised_[i] <= config_.hold_time)
+    {
+      active |= 1u << i;
+    }
+  }
+  return active;
+}
+
+/*
+ * True while an event is active; direction is then the robot frame
+ * direction (rad) of the obstacle behind the latest event.
+ */
+bool MotionMonitor::obstacle(double now, double& direction) const
+{
+  if (events(now) == Pheeno::MOTION_NONE)
+  {
+    return false;
+  }
+  direction = direction_;
+  return true;
+}
+
+/*
+ * Number of times the event was raised.
+ */
+unsigned long MotionMonitor::eventCount(Pheeno::MOTION_EVENT event) const
+{
+  int index = eventIndex(event);
+  return index < Pheeno::MOTION_EVENT_KINDS ? counts_[index] : 0;
+}
+
+bool MotionMonitor::commandedStill() const
+{
+  return std::abs(command_linear_) < config_.stall_command &&
+         std::abs(command_angular_) < config_.stall_command_yaw_rate;
+}
+
+bool MotionMonitor::wheelsStill() const
+{
+  return std::abs(wheel_linear_) < config_.stall_speed && std::abs(wheel_angular_) < config_.stall_yaw_rate;
+}
+
+/*
+ * Straight ahead for forward motion, behind for reverse.
+ */
+double MotionMonitor::travelDirection(double speed) const
+{
+  return speed >= 0.0 ? 0.0 : PI;
+}
+
+/*
+ * Marks the event active at stamp. Returns its bit if it was not active.
+ */
+unsigned int MotionMonitor::raise(Pheeno::MOTION_EVENT event, double stamp, double direction)
+{
+  int index = eventIndex(event);
+  bool active = (stamp - raised_[index] <= config_.hold_time);
+  raised_[index] = stamp;
+  direction_ = direction;
+  if (active)
+  {
+    return Pheeno::MOTION_NONE;
+  }
+  counts_[index]++;
+  return event;
+}
@@ -23,19 +23,22 @@ int main(int argc, char **argv) {
   }
 
 
+  // Predictive mode (-t) slows down ahead of obstacles using IR range rate.
+  bool predictive = cml_parser["-t"];
+
   // Initializing ROS node
   ros::init(argc, argv, "obstacle_avoidance_node");
 
-  // Crate PheenoRobot Object
-  PheenoRobot pheeno = PheenoRobot(pheeno_name);
+  // Crate PheenoRobot Object (IR only, or the packed sweep when bridged with -f)
+  PheenoRobot pheeno(pheeno_name, Pheeno::IR_SENSORS | Pheeno::SENSOR_SWEEP);
 
-  // ROS Rate loop
-  ros::Rate loop_rate(10);
+  // Tunables from ~behavior/ (Pheeno::BehaviorParams defaults)
+  const Pheeno::BehaviorParams& params = pheeno.behaviorParams();
 
   // Variables before loop
   double saved_time = ros::Time::now().toSec();
   double current_duration;
-  double turn_direction = pheeno.randomTurn(0.07);
+  double turn_direction = pheeno.randomTurn(params.random_turn);
   double linear = 0.0;
   double angular = 0.0;
   geometry_msgs::Twist cmd_vel_msg;
@@ -45,25 +48,31 @@ int main(int argc, char **argv) {
     // Find current duration of motion.
     current_duration = ros::Time::now().toSec() - saved_time;
 
-    if (current_duration <= 2.0) {
-      pheeno.avoidObstaclesLinear(linear, angular, turn_direction);
+    if (current_duration <= params.straight_time) {
+      if (predictive) {
+        pheeno.avoidObstaclesPredictive(linear, angular, turn_direction, params.linear_velocity,
+                                        params.range_to_avoid);
+      } else {
+        pheeno.avoidObstaclesLinear(linear, angular, turn_direction, params.linear_velocity,
+                                    params.range_to_avoid);
+      }
       cmd_vel_msg.linear.x = linear;
       cmd_vel_msg.angular.z = angular;
 
-    } else if (current_duration < 5.0) {
-      pheeno.avoidObstaclesAngular(angular, turn_direction);
+    } else if (current_duration < params.turn_time) {
+      pheeno.avoidObstaclesAngular(angular, turn_direction, params.angular_velocity, params.range_to_avoid);
       cmd_vel_msg.linear.x = linear;
       cmd_vel_msg.angular.z = angular;
 
     } else {
       // Reset Variables
       saved_time = ros::Time::now().toSec();
-      turn_direction = pheeno.randomTurn(0.07);
+      turn_direction = pheeno.randomTurn(params.random_turn);
     }
 
-    // Publish, Spin, and Sleep
+    // Publish, Spin, and Sleep (at the adaptive control rate)
     pheeno.publish(cmd_vel_msg);
     ros::spinOnce();
-    loop_rate.sleep();
+    pheeno.sleep();
   }
 }
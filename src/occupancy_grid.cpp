@@ -0,0 +1,630 @@
+#include "pheeno_ros/occupancy_grid.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PHEENO_MAP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PHEENO_MAP_NEON
+#endif
+
+const double TiledOccupancyGrid::LOG_ODDS_SCALE = 0.05;
+
+namespace
+{
+  const std::size_t DELTA_HEADER_SIZE = 1 + 4 + 4 + 4 + 4 + 4 + 2 + 2 + 2;
+  const std::size_t TILE_HEADER_SIZE = 2 + 2 + 1 + 2;
+
+  /*
+   * Log-odds to nav_msgs/OccupancyGrid probability (0-100, -1 unknown).
+   */
+  struct OccupancyTable
+  {
+    int8_t entries[256];
+
+    OccupancyTable()
+    {
+      for (int i = 0; i < 256; i++)
+      {
+        int log_odds = i - 128;
+        double probability = 1.0 / (1.0 + std::exp(-log_odds * TiledOccupancyGrid::LOG_ODDS_SCALE));
+        entries[i] = (log_odds == 0) ? -1 : static_cast<int8_t>(std::floor(probability * 100.0 + 0.5));
+      }
+    }
+  };
+
+  int8_t saturatingAdd(int8_t value, int8_t delta)
+  {
+    int sum = static_cast<int>(value) + delta;
+    return static_cast<int8_t>(std::min(127, std::max(-128, sum)));
+  }
+
+  // Little-endian field helpers.
+  void putUint16(std::vector<uint8_t>& out, uint16_t value)
+  {
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+  }
+
+  void putUint32(std::vector<uint8_t>& out, uint32_t value)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      out.push_back(static_cast<uint8_t>((value >> (8 * i)) & 0xFF));
+    }
+  }
+
+  void putFloat(std::vector<uint8_t>& out, float value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putUint32(out, bits);
+  }
+
+  uint16_t getUint16(const uint8_t*& in)
+  {
+    uint16_t value = static_cast<uint16_t>(in[0] | (in[1] << 8));
+    in += 2;
+    return value;
+  }
+
+  uint32_t getUint32(const uint8_t*& in)
+  {
+    uint32_t value = static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+                     (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    in += 4;
+    return value;
+  }
+
+  float getFloat(const uint8_t*& in)
+  {
+    uint32_t bits = getUint32(in);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /*
+   * Run-length encodes a tile as (count, value) pairs. Returns false if the
+   * encoding would not be smaller than the raw tile.
+   */
+  bool encodeTileRle(const int8_t* cells, std::vector<uint8_t>& out)
+  {
+    std::size_t start = out.size();
+    int i = 0;
+    while (i < Pheeno::MAP_TILE_CELLS)
+    {
+      int run = 1;
+      while (i + run < Pheeno::MAP_TILE_CELLS && run < 255 && cells[i + run] == cells[i])
+      {
+        run++;
+      }
+      out.push_back(static_cast<uint8_t>(run));
+      out.push_back(static_cast<uint8_t>(cells[i]));
+      i += run;
+
+      if (out.size() - start >= static_cast<std::size_t>(Pheeno::MAP_TILE_CELLS))
+      {
+        out.resize(start);
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+/*
+ * Contructor for the TiledOccupancyGrid Class. Falls back to the default
+ * configuration if the requested one exceeds Pheeno::MAP_MAX_BYTES. Each
+ * grid starts a new random delta session.
+ */
+TiledOccupancyGrid::TiledOccupancyGrid(const Config& config)
+  : tiles_x_(0), tiles_y_(0), delta_session_(std::random_device()()), delta_sequence_(0), refresh_cursor_(0),
+    track_changes_(false)
+{
+  if (!configure(config))
+  {
+    configure(Config());
+  }
+}
+
+/*
+ * Resizes the grid and clears it. Returns false (and leaves the grid
+ * untouched) if the configuration is invalid or would not fit in
+ * Pheeno::MAP_MAX_BYTES.
+ */
+bool TiledOccupancyGrid::configure(const Config& config)
+{
+  if (config.resolution <= 0.0 || config.width <= 0 || config.height <= 0)
+  {
+    return false;
+  }
+
+  int tiles_x = (config.width + Pheeno::MAP_TILE_SIZE - 1) / Pheeno::MAP_TILE_SIZE;
+  int tiles_y = (config.height + Pheeno::MAP_TILE_SIZE - 1) / Pheeno::MAP_TILE_SIZE;
+  std::size_t tiles = static_cast<std::size_t>(tiles_x) * tiles_y;
+  if (tiles > 0xFFFF || tiles * (Pheeno::MAP_TILE_CELLS + 1 + sizeof(uint32_t)) > Pheeno::MAP_MAX_BYTES)
+  {
+    return false;
+  }
+
+  config_ = config;
+  config_.width = tiles_x * Pheeno::MAP_TILE_SIZE;
+  config_.height = tiles_y * Pheeno::MAP_TILE_SIZE;
+  tiles_x_ = tiles_x;
+  tiles_y_ = tiles_y;
+
+  cells_.assign(tiles * Pheeno::MAP_TILE_CELLS, 0);
+  tile_dirty_.assign(tiles, 0);
+  dirty_tiles_.clear();
+  dirty_tiles_.reserve(tiles);
+  class_changes_.clear();
+  refresh_cursor_ = 0;
+  return true;
+}
+
+/*
+ * Resets every cell to unknown.
+ */
+void TiledOccupancyGrid::clear()
+{
+  std::fill(cells_.begin(), cells_.end(), 0);
+  std::fill(tile_dirty_.begin(), tile_dirty_.end(), 0);
+  dirty_tiles_.clear();
+  class_changes_.clear();
+}
+
+/*
+ * Turns the class change journal on or off. Turning it off drops any
+ * changes not yet taken.
+ */
+void TiledOccupancyGrid::setChangeTracking(bool enable)
+{
+  track_changes_ = enable;
+  class_changes_.clear();
+}
+
+/*
+ * Hands over the cells whose class changed since the last call. A cell
+ * may appear more than once.
+ */
+void TiledOccupancyGrid::takeClassChanges(std::vector<uint32_t>& cells)
+{
+  cells.clear();
+  cells.swap(class_changes_);
+}
+
+/*
+ * Bytes held by the cells and the dirty tile bookkeeping.
+ */
+std::size_t TiledOccupancyGrid::memoryBytes() const
+{
+  return cells_.capacity() + tile_dirty_.capacity() + dirty_tiles_.capacity() * sizeof(uint32_t);
+}
+
+/*
+ * Converts a world position to a cell. Returns false outside the grid.
+ */
+bool TiledOccupancyGrid::worldToCell(double wx, double wy, int& x, int& y) const
+{
+  double fx = std::floor((wx - config_.origin_x) / config_.resolution);
+  double fy = std::floor((wy - config_.origin_y) / config_.resolution);
+  if (fx < 0 || fy < 0 || fx >= config_.width || fy >= config_.height)
+  {
+    return false;
+  }
+  x = static_cast<int>(fx);
+  y = static_cast<int>(fy);
+  return true;
+}
+
+void TiledOccupancyGrid::setLogOdds(int x, int y, int8_t value)
+{
+  int8_t& cell = cells_[cellIndex(x, y)];
+  recordChange(x, y, cell, value);
+  cell = value;
+  markDirty(x, y);
+}
+
+void TiledOccupancyGrid::markDirty(int x, int y)
+{
+  uint32_t tile = static_cast<uint32_t>((y / Pheeno::MAP_TILE_SIZE) * tiles_x_ + x / Pheeno::MAP_TILE_SIZE);
+  if (!tile_dirty_[tile])
+  {
+    tile_dirty_[tile] = 1;
+    dirty_tiles_.push_back(tile);
+  }
+}
+
+void TiledOccupancyGrid::addCell(int x, int y, int8_t delta)
+{
+  int8_t& cell = cells_[cellIndex(x, y)];
+  int8_t before = cell;
+  cell = saturatingAdd(cell, delta);
+  recordChange(x, y, before, cell);
+  markDirty(x, y);
+}
+
+/*
+ * Adds delta to cells x_begin..x_end (inclusive) of row y. The cells must
+ * lie in one tile row; that row is updated with a single masked saturating
+ * add.
+ */
+void TiledOccupancyGrid::addRun(int y, int x_begin, int x_end, int8_t delta)
+{
+  if (x_begin == x_end)
+  {
+    addCell(x_begin, y, delta);
+    return;
+  }
+
+  int8_t* row = &cells_[cellIndex(x_begin & ~(Pheeno::MAP_TILE_SIZE - 1), y)];
+  int8_t first = static_cast<int8_t>(x_begin % Pheeno::MAP_TILE_SIZE);
+  int8_t last = static_cast<int8_t>(x_end % Pheeno::MAP_TILE_SIZE);
+
+  int8_t before[Pheeno::MAP_TILE_SIZE];
+  if (track_changes_)
+  {
+    std::memcpy(before, row, sizeof(before));
+  }
+
+#if defined(PHEENO_MAP_SSE2)
+  const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i mask = _mm_and_si128(_mm_cmpgt_epi8(lanes, _mm_set1_epi8(static_cast<char>(first - 1))),
+                               _mm_cmplt_epi8(lanes, _mm_set1_epi8(static_cast<char>(last + 1))));
+  __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+  cells = _mm_adds_epi8(cells, _mm_and_si128(mask, _mm_set1_epi8(delta)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(row), cells);
+#elif defined(PHEENO_MAP_NEON)
+  static const int8_t LANES[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  int8x16_t lanes = vld1q_s8(LANES);
+  uint8x16_t mask = vandq_u8(vcgeq_s8(lanes, vdupq_n_s8(first)), vcleq_s8(lanes, vdupq_n_s8(last)));
+  int8x16_t add = vandq_s8(vreinterpretq_s8_u8(mask), vdupq_n_s8(delta));
+  vst1q_s8(row, vqaddq_s8(vld1q_s8(row), add));
+#else
+  for (int i = first; i <= last; i++)
+  {
+    row[i] = saturatingAdd(row[i], delta);
+  }
+#endif
+
+  if (track_changes_)
+  {
+    int tile_x0 = x_begin - first;
+    for (int i = first; i <= last; i++)
+    {
+      recordChange(tile_x0 + i, y, before[i], row[i]);
+    }
+  }
+
+  markDirty(x_begin, y);
+}
+
+/*
+ * Traces a beam from the sensor (sx, sy) to its end point (ex, ey). Cells
+ * in between get the miss update; if hit, the end cell gets the hit update,
+ * otherwise it is free as well. Parts of the beam outside the grid are
+ * skipped.
+ */
+void TiledOccupancyGrid::insertBeam(double sx, double sy, double ex, double ey, bool hit)
+{
+  int x0 = static_cast<int>(std::floor((sx - config_.origin_x) / config_.resolution));
+  int y0 = static_cast<int>(std::floor((sy - config_.origin_y) / config_.resolution));
+  int x1 = static_cast<int>(std::floor((ex - config_.origin_x) / config_.resolution));
+  int y1 = static_cast<int>(std::floor((ey - config_.origin_y) / config_.resolution));
+
+  int dx = std::abs(x1 - x0);
+  int dy = -std::abs(y1 - y0);
+  int step_x = x0 < x1 ? 1 : -1;
+  int step_y = y0 < y1 ? 1 : -1;
+  int error = dx + dy;
+
+  // Current run of free cells within one tile row.
+  bool in_run = false;
+  int run_y = 0;
+  int run_begin = 0;
+  int run_end = 0;
+
+  int x = x0;
+  int y = y0;
+  while (x != x1 || y != y1)
+  {
+    bool inside = x >= 0 && y >= 0 && x < config_.width && y < config_.height;
+
+    if (in_run && (!inside || y != run_y ||
+                   x / Pheeno::MAP_TILE_SIZE != run_begin / Pheeno::MAP_TILE_SIZE))
+    {
+      addRun(run_y, std::min(run_begin, run_end), std::max(run_begin, run_end), config_.miss);
+      in_run = false;
+    }
+
+    if (inside)
+    {
+      if (!in_run)
+      {
+        in_run = true;
+        run_y = y;
+        run_begin = x;
+      }
+      run_end = x;
+    }
+
+    int error2 = 2 * error;
+    if (error2 >= dy)
+    {
+      error += dy;
+      x += step_x;
+    }
+    if (error2 <= dx)
+    {
+      error += dx;
+      y += step_y;
+    }
+  }
+
+  if (in_run)
+  {
+    addRun(run_y, std::min(run_begin, run_end), std::max(run_begin, run_end), config_.miss);
+  }
+
+  if (x1 >= 0 && y1 >= 0 && x1 < config_.width && y1 < config_.height)
+  {
+    addCell(x1, y1, hit ? config_.hit : config_.miss);
+  }
+}
+
+/*
+ * Serializes the tiles changed since the last call and clears their dirty
+ * flags. Layout (little-endian):
+ *
+ *   version u8, session u32, sequence u32, resolution f32, origin_x f32,
+ *   origin_y f32, width u16, height u16, tile_count u16,
+ *   tile_count x { tile_x u16, tile_y u16, encoding u8, length u16, data }
+ *
+ * A tile is run-length encoded as (count, value) pairs when that is smaller
+ * than its 256 raw bytes. With max_bytes, tiles that would not fit stay
+ * dirty for a later delta (at least one tile is always sent).
+ */
+void TiledOccupancyGrid::encodeDelta(std::vector<uint8_t>& out, std::size_t max_bytes)
+{
+  out.clear();
+  out.push_back(Pheeno::MAP_DELTA_VERSION);
+  putUint32(out, delta_session_);
+  putUint32(out, delta_sequence_++);
+  putFloat(out, static_cast<float>(config_.resolution));
+  putFloat(out, static_cast<float>(config_.origin_x));
+  putFloat(out, static_cast<float>(config_.origin_y));
+  putUint16(out, static_cast<uint16_t>(config_.width));
+  putUint16(out, static_cast<uint16_t>(config_.height));
+  std::size_t count_field = out.size();
+  putUint16(out, 0);
+
+  std::size_t sent = 0;
+  for (; sent < dirty_tiles_.size(); sent++)
+  {
+    uint32_t tile = dirty_tiles_[sent];
+    const int8_t* cells = &cells_[static_cast<std::size_t>(tile) * Pheeno::MAP_TILE_CELLS];
+    std::size_t tile_start = out.size();
+
+    putUint16(out, static_cast<uint16_t>(tile % tiles_x_));
+    putUint16(out, static_cast<uint16_t>(tile / tiles_x_));
+    std::size_t header = out.size();
+    out.push_back(Pheeno::TILE_RLE);
+    putUint16(out, 0);
+
+    std::size_t data_start = out.size();
+    if (!encodeTileRle(cells, out))
+    {
+      out[header] = Pheeno::TILE_RAW;
+      out.insert(out.end(), reinterpret_cast<const uint8_t*>(cells),
+                 reinterpret_cast<const uint8_t*>(cells) + Pheeno::MAP_TILE_CELLS);
+    }
+
+    if (max_bytes > 0 && out.size() > max_bytes && sent > 0)
+    {
+      out.resize(tile_start);
+      break;
+    }
+
+    std::size_t length = out.size() - data_start;
+    out[header + 1] = static_cast<uint8_t>(length & 0xFF);
+    out[header + 2] = static_cast<uint8_t>(length >> 8);
+
+    tile_dirty_[tile] = 0;
+  }
+
+  out[count_field] = static_cast<uint8_t>(sent & 0xFF);
+  out[count_field + 1] = static_cast<uint8_t>(sent >> 8);
+  dirty_tiles_.erase(dirty_tiles_.begin(), dirty_tiles_.begin() + sent);
+}
+
+/*
+ * Overwrites tiles with those carried by a delta from encodeDelta(). The
+ * delta must come from a grid with the same geometry. Returns false for a
+ * malformed or mismatched delta, in which case tiles decoded before the
+ * error have already been applied.
+ */
+bool TiledOccupancyGrid::applyDelta(const uint8_t* data, std::size_t size)
+{
+  MapDeltaReader reader(data, size);
+  if (!reader.valid() || reader.width() != config_.width || reader.height() != config_.height ||
+      std::abs(reader.resolution() - config_.resolution) > 1e-6)
+  {
+    return false;
+  }
+
+  int tile_x;
+  int tile_y;
+  int8_t decoded[Pheeno::MAP_TILE_CELLS];
+  while (reader.next(tile_x, tile_y, decoded))
+  {
+    if (tile_x >= tiles_x_ || tile_y >= tiles_y_)
+    {
+      return false;
+    }
+
+    int8_t* cells = &cells_[static_cast<std::size_t>(tile_y * tiles_x_ + tile_x) * Pheeno::MAP_TILE_CELLS];
+    if (track_changes_)
+    {
+      for (int i = 0; i < Pheeno::MAP_TILE_CELLS; i++)
+      {
+        recordChange(tile_x * Pheeno::MAP_TILE_SIZE + i % Pheeno::MAP_TILE_SIZE,
+                     tile_y * Pheeno::MAP_TILE_SIZE + i / Pheeno::MAP_TILE_SIZE, cells[i], decoded[i]);
+      }
+    }
+    std::memcpy(cells, decoded, sizeof(decoded));
+  }
+
+  return !reader.failed();
+}
+
+/*
+ * Marks up to count mapped (not entirely unknown) tiles dirty, continuing
+ * round-robin from the last call. Resending tiles a few at a time lets a
+ * peer that missed deltas, or joined late, converge.
+ */
+void TiledOccupancyGrid::refreshTiles(std::size_t count)
+{
+  uint32_t tiles = static_cast<uint32_t>(tile_dirty_.size());
+  for (uint32_t visited = 0; visited < tiles && count > 0; visited++)
+  {
+    uint32_t tile = refresh_cursor_;
+    refresh_cursor_ = (refresh_cursor_ + 1) % tiles;
+    if (tile_dirty_[tile])
+    {
+      continue;
+    }
+
+    const int8_t* cells = &cells_[static_cast<std::size_t>(tile) * Pheeno::MAP_TILE_CELLS];
+    for (int i = 0; i < Pheeno::MAP_TILE_CELLS; i++)
+    {
+      if (cells[i] != 0)
+      {
+        tile_dirty_[tile] = 1;
+        dirty_tiles_.push_back(tile);
+        count--;
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Writes the grid row-major (cell (0, 0) first) as occupancy probabilities
+ * in percent, -1 for unknown cells.
+ */
+void TiledOccupancyGrid::fillOccupancy(std::vector<int8_t>& out) const
+{
+  static const OccupancyTable TABLE;
+
+  out.resize(static_cast<std::size_t>(config_.width) * config_.height);
+  for (int y = 0; y < config_.height; y++)
+  {
+    for (int tile_x = 0; tile_x < tiles_x_; tile_x++)
+    {
+      const int8_t* row = &cells_[cellIndex(tile_x * Pheeno::MAP_TILE_SIZE, y)];
+      int8_t* target = &out[static_cast<std::size_t>(y) * config_.width + tile_x * Pheeno::MAP_TILE_SIZE];
+      for (int i = 0; i < Pheeno::MAP_TILE_SIZE; i++)
+      {
+        target[i] = TABLE.entries[row[i] + 128];
+      }
+    }
+  }
+}
+
+/*
+ * Contructor for the MapDeltaReader Class. Parses the delta header; the
+ * data must outlive the reader.
+ */
+MapDeltaReader::MapDeltaReader(const uint8_t* data, std::size_t size)
+  : cursor_(data), end_(data + size), valid_(false), failed_(false), session_(0), sequence_(0),
+    resolution_(0.0f), origin_x_(0.0f), origin_y_(0.0f), width_(0), height_(0),
+    tile_count_(0), tiles_read_(0)
+{
+  if (!data || size < DELTA_HEADER_SIZE || data[0] != Pheeno::MAP_DELTA_VERSION)
+  {
+    failed_ = true;
+    return;
+  }
+
+  cursor_ = data + 1;
+  session_ = getUint32(cursor_);
+  sequence_ = getUint32(cursor_);
+  resolution_ = getFloat(cursor_);
+  origin_x_ = getFloat(cursor_);
+  origin_y_ = getFloat(cursor_);
+  width_ = getUint16(cursor_);
+  height_ = getUint16(cursor_);
+  tile_count_ = getUint16(cursor_);
+  valid_ = resolution_ > 0.0f;
+  failed_ = !valid_;
+}
+
+/*
+ * Decodes the next tile into cells. Returns false after the last tile or on
+ * malformed data (then failed() is true).
+ */
+bool MapDeltaReader::next(int& tile_x, int& tile_y, int8_t* cells)
+{
+  if (failed_ || tiles_read_ >= tile_count_)
+  {
+    return false;
+  }
+
+  if (end_ - cursor_ < static_cast<std::ptrdiff_t>(TILE_HEADER_SIZE))
+  {
+    failed_ = true;
+    return false;
+  }
+
+  tile_x = getUint16(cursor_);
+  tile_y = getUint16(cursor_);
+  uint8_t encoding = *cursor_++;
+  std::size_t length = getUint16(cursor_);
+  if (static_cast<std::size_t>(end_ - cursor_) < length)
+  {
+    failed_ = true;
+    return false;
+  }
+
+  if (encoding == Pheeno::TILE_RAW && length == static_cast<std::size_t>(Pheeno::MAP_TILE_CELLS))
+  {
+    std::memcpy(cells, cursor_, length);
+  }
+  else if (encoding == Pheeno::TILE_RLE && length % 2 == 0)
+  {
+    int filled = 0;
+    for (std::size_t i = 0; i < length; i += 2)
+    {
+      int run = cursor_[i];
+      if (filled + run > Pheeno::MAP_TILE_CELLS)
+      {
+        failed_ = true;
+        return false;
+      }
+      std::memset(cells + filled, cursor_[i + 1], run);
+      filled += run;
+    }
+    if (filled != Pheeno::MAP_TILE_CELLS)
+    {
+      failed_ = true;
+      return false;
+    }
+  }
+  else
+  {
+    failed_ = true;
+    return false;
+  }
+
+  cursor_ += length;
+  tiles_read_++;
+  return true;
+}
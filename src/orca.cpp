@@ -0,0 +1,369 @@
+#include "pheeno_ros/orca.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  const double ORCA_EPSILON = 1e-9;
+
+  inline double det(double ax, double ay, double bx, double by)
+  {
+    return ax * by - ay * bx;
+  }
+}
+
+/*
+ * Contructor for the OrcaSolver Class.
+ */
+OrcaSolver::OrcaSolver(const Config& config)
+  : config_(config)
+{
+  nearest_.reserve(config_.max_neighbors + 1);
+  lines_.reserve(config_.max_neighbors);
+  projected_.reserve(config_.max_neighbors);
+}
+
+/*
+ * Picks the new velocity (vx, vy) of agent among count neighbors. dt is
+ * the control period, used to resolve overlaps within one step. Returns
+ * false if no velocity satisfies every constraint; (vx, vy) is then the
+ * one violating them least.
+ */
+bool OrcaSolver::solve(const OrcaAgent& agent, const OrcaAgent* neighbors, std::size_t count, double dt,
+                       double& vx, double& vy)
+{
+  // Closest neighbors within range, ties broken by index so the choice is
+  // deterministic.
+  nearest_.clear();
+  double range_squared = config_.neighbor_distance * config_.neighbor_distance;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    double dx = neighbors[i].x - agent.x;
+    double dy = neighbors[i].y - agent.y;
+    double distance_squared = dx * dx + dy * dy;
+    if (distance_squared < range_squared)
+    {
+      nearest_.push_back(std::make_pair(distance_squared, i));
+    }
+  }
+  if (nearest_.size() > config_.max_neighbors)
+  {
+    std::partial_sort(nearest_.begin(), nearest_.begin() + config_.max_neighbors, nearest_.end());
+    nearest_.resize(config_.max_neighbors);
+  }
+
+  double inverse_horizon = 1.0 / config_.time_horizon;
+  double inverse_dt = 1.0 / std::max(dt, 1e-3);
+  lines_.clear();
+  for (std::size_t k = 0; k < nearest_.size(); k++)
+  {
+    const OrcaAgent& other = neighbors[nearest_[k].second];
+    double rel_x = other.x - agent.x;
+    double rel_y = other.y - agent.y;
+    double rel_vx = agent.vx - other.vx;
+    double rel_vy = agent.vy - other.vy;
+    double distance_squared = rel_x * rel_x + rel_y * rel_y;
+    double combined_radius = agent.radius + other.radius;
+    double combined_radius_squared = combined_radius * combined_radius;
+
+    Line line;
+    double u_x;
+    double u_y;
+    if (distance_squared > combined_radius_squared)
+    {
+      // Not touching: w is the relative velocity seen from the center of
+      // the velocity obstacle's cut-off circle.
+      double w_x = rel_vx - inverse_horizon * rel_x;
+      double w_y = rel_vy - inverse_horizon * rel_y;
+      double w_length_squared = w_x * w_x + w_y * w_y;
+      double dot = w_x * rel_x + w_y * rel_y;
+
+      if (dot < 0.0 && dot * dot > combined_radius_squared * w_length_squared)
+      {
+        // Closest to the cut-off circle
+        double w_length = std::sqrt(w_length_squared);
+        double unit_x = w_x / w_length;
+        double unit_y = w_y / w_length;
+        line.direction_x = unit_y;
+        line.direction_y = -unit_x;
+        u_x = (combined_radius * inverse_horizon - w_length) * unit_x;
+        u_y = (combined_radius * inverse_horizon - w_length) * unit_y;
+      }
+      else
+      {
+        // Closest to one of the legs
+        double leg = std::sqrt(distance_squared - combined_radius_squared);
+        if (det(rel_x, rel_y, w_x, w_y) > 0.0)
+        {
+          line.direction_x = (rel_x * leg - rel_y * combined_radius) / distance_squared;
+          line.direction_y = (rel_x * combined_radius + rel_y * leg) / distance_squared;
+        }
+        else
+        {
+          line.direction_x = -(rel_x * leg + rel_y * combined_radius) / distance_squared;
+          line.direction_y = -(-rel_x * combined_radius + rel_y * leg) / distance_squared;
+        }
+
+        double projection = rel_vx * line.direction_x + rel_vy * line.direction_y;
+        u_x = projection * line.direction_x - rel_vx;
+        u_y = projection * line.direction_y - rel_vy;
+      }
+    }
+    else
+    {
+      // Already overlapping: separate within one control period.
+      double w_x = rel_vx - inverse_dt * rel_x;
+      double w_y = rel_vy - inverse_dt * rel_y;
+      double w_length = std::sqrt(w_x * w_x + w_y * w_y);
+      double unit_x = w_length > ORCA_EPSILON ? w_x / w_length : 1.0;
+      double unit_y = w_length > ORCA_EPSILON ? w_y / w_length : 0.0;
+      line.direction_x = unit_y;
+      line.direction_y = -unit_x;
+      u_x = (combined_radius * inverse_dt - w_length) * unit_x;
+      u_y = (combined_radius * inverse_dt - w_length) * unit_y;
+    }
+
+    // Take half of the avoidance, trusting the neighbor with the rest.
+    line.point_x = agent.vx + 0.5 * u_x;
+    line.point_y = agent.vy + 0.5 * u_y;
+    lines_.push_back(line);
+  }
+
+  std::size_t failed = linearProgram2(lines_, agent.max_speed, agent.pref_vx, agent.pref_vy, false, vx, vy);
+  if (failed < lines_.size())
+  {
+    linearProgram3(failed, agent.max_speed, vx, vy);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Optimizes along one line, subject to the lines before it and the speed
+ * disc. Returns false if that part of the line is empty.
+ */
+bool OrcaSolver::linearProgram1(const std::vector<Line>& lines, std::size_t line, double radius,
+                                double opt_x, double opt_y, bool direction_opt, double& x, double& y) const
+{
+  const Line& current = lines[line];
+  double dot = current.point_x * current.direction_x + current.point_y * current.direction_y;
+  double discriminant = dot * dot + radius * radius -
+                        (current.point_x * current.point_x + current.point_y * current.point_y);
+  if (discriminant < 0.0)
+  {
+    return false;  // The speed disc misses the line
+  }
+
+  double root = std::sqrt(discriminant);
+  double t_left = -dot - root;
+  double t_right = -dot + root;
+  for (std::size_t i = 0; i < line; i++)
+  {
+    double denominator = det(current.direction_x, current.direction_y, lines[i].direction_x, lines[i].direction_y);
+    double numerator = det(lines[i].direction_x, lines[i].direction_y,
+                           current.point_x - lines[i].point_x, current.point_y - lines[i].point_y);
+    if (std::abs(denominator) <= ORCA_EPSILON)
+    {
+      // Parallel lines
+      if (numerator < 0.0)
+      {
+        return false;
+      }
+      continue;
+    }
+
+    double t = numerator / denominator;
+    if (denominator >= 0.0)
+    {
+      t_right = std::min(t_right, t);
+    }
+    else
+    {
+      t_left = std::max(t_left, t);
+    }
+    if (t_left > t_right)
+    {
+      return false;
+    }
+  }
+
+  double t;
+  if (direction_opt)
+  {
+    t = opt_x * current.direction_x + opt_y * current.direction_y > 0.0 ? t_right : t_left;
+  }
+  else
+  {
+    t = current.direction_x * (opt_x - current.point_x) + current.direction_y * (opt_y - current.point_y);
+    t = std::max(t_left, std::min(t_right, t));
+  }
+  x = current.point_x + t * current.direction_x;
+  y = current.point_y + t * current.direction_y;
+  return true;
+}
+
+/*
+ * Velocity closest to opt (or furthest along it, with direction_opt) that
+ * satisfies every line. Returns the index of the first line that could not
+ * be satisfied, or lines.size() on success.
+ */
+std::size_t OrcaSolver::linearProgram2(const std::vector<Line>& lines, double radius, double opt_x, double opt_y,
+                                       bool direction_opt, double& x, double& y) const
+{
+  double opt_squared = opt_x * opt_x + opt_y * opt_y;
+  if (direction_opt)
+  {
+    x = opt_x * radius;
+    y = opt_y * radius;
+  }
+  else if (opt_squared > radius * radius)
+  {
+    double scale = radius / std::sqrt(opt_squared);
+    x = opt_x * scale;
+    y = opt_y * scale;
+  }
+  else
+  {
+    x = opt_x;
+    y = opt_y;
+  }
+
+  for (std::size_t i = 0; i < lines.size(); i++)
+  {
+    if (det(lines[i].direction_x, lines[i].direction_y, lines[i].point_x - x, lines[i].point_y - y) > 0.0)
+    {
+      // The current result is on the wrong side of line i.
+      double previous_x = x;
+      double previous_y = y;
+      if (!linearProgram1(lines, i, radius, opt_x, opt_y, direction_opt, x, y))
+      {
+        x = previous_x;
+        y = previous_y;
+        return i;
+      }
+    }
+  }
+  return lines.size();
+}
+
+/*
+ * Infeasible case: minimizes the largest violation over lines_, starting
+ * from the line linearProgram2() failed on.
+ */
+void OrcaSolver::linearProgram3(std::size_t begin_line, double radius, double& x, double& y)
+{
+  double distance = 0.0;
+  for (std::size_t i = begin_line; i < lines_.size(); i++)
+  {
+    const Line& line_i = lines_[i];
+    if (det(line_i.direction_x, line_i.direction_y, line_i.point_x - x, line_i.point_y - y) <= distance)
+    {
+      continue;
+    }
+
+    // Lines before i, re-expressed relative to line i
+    projected_.clear();
+    for (std::size_t j = 0; j < i; j++)
+    {
+      const Line& line_j = lines_[j];
+      Line line;
+      double determinant = det(line_i.direction_x, line_i.direction_y, line_j.direction_x, line_j.direction_y);
+      if (std::abs(determinant) <= ORCA_EPSILON)
+      {
+        if (line_i.direction_x * line_j.direction_x + line_i.direction_y * line_j.direction_y > 0.0)
+        {
+          continue;  // Same direction
+        }
+        line.point_x = 0.5 * (line_i.point_x + line_j.point_x);
+        line.point_y = 0.5 * (line_i.point_y + line_j.point_y);
+      }
+      else
+      {
+        double t = det(line_j.direction_x, line_j.direction_y,
+                       line_i.point_x - line_j.point_x, line_i.point_y - line_j.point_y) / determinant;
+        line.point_x = line_i.point_x + t * line_i.direction_x;
+        line.point_y = line_i.point_y + t * line_i.direction_y;
+      }
+
+      double direction_x = line_j.direction_x - line_i.direction_x;
+      double direction_y = line_j.direction_y - line_i.direction_y;
+      double length = std::sqrt(direction_x * direction_x + direction_y * direction_y);
+      line.direction_x = direction_x / length;
+      line.direction_y = direction_y / length;
+      projected_.push_back(line);
+    }
+
+    double previous_x = x;
+    double previous_y = y;
+    if (linearProgram2(projected_, radius, -line_i.direction_y, line_i.direction_x, true, x, y) < projected_.size())
+    {
+      // Can only fail through rounding; keep the previous result.
+      x = previous_x;
+      y = previous_y;
+    }
+    distance = det(line_i.direction_x, line_i.direction_y, line_i.point_x - x, line_i.point_y - y);
+  }
+}
+
+/*
+ * Contructor for the OrcaBatch Class.
+ */
+OrcaBatch::OrcaBatch(const OrcaSolver::Config& config, unsigned int threads)
+  : config_(config), hash_(config.neighbor_distance), team_(threads)
+{
+  solvers_.assign(team_.threadCount(), OrcaSolver(config));
+  neighbors_.resize(team_.threadCount());
+}
+
+/*
+ * New velocities (vx[i], vy[i]) for every agent, one control period dt
+ * ahead. Agents are read as a snapshot; none of them moves during the
+ * call.
+ */
+void OrcaBatch::solve(const std::vector<OrcaAgent>& agents, double dt,
+                      std::vector<double>& vx, std::vector<double>& vy)
+{
+  std::size_t count = agents.size();
+  vx.resize(count);
+  vy.resize(count);
+  x_.resize(count);
+  y_.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    x_[i] = agents[i].x;
+    y_[i] = agents[i].y;
+  }
+  hash_.build(count ? &x_[0] : NULL, count ? &y_[0] : NULL, count);
+
+  team_.run(count, BLOCK_SIZE,
+            [&](unsigned int thread, std::size_t begin, std::size_t end)
+            {
+              solveRange(thread, agents, begin, end, dt, vx, vy);
+            });
+}
+
+/*
+ * Solves agents [begin, end) with the scratch space of one thread.
+ */
+void OrcaBatch::solveRange(unsigned int thread, const std::vector<OrcaAgent>& agents, std::size_t begin,
+                           std::size_t end, double dt, std::vector<double>& vx, std::vector<double>& vy)
+{
+  OrcaSolver& solver = solvers_[thread];
+  std::vector<OrcaAgent>& neighbors = neighbors_[thread];
+  for (std::size_t i = begin; i < end; i++)
+  {
+    neighbors.clear();
+    hash_.forEachNear(agents[i].x, agents[i].y, config_.neighbor_distance,
+                      [&](uint32_t index, double, double, double)
+                      {
+                        if (index != i)
+                        {
+                          neighbors.push_back(agents[index]);
+                        }
+                      });
+
+    solver.solve(agents[i], neighbors.empty() ? NULL : &neighbors[0], neighbors.size(), dt, vx[i], vy[i]);
+  }
+}
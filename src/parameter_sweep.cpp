@@ -0,0 +1,413 @@
+//
+// Parameter sweeps of the obstacle_avoidance and random_walk behaviors over
+// the headless simulator (sim_world.h), on all cores.
+//
+//   rosrun pheeno_ros parameter_sweep -b avoidance -n 4 -k 10
+//     -p "range_to_avoid grid 10 30 5; angular_velocity list 0.6 1.2 2.4"
+//   rosrun pheeno_ros parameter_sweep -f sweep.txt -r 500 -o results.csv
+//
+// A spec names BehaviorParams fields, one per line (file) or separated by
+// ';' (-p):
+//
+//   <name> grid <first> <last> <step>
+//   <name> list <value> ...
+//   <name> uniform <low> <high>
+//
+// Without -r every combination of the grid and list values runs; with -r N
+// N parameter sets are drawn at random (uniform fields need -r). Each set
+// runs -k times. Repeat k starts from the same poses and seeds for every
+// set, so sets are compared on equal terms, and results do not depend on
+// the thread count. -m adds the IR/IMU noise and latency models
+// (sim_sensors.h).
+//
+
+#include "pheeno_ros/behaviors.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/sim_experiment.h"
+#include "pheeno_ros/work_stealing_pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // One swept field
+  struct Dimension
+  {
+    std::string name;
+    bool uniform;
+    std::vector<double> values;  // grid and list
+    double low;                  // uniform
+    double high;
+  };
+
+  // Mean and standard deviation accumulator
+  struct Stat
+  {
+    Stat() : count(0), sum(0.0), sum_squares(0.0) {}
+
+    void add(double value)
+    {
+      count++;
+      sum += value;
+      sum_squares += value * value;
+    }
+
+    double mean() const { return count > 0 ? sum / count : 0.0; }
+    double deviation() const
+    {
+      return count > 1 ? std::sqrt(std::max(0.0, (sum_squares - sum * sum / count) / (count - 1))) : 0.0;
+    }
+
+    std::size_t count;
+    double sum;
+    double sum_squares;
+  };
+
+  struct Summary
+  {
+    std::size_t set;
+    Stat coverage;
+    Stat coverage_rate;
+    Stat collisions;
+    Stat contact_time;
+    Stat stall_time;
+    Stat time_to_goal;  // Runs that reached the goal
+  };
+
+  std::string trim(const std::string& text)
+  {
+    std::size_t begin = text.find_first_not_of(" \t\r\n");
+    std::size_t end = text.find_last_not_of(" \t\r\n");
+    return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+  }
+
+  bool parseDimension(const std::string& entry, Dimension& dimension)
+  {
+    std::istringstream words(entry);
+    std::string kind;
+    if (!(words >> dimension.name >> kind))
+    {
+      return false;
+    }
+    Pheeno::BehaviorParams params;
+    if (Pheeno::behaviorParam(params, dimension.name) == NULL)
+    {
+      std::fprintf(stderr, "Unknown parameter %s\n", dimension.name.c_str());
+      return false;
+    }
+
+    dimension.uniform = false;
+    double value;
+    if (kind == "grid")
+    {
+      double first, last, step;
+      if (!(words >> first >> last >> step) || step <= 0.0 || last < first)
+      {
+        return false;
+      }
+      for (int i = 0; first + i * step <= last + 1e-9 * step; i++)
+      {
+        dimension.values.push_back(first + i * step);
+      }
+    }
+    else if (kind == "list")
+    {
+      while (words >> value)
+      {
+        dimension.values.push_back(value);
+      }
+    }
+    else if (kind == "uniform")
+    {
+      dimension.uniform = true;
+      if (!(words >> dimension.low >> dimension.high) || dimension.high < dimension.low)
+      {
+        return false;
+      }
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+    return !dimension.values.empty();
+  }
+
+  // Splits spec into entries at newlines and ';', dropping '#' comments.
+  bool parseSpec(const std::string& spec, std::vector<Dimension>& dimensions)
+  {
+    std::string entry;
+    std::istringstream lines(spec);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+      line = line.substr(0, line.find('#'));
+      std::istringstream entries(line);
+      while (std::getline(entries, entry, ';'))
+      {
+        entry = trim(entry);
+        if (entry.empty())
+        {
+          continue;
+        }
+        Dimension dimension;
+        if (!parseDimension(entry, dimension))
+        {
+          std::fprintf(stderr, "Bad sweep entry: %s\n", entry.c_str());
+          return false;
+        }
+        dimensions.push_back(dimension);
+      }
+    }
+    return true;
+  }
+
+  // Every combination of the dimensions' values, first dimension slowest.
+  void gridSets(const std::vector<Dimension>& dimensions, std::vector<std::vector<double> >& sets)
+  {
+    sets.assign(1, std::vector<double>());
+    for (std::size_t d = 0; d < dimensions.size(); d++)
+    {
+      std::vector<std::vector<double> > extended;
+      extended.reserve(sets.size() * dimensions[d].values.size());
+      for (std::size_t s = 0; s < sets.size(); s++)
+      {
+        for (std::size_t v = 0; v < dimensions[d].values.size(); v++)
+        {
+          extended.push_back(sets[s]);
+          extended.back().push_back(dimensions[d].values[v]);
+        }
+      }
+      sets.swap(extended);
+    }
+  }
+
+  void randomSets(const std::vector<Dimension>& dimensions, std::size_t count, uint32_t seed,
+                  std::vector<std::vector<double> >& sets)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    sets.assign(count, std::vector<double>(dimensions.size()));
+    for (std::size_t s = 0; s < count; s++)
+    {
+      for (std::size_t d = 0; d < dimensions.size(); d++)
+      {
+        const Dimension& dimension = dimensions[d];
+        if (dimension.uniform)
+        {
+          sets[s][d] = dimension.low + unit(rng) * (dimension.high - dimension.low);
+        }
+        else
+        {
+          sets[s][d] = dimension.values[rng() % dimension.values.size()];
+        }
+      }
+    }
+  }
+
+  bool better(const Summary& a, const Summary& b)
+  {
+    if (a.coverage_rate.mean() != b.coverage_rate.mean())
+    {
+      return a.coverage_rate.mean() > b.coverage_rate.mean();
+    }
+    if (a.collisions.mean() != b.collisions.mean())
+    {
+      return a.collisions.mean() < b.collisions.mean();
+    }
+    return a.set < b.set;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cml_parser(argc, argv);
+
+  SimExperiment::Config config;
+  if (!Pheeno::parseBehavior(cml_parser("-b", "obstacle_avoidance"), config.behavior))
+  {
+    std::fprintf(stderr, "Unknown behavior %s! Use obstacle_avoidance or random_walk.\n", cml_parser("-b").c_str());
+    return 1;
+  }
+  config.robots = std::max(1, std::atoi(cml_parser("-n", "4").c_str()));
+  config.duration = std::max(1.0, std::atof(cml_parser("-t", "120").c_str()));
+  config.goal_coverage = std::atof(cml_parser("-g", "0.5").c_str());
+  config.obstacles = std::max(0, std::atoi(cml_parser("-x", "0").c_str()));
+  config.world.arena_width = config.world.arena_height = std::max(0.5, std::atof(cml_parser("-w", "2").c_str()));
+  config.sensor_errors = cml_parser["-m"];
+  std::size_t repeats = std::max(1, std::atoi(cml_parser("-k", "10").c_str()));
+  unsigned int threads = std::max(0, std::atoi(cml_parser("-j", "0").c_str()));
+  uint32_t seed = static_cast<uint32_t>(std::strtoul(cml_parser("-s", "1").c_str(), NULL, 10));
+  std::size_t rows = std::max(1, std::atoi(cml_parser("-l", "20").c_str()));
+
+  // Sweep spec
+  std::string spec = cml_parser("-p", "");
+  if (cml_parser["-f"])
+  {
+    std::ifstream file(cml_parser("-f").c_str());
+    if (!file)
+    {
+      std::perror(cml_parser("-f").c_str());
+      return 1;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    spec += "\n" + contents.str();
+  }
+
+  std::vector<Dimension> dimensions;
+  if (!parseSpec(spec, dimensions))
+  {
+    return 1;
+  }
+
+  std::vector<std::vector<double> > sets;
+  if (cml_parser["-r"])
+  {
+    randomSets(dimensions, std::max(1, std::atoi(cml_parser("-r").c_str())), seed, sets);
+  }
+  else
+  {
+    for (std::size_t d = 0; d < dimensions.size(); d++)
+    {
+      if (dimensions[d].uniform)
+      {
+        std::fprintf(stderr, "%s is uniform: random search (-r) needed.\n", dimensions[d].name.c_str());
+        return 1;
+      }
+    }
+    gridSets(dimensions, sets);
+  }
+
+  // Run every set repeats times. Results land in a slot per run, so the
+  // table is the same whichever thread ran what.
+  std::size_t runs = sets.size() * repeats;
+  std::vector<SimResult> results(runs);
+  std::atomic<std::size_t> finished(0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  WorkStealingPool pool(threads);
+  std::printf("%lu parameter sets x %lu repeats on %u threads\n", static_cast<unsigned long>(sets.size()),
+              static_cast<unsigned long>(repeats), pool.threadCount());
+
+  for (std::size_t run = 0; run < runs; run++)
+  {
+    pool.submit([&, run]()
+    {
+      std::size_t set = run / repeats;
+      SimExperiment::Config run_config = config;
+      for (std::size_t d = 0; d < dimensions.size(); d++)
+      {
+        *Pheeno::behaviorParam(run_config.params, dimensions[d].name) = sets[set][d];
+      }
+      results[run] = SimExperiment(run_config).run(SimExperiment::runSeed(seed, run % repeats));
+
+      std::size_t done = ++finished;
+      if (done * 10 / runs != (done - 1) * 10 / runs)
+      {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::fprintf(stderr, "%lu/%lu runs, %.0f s\n", static_cast<unsigned long>(done),
+                     static_cast<unsigned long>(runs), elapsed);
+      }
+    });
+  }
+  pool.wait();
+
+  // Aggregate per set
+  std::vector<Summary> summaries(sets.size());
+  for (std::size_t set = 0; set < sets.size(); set++)
+  {
+    summaries[set].set = set;
+    for (std::size_t k = 0; k < repeats; k++)
+    {
+      const SimResult& result = results[set * repeats + k];
+      summaries[set].coverage.add(result.coverage);
+      summaries[set].coverage_rate.add(result.coverage_rate);
+      summaries[set].collisions.add(result.collisions);
+      summaries[set].contact_time.add(result.contact_time);
+      summaries[set].stall_time.add(result.stall_time);
+      if (result.time_to_goal >= 0.0)
+      {
+        summaries[set].time_to_goal.add(result.time_to_goal);
+      }
+    }
+  }
+  std::sort(summaries.begin(), summaries.end(), better);
+
+  // Results table, best coverage rate first
+  std::printf("\n%5s", "rank");
+  for (std::size_t d = 0; d < dimensions.size(); d++)
+  {
+    std::printf(" %16s", dimensions[d].name.c_str());
+  }
+  std::printf(" %15s %15s %13s %13s %6s\n", "coverage", "cov/min", "collisions", "contact s", "goal");
+  for (std::size_t r = 0; r < std::min(rows, summaries.size()); r++)
+  {
+    const Summary& summary = summaries[r];
+    std::printf("%5lu", static_cast<unsigned long>(r + 1));
+    for (std::size_t d = 0; d < dimensions.size(); d++)
+    {
+      std::printf(" %16.4g", sets[summary.set][d]);
+    }
+    std::printf(" %7.3f+-%-6.3f %7.4f+-%-6.4f %6.1f+-%-5.1f %6.1f+-%-5.1f", summary.coverage.mean(),
+                summary.coverage.deviation(), summary.coverage_rate.mean(), summary.coverage_rate.deviation(),
+                summary.collisions.mean(), summary.collisions.deviation(), summary.contact_time.mean(),
+                summary.contact_time.deviation());
+    if (summary.time_to_goal.count > 0)
+    {
+      std::printf(" %5.0fs %lu/%lu\n", summary.time_to_goal.mean(),
+                  static_cast<unsigned long>(summary.time_to_goal.count), static_cast<unsigned long>(repeats));
+    }
+    else
+    {
+      std::printf(" %6s\n", "-");
+    }
+  }
+
+  // Every set, for further analysis
+  if (cml_parser["-o"])
+  {
+    std::FILE* csv = std::fopen(cml_parser("-o").c_str(), "w");
+    if (csv == NULL)
+    {
+      std::perror(cml_parser("-o").c_str());
+      return 1;
+    }
+    for (std::size_t d = 0; d < dimensions.size(); d++)
+    {
+      std::fprintf(csv, "%s,", dimensions[d].name.c_str());
+    }
+    std::fprintf(csv, "runs,coverage,coverage_sd,coverage_rate,coverage_rate_sd,collisions,collisions_sd,"
+                      "contact_time,contact_time_sd,stall_time,stall_time_sd,goal_reached,time_to_goal\n");
+    for (std::size_t r = 0; r < summaries.size(); r++)
+    {
+      const Summary& summary = summaries[r];
+      for (std::size_t d = 0; d < dimensions.size(); d++)
+      {
+        std::fprintf(csv, "%.9g,", sets[summary.set][d]);
+      }
+      std::fprintf(csv, "%lu,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%lu,%.3f\n",
+                   static_cast<unsigned long>(repeats), summary.coverage.mean(), summary.coverage.deviation(),
+                   summary.coverage_rate.mean(), summary.coverage_rate.deviation(), summary.collisions.mean(),
+                   summary.collisions.deviation(), summary.contact_time.mean(), summary.contact_time.deviation(),
+                   summary.stall_time.mean(), summary.stall_time.deviation(),
+                   static_cast<unsigned long>(summary.time_to_goal.count),
+                   summary.time_to_goal.count > 0 ? summary.time_to_goal.mean() : -1.0);
+    }
+    std::fclose(csv);
+  }
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("\n%lu runs in %.1f s\n", static_cast<unsigned long>(runs), elapsed);
+  return 0;
+}
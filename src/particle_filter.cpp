@@ -0,0 +1,551 @@
+#include "pheeno_ros/particle_filter.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PHEENO_MCL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PHEENO_MCL_NEON
+#endif
+
+namespace
+{
+  const double PI = 3.14159265358979;
+
+  // Stands in for infinity in the distance transform (keeps the arithmetic finite).
+  const float FAR_AWAY = 1e20f;
+
+  double normalizeAngle(double angle)
+  {
+    return std::atan2(std::sin(angle), std::cos(angle));
+  }
+
+  std::size_t padded(std::size_t count)
+  {
+    return (count + 3) & ~static_cast<std::size_t>(3);
+  }
+
+  /*
+   * One-dimensional squared Euclidean distance transform of the sampled
+   * function f (Felzenszwalb and Huttenlocher). v and z are scratch space of
+   * n and n + 1 entries.
+   */
+  void distanceTransform(const float* f, int n, float* d, int* v, float* z)
+  {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -FAR_AWAY;
+    z[1] = FAR_AWAY;
+    for (int q = 1; q < n; q++)
+    {
+      float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+      while (s <= z[k])
+      {
+        k--;
+        s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+      }
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = FAR_AWAY;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++)
+    {
+      while (z[k + 1] < q)
+      {
+        k++;
+      }
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+  }
+}
+
+/*
+ * Contructor for the ParticleFilter Class. The filter is empty until a map
+ * is set and it is initialized.
+ */
+ParticleFilter::ParticleFilter(const Config& config)
+  : config_(config), rng_(config.seed), count_(0), field_width_(0), field_height_(0),
+    resolution_(1.0f), origin_x_(0.0f), origin_y_(0.0f)
+{
+  config_.min_particles = std::max(1, config_.min_particles);
+  config_.max_particles = std::max(config_.min_particles, config_.max_particles);
+
+  std::size_t capacity = padded(config_.max_particles);
+  x_.reserve(capacity);
+  y_.reserve(capacity);
+  theta_.reserve(capacity);
+  cos_.reserve(capacity);
+  sin_.reserve(capacity);
+  log_weight_.reserve(capacity);
+  weight_.reserve(capacity);
+  next_x_.reserve(capacity);
+  next_y_.reserve(capacity);
+  next_theta_.reserve(capacity);
+
+  // Histogram at most half full
+  std::size_t slots = 1;
+  while (slots < 2 * static_cast<std::size_t>(config_.max_particles))
+  {
+    slots <<= 1;
+  }
+  bins_.assign(slots, 0);
+
+  std::fill(log_likelihood_, log_likelihood_ + 256, 0.0f);
+  std::fill(covariance_, covariance_ + 9, 0.0);
+}
+
+/*
+ * Builds the distance field for a static map. Cells at 50 or above are
+ * obstacles; unknown cells count as free. Returns false for an empty map.
+ */
+bool ParticleFilter::setMap(const int8_t* occupancy, int width, int height, double resolution,
+                            double origin_x, double origin_y)
+{
+  if (!occupancy || width <= 0 || height <= 0 || resolution <= 0.0)
+  {
+    return false;
+  }
+
+  std::size_t cells = static_cast<std::size_t>(width) * height;
+  std::vector<float> squared(cells);
+  for (std::size_t i = 0; i < cells; i++)
+  {
+    squared[i] = occupancy[i] >= 50 ? 0.0f : FAR_AWAY;
+  }
+
+  // Columns, then rows
+  int longest = std::max(width, height);
+  std::vector<float> f(longest);
+  std::vector<float> d(longest);
+  std::vector<int> v(longest);
+  std::vector<float> z(longest + 1);
+  for (int x = 0; x < width; x++)
+  {
+    for (int y = 0; y < height; y++)
+    {
+      f[y] = squared[static_cast<std::size_t>(y) * width + x];
+    }
+    distanceTransform(&f[0], height, &d[0], &v[0], &z[0]);
+    for (int y = 0; y < height; y++)
+    {
+      squared[static_cast<std::size_t>(y) * width + x] = d[y];
+    }
+  }
+  for (int y = 0; y < height; y++)
+  {
+    float* row = &squared[static_cast<std::size_t>(y) * width];
+    std::copy(row, row + width, f.begin());
+    distanceTransform(&f[0], width, row, &v[0], &z[0]);
+  }
+
+  field_.resize(cells);
+  for (std::size_t i = 0; i < cells; i++)
+  {
+    float steps = std::sqrt(squared[i]) * Pheeno::FIELD_STEPS_PER_CELL + 0.5f;
+    field_[i] = static_cast<uint8_t>(std::min(steps, 255.0f));
+  }
+
+  field_width_ = width;
+  field_height_ = height;
+  resolution_ = static_cast<float>(resolution);
+  origin_x_ = static_cast<float>(origin_x);
+  origin_y_ = static_cast<float>(origin_y);
+
+  // log(z_hit * exp(-d^2 / 2 sigma^2) + z_rand) per quantized distance
+  double step = resolution / Pheeno::FIELD_STEPS_PER_CELL;
+  double sigma = std::max(config_.sigma_hit, 1e-3);
+  for (int i = 0; i < 256; i++)
+  {
+    double distance = i * step;
+    double likelihood = config_.z_hit * std::exp(-distance * distance / (2.0 * sigma * sigma)) + config_.z_rand;
+    log_likelihood_[i] = static_cast<float>(std::log(std::max(likelihood, 1e-12)));
+  }
+  return true;
+}
+
+/*
+ * Draws max_particles particles around mean.
+ */
+void ParticleFilter::initialize(const Pose2D& mean, double sigma_xy, double sigma_theta)
+{
+  std::normal_distribution<double> noise(0.0, 1.0);
+  resize(config_.max_particles);
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    x_[i] = static_cast<float>(mean.x + sigma_xy * noise(rng_));
+    y_[i] = static_cast<float>(mean.y + sigma_xy * noise(rng_));
+    theta_[i] = static_cast<float>(normalizeAngle(mean.theta + sigma_theta * noise(rng_)));
+  }
+  std::fill(weight_.begin(), weight_.end(), 1.0 / count_);
+  computeEstimate();
+}
+
+/*
+ * Spreads max_particles particles over the free cells of the map (global
+ * localization).
+ */
+void ParticleFilter::initializeUniform()
+{
+  if (!hasMap())
+  {
+    return;
+  }
+
+  std::uniform_int_distribution<int> cell_x(0, field_width_ - 1);
+  std::uniform_int_distribution<int> cell_y(0, field_height_ - 1);
+  std::uniform_real_distribution<double> heading(-PI, PI);
+  resize(config_.max_particles);
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    int x = 0;
+    int y = 0;
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+      x = cell_x(rng_);
+      y = cell_y(rng_);
+      if (field_[static_cast<std::size_t>(y) * field_width_ + x] > 0)
+      {
+        break;
+      }
+    }
+    x_[i] = origin_x_ + (x + 0.5f) * resolution_;
+    y_[i] = origin_y_ + (y + 0.5f) * resolution_;
+    theta_[i] = static_cast<float>(heading(rng_));
+  }
+  std::fill(weight_.begin(), weight_.end(), 1.0 / count_);
+  computeEstimate();
+}
+
+/*
+ * Moves every particle by the odometry motion between two odometry poses,
+ * sampling rotation and translation noise.
+ */
+void ParticleFilter::predict(const Pose2D& odom_previous, const Pose2D& odom_current)
+{
+  double dx = odom_current.x - odom_previous.x;
+  double dy = odom_current.y - odom_previous.y;
+  double translation = std::sqrt(dx * dx + dy * dy);
+  double rotation_1 = translation < 0.01 ? 0.0 : normalizeAngle(std::atan2(dy, dx) - odom_previous.theta);
+  double rotation_2 = normalizeAngle(odom_current.theta - odom_previous.theta - rotation_1);
+
+  // Driving backward is a small rotation and a negative translation.
+  if (std::fabs(rotation_1) > PI / 2.0)
+  {
+    rotation_1 = normalizeAngle(rotation_1 - PI);
+    rotation_2 = normalizeAngle(rotation_2 - PI);
+    translation = -translation;
+  }
+
+  double sigma_rotation_1 = std::sqrt(config_.alpha_rot_rot * rotation_1 * rotation_1 +
+                                      config_.alpha_rot_trans * translation * translation);
+  double sigma_translation = std::sqrt(config_.alpha_trans_trans * translation * translation +
+                                       config_.alpha_trans_rot * (rotation_1 * rotation_1 + rotation_2 * rotation_2));
+  double sigma_rotation_2 = std::sqrt(config_.alpha_rot_rot * rotation_2 * rotation_2 +
+                                      config_.alpha_rot_trans * translation * translation);
+
+  std::normal_distribution<double> noise(0.0, 1.0);
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    double r1 = rotation_1 + sigma_rotation_1 * noise(rng_);
+    double t = translation + sigma_translation * noise(rng_);
+    double r2 = rotation_2 + sigma_rotation_2 * noise(rng_);
+    double heading = theta_[i] + r1;
+    x_[i] += static_cast<float>(t * std::cos(heading));
+    y_[i] += static_cast<float>(t * std::sin(heading));
+    theta_[i] = static_cast<float>(normalizeAngle(heading + r2));
+  }
+}
+
+/*
+ * Weights the particles by how well the beams (ranges in m, sensor mounts
+ * in the robot frame) fit the map, and updates the estimate.
+ */
+void ParticleFilter::correct(const Pheeno::IrMount* mounts, const double* ranges, std::size_t count, double max_range)
+{
+  if (!hasMap() || count_ == 0)
+  {
+    return;
+  }
+
+  std::size_t lanes = padded(count_);
+  for (std::size_t i = 0; i < lanes; i++)
+  {
+    cos_[i] = std::cos(theta_[i]);
+    sin_[i] = std::sin(theta_[i]);
+  }
+  std::fill(log_weight_.begin(), log_weight_.end(), 0.0f);
+
+  const float inv_resolution = 1.0f / resolution_;
+  const float far_log_likelihood = log_likelihood_[255];
+  int32_t cell_x[4];
+  int32_t cell_y[4];
+  int32_t inside[4];
+
+  for (std::size_t b = 0; b < count; b++)
+  {
+    if (!(ranges[b] >= 0.0) || ranges[b] >= max_range)
+    {
+      continue;
+    }
+
+    // Beam end point in the robot frame
+    float bx = static_cast<float>(mounts[b].x + ranges[b] * std::cos(mounts[b].angle));
+    float by = static_cast<float>(mounts[b].y + ranges[b] * std::sin(mounts[b].angle));
+
+    for (std::size_t i = 0; i < lanes; i += 4)
+    {
+#if defined(PHEENO_MCL_SSE2)
+      __m128 c = _mm_loadu_ps(&cos_[i]);
+      __m128 s = _mm_loadu_ps(&sin_[i]);
+      __m128 ex = _mm_add_ps(_mm_loadu_ps(&x_[i]), _mm_sub_ps(_mm_mul_ps(c, _mm_set1_ps(bx)),
+                                                              _mm_mul_ps(s, _mm_set1_ps(by))));
+      __m128 ey = _mm_add_ps(_mm_loadu_ps(&y_[i]), _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(bx)),
+                                                              _mm_mul_ps(c, _mm_set1_ps(by))));
+      __m128 fx = _mm_mul_ps(_mm_sub_ps(ex, _mm_set1_ps(origin_x_)), _mm_set1_ps(inv_resolution));
+      __m128 fy = _mm_mul_ps(_mm_sub_ps(ey, _mm_set1_ps(origin_y_)), _mm_set1_ps(inv_resolution));
+      __m128 width = _mm_set1_ps(static_cast<float>(field_width_));
+      __m128 height = _mm_set1_ps(static_cast<float>(field_height_));
+      __m128 zero = _mm_setzero_ps();
+      __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmplt_ps(fx, width)),
+                             _mm_and_ps(_mm_cmpge_ps(fy, zero), _mm_cmplt_ps(fy, height)));
+      fx = _mm_and_ps(in, fx);
+      fy = _mm_and_ps(in, fy);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(cell_x), _mm_cvttps_epi32(fx));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(cell_y), _mm_cvttps_epi32(fy));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(inside), _mm_castps_si128(in));
+#elif defined(PHEENO_MCL_NEON)
+      float32x4_t c = vld1q_f32(&cos_[i]);
+      float32x4_t s = vld1q_f32(&sin_[i]);
+      float32x4_t ex = vaddq_f32(vld1q_f32(&x_[i]), vmlsq_n_f32(vmulq_n_f32(c, bx), s, by));
+      float32x4_t ey = vaddq_f32(vld1q_f32(&y_[i]), vmlaq_n_f32(vmulq_n_f32(s, bx), c, by));
+      float32x4_t fx = vmulq_n_f32(vsubq_f32(ex, vdupq_n_f32(origin_x_)), inv_resolution);
+      float32x4_t fy = vmulq_n_f32(vsubq_f32(ey, vdupq_n_f32(origin_y_)), inv_resolution);
+      float32x4_t zero = vdupq_n_f32(0.0f);
+      uint32x4_t in = vandq_u32(vandq_u32(vcgeq_f32(fx, zero), vcltq_f32(fx, vdupq_n_f32(static_cast<float>(field_width_)))),
+                                vandq_u32(vcgeq_f32(fy, zero), vcltq_f32(fy, vdupq_n_f32(static_cast<float>(field_height_)))));
+      fx = vreinterpretq_f32_u32(vandq_u32(in, vreinterpretq_u32_f32(fx)));
+      fy = vreinterpretq_f32_u32(vandq_u32(in, vreinterpretq_u32_f32(fy)));
+      vst1q_s32(cell_x, vcvtq_s32_f32(fx));
+      vst1q_s32(cell_y, vcvtq_s32_f32(fy));
+      vst1q_s32(inside, vreinterpretq_s32_u32(in));
+#else
+      for (int j = 0; j < 4; j++)
+      {
+        float ex = x_[i + j] + cos_[i + j] * bx - sin_[i + j] * by;
+        float ey = y_[i + j] + sin_[i + j] * bx + cos_[i + j] * by;
+        float fx = (ex - origin_x_) * inv_resolution;
+        float fy = (ey - origin_y_) * inv_resolution;
+        bool in = fx >= 0.0f && fx < field_width_ && fy >= 0.0f && fy < field_height_;
+        cell_x[j] = in ? static_cast<int32_t>(fx) : 0;
+        cell_y[j] = in ? static_cast<int32_t>(fy) : 0;
+        inside[j] = in ? -1 : 0;
+      }
+#endif
+
+      // Field lookups (no gather instruction on either target)
+      for (int j = 0; j < 4; j++)
+      {
+        log_weight_[i + j] += inside[j]
+          ? log_likelihood_[field_[static_cast<std::size_t>(cell_y[j]) * field_width_ + cell_x[j]]]
+          : far_log_likelihood;
+      }
+    }
+  }
+
+  float best = log_weight_[0];
+  for (std::size_t i = 1; i < count_; i++)
+  {
+    best = std::max(best, log_weight_[i]);
+  }
+
+  double total = 0.0;
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    weight_[i] *= std::exp(static_cast<double>(log_weight_[i] - best));
+    total += weight_[i];
+  }
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    weight_[i] = total > 0.0 ? weight_[i] / total : 1.0 / count_;
+  }
+
+  computeEstimate();
+}
+
+/*
+ * KLD-sampling: draws particles by weight until their count bounds the
+ * histogram error (at least min_particles, at most max_particles).
+ */
+void ParticleFilter::resample()
+{
+  if (count_ == 0)
+  {
+    return;
+  }
+
+  // Cumulative weights, in place (reset to uniform below)
+  std::vector<double>& cumulative = weight_;
+  for (std::size_t i = 1; i < count_; i++)
+  {
+    cumulative[i] += cumulative[i - 1];
+  }
+
+  std::fill(bins_.begin(), bins_.end(), 0);
+  std::uniform_real_distribution<double> uniform(0.0, cumulative[count_ - 1]);
+  next_x_.clear();
+  next_y_.clear();
+  next_theta_.clear();
+
+  std::size_t bins = 0;
+  std::size_t limit = config_.max_particles;
+  while (next_x_.size() < limit)
+  {
+    std::size_t i = std::upper_bound(cumulative.begin(), cumulative.begin() + count_, uniform(rng_)) - cumulative.begin();
+    i = std::min(i, count_ - 1);
+    next_x_.push_back(x_[i]);
+    next_y_.push_back(y_[i]);
+    next_theta_.push_back(theta_[i]);
+
+    if (insertBin(x_[i], y_[i], theta_[i]))
+    {
+      bins++;
+    }
+    limit = std::min(static_cast<std::size_t>(config_.max_particles),
+                     std::max(static_cast<std::size_t>(config_.min_particles), kldLimit(bins)));
+  }
+
+  std::size_t drawn = next_x_.size();
+  resize(drawn);
+  std::copy(next_x_.begin(), next_x_.end(), x_.begin());
+  std::copy(next_y_.begin(), next_y_.end(), y_.begin());
+  std::copy(next_theta_.begin(), next_theta_.end(), theta_.begin());
+  std::fill(weight_.begin(), weight_.end(), 1.0 / count_);
+}
+
+/*
+ * Whether the particles gathered around one pose: the standard deviations
+ * of x and y within converged_xy and the circular one of the heading within
+ * converged_theta. A freshly seeded global (uniform) filter is far from it,
+ * and one seeded with initialize() only once its spread is small enough.
+ */
+bool ParticleFilter::converged() const
+{
+  double xy = config_.converged_xy * config_.converged_xy;
+  return count_ > 0 && covariance_[0] <= xy && covariance_[4] <= xy &&
+         covariance_[8] <= config_.converged_theta * config_.converged_theta;
+}
+
+std::size_t ParticleFilter::memoryBytes() const
+{
+  return (x_.capacity() + y_.capacity() + theta_.capacity() + cos_.capacity() + sin_.capacity() +
+          log_weight_.capacity() + next_x_.capacity() + next_y_.capacity() + next_theta_.capacity()) * sizeof(float) +
+         weight_.capacity() * sizeof(double) + field_.capacity() + bins_.capacity() * sizeof(uint64_t);
+}
+
+/*
+ * Sets the particle count. Padding lanes hold zeros so the SIMD loops can
+ * run over them harmlessly.
+ */
+void ParticleFilter::resize(std::size_t count)
+{
+  count_ = count;
+  std::size_t lanes = padded(count);
+  x_.assign(lanes, 0.0f);
+  y_.assign(lanes, 0.0f);
+  theta_.assign(lanes, 0.0f);
+  cos_.assign(lanes, 0.0f);
+  sin_.assign(lanes, 0.0f);
+  log_weight_.assign(lanes, 0.0f);
+  weight_.assign(count, 0.0);
+}
+
+/*
+ * Weighted mean (circular for the heading) and covariance of the particles.
+ */
+void ParticleFilter::computeEstimate()
+{
+  double mean_x = 0.0;
+  double mean_y = 0.0;
+  double mean_cos = 0.0;
+  double mean_sin = 0.0;
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    mean_x += weight_[i] * x_[i];
+    mean_y += weight_[i] * y_[i];
+    mean_cos += weight_[i] * std::cos(theta_[i]);
+    mean_sin += weight_[i] * std::sin(theta_[i]);
+  }
+
+  double xx = 0.0;
+  double xy = 0.0;
+  double yy = 0.0;
+  for (std::size_t i = 0; i < count_; i++)
+  {
+    double dx = x_[i] - mean_x;
+    double dy = y_[i] - mean_y;
+    xx += weight_[i] * dx * dx;
+    xy += weight_[i] * dx * dy;
+    yy += weight_[i] * dy * dy;
+  }
+
+  estimate_ = Pose2D(mean_x, mean_y, std::atan2(mean_sin, mean_cos));
+  std::fill(covariance_, covariance_ + 9, 0.0);
+  covariance_[0] = xx;
+  covariance_[1] = covariance_[3] = xy;
+  covariance_[4] = yy;
+  double resultant = std::sqrt(mean_cos * mean_cos + mean_sin * mean_sin);
+  covariance_[8] = -2.0 * std::log(std::max(resultant, 1e-9));
+}
+
+/*
+ * Adds the pose's bin to the histogram. Returns true if the bin was empty.
+ */
+bool ParticleFilter::insertBin(float x, float y, float theta)
+{
+  int64_t bx = static_cast<int64_t>(std::floor(x / config_.bin_xy));
+  int64_t by = static_cast<int64_t>(std::floor(y / config_.bin_xy));
+  int64_t bt = static_cast<int64_t>(std::floor(theta / config_.bin_theta));
+  uint64_t key = ((static_cast<uint64_t>(bx) & 0x1FFFFF) << 42) | ((static_cast<uint64_t>(by) & 0x1FFFFF) << 21) |
+                 (static_cast<uint64_t>(bt) & 0x1FFFFF);
+  key += 1;
+
+  std::size_t mask = bins_.size() - 1;
+  std::size_t slot = static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+  while (bins_[slot] != 0)
+  {
+    if (bins_[slot] == key)
+    {
+      return false;
+    }
+    slot = (slot + 1) & mask;
+  }
+  bins_[slot] = key;
+  return true;
+}
+
+/*
+ * Particles needed so the KL divergence between the sampled and the true
+ * histogram over bins bins stays below kld_error with probability given by
+ * kld_z (Wilson-Hilferty approximation of the chi-square quantile).
+ */
+std::size_t ParticleFilter::kldLimit(std::size_t bins) const
+{
+  if (bins <= 1)
+  {
+    return 0;
+  }
+
+  double k = static_cast<double>(bins - 1);
+  double a = 2.0 / (9.0 * k);
+  double b = 1.0 - a + std::sqrt(a) * config_.kld_z;
+  return static_cast<std::size_t>(std::ceil(k / (2.0 * config_.kld_error) * b * b * b));
+}
@@ -0,0 +1,245 @@
+#include "pheeno_ros/path_follower.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Contructor for the PathFollower Class. The follower stands still until a
+ * path is set.
+ */
+PathFollower::PathFollower(const Config& config)
+  : config_(config), closest_(0), lookahead_(0), progress_(0.0), cross_track_error_(0.0), done_(false)
+{
+}
+
+/*
+ * Follows the polyline through points (their theta is ignored). Repeated
+ * points are dropped.
+ */
+void PathFollower::setPath(const std::vector<Pose2D>& points)
+{
+  clear();
+  for (std::size_t i = 0; i < points.size(); i++)
+  {
+    if (!x_.empty() && std::hypot(points[i].x - x_.back(), points[i].y - y_.back()) < 1e-6)
+    {
+      continue;
+    }
+    x_.push_back(points[i].x);
+    y_.push_back(points[i].y);
+  }
+  finishPath();
+}
+
+/*
+ * Follows a Catmull-Rom spline through the control points, sampled into
+ * samples_per_segment pieces between each pair of them.
+ */
+void PathFollower::setSpline(const std::vector<Pose2D>& control_points, int samples_per_segment)
+{
+  if (control_points.size() < 3)
+  {
+    setPath(control_points);
+    return;
+  }
+
+  std::vector<Pose2D> points;
+  std::size_t last = control_points.size() - 1;
+  int samples = std::max(samples_per_segment, 1);
+  points.reserve(last * samples + 1);
+  for (std::size_t i = 0; i < last; i++)
+  {
+    const Pose2D& p0 = control_points[i > 0 ? i - 1 : 0];
+    const Pose2D& p1 = control_points[i];
+    const Pose2D& p2 = control_points[i + 1];
+    const Pose2D& p3 = control_points[std::min(i + 2, last)];
+    for (int k = 0; k < samples; k++)
+    {
+      double t = static_cast<double>(k) / samples;
+      double t2 = t * t;
+      double t3 = t2 * t;
+      points.push_back(Pose2D(
+        0.5 * (2.0 * p1.x + (p2.x - p0.x) * t + (2.0 * p0.x - 5.0 * p1.x + 4.0 * p2.x - p3.x) * t2 +
+               (3.0 * p1.x - p0.x - 3.0 * p2.x + p3.x) * t3),
+        0.5 * (2.0 * p1.y + (p2.y - p0.y) * t + (2.0 * p0.y - 5.0 * p1.y + 4.0 * p2.y - p3.y) * t2 +
+               (3.0 * p1.y - p0.y - 3.0 * p2.y + p3.y) * t3)));
+    }
+  }
+  points.push_back(control_points[last]);
+  setPath(points);
+}
+
+/*
+ * Drops the path; update() then stops the robot.
+ */
+void PathFollower::clear()
+{
+  x_.clear();
+  y_.clear();
+  s_.clear();
+  heading_.clear();
+  inverse_length_.clear();
+  closest_ = 0;
+  lookahead_ = 0;
+  progress_ = 0.0;
+  cross_track_error_ = 0.0;
+  done_ = false;
+}
+
+/*
+ * Sets linear and angular to track the path from pose. Returns false (and
+ * a stop command) once the last point is within goal_tolerance, or without
+ * a path.
+ */
+bool PathFollower::update(const Pose2D& pose, double& linear, double& angular)
+{
+  linear = 0.0;
+  angular = 0.0;
+  if (x_.empty() || done_)
+  {
+    return false;
+  }
+
+  double goal_distance = std::hypot(x_.back() - pose.x, y_.back() - pose.y);
+  double remaining = length() - progress_;
+  if (goal_distance <= config_.goal_tolerance && remaining <= config_.lookahead)
+  {
+    done_ = true;
+    return false;
+  }
+
+  if (x_.size() > 1)
+  {
+    advanceClosest(pose.x, pose.y);
+    remaining = length() - progress_;
+  }
+
+  // Slow down over the last lookahead meters. The remaining path length
+  // counts too, or a closed path, ending where it starts, never starts.
+  double speed = config_.linear_velocity *
+                 std::min(1.0, std::max(goal_distance, remaining) / std::max(config_.lookahead, 1e-3));
+  double cos_yaw = std::cos(pose.theta);
+  double sin_yaw = std::sin(pose.theta);
+
+  if (config_.mode == Pheeno::FOLLOW_STANLEY && x_.size() > 1 && remaining > 1e-6)
+  {
+    double heading_error = heading_[closest_] - pose.theta;
+    heading_error = std::atan2(std::sin(heading_error), std::cos(heading_error));
+    double steer = heading_error + std::atan2(-config_.stanley_gain * cross_track_error_, speed + 1e-3);
+    angular = std::max(-config_.max_angular, std::min(config_.max_angular, config_.heading_gain * steer));
+    linear = speed * std::max(0.0, std::cos(heading_error));
+    return true;
+  }
+
+  // Pure pursuit (also the final approach in Stanley mode)
+  double target_x;
+  double target_y;
+  pointAt(std::min(progress_ + config_.lookahead, length()), target_x, target_y);
+  double dx = target_x - pose.x;
+  double dy = target_y - pose.y;
+  double local_x = cos_yaw * dx + sin_yaw * dy;
+  double local_y = -sin_yaw * dx + cos_yaw * dy;
+  double distance_squared = local_x * local_x + local_y * local_y;
+  if (distance_squared < 1e-12)
+  {
+    return true;
+  }
+
+  if (local_x <= 0.0)
+  {
+    // Target behind: turn in place toward it.
+    angular = local_y >= 0.0 ? config_.max_angular : -config_.max_angular;
+    return true;
+  }
+
+  double curvature = 2.0 * local_y / distance_squared;
+  linear = speed;
+  angular = speed * curvature;
+  if (std::abs(angular) > config_.max_angular)
+  {
+    // Keep the arc, slowing down to turn at the limit.
+    angular = angular > 0.0 ? config_.max_angular : -config_.max_angular;
+    linear = config_.max_angular / std::abs(curvature);
+  }
+  return true;
+}
+
+/*
+ * Precomputes the arc length and direction lookups of the polyline.
+ */
+void PathFollower::finishPath()
+{
+  std::size_t count = x_.size();
+  s_.assign(count, 0.0);
+  heading_.assign(count, 0.0);
+  inverse_length_.assign(count, 0.0);
+  for (std::size_t i = 0; i + 1 < count; i++)
+  {
+    double dx = x_[i + 1] - x_[i];
+    double dy = y_[i + 1] - y_[i];
+    double length = std::hypot(dx, dy);
+    s_[i + 1] = s_[i] + length;
+    heading_[i] = std::atan2(dy, dx);
+    inverse_length_[i] = 1.0 / length;
+  }
+  if (count > 1)
+  {
+    heading_[count - 1] = heading_[count - 2];
+  }
+}
+
+/*
+ * Moves the closest point forward to the nearest point on the segments
+ * within search_window meters ahead of it.
+ */
+void PathFollower::advanceClosest(double px, double py)
+{
+  std::size_t segments = x_.size() - 1;
+  std::size_t first = closest_;
+  double limit = progress_ + config_.search_window;
+  double best_distance = -1.0;
+  for (std::size_t i = first; i < segments && (i == first || s_[i] <= limit); i++)
+  {
+    double dx = x_[i + 1] - x_[i];
+    double dy = y_[i + 1] - y_[i];
+    double t = ((px - x_[i]) * dx + (py - y_[i]) * dy) * inverse_length_[i] * inverse_length_[i];
+    t = std::max(0.0, std::min(1.0, t));
+    double ex = px - (x_[i] + t * dx);
+    double ey = py - (y_[i] + t * dy);
+    double distance = ex * ex + ey * ey;
+    if (best_distance < 0.0 || distance < best_distance)
+    {
+      best_distance = distance;
+      closest_ = i;
+      progress_ = s_[i] + t * (s_[i + 1] - s_[i]);
+
+      // Signed distance, positive to the left of the segment
+      cross_track_error_ = (dx * (py - y_[i]) - dy * (px - x_[i])) * inverse_length_[i];
+    }
+  }
+}
+
+/*
+ * Point s meters along the path, found by moving the lookahead segment
+ * forward.
+ */
+void PathFollower::pointAt(double s, double& px, double& py)
+{
+  if (x_.size() == 1)
+  {
+    px = x_[0];
+    py = y_[0];
+    return;
+  }
+
+  std::size_t segments = x_.size() - 1;
+  lookahead_ = std::max(lookahead_, closest_);
+  while (lookahead_ + 1 < segments && s_[lookahead_ + 1] < s)
+  {
+    lookahead_++;
+  }
+
+  double t = std::max(0.0, std::min(1.0, (s - s_[lookahead_]) * inverse_length_[lookahead_]));
+  px = x_[lookahead_] + t * (x_[lookahead_ + 1] - x_[lookahead_]);
+  py = y_[lookahead_] + t * (y_[lookahead_ + 1] - y_[lookahead_]);
+}
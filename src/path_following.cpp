@@ -0,0 +1,123 @@
+#include "ros/ros.h"
+#include "geometry_msgs/Twist.h"
+#include "nav_msgs/Path.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/path_follower.h"
+#include "pheeno_ros/pheeno_robot.h"
+#include "pheeno_ros/pose2d.h"
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Holds the latest path from the <pheeno>/path topic.
+ */
+struct PathListener
+{
+  PathListener() : received(false) {}
+
+  void callback(const nav_msgs::Path::ConstPtr& msg)
+  {
+    points.resize(msg->poses.size());
+    for (std::size_t i = 0; i < msg->poses.size(); i++)
+    {
+      points[i] = Pose2D(msg->poses[i].pose.position.x, msg->poses[i].pose.position.y);
+    }
+    received = true;
+  }
+
+  bool received;
+  std::vector<Pose2D> points;
+};
+
+int main(int argc, char **argv)
+{
+  // Initial Variables
+  std::string pheeno_name;
+
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+
+  // Parse input arguments for Pheeno name.
+  if (cml_parser["-n"])
+  {
+    std::string pheeno_number = cml_parser("-n");
+    pheeno_name = "/pheeno_" + pheeno_number;
+  }
+  else
+  {
+    ROS_ERROR("Need to provide Pheeno number!");
+  }
+
+  // -s follows with the Stanley controller instead of pure pursuit, -c
+  // treats the path poses as spline control points, and -l sets the
+  // lookahead in meters.
+  PathFollower::Config config;
+  if (cml_parser["-s"])
+  {
+    config.mode = Pheeno::FOLLOW_STANLEY;
+  }
+  if (cml_parser["-l"])
+  {
+    config.lookahead = std::atof(cml_parser("-l").c_str());
+  }
+  bool spline = cml_parser["-c"];
+
+  // Initializing ROS node
+  ros::init(argc, argv, "path_following_node");
+  ros::NodeHandle nh;
+
+  // Create PheenoRobot object (paths are in the odometry frame)
+  PheenoRobot pheeno(pheeno_name, Pheeno::IR_SENSORS | Pheeno::ODOM);
+
+  PathListener path;
+  ros::Subscriber sub_path = nh.subscribe(pheeno_name + "/path", 1, &PathListener::callback, &path);
+
+  PathFollower follower(config);
+
+  // Variables before loop
+  double range_to_avoid = 10.0;
+  double linear = 0.0;
+  double angular = 0.0;
+  geometry_msgs::Twist cmd_vel_msg;
+
+  while (ros::ok())
+  {
+    if (path.received) {
+      // A new path replaces the one being followed.
+      if (spline) {
+        follower.setSpline(path.points);
+      } else {
+        follower.setPath(path.points);
+      }
+      path.received = false;
+      ROS_INFO("Following a %.2f m path (%zu points).", follower.length(), follower.pointCount());
+    }
+
+    cmd_vel_msg.linear.x = 0.0;
+    cmd_vel_msg.angular.z = 0.0;
+
+    if (!pheeno.odomReceived() || !follower.hasPath() || follower.done()) {
+      // Nothing to do until there is a pose and a path.
+
+    } else if (pheeno.irSensorTriggered(range_to_avoid)) {
+      // Something on the path; fall back on reactive avoidance.
+      pheeno.avoidObstaclesLinear(linear, angular);
+      cmd_vel_msg.linear.x = linear;
+      cmd_vel_msg.angular.z = angular;
+
+    } else {
+      Pose2D pose(pheeno.odom_pose_position_[0], pheeno.odom_pose_position_[1], pheeno.odomYaw());
+      if (follower.update(pose, linear, angular)) {
+        cmd_vel_msg.linear.x = linear;
+        cmd_vel_msg.angular.z = angular;
+      } else {
+        ROS_INFO("Reached the end of the path.");
+      }
+    }
+
+    // Publish, Spin, and Sleep (at the adaptive control rate)
+    pheeno.publish(cmd_vel_msg);
+    ros::spinOnce();
+    pheeno.sleep();
+  }
+}
@@ -2,170 +2,1814 @@
 #include "std_msgs/Float32.h"
 #include "std_msgs/Int16.h"
 #include "geometry_msgs/Twist.h"
+#include "geometry_msgs/PoseArray.h"
+#include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "std_msgs/UInt8MultiArray.h"
 #include "nav_msgs/Odometry.h"
 #include "pheeno_ros/pheeno_robot.h"
+#include "pheeno_ros/avoidance_kernels.h"
+#include "pheeno_ros/flock_rules.h"
+#include "pheeno_ros/ir_query.h"
+#include "pheeno_ros/map_merger.h"
+#include "pheeno_ros/motion_monitor.h"
+#include "pheeno_ros/occupancy_grid.h"
+#include "pheeno_ros/orca.h"
+#include "pheeno_ros/particle_filter.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/pose_ekf.h"
+#include "pheeno_ros/range_rate.h"
+#include "pheeno_ros/sensor_frame.h"
 #include <vector>
 #include <complex>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+  // Encoder silence (s) after which cmd_vel falls back to open loop.
+  const double WHEEL_FEEDBACK_TIMEOUT = 0.25;
+
+  // Parameter and log names of the PheenoRobot transport channels.
+  const char* CHANNEL_NAMES[Pheeno::CHANNEL_COUNT] = {
+    "ir", "ir_bottom", "odom", "encoders", "imu", "sensor_sweep", "cmd_vel"
+  };
+
+  // Sensor groups carried by each channel (cmd_vel carries none).
+  const unsigned int CHANNEL_SENSORS[Pheeno::CHANNEL_COUNT] = {
+    Pheeno::IR_SENSORS, Pheeno::IR_BOTTOM, Pheeno::ODOM, Pheeno::ENCODERS,
+    Pheeno::IMU, Pheeno::SENSOR_SWEEP, Pheeno::NO_SENSORS
+  };
+
+  double quaternionYaw(double qx, double qy, double qz, double qw)
+  {
+    return std::atan2(2.0 * (qw * qz + qx * qy), 1.0 - 2.0 * (qy * qy + qz * qz));
+  }
+}
+
+/*
+ * Contructor for the PheenoRobot Class.
+ *
+ * The class constructor fills all std::vector variables with zeros
+ * for use by the setters. Publishers and Subscribers are formally
+ * defined as well. IR and encoder counts and topics come from the
+ * Pheeno::Hardware descriptor this package was built for. Only the
+ * sensor groups in `sensors` (a Pheeno::SENSOR bitmask) are subscribed,
+ * so a behavior pays for the topics it reads. Each channel's transport
+ * is read from ~transport/<channel>/ parameters.
+ *
+ */
+PheenoRobot::PheenoRobot(std::string pheeno_name, unsigned int sensors)
+  : sensor_sweep_count_(0), sensor_sweep_dropped_(0), enabled_sensors_(Pheeno::NO_SENSORS),
+    behavior_slot_(-1), last_command_slot_(CommandArbiter::NO_COMMAND), wheel_control_enabled_(false),
+    wheel_control_idle_(true), fresh_encoders_(0), wheel_odometry_reference_(false), wheel_odometry_stamp_(0.0),
+    ekf_enabled_(false), ekf_magnetometer_(false), ekf_odom_twist_(false), motion_monitor_enabled_(false), virtual_obstacle_range_(5.0),
+    mapping_enabled_(false), odom_received_(false),
+    map_sharing_enabled_(false), map_delta_budget_(0), map_refresh_tiles_(0), localization_enabled_(false), localized_(false), localization_odom_valid_(false),
+    fleet_joined_(false), orca_enabled_(false), flocking_enabled_(false), adaptive_rate_enabled_(false),
+    control_rate_(10.0), closest_range_(std::numeric_limits<double>::infinity()),
+    time_to_collision_(-1.0), last_sweep_sequence_(0)
+{
+  ROS_INFO("Creating Pheeno Robot.");
+  pheeno_namespace_id_ = pheeno_name;
+
+  // IR and encoder arrays are sized by the hardware descriptor.
+  ir_sensor_vals_.fill(0);
+  encoder_vals_.fill(0);
+
+  for (std::size_t i = 0; i < sub_ir_.size(); i++)
+  {
+    sub_ir_[i].robot = this;
+    sub_ir_[i].index = i;
+    sub_ir_[i].method = &PheenoRobot::irSensorCallback;
+  }
+
+  for (std::size_t i = 0; i < sub_encoder_.size(); i++)
+  {
+    sub_encoder_[i].robot = this;
+    sub_encoder_[i].index = i;
+    sub_encoder_[i].method = &PheenoRobot::encoderCallback;
+  }
+
+  // Create sensor vector upon construction. (3 placements)
+  for (int i = 0; i < 3; i++)
+  {
+    odom_pose_position_.push_back(0);
+    odom_twist_linear_.push_back(0);
+    odom_twist_angular_.push_back(0);
+
+    magnetometer_vals_.push_back(0);
+    gyroscope_vals_.push_back(0);
+    accelerometer_vals_.push_back(0);
+  }
+
+  // Create sensor vector upon construction. (4 placements)
+  for (int i = 0; i < 4; i++)
+  {
+    odom_pose_orient_.push_back(0);
+  }
+
+  // Transport configuration for every channel
+  loadChannelTransport();
+
+  // Sensor Subscribers (only the groups this behavior asked for)
+  enableSensors(sensors);
+
+  // cmd_vel Publisher (queue of one: a slow link drops stale commands)
+  pub_cmd_vel_ = nh_.advertise<geometry_msgs::Twist>(
+      pheeno_name + "/cmd_vel", channel_transport_[Pheeno::CMD_VEL_CHANNEL].queue_size);
+
+  // Command arbiter. publish() feeds the behavior slot; other controllers
+  // add their own slots with addCommandSlot().
+  ros::NodeHandle private_nh("~");
+  double control_rate;
+  double behavior_timeout;
+  private_nh.param("control_rate", control_rate, 10.0);
+  private_nh.param("behavior_timeout", behavior_timeout, 0.5);
+  behavior_slot_ = command_arbiter_.addSlot("behavior", 0, behavior_timeout);
+  control_rate_ = std::max(control_rate, 1.0);
+  command_timer_ = nh_.createTimer(ros::Duration(1.0 / control_rate_),
+                                   &PheenoRobot::commandTimerCallback, this);
+
+  // Behavior tunables as ~behavior/<name> (the names of behaviorParamName),
+  // so behavior_optimizer and sweep results can be deployed to the nodes.
+  for (std::size_t i = 0; Pheeno::behaviorParamName(i) != NULL; i++)
+  {
+    double* value = Pheeno::behaviorParam(behavior_params_, Pheeno::behaviorParamName(i));
+    private_nh.param(std::string("behavior/") + Pheeno::behaviorParamName(i), *value, *value);
+  }
+
+  // Adaptive control rate (opt in with ~adaptive_rate/enabled). The fixed
+  // ~control_rate is used while it is disabled.
+  AdaptiveRate::Bounds bounds;
+  bool adaptive;
+  private_nh.param("adaptive_rate/enabled", adaptive, false);
+  private_nh.param("adaptive_rate/min_rate", bounds.min_rate, bounds.min_rate);
+  private_nh.param("adaptive_rate/max_rate", bounds.max_rate, bounds.max_rate);
+  private_nh.param("adaptive_rate/near_range", bounds.near_range, bounds.near_range);
+  private_nh.param("adaptive_rate/far_range", bounds.far_range, bounds.far_range);
+  private_nh.param("adaptive_rate/near_ttc", bounds.near_ttc, bounds.near_ttc);
+  private_nh.param("adaptive_rate/far_ttc", bounds.far_ttc, bounds.far_ttc);
+  private_nh.param("adaptive_rate/decay", bounds.decay, bounds.decay);
+  setAdaptiveRate(adaptive, bounds);
+
+  // Closed-loop wheel speed control (subscribes to the encoders when enabled)
+  WheelController::Gains gains;
+  bool wheel_control;
+  private_nh.param("wheel_control/enabled", wheel_control, false);
+  private_nh.param("wheel_control/kp", gains.kp, gains.kp);
+  private_nh.param("wheel_control/ki", gains.ki, gains.ki);
+  private_nh.param("wheel_control/kff", gains.kff, gains.kff);
+  private_nh.param("wheel_control/max_speed", gains.max_speed, gains.max_speed);
+  private_nh.param("wheel_control/filter", gains.filter, gains.filter);
+  if (wheel_control)
+  {
+    enableSensors(Pheeno::ENCODERS);
+  }
+  setWheelControl(wheel_control, gains);
+
+  // Pose EKF. Fuses the encoders, the gyroscope, the magnetometer (unless
+  // ~ekf/magnetometer is false) and, with ~ekf/visual_odometry, camera
+  // ego-motion from <pheeno>/visual_odom into the odometry pose. With
+  // ~ekf/odom_twist the twist on <pheeno>/odom (Gazebo, sim_bridge) is the
+  // wheel odometry instead of the encoders; never both, since they measure
+  // the same motion.
+  bool ekf;
+  bool visual_odometry;
+  double ekf_rate;
+  PoseEkf::Config ekf_config;
+  private_nh.param("ekf/enabled", ekf, false);
+  private_nh.param("ekf/magnetometer", ekf_magnetometer_, true);
+  private_nh.param("ekf/visual_odometry", visual_odometry, false);
+  private_nh.param("ekf/odom_twist", ekf_odom_twist_, false);
+  private_nh.param("ekf/rate", ekf_rate, 50.0);
+  private_nh.param("ekf/frame_id", ekf_frame_id_, std::string("odom"));
+  private_nh.param("ekf/acceleration_noise", ekf_config.acceleration_noise, ekf_config.acceleration_noise);
+  private_nh.param("ekf/angular_acceleration_noise", ekf_config.angular_acceleration_noise, ekf_config.angular_acceleration_noise);
+  private_nh.param("ekf/gyro_bias_noise", ekf_config.gyro_bias_noise, ekf_config.gyro_bias_noise);
+  private_nh.param("ekf/wheel_linear_noise", ekf_config.wheel_linear_noise, ekf_config.wheel_linear_noise);
+  private_nh.param("ekf/wheel_angular_noise", ekf_config.wheel_angular_noise, ekf_config.wheel_angular_noise);
+  private_nh.param("ekf/gyro_noise", ekf_config.gyro_noise, ekf_config.gyro_noise);
+  private_nh.param("ekf/magnetometer_noise", ekf_config.magnetometer_noise, ekf_config.magnetometer_noise);
+  private_nh.param("ekf/magnetometer_offset", ekf_config.magnetometer_offset, ekf_config.magnetometer_offset);
+  private_nh.param("ekf/visual_linear_noise", ekf_config.visual_linear_noise, ekf_config.visual_linear_noise);
+  private_nh.param("ekf/visual_angular_noise", ekf_config.visual_angular_noise, ekf_config.visual_angular_noise);
+  private_nh.param("ekf/gate", ekf_config.gate, ekf_config.gate);
+  private_nh.param("ekf/max_delay", ekf_config.max_delay, ekf_config.max_delay);
+
+  // An absolute heading source leaves the start heading free.
+  ekf_config.initial_yaw_noise = ekf_magnetometer_ ? 3.14159265 : 0.0;
+  private_nh.param("ekf/initial_yaw_noise", ekf_config.initial_yaw_noise, ekf_config.initial_yaw_noise);
+  pose_ekf_ = PoseEkf(ekf_config);
+
+  if (ekf)
+  {
+    pub_fused_odom_ = nh_.advertise<nav_msgs::Odometry>(pheeno_name + "/odom_fused", 10);
+    ekf_timer_ = nh_.createTimer(ros::Duration(1.0 / std::max(ekf_rate, 0.1)), &PheenoRobot::ekfTimerCallback, this);
+    if (visual_odometry)
+    {
+      sub_visual_odom_ = nh_.subscribe(pheeno_name + "/visual_odom", 10, &PheenoRobot::visualOdomCallback, this);
+    }
+    enableSensors(ekfSensors());
+    setPoseEkf(true);
+  }
+
+  // Slip, stall and impact detection. Events put a virtual obstacle
+  // ~motion_monitor/virtual_range cm from the IR sensor facing it.
+  bool motion_monitor;
+  MotionMonitor::Config monitor_config;
+  private_nh.param("motion_monitor/enabled", motion_monitor, false);
+  private_nh.param("motion_monitor/virtual_range", virtual_obstacle_range_, 5.0);
+  private_nh.param("motion_monitor/slip_yaw_rate", monitor_config.slip_yaw_rate, monitor_config.slip_yaw_rate);
+  private_nh.param("motion_monitor/slip_speed", monitor_config.slip_speed, monitor_config.slip_speed);
+  private_nh.param("motion_monitor/stall_time", monitor_config.stall_time, monitor_config.stall_time);
+  private_nh.param("motion_monitor/impact_acceleration", monitor_config.impact_acceleration, monitor_config.impact_acceleration);
+  private_nh.param("motion_monitor/hold_time", monitor_config.hold_time, monitor_config.hold_time);
+  motion_monitor_ = MotionMonitor(monitor_config);
+  if (motion_monitor)
+  {
+    enableSensors(Pheeno::ENCODERS | Pheeno::GYROSCOPE | Pheeno::ACCELEROMETER);
+    setMotionMonitor(true);
+  }
+
+  // Occupancy grid mapping (square map centered on the odometry origin)
+  bool mapping;
+  double map_size;
+  double delta_period;
+  double full_period;
+  double max_rate;
+  int refresh_tiles;
+  TiledOccupancyGrid::Config map_config;
+  private_nh.param("map/enabled", mapping, false);
+  private_nh.param("map/resolution", map_config.resolution, map_config.resolution);
+  private_nh.param("map/size", map_size, 10.24);
+  private_nh.param("map/delta_period", delta_period, 1.0);
+  private_nh.param("map/full_period", full_period, 5.0);
+  private_nh.param("map/frame_id", map_frame_id_, std::string("odom"));
+  private_nh.param("map/max_rate", max_rate, 2048.0);
+  private_nh.param("map/refresh_tiles", refresh_tiles, 1);
+  map_config.width = map_config.height = static_cast<int>(std::ceil(map_size / std::max(map_config.resolution, 1e-3)));
+  map_config.origin_x = map_config.origin_y = -map_size / 2.0;
+  if (!map_.configure(map_config))
+  {
+    ROS_ERROR("Map of %.2f m at %.3f m/cell exceeds %lu bytes. Using the default map.",
+              map_size, map_config.resolution, static_cast<unsigned long>(Pheeno::MAP_MAX_BYTES));
+  }
+
+  // Deltas stay under ~map/max_rate bytes/s (0 for no limit). A few
+  // unchanged tiles are resent with each delta so peers that missed one, or
+  // joined late, catch up.
+  delta_period = std::max(delta_period, 0.05);
+  map_delta_budget_ = max_rate > 0 ? static_cast<std::size_t>(std::max(max_rate * delta_period, 1.0)) : 0;
+  map_refresh_tiles_ = static_cast<std::size_t>(std::max(refresh_tiles, 0));
+
+  if (mapping)
+  {
+    pub_map_delta_ = nh_.advertise<std_msgs::UInt8MultiArray>(pheeno_name + "/map_delta", 10);
+    map_delta_timer_ = nh_.createTimer(ros::Duration(delta_period),
+                                       &PheenoRobot::mapDeltaTimerCallback, this);
+    if (full_period > 0)
+    {
+      pub_map_ = nh_.advertise<nav_msgs::OccupancyGrid>(pheeno_name + "/map", 1, true);
+      map_timer_ = nh_.createTimer(ros::Duration(full_period), &PheenoRobot::mapTimerCallback, this);
+    }
+    enableSensors(Pheeno::IR_SENSORS | Pheeno::ODOM);
+    setMapping(true);
+  }
+
+  // Map sharing. Each peer in ~map/share/peers (a Pheeno name such as
+  // "pheeno_02") has an x, y, yaw triple in ~map/share/transforms placing
+  // its map frame in this robot's map frame.
+  bool sharing;
+  std::vector<std::string> peers;
+  std::vector<double> transforms;
+  private_nh.param("map/share/enabled", sharing, false);
+  private_nh.param("map/share/peers", peers, std::vector<std::string>());
+  private_nh.param("map/share/transforms", transforms, std::vector<double>());
+  if (mapping && sharing)
+  {
+    if (transforms.size() != 3 * peers.size())
+    {
+      ROS_WARN("~map/share/transforms needs x, y, yaw for each of the %lu peers. Using identity transforms.",
+               static_cast<unsigned long>(peers.size()));
+      transforms.assign(3 * peers.size(), 0.0);
+    }
+
+    map_merger_.configure(map_.config());
+    map_merger_.addSource();  // This robot
+
+    // Sized up front: the subscriptions hold pointers into the vector.
+    sub_peer_map_delta_.resize(peers.size());
+    for (std::size_t i = 0; i < peers.size(); i++)
+    {
+      map_merger_.addSource(Pose2D(transforms[3 * i], transforms[3 * i + 1], transforms[3 * i + 2]));
+      sub_peer_map_delta_[i].robot = this;
+      sub_peer_map_delta_[i].index = i;
+      sub_peer_map_delta_[i].method = &PheenoRobot::peerMapDeltaCallback;
+      sub_peer_map_delta_[i].subscriber = nh_.subscribe(
+          "/" + peers[i] + "/map_delta", 10,
+          &IndexedSubscription<std_msgs::UInt8MultiArray>::callback, &sub_peer_map_delta_[i]);
+    }
+
+    if (full_period > 0)
+    {
+      pub_merged_map_ = nh_.advertise<nav_msgs::OccupancyGrid>(pheeno_name + "/merged_map", 1, true);
+    }
+    map_sharing_enabled_ = true;
+  }
+
+  // Monte Carlo localization against a static arena map (nav_msgs/OccupancyGrid)
+  bool localization;
+  double localization_rate;
+  std::string arena_map_topic;
+  ParticleFilter::Config filter_config;
+  private_nh.param("localization/enabled", localization, false);
+  private_nh.param("localization/map_topic", arena_map_topic, std::string("/map"));
+  private_nh.param("localization/frame_id", localization_frame_id_, std::string("map"));
+  private_nh.param("localization/rate", localization_rate, 10.0);
+  private_nh.param("localization/min_particles", filter_config.min_particles, filter_config.min_particles);
+  private_nh.param("localization/max_particles", filter_config.max_particles, filter_config.max_particles);
+  private_nh.param("localization/kld_error", filter_config.kld_error, filter_config.kld_error);
+  private_nh.param("localization/sigma_hit", filter_config.sigma_hit, filter_config.sigma_hit);
+  private_nh.param("localization/z_hit", filter_config.z_hit, filter_config.z_hit);
+  private_nh.param("localization/z_rand", filter_config.z_rand, filter_config.z_rand);
+  private_nh.param("localization/converged_xy", filter_config.converged_xy, filter_config.converged_xy);
+  private_nh.param("localization/converged_yaw", filter_config.converged_theta, filter_config.converged_theta);
+  private_nh.param("localization/update_distance", localization_update_distance_, 0.02);
+  private_nh.param("localization/update_angle", localization_update_angle_, 0.05);
+  private_nh.param("localization/global", global_localization_, false);
+  private_nh.param("localization/initial_x", initial_pose_.x, 0.0);
+  private_nh.param("localization/initial_y", initial_pose_.y, 0.0);
+  private_nh.param("localization/initial_yaw", initial_pose_.theta, 0.0);
+  private_nh.param("localization/initial_spread", initial_spread_, 0.1);
+  private_nh.param("localization/initial_spread_yaw", initial_spread_yaw_, 0.3);
+  particle_filter_ = ParticleFilter(filter_config);
+
+  if (localization)
+  {
+    sub_arena_map_ = nh_.subscribe(arena_map_topic, 1, &PheenoRobot::arenaMapCallback, this);
+    sub_initial_pose_ = nh_.subscribe(pheeno_name + "/initialpose", 1, &PheenoRobot::initialPoseCallback, this);
+    pub_localized_pose_ = nh_.advertise<geometry_msgs::PoseWithCovarianceStamped>(pheeno_name + "/localized_pose", 10);
+    pub_particles_ = nh_.advertise<geometry_msgs::PoseArray>(pheeno_name + "/particles", 1);
+    localization_timer_ = nh_.createTimer(ros::Duration(1.0 / std::max(localization_rate, 0.1)),
+                                          &PheenoRobot::localizationTimerCallback, this);
+    enableSensors(Pheeno::IR_SENSORS | Pheeno::ODOM);
+    setLocalization(true);
+  }
+
+  // Fleet state sharing. Robots using ORCA or flocking share their pose and
+  // velocity on ~fleet/topic and react to the neighbors heard there.
+  private_nh.param("fleet/topic", fleet_topic_, std::string("/fleet_state"));
+  private_nh.param("fleet/rate", fleet_rate_, 10.0);
+  private_nh.param("fleet/timeout", fleet_timeout_, 1.0);
+  private_nh.param("fleet/heading_gain", fleet_heading_gain_, 2.0);
+  private_nh.param("fleet/max_angular", fleet_max_angular_, 1.2);
+
+  // Unlocalized robots share odometry poses. Each robot's odometry starts
+  // at its own origin, so the frame is per robot unless
+  // ~fleet/shared_odom_frame says the odometry frames coincide (Gazebo or
+  // sim_bridge ground truth). ORCA and flocking need one of the two; see
+  // joinFleet().
+  private_nh.param("fleet/shared_odom_frame", fleet_shared_odom_frame_, false);
+  fleet_odom_frame_id_ = map_frame_id_;
+  if (!fleet_shared_odom_frame_)
+  {
+    std::string robot_frame = pheeno_name;
+    robot_frame.erase(0, robot_frame.find_first_not_of('/'));
+    fleet_odom_frame_id_ = robot_frame + "/" + map_frame_id_;
+  }
+
+  // ORCA collision avoidance between robots (adjusts every published command)
+  bool orca;
+  int max_neighbors;
+  OrcaSolver::Config orca_config;
+  private_nh.param("orca/enabled", orca, false);
+  private_nh.param("orca/radius", orca_radius_, 0.07);
+  private_nh.param("orca/max_speed", orca_max_speed_, 0.15);
+  private_nh.param("orca/time_horizon", orca_config.time_horizon, orca_config.time_horizon);
+  private_nh.param("orca/neighbor_distance", orca_config.neighbor_distance, orca_config.neighbor_distance);
+  private_nh.param("orca/max_neighbors", max_neighbors, static_cast<int>(orca_config.max_neighbors));
+  orca_config.max_neighbors = static_cast<std::size_t>(std::max(max_neighbors, 1));
+  orca_solver_ = OrcaSolver(orca_config);
+  if (orca)
+  {
+    enableSensors(Pheeno::ODOM);
+    setOrca(true);
+  }
+
+  // Flocking, aggregation or dispersion (~flocking/mode) for flock(). The
+  // mode picks the preset weights; the other parameters override them.
+  bool flocking;
+  std::string flock_mode_name;
+  Pheeno::FLOCK_MODE flock_mode = Pheeno::FLOCK_FLOCK;
+  private_nh.param("flocking/enabled", flocking, false);
+  private_nh.param("flocking/mode", flock_mode_name, std::string("flock"));
+  if (!FlockRules::parseMode(flock_mode_name, flock_mode))
+  {
+    ROS_WARN("Unknown ~flocking/mode '%s'. Using flock.", flock_mode_name.c_str());
+  }
+  FlockRules::Config flock_config = FlockRules::preset(flock_mode);
+  private_nh.param("flocking/separation", flock_config.separation, flock_config.separation);
+  private_nh.param("flocking/alignment", flock_config.alignment, flock_config.alignment);
+  private_nh.param("flocking/cohesion", flock_config.cohesion, flock_config.cohesion);
+  private_nh.param("flocking/separation_distance", flock_config.separation_distance, flock_config.separation_distance);
+  private_nh.param("flocking/neighbor_distance", flock_config.neighbor_distance, flock_config.neighbor_distance);
+  private_nh.param("flocking/inertia", flock_config.inertia, flock_config.inertia);
+  private_nh.param("flocking/min_speed", flock_config.min_speed, flock_config.min_speed);
+  private_nh.param("flocking/max_speed", flock_config.max_speed, flock_config.max_speed);
+  setFlockRules(flock_config);
+  if (flocking)
+  {
+    enableSensors(Pheeno::ODOM);
+    setFlocking(true);
+  }
+
+  // Control loop diagnostics (1 Hz)
+  pub_diagnostics_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  diagnostics_timer_ = nh_.createTimer(ros::Duration(1.0), &PheenoRobot::diagnosticsTimerCallback, this);
+
+  // Periodic latency report (disabled unless ~latency_report_period > 0)
+  double report_period;
+  private_nh.param("latency_report_period", report_period, 0.0);
+  if (report_period > 0)
+  {
+    latency_report_timer_ = nh_.createTimer(ros::Duration(report_period),
+                                             &PheenoRobot::latencyReportCallback, this);
+  }
+
+}
+
+/*
+ * Subscribes to the given sensor groups (Pheeno::SENSOR bitmask). Groups
+ * that are already subscribed are left untouched.
+ */
+void PheenoRobot::enableSensors(unsigned int sensors)
+{
+  sensors &= ~enabled_sensors_;
+  std::string pheeno_name = pheeno_namespace_id_;
+
+  // IR Sensor Subscribers
+  if (sensors & Pheeno::IR_SENSORS)
+  {
+    const ChannelTransport& ir = channel_transport_[Pheeno::IR_CHANNEL];
+    for (std::size_t i = 0; i < sub_ir_.size(); i++)
+    {
+      sub_ir_[i].subscriber = nh_.subscribe(
+          pheeno_name + "/" + Pheeno::Hardware::irTopic(i), ir.queue_size,
+          &IndexedSubscription<std_msgs::Float32>::callback, &sub_ir_[i], ir.hints());
+    }
+  }
+
+  if (sensors & Pheeno::IR_BOTTOM)
+  {
+    const ChannelTransport& bottom = channel_transport_[Pheeno::IR_BOTTOM_CHANNEL];
+    sub_ir_bottom_ = nh_.subscribe(pheeno_name + "/scan_bottom", bottom.queue_size,
+                                   &PheenoRobot::irSensorBottomCallback, this, bottom.hints());
+  }
+
+  // Odom Subscriber
+  if (sensors & Pheeno::ODOM)
+  {
+    const ChannelTransport& odom = channel_transport_[Pheeno::ODOM_CHANNEL];
+    sub_odom_ = nh_.subscribe(pheeno_name + "/odom", odom.queue_size,
+                              &PheenoRobot::odomCallback, this, odom.hints());
+  }
+
+  // Encoder Subscribers
+  if (sensors & Pheeno::ENCODERS)
+  {
+    const ChannelTransport& encoder = channel_transport_[Pheeno::ENCODER_CHANNEL];
+    for (std::size_t i = 0; i < sub_encoder_.size(); i++)
+    {
+      sub_encoder_[i].subscriber = nh_.subscribe(
+          pheeno_name + "/" + Pheeno::Hardware::encoderTopic(i), encoder.queue_size,
+          &IndexedSubscription<std_msgs::Int16>::callback, &sub_encoder_[i], encoder.hints());
+    }
+  }
+
+  // Magnetometer, Gyroscope, Accelerometer Subscriber
+  const ChannelTransport& imu = channel_transport_[Pheeno::IMU_CHANNEL];
+  if (sensors & Pheeno::MAGNETOMETER)
+  {
+    sub_magnetometer_ = nh_.subscribe(pheeno_name + "/magnetometer", imu.queue_size,
+                                      &PheenoRobot::magnetometerCallback, this, imu.hints());
+  }
+
+  if (sensors & Pheeno::GYROSCOPE)
+  {
+    sub_gyroscope_ = nh_.subscribe(pheeno_name + "/gyroscope", imu.queue_size,
+                                   &PheenoRobot::gyroscopeCallback, this, imu.hints());
+  }
+
+  if (sensors & Pheeno::ACCELEROMETER)
+  {
+    sub_accelerometer_ = nh_.subscribe(pheeno_name + "/accelerometer", imu.queue_size,
+                                       &PheenoRobot::accelerometerCallback, this, imu.hints());
+  }
+
+  // Packed Sensor Sweep Subscriber (serial_bridge -f)
+  if (sensors & Pheeno::SENSOR_SWEEP)
+  {
+    const ChannelTransport& sweep = channel_transport_[Pheeno::SENSOR_SWEEP_CHANNEL];
+    sub_sensor_sweep_ = nh_.subscribe(pheeno_name + "/sensor_sweep", sweep.queue_size,
+                                      &PheenoRobot::sensorSweepCallback, this, sweep.hints());
+  }
+
+  enabled_sensors_ |= sensors;
+}
+
+/*
+ * Unsubscribes from the given sensor groups. Their last values are kept.
+ */
+void PheenoRobot::disableSensors(unsigned int sensors)
+{
+  sensors &= enabled_sensors_;
+
+  if (sensors & Pheeno::IR_SENSORS)
+  {
+    for (std::size_t i = 0; i < sub_ir_.size(); i++)
+    {
+      sub_ir_[i].subscriber.shutdown();
+    }
+  }
+
+  if (sensors & Pheeno::IR_BOTTOM)
+  {
+    sub_ir_bottom_.shutdown();
+  }
+
+  if (sensors & Pheeno::ODOM)
+  {
+    sub_odom_.shutdown();
+  }
+
+  if (sensors & Pheeno::ENCODERS)
+  {
+    for (std::size_t i = 0; i < sub_encoder_.size(); i++)
+    {
+      sub_encoder_[i].subscriber.shutdown();
+    }
+  }
+
+  if (sensors & Pheeno::MAGNETOMETER)
+  {
+    sub_magnetometer_.shutdown();
+  }
+
+  if (sensors & Pheeno::GYROSCOPE)
+  {
+    sub_gyroscope_.shutdown();
+  }
+
+  if (sensors & Pheeno::ACCELEROMETER)
+  {
+    sub_accelerometer_.shutdown();
+  }
+
+  if (sensors & Pheeno::SENSOR_SWEEP)
+  {
+    sub_sensor_sweep_.shutdown();
+  }
+
+  enabled_sensors_ &= ~sensors;
+}
+
+/*
+ * Lazily subscribes to sensor groups a method depends on but the behavior
+ * did not request at construction. Values read before the first message
+ * arrives are still zero, so this is warned about once.
+ *
+ * A packed sensor sweep carries every sensor, but enabling SENSOR_SWEEP
+ * only says the bridge may send sweeps (serial_bridge -f). The individual
+ * topics are skipped only once a sweep has actually arrived; the bridges
+ * publish one form or the other, so subscribing to both is harmless.
+ */
+void PheenoRobot::requireSensors(unsigned int sensors, const char* user)
+{
+  if ((sensors & ~enabled_sensors_) == 0 || sensor_sweep_count_ > 0)
+  {
+    return;
+  }
+
+  if (enabled_sensors_ & Pheeno::SENSOR_SWEEP)
+  {
+    ROS_INFO("%s: no sensor sweep received yet. Also subscribing to the individual sensor topics.", user);
+  }
+  else
+  {
+    ROS_WARN("%s needs sensors that were not enabled at construction. Subscribing now.", user);
+  }
+  enableSensors(sensors);
+}
+
+/*
+ * Sets up the default channel transports and overrides them from the
+ * ~transport/<channel>/{queue_size,tcp_no_delay,unreliable} parameters.
+ *
+ * Defaults are chosen for latency: every queue holds only the newest
+ * message, TCP_NODELAY is on, and the high-rate IR, encoder, IMU and sweep
+ * channels prefer UDPROS (falling back to TCPROS for rospy publishers).
+ */
+void PheenoRobot::loadChannelTransport()
+{
+  channel_transport_[Pheeno::IR_CHANNEL] = ChannelTransport(1, true, true);
+  channel_transport_[Pheeno::IR_BOTTOM_CHANNEL] = ChannelTransport(1, true, false);
+  channel_transport_[Pheeno::ODOM_CHANNEL] = ChannelTransport(1, true, false);
+  channel_transport_[Pheeno::ENCODER_CHANNEL] = ChannelTransport(1, true, true);
+  channel_transport_[Pheeno::IMU_CHANNEL] = ChannelTransport(1, true, true);
+  channel_transport_[Pheeno::SENSOR_SWEEP_CHANNEL] = ChannelTransport(1, true, true);
+  channel_transport_[Pheeno::CMD_VEL_CHANNEL] = ChannelTransport(1, true, false);
+
+  ros::NodeHandle private_nh("~");
+  for (int i = 0; i < Pheeno::CHANNEL_COUNT; i++)
+  {
+    std::string prefix = std::string("transport/") + CHANNEL_NAMES[i] + "/";
+    ChannelTransport& transport = channel_transport_[i];
+    int queue_size = static_cast<int>(transport.queue_size);
+
+    private_nh.param(prefix + "queue_size", queue_size, queue_size);
+    private_nh.param(prefix + "tcp_no_delay", transport.tcp_no_delay, transport.tcp_no_delay);
+    private_nh.param(prefix + "unreliable", transport.unreliable, transport.unreliable);
+    transport.queue_size = static_cast<uint32_t>(std::max(queue_size, 1));
+  }
+}
+
+/*
+ * Changes the transport of a channel at runtime. Subscriptions on the
+ * channel are recreated so the new settings take effect immediately.
+ */
+void PheenoRobot::setChannelTransport(Pheeno::CHANNEL channel, const ChannelTransport& transport)
+{
+  channel_transport_[channel] = transport;
+
+  if (channel == Pheeno::CMD_VEL_CHANNEL)
+  {
+    pub_cmd_vel_ = nh_.advertise<geometry_msgs::Twist>(pheeno_namespace_id_ + "/cmd_vel",
+                                                       transport.queue_size);
+    return;
+  }
+
+  unsigned int sensors = CHANNEL_SENSORS[channel] & enabled_sensors_;
+  disableSensors(sensors);
+  enableSensors(sensors);
+}
+
+/*
+ * Records how long a message waited between arriving at the subscriber and
+ * reaching its callback and, given the message's sensor stamp (s, 0 if it
+ * has none), how long it took from the sensor to the callback.
+ */
+void PheenoRobot::recordLatency(Pheeno::CHANNEL channel, const ros::Time& receipt_time, double stamp)
+{
+  ros::Time now = ros::Time::now();
+  channel_latency_[channel].record((now - receipt_time).toSec());
+  if (stamp > 0.0)
+  {
+    channel_end_to_end_[channel].record(now.toSec() - stamp);
+  }
+}
+
+/*
+ * Logs the latency statistics of every active channel together with its
+ * transport settings, then starts a new measurement window.
+ */
+void PheenoRobot::logLatency()
+{
+  for (int i = 0; i < Pheeno::CHANNEL_COUNT; i++)
+  {
+    LatencyStats& latency = channel_latency_[i];
+    if (latency.count == 0)
+    {
+      continue;
+    }
+
+    // The sweep is stamped on the Teensy clock, so its end-to-end delay is
+    // reported above the fastest sweep of the window.
+    LatencyStats& end_to_end = channel_end_to_end_[i];
+    double offset = (i == Pheeno::SENSOR_SWEEP_CHANNEL) ? end_to_end.min : 0.0;
+    char end_to_end_text[96] = "";
+    if (end_to_end.count > 0)
+    {
+      std::snprintf(end_to_end_text, sizeof(end_to_end_text), ", end-to-end%s mean %.2f ms, max %.2f ms",
+                    (i == Pheeno::SENSOR_SWEEP_CHANNEL) ? " above fastest" : "",
+                    (end_to_end.mean() - offset) * 1000.0, (end_to_end.max - offset) * 1000.0);
+    }
+
+    const ChannelTransport& transport = channel_transport_[i];
+    ROS_INFO("%s latency: %lu msgs, queue mean %.2f ms, max %.2f ms%s (queue %u%s%s)",
+             CHANNEL_NAMES[i], latency.count, latency.mean() * 1000.0, latency.max * 1000.0,
+             end_to_end_text, transport.queue_size, transport.tcp_no_delay ? ", nodelay" : "",
+             transport.unreliable ? ", udp" : "");
+    latency.reset();
+    end_to_end.reset();
+  }
+}
+
+/*
+ * Timer callback for the periodic latency report.
+ */
+void PheenoRobot::latencyReportCallback(const ros::TimerEvent& event)
+{
+  logLatency();
+}
+
+/*
+ * Publishes command velocity (cmd_vel) messages.
+ *
+ * The specific Topic name that the message is published to is defined
+ * in the Constructor for the PheenoRobot class. The command goes through
+ * the behavior slot of the command arbiter. When the behavior slot wins
+ * arbitration the command is sent right away; the command timer then
+ * repeats it every control period and handles the timeouts.
+ */
+void PheenoRobot::publish(geometry_msgs::Twist velocity)
+{
+  submitCommand(behavior_slot_, orca_enabled_ ? orcaVelocity(velocity) : velocity);
+  sendCommand(true);
+}
+
+/*
+ * Adds a command arbiter slot for another controller (teleop, swarm layer,
+ * ...). Higher priorities win; a slot drops out when its last command is
+ * older than timeout seconds. Returns the slot index for submitCommand().
+ */
+int PheenoRobot::addCommandSlot(const std::string& name, int priority, double timeout)
+{
+  int slot = command_arbiter_.addSlot(name, priority, timeout);
+  if (slot < 0)
+  {
+    ROS_ERROR("No free command slot for %s.", name.c_str());
+  }
+  return slot;
+}
+
+/*
+ * Submits a command to a slot. Lock-free, so each controller thread can
+ * submit to its own slot at any rate without contention.
+ */
+void PheenoRobot::submitCommand(int slot, const geometry_msgs::Twist& velocity)
+{
+  command_arbiter_.submit(slot, VelocityCommand(velocity.linear.x, velocity.angular.z),
+                          ros::Time::now().toSec());
+}
+
+/*
+ * Engages or releases the safety stop. While engaged, zero velocity is sent
+ * every control period regardless of the other slots.
+ */
+void PheenoRobot::safetyStop(bool engage)
+{
+  if (engage)
+  {
+    command_arbiter_.engageSafetyStop();
+  }
+  else
+  {
+    command_arbiter_.releaseSafetyStop();
+  }
+}
+
+/*
+ * Changes how often the arbitrated command is sent.
+ */
+void PheenoRobot::setControlRate(double rate)
+{
+  control_rate_ = std::max(rate, 1.0);
+  command_timer_.setPeriod(ros::Duration(1.0 / control_rate_));
+}
+
+/*
+ * Enables or disables the adaptive control rate. While enabled, sleep()
+ * picks the rate from the closest IR range and the time to collision
+ * within the given bounds.
+ */
+void PheenoRobot::setAdaptiveRate(bool enable, const AdaptiveRate::Bounds& bounds)
+{
+  adaptive_rate_enabled_ = enable;
+  adaptive_rate_.setBounds(bounds);
+}
+
+/*
+ * Sleeps for the remainder of the current control period, like
+ * ros::Rate::sleep(). Behaviors call this at the end of each loop iteration
+ * instead of keeping their own fixed-rate ros::Rate. An overrun period
+ * starts the next one immediately instead of trying to catch up.
+ */
+void PheenoRobot::sleep()
+{
+  if (adaptive_rate_enabled_)
+  {
+    updateControlRate();
+  }
+
+  ros::Time now = ros::Time::now();
+  if (loop_deadline_.isZero())
+  {
+    loop_deadline_ = now;
+  }
+
+  loop_deadline_ = loop_deadline_ + ros::Duration(1.0 / control_rate_);
+  if (loop_deadline_ < now)
+  {
+    loop_deadline_ = now;
+    return;
+  }
+
+  (loop_deadline_ - now).sleep();
+}
+
+/*
+ * Picks the control rate for the next period from the closest forward IR
+ * range and the time to collision. The command timer is only reset when
+ * the rate moved noticeably, because resetting it restarts its period.
+ */
+void PheenoRobot::updateControlRate()
+{
+  closest_range_ = std::numeric_limits<double>::infinity();
+  if (enabled_sensors_ & (Pheeno::IR_SENSORS | Pheeno::SENSOR_SWEEP))
+  {
+    for (std::size_t i = 0; i < ir_sensor_vals_.size(); i++)
+    {
+      if ((Pheeno::Hardware::IR_FORWARD_MASK >> i) & 1u)
+      {
+        closest_range_ = std::min(closest_range_, ir_sensor_vals_[i]);
+      }
+    }
+  }
+
+  estimateTimeToCollision();
+
+  double rate = adaptive_rate_.update(closest_range_, time_to_collision_);
+  if (std::abs(rate - control_rate_) >= 0.5)
+  {
+    setControlRate(rate);
+  }
+}
+
+/*
+ * Time to collision with whatever is ahead. The IR range rate is used when
+ * a forward channel is closing; otherwise the obstacle is assumed to stand
+ * still and the robot to keep its commanded speed. Negative when not
+ * approaching anything.
+ */
+void PheenoRobot::estimateTimeToCollision()
+{
+  time_to_collision_ = ir_range_rate_.minTimeToCollision(Pheeno::Hardware::IR_FORWARD_MASK);
+  if (time_to_collision_ >= 0.0)
+  {
+    return;
+  }
+
+  double speed = cmd_vel_msg_.linear.x * 100.0;  // cm/s, like the IR ranges
+  double front_range = std::numeric_limits<double>::infinity();
+  if (enabled_sensors_ & (Pheeno::IR_SENSORS | Pheeno::SENSOR_SWEEP))
+  {
+    for (std::size_t i = 0; i < ir_sensor_vals_.size(); i++)
+    {
+      if ((Pheeno::Hardware::IR_FRONT_MASK >> i) & 1u)
+      {
+        front_range = std::min(front_range, ir_sensor_vals_[i]);
+      }
+    }
+  }
+
+  time_to_collision_ = (speed > 0.0 && front_range < std::numeric_limits<double>::infinity())
+                         ? front_range / speed
+                         : -1.0;
+}
+
+/*
+ * Publishes the control loop state (rate, its bounds and the inputs it was
+ * chosen from) on /diagnostics.
+ */
+void PheenoRobot::diagnosticsTimerCallback(const ros::TimerEvent& event)
+{
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = pheeno_namespace_id_ + ": control loop";
+  status.hardware_id = pheeno_namespace_id_;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = adaptive_rate_enabled_ ? "Adaptive rate" : "Fixed rate";
+
+  const AdaptiveRate::Bounds& bounds = adaptive_rate_.bounds();
+  const std::string keys[] = {
+    "rate (Hz)", "min rate (Hz)", "max rate (Hz)", "urgency", "closest range (cm)", "time to collision (s)"
+  };
+  const double values[] = {
+    control_rate_, bounds.min_rate, bounds.max_rate, adaptive_rate_.urgency(), closest_range_, time_to_collision_
+  };
+  for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    std::ostringstream stream;
+    stream << values[i];
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = keys[i];
+    key_value.value = stream.str();
+    status.values.push_back(key_value);
+  }
+
+  diagnostics_msg_.header.stamp = ros::Time::now();
+  diagnostics_msg_.status.assign(1, status);
+  pub_diagnostics_.publish(diagnostics_msg_);
+}
+
+/*
+ * Control period timer. Publishes the arbitrated command, or a single stop
+ * once every slot has timed out, then stays quiet until a command arrives.
+ * With wheel speed control and fresh encoder feedback, the command only
+ * becomes the controller's target and updateWheelControl() publishes the
+ * corrected command at the encoder rate. A safety stop is always sent here.
+ */
+void PheenoRobot::commandTimerCallback(const ros::TimerEvent& event)
+{
+  sendCommand(false);
+}
+
+/*
+ * Arbitrates and sends the winning command (see commandTimerCallback). With
+ * behavior_only, nothing happens unless the behavior slot wins, so
+ * publish() never sends another controller's command early.
+ */
+void PheenoRobot::sendCommand(bool behavior_only)
+{
+  VelocityCommand command;
+  int slot = command_arbiter_.arbitrate(ros::Time::now().toSec(), command);
+  if (behavior_only && slot != behavior_slot_)
+  {
+    return;
+  }
+
+  if (wheel_control_enabled_)
+  {
+    wheel_controller_.setTarget(command);
+  }
+  if (motion_monitor_enabled_)
+  {
+    motion_monitor_.command(ros::Time::now().toSec(), command.linear, command.angular);
+  }
+
+  if (slot == CommandArbiter::NO_COMMAND && last_command_slot_ == CommandArbiter::NO_COMMAND)
+  {
+    return;
+  }
+
+  if (slot != last_command_slot_)
+  {
+    ROS_INFO("cmd_vel source: %s", slot >= 0 ? command_arbiter_.slotName(slot).c_str()
+                                             : (slot == CommandArbiter::SAFETY_STOP ? "safety stop" : "none"));
+  }
+  last_command_slot_ = slot;
+
+  if (wheel_control_enabled_ && slot != CommandArbiter::SAFETY_STOP &&
+      (ros::Time::now() - last_encoder_update_).toSec() < WHEEL_FEEDBACK_TIMEOUT)
+  {
+    return;
+  }
+
+  cmd_vel_msg_.linear.x = command.linear;
+  cmd_vel_msg_.angular.z = command.angular;
+  pub_cmd_vel_.publish(cmd_vel_msg_);
+}
+
+/*
+ * Enables or disables closed-loop wheel speed control. Enabling it
+ * subscribes to the encoders if the behavior did not ask for them.
+ */
+void PheenoRobot::setWheelControl(bool enable, const WheelController::Gains& gains)
+{
+  wheel_controller_.setGains(gains);
+  wheel_controller_.reset();
+  wheel_control_enabled_ = enable;
+  wheel_control_idle_ = true;
+
+  if (enable)
+  {
+    requireSensors(Pheeno::ENCODERS, "Wheel speed control");
+  }
+}
+
+/*
+ * Runs the wheel speed controller on a complete set of encoder counts taken
+ * at stamp and publishes the corrected command. Once the target is a stop,
+ * a single zero command is sent and the controller stays quiet.
+ */
+void PheenoRobot::updateWheelControl(double stamp)
+{
+  if (!wheel_control_enabled_)
+  {
+    return;
+  }
+
+  last_encoder_update_ = ros::Time::now();
+
+  VelocityCommand corrected;
+  if (!wheel_controller_.update(encoder_vals_, stamp, corrected) ||
+      command_arbiter_.safetyStopEngaged())
+  {
+    return;
+  }
+
+  const VelocityCommand& target = wheel_controller_.target();
+  bool idle = (target.linear == 0.0 && target.angular == 0.0);
+  if (idle && wheel_control_idle_)
+  {
+    return;
+  }
+  wheel_control_idle_ = idle;
+
+  cmd_vel_msg_.linear.x = corrected.linear;
+  cmd_vel_msg_.angular.z = corrected.angular;
+  pub_cmd_vel_.publish(cmd_vel_msg_);
+}
+
+/*
+ * Enables or disables the pose EKF. While enabled, the fused estimate is
+ * written to the odometry pose and twist (odom_pose_position_ and friends),
+ * so mapping, localization and the fleet use it on hardware without a
+ * Gazebo odom topic. The wheel odometry comes from the encoders, or from
+ * the odom twist with ~ekf/odom_twist. The sensors of ekfSensors() are
+ * subscribed to if the behavior did not ask for them.
+ */
+void PheenoRobot::setPoseEkf(bool enable)
+{
+  if (enable && !ekf_enabled_)
+  {
+    pose_ekf_.reset();
+    wheel_odometry_reference_ = false;
+  }
+
+  ekf_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(ekfSensors(), "Pose EKF");
+  }
+}
+
+/*
+ * Sensor groups the EKF reads: the wheel odometry source, the gyroscope
+ * and, unless disabled, the magnetometer.
+ */
+unsigned int PheenoRobot::ekfSensors() const
+{
+  return (ekf_odom_twist_ ? Pheeno::ODOM : Pheeno::ENCODERS) | Pheeno::GYROSCOPE |
+         (ekf_magnetometer_ ? Pheeno::MAGNETOMETER : 0);
+}
+
+/*
+ * Feeds the wheel velocities since the previous complete set of encoder
+ * counts to the EKF and the motion monitor. sensor_stamp (s) times the
+ * counts on the sensor's clock; stamp is the measurement time on the ROS
+ * clock shared with the IMU inputs.
+ */
+void PheenoRobot::updateWheelOdometry(double sensor_stamp, double stamp)
+{
+  bool to_ekf = ekf_enabled_ && !ekf_odom_twist_;
+  if (!to_ekf && !motion_monitor_enabled_)
+  {
+    return;
+  }
+
+  double dt = sensor_stamp - wheel_odometry_stamp_;
+  if (wheel_odometry_reference_ && dt > 0.0 && dt < 0.5)
+  {
+    double left;
+    double right;
+    Pheeno::wheelTravel<Pheeno::Hardware>(encoder_vals_, wheel_odometry_counts_, left, right);
+    double linear = (left + right) / (2.0 * dt);
+    double angular = (right - left) / (Pheeno::Hardware::wheelBase() * dt);
+
+    if (to_ekf)
+    {
+      pose_ekf_.wheelOdometry(stamp, linear, angular);
+      ekfPoseChanged();
+    }
+    if (motion_monitor_enabled_)
+    {
+      motionEventsRaised(motion_monitor_.wheels(stamp, linear, angular));
+    }
+  }
+
+  wheel_odometry_counts_ = encoder_vals_;
+  wheel_odometry_stamp_ = sensor_stamp;
+  wheel_odometry_reference_ = true;
+}
+
+/*
+ * Copies the EKF estimate into the odometry pose and twist.
+ */
+void PheenoRobot::ekfPoseChanged()
+{
+  if (!pose_ekf_.initialized())
+  {
+    return;
+  }
+
+  Pose2D pose = pose_ekf_.pose();
+  odom_pose_position_[0] = pose.x;
+  odom_pose_position_[1] = pose.y;
+  odom_pose_position_[2] = 0.0;
+  odom_pose_orient_[0] = 0.0;
+  odom_pose_orient_[1] = 0.0;
+  odom_pose_orient_[2] = std::sin(pose.theta / 2.0);
+  odom_pose_orient_[3] = std::cos(pose.theta / 2.0);
+  odom_twist_linear_[0] = pose_ekf_.state(PoseEkf::V);
+  odom_twist_angular_[2] = pose_ekf_.state(PoseEkf::W);
+  odom_received_ = true;
+}
+
+/*
+ * Publishes the fused estimate on <pheeno>/odom_fused with its covariance.
+ */
+void PheenoRobot::ekfTimerCallback(const ros::TimerEvent& event)
+{
+  if (!ekf_enabled_ || !pose_ekf_.initialized())
+  {
+    return;
+  }
+
+  // Pose and twist covariances are row-major over x, y, z, roll, pitch, yaw.
+  const PoseEkf::STATE pose_states[3] = {PoseEkf::X, PoseEkf::Y, PoseEkf::YAW};
+  const int pose_rows[3] = {0, 1, 5};
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      fused_odom_msg_.pose.covariance[pose_rows[i] * 6 + pose_rows[j]] = pose_ekf_.covariance(pose_states[i], pose_states[j]);
+    }
+  }
+  fused_odom_msg_.twist.covariance[0] = pose_ekf_.covariance(PoseEkf::V, PoseEkf::V);
+  fused_odom_msg_.twist.covariance[5] = pose_ekf_.covariance(PoseEkf::V, PoseEkf::W);
+  fused_odom_msg_.twist.covariance[30] = pose_ekf_.covariance(PoseEkf::W, PoseEkf::V);
+  fused_odom_msg_.twist.covariance[35] = pose_ekf_.covariance(PoseEkf::W, PoseEkf::W);
+
+  Pose2D pose = pose_ekf_.pose();
+  fused_odom_msg_.header.stamp.fromSec(pose_ekf_.stamp());
+  fused_odom_msg_.header.frame_id = ekf_frame_id_;
+  fused_odom_msg_.child_frame_id = pheeno_namespace_id_;
+  fused_odom_msg_.pose.pose.position.x = pose.x;
+  fused_odom_msg_.pose.pose.position.y = pose.y;
+  fused_odom_msg_.pose.pose.orientation.z = std::sin(pose.theta / 2.0);
+  fused_odom_msg_.pose.pose.orientation.w = std::cos(pose.theta / 2.0);
+  fused_odom_msg_.twist.twist.linear.x = pose_ekf_.state(PoseEkf::V);
+  fused_odom_msg_.twist.twist.angular.z = pose_ekf_.state(PoseEkf::W);
+  pub_fused_odom_.publish(fused_odom_msg_);
+}
+
+/*
+ * Enables or disables slip, stall and impact detection. While enabled,
+ * irSensorTriggered(), queryIr() and the avoidance methods see a virtual
+ * obstacle in the direction of the latest active event, so a robot pushing
+ * against something the IR sensors miss turns away from it. The encoders,
+ * the gyroscope and the accelerometer are subscribed to if the behavior did
+ * not ask for them.
+ */
+void PheenoRobot::setMotionMonitor(bool enable)
+{
+  if (enable && !motion_monitor_enabled_)
+  {
+    motion_monitor_.reset();
+    wheel_odometry_reference_ = false;
+  }
+
+  motion_monitor_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(Pheeno::ENCODERS | Pheeno::GYROSCOPE | Pheeno::ACCELEROMETER, "Motion monitor");
+  }
+}
+
+/*
+ * Active motion events (Pheeno::MOTION_EVENT bitmask).
+ */
+unsigned int PheenoRobot::motionEvents() const
+{
+  if (!motion_monitor_enabled_)
+  {
+    return Pheeno::MOTION_NONE;
+  }
+  return motion_monitor_.events(ros::Time::now().toSec());
+}
+
+/*
+ * The IR ranges with the virtual obstacle of an active motion event: the
+ * sensor facing the event's direction reads at most virtual_range.
+ */
+const Pheeno::IrRanges<Pheeno::Hardware>& PheenoRobot::avoidanceRanges()
+{
+  double direction;
+  if (!motion_monitor_enabled_ || !motion_monitor_.obstacle(ros::Time::now().toSec(), direction))
+  {
+    return ir_sensor_vals_;
+  }
+
+  std::size_t facing = 0;
+  double closest = 10.0;
+  for (std::size_t i = 0; i < Pheeno::Hardware::IR_COUNT; i++)
+  {
+    double difference = direction - Pheeno::Hardware::irMount(i).angle;
+    difference = std::abs(std::atan2(std::sin(difference), std::cos(difference)));
+    if (difference < closest)
+    {
+      closest = difference;
+      facing = i;
+    }
+  }
+
+  avoidance_ranges_ = ir_sensor_vals_;
+  avoidance_ranges_[facing] = std::min(avoidance_ranges_[facing], virtual_obstacle_range_);
+  return avoidance_ranges_;
+}
+
+/*
+ * Logs newly raised motion events.
+ */
+void PheenoRobot::motionEventsRaised(unsigned int events)
+{
+  if (events & Pheeno::MOTION_IMPACT)
+  {
+    ROS_WARN("%s: impact detected.", pheeno_namespace_id_.c_str());
+  }
+  if (events & Pheeno::MOTION_STALL)
+  {
+    ROS_WARN("%s: wheels stalled.", pheeno_namespace_id_.c_str());
+  }
+  if (events & Pheeno::MOTION_SLIP)
+  {
+    ROS_WARN("%s: wheel slip detected.", pheeno_namespace_id_.c_str());
+  }
+}
+
+/*
+ * Callback function for the IR Sensor ROS subscribers. index is the
+ * sensor's position in the hardware descriptor.
+ */
+void PheenoRobot::irSensorCallback(std::size_t index, const ros::MessageEvent<std_msgs::Float32 const>& event)
+{
+  std_msgs::Float32::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::IR_CHANNEL, event.getReceiptTime());
+  ir_sensor_vals_[index] = static_cast<double>(msg->data);
+  ir_range_rate_.update(index, ir_sensor_vals_[index], event.getReceiptTime().toSec());
+  insertIrBeam(index);
+}
+
+/*
+ * Given a specific sensor limit, this member function returns a bool if
+ * any of the forward facing sensors within ir_sensor_values is triggered.
+ * The back sensor(s) are excluded by the hardware descriptor's
+ * IR_FORWARD_MASK, so one hit is enough; before the descriptor two hits
+ * among all sensors were needed to make up for the back one. The IR
+ * topics are subscribed to if the behavior did not ask for them.
+ */
+bool PheenoRobot::irSensorTriggered(float sensor_limit)
+{
+  requireSensors(Pheeno::IR_SENSORS, "irSensorTriggered");
+  return Pheeno::irTriggered<Pheeno::Hardware>(avoidanceRanges(), sensor_limit);
+}
+
+/*
+ * Answers several IR trigger queries (threshold plus sensor mask, e.g. the
+ * descriptor's IR_FRONT_MASK) in one vectorized pass over the IR values.
+ * results must hold query_count entries.
+ */
+void PheenoRobot::queryIr(const IrQuery* queries, std::size_t query_count, IrQueryResult* results)
+{
+  requireSensors(Pheeno::IR_SENSORS, "queryIr");
+  evaluateIrQueries<Pheeno::Hardware>(avoidanceRanges(), queries, query_count, results);
+}
+
+/*
+ * Enables or disables occupancy grid mapping. Mapping needs the IR sensors
+ * and odometry, which are subscribed to if the behavior did not ask for
+ * them. Map publishing is configured by the ~map/ parameters.
+ */
+void PheenoRobot::setMapping(bool enable)
+{
+  mapping_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(Pheeno::IR_SENSORS | Pheeno::ODOM, "Occupancy grid mapping");
+  }
+}
+
+/*
+ * Heading (rad) of the latest odometry pose.
+ */
+double PheenoRobot::odomYaw() const
+{
+  return quaternionYaw(odom_pose_orient_[0], odom_pose_orient_[1], odom_pose_orient_[2], odom_pose_orient_[3]);
+}
+
+/*
+ * Inserts the latest reading of one IR sensor into the map. The beam starts
+ * at the sensor's mounting point, transformed by the odometry pose. A range
+ * at or beyond the sensor's maximum clears the beam without a hit.
+ */
+void PheenoRobot::insertIrBeam(std::size_t index)
+{
+  if (!mapping_enabled_ || !odom_received_)
+  {
+    return;
+  }
+
+  double yaw = odomYaw();
+  double cos_yaw = std::cos(yaw);
+  double sin_yaw = std::sin(yaw);
+
+  const Pheeno::IrMount& mount = Pheeno::Hardware::irMount(index);
+  double sensor_x = odom_pose_position_[0] + cos_yaw * mount.x - sin_yaw * mount.y;
+  double sensor_y = odom_pose_position_[1] + sin_yaw * mount.x + cos_yaw * mount.y;
+
+  double max_range = Pheeno::Hardware::irMaxRange();
+  bool hit = ir_sensor_vals_[index] < max_range;
+  double range = std::max(0.0, std::min(ir_sensor_vals_[index], max_range)) / 100.0;  // cm to m
+  double angle = yaw + mount.angle;
+
+  map_.insertBeam(sensor_x, sensor_y, sensor_x + range * std::cos(angle),
+                  sensor_y + range * std::sin(angle), hit);
+}
+
+/*
+ * Publishes the map tiles changed since the last delta.
+ */
+void PheenoRobot::mapDeltaTimerCallback(const ros::TimerEvent& event)
+{
+  map_.refreshTiles(map_refresh_tiles_);
+  if (map_.dirtyTileCount() == 0)
+  {
+    return;
+  }
+
+  map_.encodeDelta(map_delta_msg_.data, map_delta_budget_);
+  pub_map_delta_.publish(map_delta_msg_);
+
+  // The merged map sees this robot's map through the same deltas as its
+  // peers do.
+  if (map_sharing_enabled_)
+  {
+    map_merger_.applyDelta(0, &map_delta_msg_.data[0], map_delta_msg_.data.size());
+    map_merger_.update();
+  }
+}
+
+/*
+ * Merges a map delta from one of the peers in ~map/share/peers.
+ */
+void PheenoRobot::peerMapDeltaCallback(std::size_t index,
+                                       const ros::MessageEvent<std_msgs::UInt8MultiArray const>& event)
+{
+  std_msgs::UInt8MultiArray::ConstPtr msg = event.getMessage();
+  if (msg->data.empty() || !map_merger_.applyDelta(static_cast<int>(index) + 1, &msg->data[0], msg->data.size()))
+  {
+    ROS_WARN_THROTTLE(5.0, "Dropping malformed map delta from peer %lu.", static_cast<unsigned long>(index));
+    return;
+  }
+  map_merger_.update();
+}
+
+/*
+ * Publishes the whole map as a nav_msgs/OccupancyGrid (for RViz).
+ */
+void PheenoRobot::mapTimerCallback(const ros::TimerEvent& event)
+{
+  const TiledOccupancyGrid::Config& config = map_.config();
+  map_msg_.header.stamp = ros::Time::now();
+  map_msg_.header.frame_id = map_frame_id_;
+  map_msg_.info.resolution = config.resolution;
+  map_msg_.info.width = config.width;
+  map_msg_.info.height = config.height;
+  map_msg_.info.origin.position.x = config.origin_x;
+  map_msg_.info.origin.position.y = config.origin_y;
+  map_msg_.info.origin.orientation.w = 1.0;
+  map_.fillOccupancy(map_msg_.data);
+  pub_map_.publish(map_msg_);
+
+  if (map_sharing_enabled_)
+  {
+    merged_map_msg_.header = map_msg_.header;
+    merged_map_msg_.info = map_msg_.info;
+    map_merger_.map().fillOccupancy(merged_map_msg_.data);
+    pub_merged_map_.publish(merged_map_msg_);
+  }
+}
+
+/*
+ * Enables or disables Monte Carlo localization. Localization needs the IR
+ * sensors and odometry, which are subscribed to if the behavior did not ask
+ * for them. The arena map and the filter are configured by the
+ * ~localization/ parameters.
+ */
+void PheenoRobot::setLocalization(bool enable)
+{
+  localization_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(Pheeno::IR_SENSORS | Pheeno::ODOM, "Localization");
+  }
+}
 
 /*
- * Contructor for the PheenoRobot Class.
- *
- * The class constructor fills all std::vector variables with zeros
- * for use by the setters. Publishers and Subscribers are formally
- * defined as well.
- *
+ * Enables or disables ORCA collision avoidance. Once enabled, publish()
+ * passes behavior commands through orcaVelocity(). ORCA needs odometry,
+ * which is subscribed to if the behavior did not ask for it, and the fleet
+ * topic, which is joined on first use.
  */
-PheenoRobot::PheenoRobot(std::string pheeno_name)
+void PheenoRobot::setOrca(bool enable)
 {
-  ROS_INFO("Creating Pheeno Robot.");
-  pheeno_namespace_id_ = pheeno_name;
+  orca_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(Pheeno::ODOM, "ORCA collision avoidance");
+    joinFleet();
+  }
+}
 
-  // Create IR sensor vector upon construction. (6 placements)
-  for (int i = 0; i < 6; i++)
+/*
+ * Adjusts a behavior command so the robot avoids the neighbors heard on the
+ * fleet topic. The command's forward speed along the current heading is
+ * the preferred velocity. If ORCA keeps it, the command is returned as is
+ * (turns in place included). Otherwise the robot turns toward the ORCA
+ * velocity and drives at its speed projected on the heading, since a
+ * Pheeno cannot move sideways.
+ */
+geometry_msgs::Twist PheenoRobot::orcaVelocity(const geometry_msgs::Twist& preferred)
+{
+  if (!odom_received_)
   {
-    ir_sensor_vals_.push_back(0);
+    return preferred;
   }
 
-  // Create sensor vector upon construction. (3 placements)
-  for (int i = 0; i < 3; i++)
+  std::string frame_id;
+  Pose2D pose = fleetPose(frame_id);
+  double cos_yaw = std::cos(pose.theta);
+  double sin_yaw = std::sin(pose.theta);
+
+  // Neighbors heard from recently, in the same frame as this robot
+  double now = ros::Time::now().toSec();
+  orca_neighbors_.clear();
+  for (std::size_t i = 0; i < fleet_.size(); i++)
   {
-    odom_pose_position_.push_back(0);
-    odom_twist_linear_.push_back(0);
-    odom_twist_angular_.push_back(0);
+    if (fleetNeighborActive(fleet_[i], frame_id, now))
+    {
+      OrcaAgent neighbor = {fleet_[i].x, fleet_[i].y, fleet_[i].vx, fleet_[i].vy,
+                            fleet_[i].vx, fleet_[i].vy, orca_radius_, orca_max_speed_};
+      orca_neighbors_.push_back(neighbor);
+    }
+  }
 
-    magnetometer_vals_.push_back(0);
-    gyroscope_vals_.push_back(0);
-    accelerometer_vals_.push_back(0);
+  OrcaAgent agent;
+  agent.x = pose.x;
+  agent.y = pose.y;
+  agent.vx = odom_twist_linear_[0] * cos_yaw;
+  agent.vy = odom_twist_linear_[0] * sin_yaw;
+  agent.pref_vx = preferred.linear.x * cos_yaw;
+  agent.pref_vy = preferred.linear.x * sin_yaw;
+  agent.radius = orca_radius_;
+  agent.max_speed = orca_max_speed_;
+
+  double vx;
+  double vy;
+  orca_solver_.solve(agent, orca_neighbors_.empty() ? NULL : &orca_neighbors_[0], orca_neighbors_.size(),
+                     1.0 / control_rate_, vx, vy);
+  if (std::hypot(vx - agent.pref_vx, vy - agent.pref_vy) < 1e-3)
+  {
+    return preferred;
   }
 
-  // Create sensor vector upon construction. (4 placements)
-  for (int i = 0; i < 4; i++)
+  geometry_msgs::Twist velocity = preferred;
+  double speed = std::hypot(vx, vy);
+  if (speed < 1e-3)
   {
-    odom_pose_orient_.push_back(0);
-    encoder_vals_.push_back(0);
+    velocity.linear.x = 0.0;  // Wait, keeping the behavior's turn
+    return velocity;
   }
 
-  // IR Sensor Subscribers
-  sub_ir_center_ = nh_.subscribe(pheeno_name + "/scan_center", 10,
-                                 &PheenoRobot::irSensorCenterCallback, this);
-  sub_ir_right_ = nh_.subscribe(pheeno_name + "/scan_right", 10,
-                                &PheenoRobot::irSensorRightCallback, this);
-  sub_ir_left_ = nh_.subscribe(pheeno_name + "/scan_left", 10,
-                              &PheenoRobot::irSensorLeftCallback, this);
-  sub_ir_cr_ = nh_.subscribe(pheeno_name + "/scan_cr", 10,
-                             &PheenoRobot::irSensorCRightCallback, this);
-  sub_ir_cl_ = nh_.subscribe(pheeno_name + "/scan_cl", 10,
-                             &PheenoRobot::irSensorCLeftCallback, this);
-  sub_ir_back_ = nh_.subscribe(pheeno_name + "/scan_back", 10,
-                               &PheenoRobot::irSensorBackCallback, this);
-  sub_ir_bottom_ = nh_.subscribe(pheeno_name + "/scan_bottom", 10,
-                                 &PheenoRobot::irSensorBottomCallback, this);
+  headingCommand(vx, vy, pose.theta, velocity.linear.x, velocity.angular.z);
+  return velocity;
+}
 
-  // Odom Subscriber
-  sub_odom_ = nh_.subscribe(pheeno_name + "/odom", 1,
-                            &PheenoRobot::odomCallback, this);
+/*
+ * Enables or disables flock(). Like ORCA, it needs odometry and joins the
+ * fleet topic. The rules come from the ~flocking/ parameters or
+ * setFlockRules().
+ */
+void PheenoRobot::setFlocking(bool enable)
+{
+  flocking_enabled_ = enable;
+  if (enable)
+  {
+    requireSensors(Pheeno::ODOM, "Flocking");
+    joinFleet();
+  }
+}
 
-  // Encoder Subscribers
-  sub_encoder_LL_ = nh_.subscribe(pheeno_name + "/encoder_LL", 10,
-                                  &PheenoRobot::encoderLLCallback, this);
-  sub_encoder_LR_ = nh_.subscribe(pheeno_name + "/encoder_LR", 10,
-                                  &PheenoRobot::encoderLRCallback, this);
-  sub_encoder_RL_ = nh_.subscribe(pheeno_name + "/encoder_RL", 10,
-                                  &PheenoRobot::encoderRLCallback, this);
-  sub_encoder_RR_ = nh_.subscribe(pheeno_name + "/encoder_RR", 10,
-                                  &PheenoRobot::encoderRRCallback, this);
+/*
+ * Flocking, aggregation or dispersion, depending on the flock rules. Sets
+ * linear and angular to steer toward the rules' desired velocity. Returns
+ * false, leaving them untouched, when flocking is disabled or no neighbor
+ * is within range (the behavior should then explore on its own).
+ */
+bool PheenoRobot::flock(double &linear, double &angular)
+{
+  if (!flocking_enabled_ || !odom_received_)
+  {
+    return false;
+  }
 
-  // Magnetometer, Gyroscope, Accelerometer Subscriber
-  sub_magnetometer_ = nh_.subscribe(pheeno_name + "/magnetometer", 10,
-                                    &PheenoRobot::magnetometerCallback, this);
-  sub_gyroscope_ = nh_.subscribe(pheeno_name + "/gyroscope", 10,
-                                 &PheenoRobot::gyroscopeCallback, this);
-  sub_accelerometer_ = nh_.subscribe(pheeno_name + "/accelerometer", 10,
-                                     &PheenoRobot::accelerometerCallback, this);
+  std::string frame_id;
+  Pose2D pose = fleetPose(frame_id);
+  double now = ros::Time::now().toSec();
+  flock_neighbors_.clear();
+  for (std::size_t i = 0; i < fleet_.size(); i++)
+  {
+    if (fleetNeighborActive(fleet_[i], frame_id, now))
+    {
+      FlockMember neighbor = {fleet_[i].x, fleet_[i].y, fleet_[i].vx, fleet_[i].vy};
+      flock_neighbors_.push_back(neighbor);
+    }
+  }
 
-  // cmd_vel Publisher
-  pub_cmd_vel_ = nh_.advertise<geometry_msgs::Twist>(pheeno_name + "/cmd_vel", 100);
+  FlockMember self = {pose.x, pose.y, odom_twist_linear_[0] * std::cos(pose.theta),
+                      odom_twist_linear_[0] * std::sin(pose.theta)};
+  double vx;
+  double vy;
+  flock_rules_.steer(self, flock_neighbors_.empty() ? NULL : &flock_neighbors_[0], flock_neighbors_.size(), vx, vy);
+  if (flock_rules_.neighborCount() == 0)
+  {
+    return false;
+  }
 
+  headingCommand(vx, vy, pose.theta, linear, angular);
+  return true;
 }
 
 /*
- * Publishes command velocity (cmd_vel) messages.
+ * Subscribes to and starts publishing on the fleet topic, once.
  *
- * The specific Topic name that the message is published to is defined
- * in the Constructor for the PheenoRobot class.
+ * Robots only react to neighbors in their own frame, so without
+ * ~fleet/shared_odom_frame or ~localization/enabled every robot would sit
+ * in its own <pheeno>/odom frame and ORCA and flocking would silently do
+ * nothing. That setup is refused: the node is shut down with an error.
  */
-void PheenoRobot::publish(geometry_msgs::Twist velocity)
+void PheenoRobot::joinFleet()
 {
-  pub_cmd_vel_.publish(velocity);
+  if (fleet_joined_)
+  {
+    return;
+  }
+
+  if (!fleet_shared_odom_frame_ && !localization_enabled_)
+  {
+    ROS_FATAL("%s: ORCA and flocking need the robots in one frame. Set ~fleet/shared_odom_frame when "
+              "the odometry frames coincide (Gazebo, sim_bridge), or enable ~localization.",
+              pheeno_namespace_id_.c_str());
+    ros::shutdown();
+    return;
+  }
+
+  sub_fleet_state_ = nh_.subscribe(fleet_topic_, 50, &PheenoRobot::fleetStateCallback, this);
+  pub_fleet_state_ = nh_.advertise<nav_msgs::Odometry>(fleet_topic_, 10);
+  fleet_state_timer_ = nh_.createTimer(ros::Duration(1.0 / std::max(fleet_rate_, 1.0)),
+                                       &PheenoRobot::fleetStateTimerCallback, this);
+  fleet_joined_ = true;
 }
 
 /*
- * Callback function for the IR Sensor (center) ROS subscriber.
+ * Whether a neighbor was heard from within ~fleet/timeout, in frame_id.
+ * Neighbors in another frame (unrelated odometry, or one robot localized
+ * and the other not) are dropped.
  */
-void PheenoRobot::irSensorCenterCallback(const std_msgs::Float32::ConstPtr& msg)
+bool PheenoRobot::fleetNeighborActive(const FleetNeighbor& neighbor, const std::string& frame_id, double now) const
 {
-  ir_sensor_vals_[Pheeno::IR::CENTER] = static_cast<double>(msg->data);
+  if (now - neighbor.received > fleet_timeout_)
+  {
+    return false;
+  }
+  if (neighbor.frame_id != frame_id)
+  {
+    ROS_WARN_ONCE("%s: ignoring fleet neighbors outside frame %s (%s is in %s). Localize the robots or set "
+                  "~fleet/shared_odom_frame if their odometry frames coincide.", pheeno_namespace_id_.c_str(),
+                  frame_id.c_str(), neighbor.name.c_str(), neighbor.frame_id.c_str());
+    return false;
+  }
+  return true;
 }
 
 /*
- * Callback function for the IR Sensor (back) ROS subscriber.
+ * Differential drive command for a world frame velocity: turn toward it and
+ * drive at its speed projected on the current heading.
  */
-void PheenoRobot::irSensorBackCallback(const std_msgs::Float32::ConstPtr& msg)
+void PheenoRobot::headingCommand(double vx, double vy, double yaw, double &linear, double &angular) const
 {
-  ir_sensor_vals_[Pheeno::IR::BACK] = static_cast<double>(msg->data);
+  double speed = std::hypot(vx, vy);
+  if (speed < 1e-3)
+  {
+    linear = 0.0;
+    angular = 0.0;
+    return;
+  }
+
+  double heading_error = std::atan2(vy, vx) - yaw;
+  heading_error = std::atan2(std::sin(heading_error), std::cos(heading_error));
+  linear = speed * std::max(0.0, std::cos(heading_error));
+  angular = std::max(-fleet_max_angular_, std::min(fleet_max_angular_, fleet_heading_gain_ * heading_error));
 }
 
 /*
- * Callback function for the IR Sensor (right) ROS subscriber.
+ * Pose shared on the fleet topic: the localized pose once Monte Carlo
+ * localization has converged (ParticleFilter::converged(), bounded by
+ * ~localization/converged_xy and ~localization/converged_yaw), the
+ * odometry pose otherwise. Being seeded is not enough: a global filter
+ * starts spread over the whole arena and its mean is meaningless. A filter
+ * that spreads out again falls back to odometry. frame_id is set to the
+ * frame the pose is in (<pheeno>/odom for odometry, see
+ * ~fleet/shared_odom_frame); robots only react to neighbors in their own
+ * frame.
  */
-void PheenoRobot::irSensorRightCallback(const std_msgs::Float32::ConstPtr& msg)
+Pose2D PheenoRobot::fleetPose(std::string& frame_id) const
 {
-  ir_sensor_vals_[Pheeno::IR::RIGHT] = static_cast<double>(msg->data);
+  if (localization_enabled_ && localized_ && particle_filter_.converged())
+  {
+    frame_id = localization_frame_id_;
+    return particle_filter_.estimate();
+  }
+
+  frame_id = fleet_odom_frame_id_;
+  return odomPose();
 }
 
 /*
- * Callback function for the IR Sensor (left) ROS subscriber.
+ * Records a neighbor's state from the fleet topic (its Pheeno name is the
+ * child_frame_id; this robot's own messages are skipped).
  */
-void PheenoRobot::irSensorLeftCallback(const std_msgs::Float32::ConstPtr& msg)
+void PheenoRobot::fleetStateCallback(const nav_msgs::Odometry::ConstPtr& msg)
 {
-  ir_sensor_vals_[Pheeno::IR::LEFT] = static_cast<double>(msg->data);
+  if (msg->child_frame_id == pheeno_namespace_id_)
+  {
+    return;
+  }
+
+  std::size_t i = 0;
+  while (i < fleet_.size() && fleet_[i].name != msg->child_frame_id)
+  {
+    i++;
+  }
+  if (i == fleet_.size())
+  {
+    fleet_.push_back(FleetNeighbor());
+    fleet_.back().name = msg->child_frame_id;
+  }
+
+  const geometry_msgs::Quaternion& q = msg->pose.pose.orientation;
+  double yaw = quaternionYaw(q.x, q.y, q.z, q.w);
+  FleetNeighbor& neighbor = fleet_[i];
+  neighbor.frame_id = msg->header.frame_id;
+  neighbor.received = ros::Time::now().toSec();
+  neighbor.x = msg->pose.pose.position.x;
+  neighbor.y = msg->pose.pose.position.y;
+  neighbor.vx = msg->twist.twist.linear.x * std::cos(yaw);
+  neighbor.vy = msg->twist.twist.linear.x * std::sin(yaw);
 }
 
 /*
- * Callback function for the IR Sensor (center-right) ROS subscriber.
+ * Shares this robot's pose and velocity (body frame twist, as in
+ * nav_msgs/Odometry) on the fleet topic.
  */
-void PheenoRobot::irSensorCRightCallback(const std_msgs::Float32::ConstPtr& msg)
+void PheenoRobot::fleetStateTimerCallback(const ros::TimerEvent& event)
 {
-  ir_sensor_vals_[Pheeno::IR::CRIGHT] = static_cast<double>(msg->data);
+  if (!odom_received_)
+  {
+    return;
+  }
+
+  Pose2D pose = fleetPose(fleet_state_msg_.header.frame_id);
+  fleet_state_msg_.header.stamp = ros::Time::now();
+  fleet_state_msg_.child_frame_id = pheeno_namespace_id_;
+  fleet_state_msg_.pose.pose.position.x = pose.x;
+  fleet_state_msg_.pose.pose.position.y = pose.y;
+  fleet_state_msg_.pose.pose.orientation.z = std::sin(pose.theta / 2.0);
+  fleet_state_msg_.pose.pose.orientation.w = std::cos(pose.theta / 2.0);
+  fleet_state_msg_.twist.twist.linear.x = odom_twist_linear_[0];
+  fleet_state_msg_.twist.twist.angular.z = odom_twist_angular_[2];
+  pub_fleet_state_.publish(fleet_state_msg_);
 }
 
 /*
- * Callback function for the IR Sensor (center-left) ROS subscriber.
+ * Odometry pose as (x, y, yaw).
  */
-void PheenoRobot::irSensorCLeftCallback(const std_msgs::Float32::ConstPtr& msg)
+Pose2D PheenoRobot::odomPose() const
 {
-  ir_sensor_vals_[Pheeno::IR::CLEFT] = static_cast<double>(msg->data);
+  return Pose2D(odom_pose_position_[0], odom_pose_position_[1], odomYaw());
 }
 
 /*
- * Given a specific sensor limit, this member function returns a bool if
- * any of the sensors within ir_sensor_values is triggered.
+ * Builds the likelihood field for the arena map and seeds the particles,
+ * around the initial pose or (with ~localization/global) over the whole
+ * map.
  */
-bool PheenoRobot::irSensorTriggered(float sensor_limit)
+void PheenoRobot::arenaMapCallback(const nav_msgs::OccupancyGrid::ConstPtr& msg)
 {
-  int count = 0;
-  for (int i = 0; i < 7; i++)
+  if (msg->data.empty() || msg->data.size() != static_cast<std::size_t>(msg->info.width) * msg->info.height ||
+      !particle_filter_.setMap(&msg->data[0], msg->info.width, msg->info.height, msg->info.resolution,
+                               msg->info.origin.position.x, msg->info.origin.position.y))
   {
-    if (ir_sensor_vals_[i] < sensor_limit)
+    ROS_ERROR("Arena map is empty or malformed; localization is waiting for another.");
+    return;
+  }
+
+  if (!localized_)
+  {
+    if (global_localization_)
+    {
+      particle_filter_.initializeUniform();
+    }
+    else
     {
-      count += 1;
+      particle_filter_.initialize(initial_pose_, initial_spread_, initial_spread_yaw_);
     }
+    localized_ = true;
+  }
+}
+
+/*
+ * Reseeds the particles around a pose set from RViz (2D Pose Estimate).
+ */
+void PheenoRobot::initialPoseCallback(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr& msg)
+{
+  const geometry_msgs::Quaternion& q = msg->pose.pose.orientation;
+  initial_pose_ = Pose2D(msg->pose.pose.position.x, msg->pose.pose.position.y,
+                         std::atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z)));
+  if (particle_filter_.hasMap())
+  {
+    particle_filter_.initialize(initial_pose_, initial_spread_, initial_spread_yaw_);
+    localized_ = true;
+  }
+}
+
+/*
+ * Runs one filter update once the robot moved far enough since the last
+ * (updating while standing still would make the filter overconfident), and
+ * publishes the pose estimate and the particles.
+ */
+void PheenoRobot::localizationTimerCallback(const ros::TimerEvent& event)
+{
+  if (!localization_enabled_ || !localized_ || !odom_received_)
+  {
+    return;
   }
 
-  // Greater than 1 instead of 0, because we aren't using the back IR sensor.
-  return (count > 1) ? true : false;
+  Pose2D odom = odomPose();
+  if (!localization_odom_valid_)
+  {
+    localization_odom_ = odom;
+    localization_odom_valid_ = true;
+    return;
+  }
+
+  double moved = std::hypot(odom.x - localization_odom_.x, odom.y - localization_odom_.y);
+  double turn = odom.theta - localization_odom_.theta;
+  double turned = std::fabs(std::atan2(std::sin(turn), std::cos(turn)));
+  if (moved < localization_update_distance_ && turned < localization_update_angle_)
+  {
+    return;
+  }
+
+  particle_filter_.predict(localization_odom_, odom);
+  localization_odom_ = odom;
+  particle_filter_.correct<Pheeno::Hardware>(ir_sensor_vals_);
+  particle_filter_.resample();
+
+  const Pose2D& estimate = particle_filter_.estimate();
+  localized_pose_msg_.header.stamp = ros::Time::now();
+  localized_pose_msg_.header.frame_id = localization_frame_id_;
+  localized_pose_msg_.pose.pose.position.x = estimate.x;
+  localized_pose_msg_.pose.pose.position.y = estimate.y;
+  localized_pose_msg_.pose.pose.orientation.z = std::sin(estimate.theta / 2.0);
+  localized_pose_msg_.pose.pose.orientation.w = std::cos(estimate.theta / 2.0);
+  for (int i = 0; i < 36; i++)
+  {
+    localized_pose_msg_.pose.covariance[i] = 0.0;
+  }
+  localized_pose_msg_.pose.covariance[0] = particle_filter_.covariance(0, 0);
+  localized_pose_msg_.pose.covariance[1] = particle_filter_.covariance(0, 1);
+  localized_pose_msg_.pose.covariance[6] = particle_filter_.covariance(1, 0);
+  localized_pose_msg_.pose.covariance[7] = particle_filter_.covariance(1, 1);
+  localized_pose_msg_.pose.covariance[35] = particle_filter_.covariance(2, 2);
+  pub_localized_pose_.publish(localized_pose_msg_);
+
+  particles_msg_.header = localized_pose_msg_.header;
+  particles_msg_.poses.resize(particle_filter_.size());
+  for (std::size_t i = 0; i < particle_filter_.size(); i++)
+  {
+    Pose2D particle = particle_filter_.particle(i);
+    particles_msg_.poses[i].position.x = particle.x;
+    particles_msg_.poses[i].position.y = particle.y;
+    particles_msg_.poses[i].orientation.z = std::sin(particle.theta / 2.0);
+    particles_msg_.poses[i].orientation.w = std::cos(particle.theta / 2.0);
+  }
+  pub_particles_.publish(particles_msg_);
 }
 
 /*
@@ -178,8 +1822,10 @@ bool PheenoRobot::irSensorTriggered(float sensor_limit)
  *
  * NOTE: ONLY FOR THE PHEENO MARKOV CHAIN EXPERIMENT.
  */
-void PheenoRobot::irSensorBottomCallback(const std_msgs::Int16::ConstPtr& msg)
+void PheenoRobot::irSensorBottomCallback(const ros::MessageEvent<std_msgs::Int16 const>& event)
 {
+  std_msgs::Int16::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::IR_BOTTOM_CHANNEL, event.getReceiptTime());
   if (msg->data < 1600)
   {
     ir_sensor_bottom_.data = 0;  // Black on the bottom
@@ -198,8 +1844,25 @@ void PheenoRobot::irSensorBottomCallback(const std_msgs::Int16::ConstPtr& msg)
  *
  * NOTE: ONLY USED IF `libgazebo_ros_p3d.so` PLUGIN IS IN THE XACRO FILE.
  */
-void PheenoRobot::odomCallback(const nav_msgs::Odometry::ConstPtr& msg)
+void PheenoRobot::odomCallback(const ros::MessageEvent<nav_msgs::Odometry const>& event)
 {
+  nav_msgs::Odometry::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::ODOM_CHANNEL, event.getReceiptTime(), msg->header.stamp.toSec());
+
+  // With the EKF, the odometry twist is the wheel odometry if
+  // ~ekf/odom_twist chose it over the encoders, and ignored otherwise.
+  if (ekf_enabled_)
+  {
+    if (ekf_odom_twist_)
+    {
+      pose_ekf_.wheelOdometry(event.getReceiptTime().toSec(), msg->twist.twist.linear.x, msg->twist.twist.angular.z);
+      ekfPoseChanged();
+    }
+    return;
+  }
+
+  odom_received_ = true;
+
   // Assign values to appropriate pose information.
   odom_pose_position_[0] = static_cast<double>(msg->pose.pose.position.x);
   odom_pose_position_[1] = static_cast<double>(msg->pose.pose.position.y);
@@ -219,65 +1882,197 @@ void PheenoRobot::odomCallback(const nav_msgs::Odometry::ConstPtr& msg)
 }
 
 /*
- * Callback function for the Encoder LL ROS subscriber.
+ * Callback function for the visual odometry ROS subscriber (~ekf/visual_odometry).
+ *
+ * Camera ego-motion arrives after image processing; the header stamp (the
+ * capture time) places it in the EKF history.
  */
-void PheenoRobot::encoderLLCallback(const std_msgs::Int16::ConstPtr& msg)
+void PheenoRobot::visualOdomCallback(const ros::MessageEvent<nav_msgs::Odometry const>& event)
 {
-  encoder_vals_[Pheeno::ENCODER::LL] = static_cast<int>(msg->data);
-}
+  nav_msgs::Odometry::ConstPtr msg = event.getMessage();
+  if (!ekf_enabled_)
+  {
+    return;
+  }
 
-/*
- * Callback function for the Encoder LR ROS subscriber.
- */
-void PheenoRobot::encoderLRCallback(const std_msgs::Int16::ConstPtr& msg)
-{
-  encoder_vals_[Pheeno::ENCODER::LR] = static_cast<int>(msg->data);
+  double stamp = msg->header.stamp.isZero() ? event.getReceiptTime().toSec() : msg->header.stamp.toSec();
+  if (!pose_ekf_.visualOdometry(stamp, msg->twist.twist.linear.x, msg->twist.twist.angular.z))
+  {
+    ROS_WARN_THROTTLE(5.0, "Visual odometry %.3f s old dropped by the pose EKF.", event.getReceiptTime().toSec() - stamp);
+  }
+  ekfPoseChanged();
 }
 
 /*
- * Callback function for the Encoder RL ROS subscriber.
+ * Callback function for the Encoder ROS subscribers. index is the
+ * channel's position in the hardware descriptor.
  */
-void PheenoRobot::encoderRLCallback(const std_msgs::Int16::ConstPtr& msg)
+void PheenoRobot::encoderCallback(std::size_t index, const ros::MessageEvent<std_msgs::Int16 const>& event)
 {
-  encoder_vals_[Pheeno::ENCODER::RL] = static_cast<int>(msg->data);
-}
+  std_msgs::Int16::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::ENCODER_CHANNEL, event.getReceiptTime());
+  encoder_vals_[index] = static_cast<int>(msg->data);
 
-/*
- * Callback function for the Encoder RR ROS subscriber.
- */
-void PheenoRobot::encoderRRCallback(const std_msgs::Int16::ConstPtr& msg)
-{
-  encoder_vals_[Pheeno::ENCODER::RR] = static_cast<int>(msg->data);
+  // Encoder channels arrive as separate topics; control on complete sets.
+  fresh_encoders_ |= 1u << index;
+  if (fresh_encoders_ == (1u << encoder_vals_.size()) - 1)
+  {
+    fresh_encoders_ = 0;
+    updateWheelControl(event.getReceiptTime().toSec());
+    updateWheelOdometry(event.getReceiptTime().toSec(), event.getReceiptTime().toSec());
+  }
 }
 
 /*
  * Callback function for the Magnetometer sensor ROS subscriber.
  */
-void PheenoRobot::magnetometerCallback(const geometry_msgs::Vector3::ConstPtr& msg)
+void PheenoRobot::magnetometerCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event)
 {
+  geometry_msgs::Vector3::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::IMU_CHANNEL, event.getReceiptTime());
   magnetometer_vals_[0] = static_cast<double>(msg->x);
   magnetometer_vals_[1] = static_cast<double>(msg->y);
   magnetometer_vals_[2] = static_cast<double>(msg->z);
+
+  // Heading of the robot's x axis from east, counterclockwise (x forward,
+  // y left; tilt is ignored on the flat arena floor).
+  if (ekf_enabled_ && ekf_magnetometer_)
+  {
+    pose_ekf_.magnetometer(event.getReceiptTime().toSec(), std::atan2(magnetometer_vals_[0], magnetometer_vals_[1]));
+    ekfPoseChanged();
+  }
 }
 
 /*
  * Callback function for the Gyroscope sensor ROS subscriber.
  */
-void PheenoRobot::gyroscopeCallback(const geometry_msgs::Vector3::ConstPtr& msg)
+void PheenoRobot::gyroscopeCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event)
 {
+  geometry_msgs::Vector3::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::IMU_CHANNEL, event.getReceiptTime());
   gyroscope_vals_[0] = static_cast<double>(msg->x);
   gyroscope_vals_[1] = static_cast<double>(msg->y);
   gyroscope_vals_[2] = static_cast<double>(msg->z);
+
+  if (ekf_enabled_)
+  {
+    pose_ekf_.gyroscope(event.getReceiptTime().toSec(), gyroscope_vals_[2]);
+    ekfPoseChanged();
+  }
+  if (motion_monitor_enabled_)
+  {
+    motionEventsRaised(motion_monitor_.gyroscope(event.getReceiptTime().toSec(), gyroscope_vals_[2]));
+  }
 }
 
 /*
  * Callback function for the Accelerometer sensor ROS subscriber.
  */
-void PheenoRobot::accelerometerCallback(const geometry_msgs::Vector3::ConstPtr& msg)
+void PheenoRobot::accelerometerCallback(const ros::MessageEvent<geometry_msgs::Vector3 const>& event)
 {
+  geometry_msgs::Vector3::ConstPtr msg = event.getMessage();
+  recordLatency(Pheeno::IMU_CHANNEL, event.getReceiptTime());
   accelerometer_vals_[0] = static_cast<double>(msg->x);
   accelerometer_vals_[1] = static_cast<double>(msg->y);
   accelerometer_vals_[2] = static_cast<double>(msg->z);
+
+  if (motion_monitor_enabled_)
+  {
+    motionEventsRaised(motion_monitor_.accelerometer(event.getReceiptTime().toSec(),
+                                                     accelerometer_vals_[0], accelerometer_vals_[1]));
+  }
+}
+
+/*
+ * Callback function for the packed sensor sweep ROS subscriber.
+ *
+ * The message carries a verified frame payload from serial_bridge. It is
+ * decoded and applied in a single pass, so all sensor values always come
+ * from the same sweep. Gaps in the sequence number are counted as drops;
+ * duplicates are ignored.
+ */
+void PheenoRobot::sensorSweepCallback(const ros::MessageEvent<std_msgs::UInt8MultiArray const>& event)
+{
+  std_msgs::UInt8MultiArray::ConstPtr msg = event.getMessage();
+  SensorSweep sweep;
+  if (msg->data.empty() || !decodeSensorSweep(&msg->data[0], msg->data.size(), sweep))
+  {
+    recordLatency(Pheeno::SENSOR_SWEEP_CHANNEL, event.getReceiptTime());
+    ROS_WARN_THROTTLE(5.0, "Dropping sensor sweep with unsupported version or type.");
+    return;
+  }
+  recordLatency(Pheeno::SENSOR_SWEEP_CHANNEL, event.getReceiptTime(), sweep.stamp_ms * 0.001);
+
+  // A repeated sequence is a duplicate frame and a step back a firmware
+  // reset; neither loses sweeps.
+  if (sensor_sweep_count_ > 0)
+  {
+    int16_t gap = static_cast<int16_t>(sweep.sequence - last_sweep_sequence_);
+    if (gap == 0)
+    {
+      return;
+    }
+    if (gap > 0)
+    {
+      sensor_sweep_dropped_ += gap - 1;
+    }
+  }
+  last_sweep_sequence_ = sweep.sequence;
+  sensor_sweep_count_++;
+
+  applySensorSweep(sweep);
+}
+
+/*
+ * Copies a decoded sensor sweep into the sensor state. The bottom IR uses
+ * the same threshold as irSensorBottomCallback. A sweep carries the
+ * standard layout; extra sensors of other variants keep their last value.
+ */
+void PheenoRobot::applySensorSweep(const SensorSweep& sweep)
+{
+  const std::size_t ir_count = std::min<std::size_t>(ir_sensor_vals_.size(), Pheeno::SENSOR_SWEEP_IR_COUNT);
+  for (std::size_t i = 0; i < ir_count; i++)
+  {
+    ir_sensor_vals_[i] = static_cast<double>(sweep.ir[i]);
+    ir_range_rate_.update(i, ir_sensor_vals_[i], sweep.stamp_ms * 0.001);
+    insertIrBeam(i);
+  }
+
+  ir_sensor_bottom_.data = (sweep.ir_bottom < 1600) ? 0 : 1;
+
+  const std::size_t encoder_count = std::min<std::size_t>(encoder_vals_.size(), Pheeno::SENSOR_SWEEP_ENCODER_COUNT);
+  for (std::size_t i = 0; i < encoder_count; i++)
+  {
+    encoder_vals_[i] = static_cast<int>(sweep.encoders[i]);
+  }
+  updateWheelControl(sweep.stamp_ms * 0.001);
+
+  for (int i = 0; i < 3; i++)
+  {
+    magnetometer_vals_[i] = static_cast<double>(sweep.magnetometer[i]);
+    gyroscope_vals_[i] = static_cast<double>(sweep.gyroscope[i]);
+    accelerometer_vals_[i] = static_cast<double>(sweep.accelerometer[i]);
+  }
+
+  // The sweep's stamp times the encoder counts; the EKF and the motion
+  // monitor run on ROS time.
+  double now = ros::Time::now().toSec();
+  updateWheelOdometry(sweep.stamp_ms * 0.001, now);
+  if (motion_monitor_enabled_)
+  {
+    motionEventsRaised(motion_monitor_.gyroscope(now, gyroscope_vals_[2]) |
+                       motion_monitor_.accelerometer(now, accelerometer_vals_[0], accelerometer_vals_[1]));
+  }
+
+  if (ekf_enabled_)
+  {
+    pose_ekf_.gyroscope(now, gyroscope_vals_[2]);
+    if (ekf_magnetometer_)
+    {
+      pose_ekf_.magnetometer(now, std::atan2(magnetometer_vals_[0], magnetometer_vals_[1]));
+    }
+    ekfPoseChanged();
+  }
 }
 
 /*
@@ -310,56 +2105,27 @@ double PheenoRobot::randomTurn(float angular)
  */
 void PheenoRobot::avoidObstaclesLinear(double& linear, double& angular, float angular_velocity, float linear_velocity, double range_to_avoid)
 {
-  if (ir_sensor_vals_[Pheeno::IR::CENTER] < range_to_avoid)
-  {
-    if (std::abs((ir_sensor_vals_[Pheeno::IR::RIGHT] - ir_sensor_vals_[Pheeno::IR::LEFT])) < 5.0 ||
-        (ir_sensor_vals_[Pheeno::IR::RIGHT] > range_to_avoid && ir_sensor_vals_[Pheeno::IR::LEFT] > range_to_avoid))
-    {
-      linear = 0.0;
-      angular = randomTurn();
-    }
+  requireSensors(Pheeno::IR_SENSORS, "avoidObstaclesLinear");
+  Pheeno::avoidObstaclesLinear<Pheeno::Hardware>(avoidanceRanges(), linear, angular, angular_velocity,
+                                                 linear_velocity, range_to_avoid,
+                                                 [this]() { return randomTurn(); });
+}
 
-    if (ir_sensor_vals_[Pheeno::IR::RIGHT] < ir_sensor_vals_[Pheeno::IR::LEFT])
-    {
-      linear = 0.0;
-      angular = -1 * angular_velocity;  // Turn Left
-    }
-    else
-    {
-      linear = 0.0;
-      angular = angular_velocity;  // Turn Right
-    }
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CRIGHT] < range_to_avoid && ir_sensor_vals_[Pheeno::IR::CLEFT] < range_to_avoid)
-  {
-    linear = 0.0;
-    angular = randomTurn();
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CRIGHT] < range_to_avoid)
-  {
-    linear = 0.0;
-    angular = -1 * angular_velocity;  // Turn Left
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CLEFT] < range_to_avoid)
-  {
-    linear = 0.0;
-    angular = angular_velocity;  // Turn Right
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::RIGHT] < range_to_avoid)
-  {
-    linear = 0.0;
-    angular = -1 * angular_velocity;  // Turn Left
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::LEFT] < range_to_avoid)
-  {
-    linear = 0.0;
-    angular = angular_velocity;  // Turn Right
-  }
-  else
-  {
-    linear = linear_velocity;  // Move Straight
-    angular = 0.0;
-  }
+/*
+ * Predictive obstacle avoidance for a robot moving in a linear motion.
+ *
+ * Runs avoidObstaclesLinear and, while it drives straight, scales the speed
+ * down with the smallest time to collision of the forward IR channels:
+ * full speed beyond slow_ttc seconds, stopped at stop_ttc. The robot slows
+ * before an obstacle crosses range_to_avoid instead of braking at it.
+ */
+void PheenoRobot::avoidObstaclesPredictive(double& linear, double& angular, float angular_velocity, float linear_velocity,
+                                           double range_to_avoid, double stop_ttc, double slow_ttc)
+{
+  avoidObstaclesLinear(linear, angular, angular_velocity, linear_velocity, range_to_avoid);
+
+  double time_to_collision = ir_range_rate_.minTimeToCollision(Pheeno::Hardware::IR_FORWARD_MASK);
+  linear *= Pheeno::predictiveSpeedScale(time_to_collision, stop_ttc, slow_ttc);
 }
 
 /*
@@ -373,50 +2139,8 @@ void PheenoRobot::avoidObstaclesLinear(double& linear, double& angular, float an
  */
 void PheenoRobot::avoidObstaclesAngular(double& angular, double& random_turn_value, float angular_velocity, double range_to_avoid)
 {
-  if (ir_sensor_vals_[Pheeno::IR::CENTER] < range_to_avoid)
-  {
-    if (std::abs((ir_sensor_vals_[Pheeno::IR::RIGHT] - ir_sensor_vals_[Pheeno::IR::LEFT])) < 5.0 ||
-        (ir_sensor_vals_[Pheeno::IR::RIGHT] > range_to_avoid && ir_sensor_vals_[Pheeno::IR::LEFT] > range_to_avoid))
-    {
-      angular = randomTurn();
-    }
-
-    if (ir_sensor_vals_[Pheeno::IR::RIGHT] < ir_sensor_vals_[Pheeno::IR::LEFT])
-    {
-      angular = -1 * angular_velocity;  // Turn Left
-    }
-    else
-    {
-      angular = angular_velocity;  // Turn Right
-    }
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CRIGHT] < range_to_avoid && ir_sensor_vals_[Pheeno::IR::CLEFT] < range_to_avoid)
-  {
-    angular = randomTurn();
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CRIGHT] < range_to_avoid)
-  {
-    angular = -1 * angular_velocity;  // Turn Left
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::CLEFT] < range_to_avoid)
-  {
-    angular = angular_velocity;  // Turn Right
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::RIGHT] < range_to_avoid)
-  {
-    angular = -1 * angular_velocity;  // Turn Left
-  }
-  else if (ir_sensor_vals_[Pheeno::IR::LEFT] < range_to_avoid)
-  {
-    angular = angular_velocity;  // Turn Right
-  }
-  else
-  {
-    angular = random_turn_value;
-  }
-
-  if (angular != random_turn_value)
-  {
-    random_turn_value = angular;
-  }
+  requireSensors(Pheeno::IR_SENSORS, "avoidObstaclesAngular");
+  Pheeno::avoidObstaclesAngular<Pheeno::Hardware>(avoidanceRanges(), angular, random_turn_value,
+                                                  angular_velocity, range_to_avoid,
+                                                  [this]() { return randomTurn(); });
 }
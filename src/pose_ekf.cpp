@@ -0,0 +1,304 @@
+#include "pheeno_ros/pose_ekf.h"
+#include <cmath>
+
+namespace
+{
+  double normalizeAngle(double angle)
+  {
+    return std::atan2(std::sin(angle), std::cos(angle));
+  }
+}
+
+/*
+ * Contructor for the PoseEkf Class. The estimate starts at the origin.
+ */
+PoseEkf::PoseEkf(const Config& config)
+  : config_(config)
+{
+  reset();
+}
+
+/*
+ * Restarts the filter at pose with zero velocity. The position is taken as
+ * exact (it defines the odometry frame); the heading has initial_yaw_noise.
+ */
+void PoseEkf::reset(const Pose2D& pose)
+{
+  initialized_ = false;
+  initial_.stamp = 0.0;
+  for (int i = 0; i < STATE_SIZE; i++)
+  {
+    initial_.x[i] = 0.0;
+    for (int j = 0; j < STATE_SIZE; j++)
+    {
+      initial_.p[i][j] = 0.0;
+    }
+  }
+  initial_.x[X] = pose.x;
+  initial_.x[Y] = pose.y;
+  initial_.x[YAW] = normalizeAngle(pose.theta);
+  initial_.p[YAW][YAW] = config_.initial_yaw_noise * config_.initial_yaw_noise;
+  initial_.p[V][V] = config_.wheel_linear_noise * config_.wheel_linear_noise;
+  initial_.p[W][W] = config_.wheel_angular_noise * config_.wheel_angular_noise;
+  initial_.p[GYRO_BIAS][GYRO_BIAS] = config_.initial_gyro_bias_noise * config_.initial_gyro_bias_noise;
+  current_ = initial_;
+  base_ = initial_;
+
+  history_first_ = 0;
+  history_count_ = 0;
+  measurements_ = 0;
+  late_ = 0;
+  replayed_ = 0;
+  for (int i = 0; i < Pheeno::EKF_SOURCE_COUNT; i++)
+  {
+    rejected_[i] = 0;
+  }
+}
+
+/*
+ * Body velocities measured by the wheel encoders.
+ */
+bool PoseEkf::wheelOdometry(double stamp, double linear, double angular)
+{
+  return add(Pheeno::EKF_WHEEL_ODOMETRY, stamp, linear, angular);
+}
+
+/*
+ * Yaw rate measured by the gyroscope (rad/s).
+ */
+bool PoseEkf::gyroscope(double stamp, double yaw_rate)
+{
+  return add(Pheeno::EKF_GYROSCOPE, stamp, yaw_rate, 0.0);
+}
+
+/*
+ * Magnetic heading (rad). magnetometer_offset is subtracted to get the yaw.
+ */
+bool PoseEkf::magnetometer(double stamp, double heading)
+{
+  return add(Pheeno::EKF_MAGNETOMETER, stamp, heading, 0.0);
+}
+
+/*
+ * Body velocities from camera ego-motion.
+ */
+bool PoseEkf::visualOdometry(double stamp, double linear, double angular)
+{
+  return add(Pheeno::EKF_VISUAL_ODOMETRY, stamp, linear, angular);
+}
+
+/*
+ * The current pose carried forward to stamp with the estimated velocities.
+ */
+Pose2D PoseEkf::predictPose(double stamp) const
+{
+  Estimate estimate = current_;
+  if (initialized_)
+  {
+    predict(estimate, stamp);
+  }
+  return Pose2D(estimate.x[X], estimate.x[Y], estimate.x[YAW]);
+}
+
+/*
+ * Inserts a measurement into the history in stamp order and brings the
+ * current estimate up to date. An in-order measurement is a single predict
+ * and update; a late one replays everything after it.
+ */
+bool PoseEkf::add(Pheeno::EKF_SOURCE source, double stamp, double z0, double z1)
+{
+  if (!initialized_)
+  {
+    initialized_ = true;
+    current_.stamp = stamp;
+    base_.stamp = stamp;
+  }
+
+  // Find the insertion point, searching back from the newest entry.
+  std::size_t position = history_count_;
+  while (position > 0 && entry(position - 1).measurement.stamp > stamp)
+  {
+    position--;
+  }
+
+  bool in_order = (position == history_count_ && stamp >= current_.stamp);
+  if (!in_order && (position == 0 || current_.stamp - stamp > config_.max_delay))
+  {
+    late_++;
+    return false;
+  }
+
+  if (history_count_ == HISTORY_SIZE)
+  {
+    // Forget the oldest measurement. Its estimate is the base for the next.
+    base_ = entry(0).estimate;
+    history_first_ = (history_first_ + 1) % HISTORY_SIZE;
+    history_count_--;
+    position--;
+  }
+
+  for (std::size_t i = history_count_; i > position; i--)
+  {
+    entry(i) = entry(i - 1);
+  }
+  history_count_++;
+
+  Entry& added = entry(position);
+  added.measurement.source = source;
+  added.measurement.stamp = stamp;
+  added.measurement.z[0] = z0;
+  added.measurement.z[1] = z1;
+  added.estimate = (position > 0) ? entry(position - 1).estimate : base_;
+
+  measurements_++;
+  if (!apply(added.measurement, added.estimate))
+  {
+    rejected_[source]++;
+  }
+
+  for (std::size_t i = position + 1; i < history_count_; i++)
+  {
+    Entry& next = entry(i);
+    next.estimate = entry(i - 1).estimate;
+    apply(next.measurement, next.estimate);
+    replayed_++;
+  }
+
+  current_ = entry(history_count_ - 1).estimate;
+  return true;
+}
+
+/*
+ * Predicts estimate to the measurement's stamp and updates it. Returns
+ * false if any part of the measurement failed the gate.
+ */
+bool PoseEkf::apply(const Measurement& measurement, Estimate& estimate) const
+{
+  predict(estimate, measurement.stamp);
+
+  const double* x = estimate.x;
+  double h[STATE_SIZE] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  bool accepted = true;
+
+  switch (measurement.source)
+  {
+    case Pheeno::EKF_WHEEL_ODOMETRY:
+    case Pheeno::EKF_VISUAL_ODOMETRY:
+    {
+      bool wheel = (measurement.source == Pheeno::EKF_WHEEL_ODOMETRY);
+      double linear_noise = wheel ? config_.wheel_linear_noise : config_.visual_linear_noise;
+      double angular_noise = wheel ? config_.wheel_angular_noise : config_.visual_angular_noise;
+
+      h[V] = 1.0;
+      accepted &= update(estimate, h, measurement.z[0] - x[V], linear_noise * linear_noise);
+      h[V] = 0.0;
+      h[W] = 1.0;
+      accepted &= update(estimate, h, measurement.z[1] - x[W], angular_noise * angular_noise);
+      break;
+    }
+
+    case Pheeno::EKF_GYROSCOPE:
+      h[W] = 1.0;
+      h[GYRO_BIAS] = 1.0;
+      accepted = update(estimate, h, measurement.z[0] - x[W] - x[GYRO_BIAS],
+                        config_.gyro_noise * config_.gyro_noise);
+      break;
+
+    case Pheeno::EKF_MAGNETOMETER:
+      h[YAW] = 1.0;
+      accepted = update(estimate, h, normalizeAngle(measurement.z[0] - config_.magnetometer_offset - x[YAW]),
+                        config_.magnetometer_noise * config_.magnetometer_noise);
+      break;
+
+    default:
+      break;
+  }
+
+  return accepted;
+}
+
+/*
+ * Constant velocity unicycle prediction to stamp: P = F P F' + Q, with the
+ * velocities and the gyroscope bias driven by white noise.
+ */
+void PoseEkf::predict(Estimate& estimate, double stamp) const
+{
+  double dt = stamp - estimate.stamp;
+  if (dt <= 0.0)
+  {
+    return;
+  }
+  estimate.stamp = stamp;
+
+  double* x = estimate.x;
+  double (*p)[STATE_SIZE] = estimate.p;
+  double cos_yaw = std::cos(x[YAW]);
+  double sin_yaw = std::sin(x[YAW]);
+
+  // Jacobian entries off the identity
+  double f_x_yaw = -x[V] * sin_yaw * dt;
+  double f_x_v = cos_yaw * dt;
+  double f_y_yaw = x[V] * cos_yaw * dt;
+  double f_y_v = sin_yaw * dt;
+  double f_yaw_w = dt;
+
+  x[X] += x[V] * cos_yaw * dt;
+  x[Y] += x[V] * sin_yaw * dt;
+  x[YAW] = normalizeAngle(x[YAW] + x[W] * dt);
+
+  // F P: only the X, Y and YAW rows change.
+  for (int j = 0; j < STATE_SIZE; j++)
+  {
+    p[X][j] += f_x_yaw * p[YAW][j] + f_x_v * p[V][j];
+    p[Y][j] += f_y_yaw * p[YAW][j] + f_y_v * p[V][j];
+    p[YAW][j] += f_yaw_w * p[W][j];
+  }
+
+  // (F P) F': the same for the columns.
+  for (int i = 0; i < STATE_SIZE; i++)
+  {
+    p[i][X] += f_x_yaw * p[i][YAW] + f_x_v * p[i][V];
+    p[i][Y] += f_y_yaw * p[i][YAW] + f_y_v * p[i][V];
+    p[i][YAW] += f_yaw_w * p[i][W];
+  }
+
+  p[V][V] += config_.acceleration_noise * config_.acceleration_noise * dt;
+  p[W][W] += config_.angular_acceleration_noise * config_.angular_acceleration_noise * dt;
+  p[GYRO_BIAS][GYRO_BIAS] += config_.gyro_bias_noise * config_.gyro_bias_noise * dt;
+}
+
+/*
+ * Scalar Kalman update with measurement row h. The covariance update
+ * P -= (P h')(P h')' / s keeps P symmetric.
+ */
+bool PoseEkf::update(Estimate& estimate, const double* h, double innovation, double variance) const
+{
+  double ph[STATE_SIZE];
+  double s = variance;
+  for (int i = 0; i < STATE_SIZE; i++)
+  {
+    ph[i] = 0.0;
+    for (int j = 0; j < STATE_SIZE; j++)
+    {
+      ph[i] += estimate.p[i][j] * h[j];
+    }
+    s += h[i] * ph[i];
+  }
+
+  if (s <= 0.0 || (config_.gate > 0.0 && innovation * innovation > config_.gate * config_.gate * s))
+  {
+    return false;
+  }
+
+  double inverse_s = 1.0 / s;
+  for (int i = 0; i < STATE_SIZE; i++)
+  {
+    estimate.x[i] += ph[i] * inverse_s * innovation;
+    for (int j = 0; j < STATE_SIZE; j++)
+    {
+      estimate.p[i][j] -= ph[i] * ph[j] * inverse_s;
+    }
+  }
+  estimate.x[YAW] = normalizeAngle(estimate.x[YAW]);
+  return true;
+}
@@ -26,17 +26,14 @@ int main(int argc, char **argv)
   // Initializing ROS node
   ros::init(argc, argv, "random_walk_node");
 
-  // Create PheenoRobot object
-  PheenoRobot pheeno = PheenoRobot(pheeno_name);
-
-  // ROS Rate loop
-  ros::Rate loop_rate(10);
+  // Create PheenoRobot object (random walk reads no sensors)
+  PheenoRobot pheeno(pheeno_name, Pheeno::NO_SENSORS);
 
   // Variables before loop
   double saved_time = ros::Time::now().toSec();
   double current_duration;
-  double angular = 0.07;
-  double turn_direction = pheeno.randomTurn(angular);
+  const Pheeno::BehaviorParams& params = pheeno.behaviorParams();  // ~behavior/ tunables
+  double turn_direction = pheeno.randomTurn(params.random_turn);
   geometry_msgs::Twist cmd_vel_msg;
 
   while (ros::ok())
@@ -44,23 +41,23 @@ int main(int argc, char **argv)
     // Find current duration of motion.
     current_duration = ros::Time::now().toSec() - saved_time;
 
-    if (current_duration <= 10.0) {
+    if (current_duration <= params.walk_turn_time) {
       cmd_vel_msg.linear.x = 0.0;
       cmd_vel_msg.angular.z = turn_direction;
 
-    } else if (current_duration < 20.0) {
-      cmd_vel_msg.linear.x = 0.05;
+    } else if (current_duration < params.walk_time) {
+      cmd_vel_msg.linear.x = params.walk_linear;
       cmd_vel_msg.angular.z = 0.0;
 
     } else {
       // Reset Variables
       saved_time = ros::Time::now().toSec();
-      turn_direction = pheeno.randomTurn(angular);
+      turn_direction = pheeno.randomTurn(params.random_turn);
     }
 
-    // Publish, Spin, and Sleep
+    // Publish, Spin, and Sleep (at the adaptive control rate)
     pheeno.publish(cmd_vel_msg);
     ros::spinOnce();
-    loop_rate.sleep();
+    pheeno.sleep();
   }
 }
@@ -0,0 +1,254 @@
+#include "pheeno_ros/rosserial_protocol.h"
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const uint8_t SYNC_FLAG = 0xFF;
+  const uint8_t PROTOCOL_VERSION = 0xFE;  // rosserial Hydro and newer
+
+  /*
+   * Appends a little-endian uint32 length prefixed string (the ROS
+   * serialization of std::string) to the output buffer.
+   */
+  void appendString(const std::string& value, std::vector<uint8_t>& out)
+  {
+    uint32_t length = static_cast<uint32_t>(value.size());
+    for (int i = 0; i < 4; i++)
+    {
+      out.push_back(static_cast<uint8_t>((length >> (8 * i)) & 0xFF));
+    }
+    out.insert(out.end(), value.begin(), value.end());
+  }
+
+  /*
+   * Reads a ROS serialized std::string. Returns false if the string would
+   * run past the end of the buffer.
+   */
+  bool readString(const uint8_t* data, std::size_t length, std::size_t& offset,
+                  std::string& value)
+  {
+    // offset <= length always holds, so length - offset cannot wrap where
+    // offset + size could (size_t is 32 bits on the Raspberry Pi)
+    if (4 > length - offset)
+    {
+      return false;
+    }
+
+    uint32_t size = static_cast<uint32_t>(data[offset]) |
+                    (static_cast<uint32_t>(data[offset + 1]) << 8) |
+                    (static_cast<uint32_t>(data[offset + 2]) << 16) |
+                    (static_cast<uint32_t>(data[offset + 3]) << 24);
+    offset += 4;
+
+    if (size > length - offset)
+    {
+      return false;
+    }
+
+    value.assign(reinterpret_cast<const char*>(data + offset), size);
+    offset += size;
+    return true;
+  }
+}
+
+/*
+ * Contructor for the RosserialFrameParser Class.
+ *
+ * The payload buffer is sized for the largest frame the parser will accept.
+ * Frames announcing a larger length are rejected as LENGTH_ERROR.
+ */
+RosserialFrameParser::RosserialFrameParser(std::size_t max_payload)
+  : state_(SYNC), payload_(max_payload > 0 ? max_payload : 1), length_(0),
+    index_(0), topic_id_(0), checksum_(0), frame_count_(0),
+    length_error_count_(0), checksum_error_count_(0)
+{
+}
+
+/*
+ * Drops any partially received frame and waits for the next sync flag.
+ */
+void RosserialFrameParser::reset()
+{
+  state_ = SYNC;
+  length_ = 0;
+  index_ = 0;
+  checksum_ = 0;
+}
+
+/*
+ * Advances the parser state machine by a single byte.
+ *
+ * Returns FRAME_READY once a complete frame with valid length and message
+ * checksums has been received. Errors are counted and the parser
+ * resynchronizes on the next sync flag by itself.
+ */
+RosserialFrameParser::Result RosserialFrameParser::feed(uint8_t byte)
+{
+  switch (state_)
+  {
+    case SYNC:
+      if (byte == SYNC_FLAG)
+      {
+        state_ = PROTOCOL;
+      }
+      return NEED_MORE;
+
+    case PROTOCOL:
+      if (byte == PROTOCOL_VERSION)
+      {
+        state_ = LENGTH_LOW;
+      }
+      else if (byte != SYNC_FLAG)
+      {
+        reset();
+      }
+      return NEED_MORE;
+
+    case LENGTH_LOW:
+      length_ = byte;
+      checksum_ = byte;
+      state_ = LENGTH_HIGH;
+      return NEED_MORE;
+
+    case LENGTH_HIGH:
+      length_ |= static_cast<std::size_t>(byte) << 8;
+      checksum_ += byte;
+      state_ = LENGTH_CHECKSUM;
+      return NEED_MORE;
+
+    case LENGTH_CHECKSUM:
+      if (((checksum_ + byte) & 0xFF) != 0xFF || length_ > payload_.size())
+      {
+        length_error_count_++;
+        reset();
+        return LENGTH_ERROR;
+      }
+      state_ = TOPIC_LOW;
+      return NEED_MORE;
+
+    case TOPIC_LOW:
+      topic_id_ = byte;
+      checksum_ = byte;
+      state_ = TOPIC_HIGH;
+      return NEED_MORE;
+
+    case TOPIC_HIGH:
+      topic_id_ |= static_cast<uint16_t>(byte << 8);
+      checksum_ += byte;
+      index_ = 0;
+      state_ = (length_ > 0) ? PAYLOAD : MESSAGE_CHECKSUM;
+      return NEED_MORE;
+
+    case PAYLOAD:
+      payload_[index_++] = byte;
+      checksum_ += byte;
+      if (index_ == length_)
+      {
+        state_ = MESSAGE_CHECKSUM;
+      }
+      return NEED_MORE;
+
+    case MESSAGE_CHECKSUM:
+      state_ = SYNC;
+      if (((checksum_ + byte) & 0xFF) != 0xFF)
+      {
+        checksum_error_count_++;
+        return CHECKSUM_ERROR;
+      }
+      frame_count_++;
+      return FRAME_READY;
+  }
+
+  return NEED_MORE;
+}
+
+/*
+ * Appends a complete rosserial frame for the given topic id and payload to
+ * the output buffer. Returns the number of bytes appended.
+ */
+std::size_t encodeRosserialFrame(uint16_t topic_id, const uint8_t* data,
+                                 std::size_t length, std::vector<uint8_t>& out)
+{
+  std::size_t start = out.size();
+  uint8_t length_low = static_cast<uint8_t>(length & 0xFF);
+  uint8_t length_high = static_cast<uint8_t>((length >> 8) & 0xFF);
+  uint8_t topic_low = static_cast<uint8_t>(topic_id & 0xFF);
+  uint8_t topic_high = static_cast<uint8_t>((topic_id >> 8) & 0xFF);
+
+  out.push_back(SYNC_FLAG);
+  out.push_back(PROTOCOL_VERSION);
+  out.push_back(length_low);
+  out.push_back(length_high);
+  out.push_back(static_cast<uint8_t>(255 - ((length_low + length_high) % 256)));
+  out.push_back(topic_low);
+  out.push_back(topic_high);
+
+  unsigned int checksum = topic_low + topic_high;
+  for (std::size_t i = 0; i < length; i++)
+  {
+    checksum += data[i];
+  }
+  out.insert(out.end(), data, data + length);
+  out.push_back(static_cast<uint8_t>(255 - (checksum % 256)));
+
+  return out.size() - start;
+}
+
+/*
+ * Deserializes a rosserial_msgs/TopicInfo payload. Returns false if the
+ * payload is truncated.
+ */
+bool decodeRosserialTopicInfo(const uint8_t* data, std::size_t length,
+                              RosserialTopicInfo& info)
+{
+  std::size_t offset = 0;
+  if (length < 2)
+  {
+    return false;
+  }
+
+  info.topic_id = static_cast<uint16_t>(data[0] | (data[1] << 8));
+  offset = 2;
+
+  if (!readString(data, length, offset, info.topic_name) ||
+      !readString(data, length, offset, info.message_type) ||
+      !readString(data, length, offset, info.md5sum) ||
+      4 > length - offset)
+  {
+    return false;
+  }
+
+  uint32_t buffer_size = static_cast<uint32_t>(data[offset]) |
+                         (static_cast<uint32_t>(data[offset + 1]) << 8) |
+                         (static_cast<uint32_t>(data[offset + 2]) << 16) |
+                         (static_cast<uint32_t>(data[offset + 3]) << 24);
+  std::memcpy(&info.buffer_size, &buffer_size, sizeof(buffer_size));
+  return true;
+}
+
+/*
+ * Serializes a rosserial_msgs/TopicInfo payload (used by the Teensy
+ * emulator to announce its topics).
+ */
+std::size_t encodeRosserialTopicInfo(const RosserialTopicInfo& info,
+                                     std::vector<uint8_t>& out)
+{
+  std::size_t start = out.size();
+  out.push_back(static_cast<uint8_t>(info.topic_id & 0xFF));
+  out.push_back(static_cast<uint8_t>((info.topic_id >> 8) & 0xFF));
+  appendString(info.topic_name, out);
+  appendString(info.message_type, out);
+  appendString(info.md5sum, out);
+
+  uint32_t buffer_size;
+  std::memcpy(&buffer_size, &info.buffer_size, sizeof(buffer_size));
+  for (int i = 0; i < 4; i++)
+  {
+    out.push_back(static_cast<uint8_t>((buffer_size >> (8 * i)) & 0xFF));
+  }
+
+  return out.size() - start;
+}
@@ -0,0 +1,364 @@
+#include "pheeno_ros/sensor_frame.h"
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  /*
+   * Builds the 256 entry lookup table for CRC-16/CCITT (polynomial 0x1021).
+   */
+  struct Crc16Table
+  {
+    uint16_t entries[256];
+
+    Crc16Table()
+    {
+      for (int i = 0; i < 256; i++)
+      {
+        uint16_t crc = static_cast<uint16_t>(i << 8);
+        for (int bit = 0; bit < 8; bit++)
+        {
+          crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                               : static_cast<uint16_t>(crc << 1);
+        }
+        entries[i] = crc;
+      }
+    }
+  };
+
+  const Crc16Table CRC16_TABLE;
+
+  // Little-endian field helpers.
+  void putUint16(uint8_t*& out, uint16_t value)
+  {
+    *out++ = static_cast<uint8_t>(value & 0xFF);
+    *out++ = static_cast<uint8_t>(value >> 8);
+  }
+
+  void putUint32(uint8_t*& out, uint32_t value)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      *out++ = static_cast<uint8_t>((value >> (8 * i)) & 0xFF);
+    }
+  }
+
+  void putFloat(uint8_t*& out, float value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putUint32(out, bits);
+  }
+
+  uint16_t getUint16(const uint8_t*& in)
+  {
+    uint16_t value = static_cast<uint16_t>(in[0] | (in[1] << 8));
+    in += 2;
+    return value;
+  }
+
+  uint32_t getUint32(const uint8_t*& in)
+  {
+    uint32_t value = static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+                     (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    in += 4;
+    return value;
+  }
+
+  float getFloat(const uint8_t*& in)
+  {
+    uint32_t bits = getUint32(in);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /*
+   * IR ranges are carried as hundredths of a centimeter, saturating at the
+   * top of the uint16 range.
+   */
+  uint16_t packRange(float range)
+  {
+    if (!(range > 0.0f))
+    {
+      return 0;
+    }
+
+    float scaled = range * 100.0f + 0.5f;
+    return scaled >= 65535.0f ? 65535 : static_cast<uint16_t>(scaled);
+  }
+}
+
+/*
+ * Consistent Overhead Byte Stuffing. Writes at most length + length / 254 + 1
+ * bytes, none of which are zero, and returns the encoded length. The frame
+ * delimiter is not written.
+ */
+std::size_t cobsEncode(const uint8_t* data, std::size_t length, uint8_t* out)
+{
+  std::size_t write_index = 1;
+  std::size_t code_index = 0;
+  uint8_t code = 1;
+
+  for (std::size_t i = 0; i < length; i++)
+  {
+    if (data[i] == 0)
+    {
+      out[code_index] = code;
+      code = 1;
+      code_index = write_index++;
+    }
+    else
+    {
+      out[write_index++] = data[i];
+      code++;
+      if (code == 0xFF)
+      {
+        out[code_index] = code;
+        code = 1;
+        code_index = write_index++;
+      }
+    }
+  }
+
+  out[code_index] = code;
+  return write_index;
+}
+
+/*
+ * Reverses cobsEncode. Returns the decoded length, or 0 if the input is not
+ * valid COBS (a zero byte or a code that runs past the end).
+ */
+std::size_t cobsDecode(const uint8_t* data, std::size_t length, uint8_t* out)
+{
+  std::size_t read_index = 0;
+  std::size_t write_index = 0;
+
+  while (read_index < length)
+  {
+    uint8_t code = data[read_index];
+    if (code == 0 || read_index + code > length)
+    {
+      return 0;
+    }
+    read_index++;
+
+    for (uint8_t i = 1; i < code; i++)
+    {
+      out[write_index++] = data[read_index++];
+    }
+
+    if (code != 0xFF && read_index != length)
+    {
+      out[write_index++] = 0;
+    }
+  }
+
+  return write_index;
+}
+
+/*
+ * Table driven CRC-16/CCITT-FALSE. Pass a previous result as crc to continue
+ * a running checksum.
+ */
+uint16_t crc16Ccitt(const uint8_t* data, std::size_t length, uint16_t crc)
+{
+  for (std::size_t i = 0; i < length; i++)
+  {
+    crc = static_cast<uint16_t>((crc << 8) ^ CRC16_TABLE.entries[((crc >> 8) ^ data[i]) & 0xFF]);
+  }
+  return crc;
+}
+
+/*
+ * Builds a complete frame (version, type, body, CRC, COBS and delimiter) in
+ * out, which must hold Pheeno::SENSOR_FRAME_MAX_ENCODED bytes. Returns the
+ * number of bytes to transmit, or 0 if the body is too large.
+ */
+std::size_t encodeSensorFrame(uint8_t type, const uint8_t* body, std::size_t length, uint8_t* out)
+{
+  uint8_t payload[Pheeno::SENSOR_FRAME_MAX_PAYLOAD];
+  if (length + 4 > sizeof(payload))
+  {
+    return 0;
+  }
+
+  payload[0] = Pheeno::SENSOR_FRAME_VERSION;
+  payload[1] = type;
+  std::memcpy(payload + 2, body, length);
+
+  uint16_t crc = crc16Ccitt(payload, length + 2);
+  payload[length + 2] = static_cast<uint8_t>(crc & 0xFF);
+  payload[length + 3] = static_cast<uint8_t>(crc >> 8);
+
+  std::size_t encoded = cobsEncode(payload, length + 4, out);
+  out[encoded++] = 0x00;
+  return encoded;
+}
+
+/*
+ * Reference encoder for a full sensor sweep.
+ */
+std::size_t encodeSensorSweep(const SensorSweep& sweep, uint8_t* out)
+{
+  uint8_t body[Pheeno::SENSOR_SWEEP_BODY_SIZE];
+  uint8_t* cursor = body;
+
+  putUint16(cursor, sweep.sequence);
+  putUint32(cursor, sweep.stamp_ms);
+  for (std::size_t i = 0; i < Pheeno::SENSOR_SWEEP_IR_COUNT; i++)
+  {
+    putUint16(cursor, packRange(sweep.ir[i]));
+  }
+  putUint16(cursor, static_cast<uint16_t>(sweep.ir_bottom));
+  for (std::size_t i = 0; i < Pheeno::SENSOR_SWEEP_ENCODER_COUNT; i++)
+  {
+    putUint16(cursor, static_cast<uint16_t>(sweep.encoders[i]));
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    putFloat(cursor, sweep.magnetometer[i]);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    putFloat(cursor, sweep.gyroscope[i]);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    putFloat(cursor, sweep.accelerometer[i]);
+  }
+
+  return encodeSensorFrame(Pheeno::FRAME_SENSOR_SWEEP, body, sizeof(body), out);
+}
+
+/*
+ * Reference encoder for a velocity command (host to Teensy).
+ */
+std::size_t encodeCommandFrame(float linear, float angular, uint8_t* out)
+{
+  uint8_t body[Pheeno::COMMAND_BODY_SIZE];
+  uint8_t* cursor = body;
+  putFloat(cursor, linear);
+  putFloat(cursor, angular);
+  return encodeSensorFrame(Pheeno::FRAME_COMMAND, body, sizeof(body), out);
+}
+
+/*
+ * Decodes a sensor sweep payload in a single pass. Frames from a different
+ * protocol version or of a different type are rejected.
+ */
+bool decodeSensorSweep(const uint8_t* payload, std::size_t length, SensorSweep& sweep)
+{
+  if (length != 2 + Pheeno::SENSOR_SWEEP_BODY_SIZE ||
+      payload[0] != Pheeno::SENSOR_FRAME_VERSION ||
+      payload[1] != Pheeno::FRAME_SENSOR_SWEEP)
+  {
+    return false;
+  }
+
+  const uint8_t* cursor = payload + 2;
+  sweep.sequence = getUint16(cursor);
+  sweep.stamp_ms = getUint32(cursor);
+  for (std::size_t i = 0; i < Pheeno::SENSOR_SWEEP_IR_COUNT; i++)
+  {
+    sweep.ir[i] = getUint16(cursor) * 0.01f;
+  }
+  sweep.ir_bottom = static_cast<int16_t>(getUint16(cursor));
+  for (std::size_t i = 0; i < Pheeno::SENSOR_SWEEP_ENCODER_COUNT; i++)
+  {
+    sweep.encoders[i] = static_cast<int16_t>(getUint16(cursor));
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    sweep.magnetometer[i] = getFloat(cursor);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    sweep.gyroscope[i] = getFloat(cursor);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    sweep.accelerometer[i] = getFloat(cursor);
+  }
+
+  return true;
+}
+
+/*
+ * Decodes a velocity command payload.
+ */
+bool decodeCommandFrame(const uint8_t* payload, std::size_t length, float& linear, float& angular)
+{
+  if (length != 2 + Pheeno::COMMAND_BODY_SIZE ||
+      payload[0] != Pheeno::SENSOR_FRAME_VERSION ||
+      payload[1] != Pheeno::FRAME_COMMAND)
+  {
+    return false;
+  }
+
+  const uint8_t* cursor = payload + 2;
+  linear = getFloat(cursor);
+  angular = getFloat(cursor);
+  return true;
+}
+
+/*
+ * Contructor for the SensorFrameReader Class.
+ */
+SensorFrameReader::SensorFrameReader(std::size_t max_encoded)
+  : encoded_(max_encoded), decoded_(max_encoded), encoded_length_(0),
+    decoded_length_(0), overflow_(false), frame_count_(0),
+    crc_error_count_(0), framing_error_count_(0)
+{
+}
+
+/*
+ * Accumulates one byte. On the delimiter the buffered frame is decoded and
+ * its CRC verified; the payload (version, type and body) is then available
+ * through data() and size().
+ */
+SensorFrameReader::Result SensorFrameReader::feed(uint8_t byte)
+{
+  if (byte != 0x00)
+  {
+    if (encoded_length_ < encoded_.size())
+    {
+      encoded_[encoded_length_++] = byte;
+    }
+    else
+    {
+      overflow_ = true;
+    }
+    return NEED_MORE;
+  }
+
+  std::size_t encoded_length = encoded_length_;
+  bool overflow = overflow_;
+  encoded_length_ = 0;
+  overflow_ = false;
+
+  if (encoded_length == 0)
+  {
+    return NEED_MORE;  // Back to back delimiters
+  }
+
+  std::size_t decoded = overflow ? 0 : cobsDecode(&encoded_[0], encoded_length, &decoded_[0]);
+  if (decoded < 4)
+  {
+    framing_error_count_++;
+    return FRAME_ERROR;
+  }
+
+  uint16_t crc = static_cast<uint16_t>(decoded_[decoded - 2] | (decoded_[decoded - 1] << 8));
+  if (crc16Ccitt(&decoded_[0], decoded - 2) != crc)
+  {
+    crc_error_count_++;
+    return FRAME_ERROR;
+  }
+
+  decoded_length_ = decoded - 2;
+  frame_count_++;
+  return FRAME_READY;
+}
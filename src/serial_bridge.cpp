@@ -0,0 +1,838 @@
+#include "ros/ros.h"
+#include "std_msgs/Float32.h"
+#include "std_msgs/Int16.h"
+#include "std_msgs/UInt8MultiArray.h"
+#include "geometry_msgs/Twist.h"
+#include "geometry_msgs/Vector3.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "pheeno_ros/rosserial_protocol.h"
+#include "pheeno_ros/sensor_frame.h"
+#include "pheeno_ros/serial_bridge.h"
+#include <boost/shared_ptr.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const double TOPIC_REQUEST_PERIOD = 1.0;  // Seconds between requests while unconfigured
+  const double SYNC_TIMEOUT = 15.0;         // Seconds of silence before renegotiating
+  const double REOPEN_PERIOD = 1.0;         // Seconds between attempts to reopen the port
+  const double DIAGNOSTICS_PERIOD = 1.0;
+
+  /*
+   * Maps an integer baud rate onto the termios speed constant.
+   */
+  speed_t baudToSpeed(int baud)
+  {
+    switch (baud)
+    {
+      case 9600: return B9600;
+      case 19200: return B19200;
+      case 38400: return B38400;
+      case 57600: return B57600;
+      case 115200: return B115200;
+      case 230400: return B230400;
+#ifdef B460800
+      case 460800: return B460800;
+#endif
+#ifdef B921600
+      case 921600: return B921600;
+#endif
+      default: return B57600;
+    }
+  }
+
+  /*
+   * Device -> ROS topic. The message object is allocated once and every
+   * frame is deserialized into it directly from the receive buffer.
+   */
+  template <class M>
+  class TypedPublisher : public BridgedTopic
+  {
+
+  public:
+    TypedPublisher(ros::NodeHandle& nh, const RosserialTopicInfo& info)
+      : BridgedTopic(info)
+    {
+      pub_ = nh.advertise<M>(info.topic_name, 1);
+    }
+
+    bool publish(const uint8_t* data, std::size_t length)
+    {
+      try
+      {
+        ros::serialization::IStream stream(const_cast<uint8_t*>(data),
+                                           static_cast<uint32_t>(length));
+        ros::serialization::deserialize(stream, msg_);
+      }
+      catch (ros::serialization::StreamOverrunException&)
+      {
+        stats_.decode_errors++;
+        return false;
+      }
+
+      pub_.publish(msg_);
+      return true;
+    }
+
+  private:
+    ros::Publisher pub_;
+    M msg_;
+  };
+
+  /*
+   * ROS -> device topic. Incoming messages are serialized into a scratch
+   * buffer sized from the TopicInfo buffer_size and framed for the Teensy.
+   */
+  template <class M>
+  class TypedSubscriber : public BridgedTopic
+  {
+
+  public:
+    TypedSubscriber(ros::NodeHandle& nh, const RosserialTopicInfo& info,
+                    SerialBridge* bridge)
+      : BridgedTopic(info), bridge_(bridge)
+    {
+      scratch_.resize(info.buffer_size > 0 ? info.buffer_size : 64);
+      sub_ = nh.subscribe(info.topic_name, 1, &TypedSubscriber<M>::callback, this,
+                          ros::TransportHints().tcpNoDelay());
+    }
+
+    void callback(const boost::shared_ptr<M const>& msg)
+    {
+      uint32_t length = ros::serialization::serializationLength(*msg);
+      if (length > scratch_.size())
+      {
+        stats_.decode_errors++;
+        return;
+      }
+
+      ros::serialization::OStream stream(&scratch_[0], length);
+      ros::serialization::serialize(stream, *msg);
+
+      if (bridge_->sendFrame(info_.topic_id, &scratch_[0], length))
+      {
+        stats_.messages++;
+        stats_.bytes += length;
+      }
+    }
+
+  private:
+    ros::Subscriber sub_;
+    SerialBridge* bridge_;
+    std::vector<uint8_t> scratch_;
+  };
+
+  /*
+   * Packed mode: forwards each verified sensor sweep payload. The message is
+   * reused, so after the first frame assigning the payload does not allocate.
+   */
+  class SweepPublisher : public BridgedTopic
+  {
+
+  public:
+    SweepPublisher(ros::NodeHandle& nh, const RosserialTopicInfo& info)
+      : BridgedTopic(info)
+    {
+      msg_.data.reserve(Pheeno::SENSOR_FRAME_MAX_PAYLOAD);
+      pub_ = nh.advertise<std_msgs::UInt8MultiArray>(info.topic_name, 1);
+    }
+
+    bool publish(const uint8_t* data, std::size_t length)
+    {
+      msg_.data.assign(data, data + length);
+      pub_.publish(msg_);
+      return true;
+    }
+
+  private:
+    ros::Publisher pub_;
+    std_msgs::UInt8MultiArray msg_;
+  };
+
+  /*
+   * Packed mode: sends cmd_vel to the Teensy as a command frame.
+   */
+  class CommandSubscriber : public BridgedTopic
+  {
+
+  public:
+    CommandSubscriber(ros::NodeHandle& nh, const RosserialTopicInfo& info,
+                      SerialBridge* bridge)
+      : BridgedTopic(info), bridge_(bridge)
+    {
+      sub_ = nh.subscribe(info.topic_name, 1, &CommandSubscriber::callback, this,
+                          ros::TransportHints().tcpNoDelay());
+    }
+
+    void callback(const geometry_msgs::Twist::ConstPtr& msg)
+    {
+      std::size_t length = encodeCommandFrame(static_cast<float>(msg->linear.x),
+                                              static_cast<float>(msg->angular.z), frame_);
+      if (bridge_->sendPackedFrame(frame_, length))
+      {
+        stats_.messages++;
+        stats_.bytes += length;
+      }
+    }
+
+  private:
+    ros::Subscriber sub_;
+    SerialBridge* bridge_;
+    uint8_t frame_[Pheeno::SENSOR_FRAME_MAX_ENCODED];
+  };
+
+  RosserialTopicInfo packedTopicInfo(const std::string& name, const std::string& type)
+  {
+    RosserialTopicInfo info;
+    info.topic_id = Pheeno::USER_TOPIC_START;
+    info.topic_name = name;
+    info.message_type = type;
+    info.buffer_size = Pheeno::SENSOR_FRAME_MAX_ENCODED;
+    return info;
+  }
+
+  /*
+   * Message types the Pheeno firmware uses. Anything else is reported and
+   * ignored rather than handled generically.
+   */
+  struct MessageHandler
+  {
+    const char* type;
+    const char* md5sum;
+    BridgedTopic* (*makePublisher)(ros::NodeHandle&, const RosserialTopicInfo&);
+    BridgedTopic* (*makeSubscriber)(ros::NodeHandle&, const RosserialTopicInfo&, SerialBridge*);
+  };
+
+  template <class M>
+  BridgedTopic* makePublisher(ros::NodeHandle& nh, const RosserialTopicInfo& info)
+  {
+    return new TypedPublisher<M>(nh, info);
+  }
+
+  template <class M>
+  BridgedTopic* makeSubscriber(ros::NodeHandle& nh, const RosserialTopicInfo& info,
+                               SerialBridge* bridge)
+  {
+    return new TypedSubscriber<M>(nh, info, bridge);
+  }
+
+  template <class M>
+  MessageHandler handlerFor()
+  {
+    MessageHandler handler = {ros::message_traits::DataType<M>::value(),
+                              ros::message_traits::MD5Sum<M>::value(),
+                              &makePublisher<M>, &makeSubscriber<M>};
+    return handler;
+  }
+
+  const MessageHandler* findHandler(const std::string& type)
+  {
+    static const MessageHandler handlers[] = {
+      handlerFor<std_msgs::Float32>(),
+      handlerFor<std_msgs::Int16>(),
+      handlerFor<geometry_msgs::Vector3>(),
+      handlerFor<geometry_msgs::Twist>()
+    };
+
+    for (std::size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++)
+    {
+      if (type == handlers[i].type)
+      {
+        return &handlers[i];
+      }
+    }
+
+    return NULL;
+  }
+
+  /*
+   * Appends a key/value pair to a diagnostic status.
+   */
+  template <class T>
+  void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, T value)
+  {
+    std::ostringstream stream;
+    stream << value;
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = stream.str();
+    status.values.push_back(key_value);
+  }
+}
+
+/*
+ * Contructor for the SerialBridge Class.
+ *
+ * Receive and transmit buffers are allocated here. The serial port itself is
+ * opened by open() so that the node can keep retrying while the Teensy is
+ * unplugged. In packed mode the topic set is fixed, so the sensor_sweep
+ * publisher and cmd_vel subscriber are created here as well.
+ */
+SerialBridge::SerialBridge(std::string port, int baud, bool packed)
+  : port_(port), baud_(baud), fd_(-1), packed_(packed), parser_(1024),
+    configured_(false), bytes_read_(0), bytes_written_(0), unknown_topic_frames_(0)
+{
+  read_buffer_.resize(512);
+  write_buffer_.reserve(1024);
+
+  if (packed_)
+  {
+    publishers_.push_back(boost::shared_ptr<BridgedTopic>(new SweepPublisher(
+        nh_, packedTopicInfo("sensor_sweep", "std_msgs/UInt8MultiArray"))));
+    subscribers_.push_back(boost::shared_ptr<BridgedTopic>(new CommandSubscriber(
+        nh_, packedTopicInfo("cmd_vel", "geometry_msgs/Twist"), this)));
+  }
+
+  pub_diagnostics_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  last_diagnostics_time_ = ros::WallTime::now();
+}
+
+SerialBridge::~SerialBridge()
+{
+  close();
+}
+
+/*
+ * Opens and configures the serial device in raw 8N1 mode. Works the same
+ * for a real USB serial device and for the slave side of a pseudo-terminal.
+ */
+bool SerialBridge::open()
+{
+  last_open_attempt_ = ros::WallTime::now();
+  fd_ = ::open(port_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd_ < 0)
+  {
+    ROS_ERROR("Unable to open %s: %s", port_.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  struct termios tty;
+  if (tcgetattr(fd_, &tty) != 0)
+  {
+    ROS_ERROR("Unable to read attributes of %s: %s", port_.c_str(), std::strerror(errno));
+    close();
+    return false;
+  }
+
+  cfmakeraw(&tty);
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~CSTOPB;
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  cfsetispeed(&tty, baudToSpeed(baud_));
+  cfsetospeed(&tty, baudToSpeed(baud_));
+
+  if (tcsetattr(fd_, TCSANOW, &tty) != 0)
+  {
+    ROS_ERROR("Unable to configure %s: %s", port_.c_str(), std::strerror(errno));
+    close();
+    return false;
+  }
+
+  tcflush(fd_, TCIOFLUSH);
+  ROS_INFO("Connected to %s at %d baud.", port_.c_str(), baud_);
+
+  parser_.reset();
+  configured_ = false;
+  last_frame_time_ = ros::WallTime::now();
+  if (!packed_)
+  {
+    requestTopics();
+  }
+  return true;
+}
+
+/*
+ * Tells the Teensy to stop transmitting and closes the serial device.
+ */
+void SerialBridge::close()
+{
+  if (fd_ < 0)
+  {
+    return;
+  }
+
+  if (!packed_)
+  {
+    sendFrame(Pheeno::ID_TX_STOP, NULL, 0);
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+/*
+ * Waits up to timeout_ms for serial data, then parses and dispatches every
+ * complete frame that arrived. Also handles topic renegotiation, reopening
+ * the port and the periodic diagnostics report.
+ */
+void SerialBridge::spinOnce(int timeout_ms)
+{
+  ros::WallTime now = ros::WallTime::now();
+
+  if (fd_ < 0)
+  {
+    if ((now - last_open_attempt_).toSec() >= REOPEN_PERIOD)
+    {
+      open();
+    }
+  }
+  else
+  {
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, timeout_ms) > 0)
+    {
+      ssize_t count = ::read(fd_, &read_buffer_[0], read_buffer_.size());
+      if (count > 0)
+      {
+        bytes_read_ += count;
+        if (packed_)
+        {
+          for (ssize_t i = 0; i < count; i++)
+          {
+            switch (frame_reader_.feed(read_buffer_[i]))
+            {
+              case SensorFrameReader::FRAME_READY:
+                handlePackedFrame();
+                break;
+
+              case SensorFrameReader::FRAME_ERROR:
+                publishers_[0]->stats_.checksum_errors++;
+                break;
+
+              default:
+                break;
+            }
+          }
+        }
+        else
+        {
+          for (ssize_t i = 0; i < count; i++)
+          {
+            switch (parser_.feed(read_buffer_[i]))
+            {
+              case RosserialFrameParser::FRAME_READY:
+                handleFrame();
+                break;
+
+              case RosserialFrameParser::CHECKSUM_ERROR:
+              {
+                std::size_t index = parser_.topicId() - Pheeno::USER_TOPIC_START;
+                if (parser_.topicId() >= Pheeno::USER_TOPIC_START &&
+                    index < publishers_.size() && publishers_[index])
+                {
+                  publishers_[index]->stats_.checksum_errors++;
+                }
+                break;
+              }
+
+              default:
+                break;
+            }
+          }
+        }
+      }
+      else if (count < 0 && errno != EAGAIN && errno != EINTR)
+      {
+        ROS_ERROR("Lost connection to %s: %s", port_.c_str(), std::strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+      }
+      else if (pfd.revents & (POLLHUP | POLLERR))
+      {
+        ROS_ERROR("Lost connection to %s.", port_.c_str());
+        ::close(fd_);
+        fd_ = -1;
+      }
+    }
+
+    now = ros::WallTime::now();
+    if (packed_)
+    {
+      if (configured_ && (now - last_frame_time_).toSec() >= SYNC_TIMEOUT)
+      {
+        ROS_WARN("No sensor frames received for %.0f seconds.", SYNC_TIMEOUT);
+        configured_ = false;
+      }
+    }
+    else if ((!configured_ && (now - last_topic_request_).toSec() >= TOPIC_REQUEST_PERIOD) ||
+        (configured_ && (now - last_frame_time_).toSec() >= SYNC_TIMEOUT))
+    {
+      if (configured_)
+      {
+        ROS_WARN("Lost sync with device, requesting topics again.");
+      }
+      configured_ = false;
+      requestTopics();
+    }
+  }
+
+  if ((now - last_diagnostics_time_).toSec() >= DIAGNOSTICS_PERIOD)
+  {
+    publishDiagnostics();
+  }
+}
+
+/*
+ * Frames and writes a payload to the Teensy. The transmit buffer is reused
+ * between calls, so steady-state writes do not allocate.
+ */
+bool SerialBridge::sendFrame(uint16_t topic_id, const uint8_t* data, std::size_t length)
+{
+  if (fd_ < 0)
+  {
+    return false;
+  }
+
+  write_buffer_.clear();
+  encodeRosserialFrame(topic_id, data, length, write_buffer_);
+  return writeBytes(&write_buffer_[0], write_buffer_.size());
+}
+
+/*
+ * Writes an already encoded packed frame to the Teensy.
+ */
+bool SerialBridge::sendPackedFrame(const uint8_t* frame, std::size_t length)
+{
+  if (fd_ < 0)
+  {
+    return false;
+  }
+
+  return writeBytes(frame, length);
+}
+
+/*
+ * Blocking write of a complete buffer to the serial device.
+ */
+bool SerialBridge::writeBytes(const uint8_t* data, std::size_t length)
+{
+  std::size_t written = 0;
+  while (written < length)
+  {
+    ssize_t count = ::write(fd_, data + written, length - written);
+    if (count < 0)
+    {
+      if (errno == EAGAIN || errno == EINTR)
+      {
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        poll(&pfd, 1, 10);
+        continue;
+      }
+
+      ROS_ERROR("Write to %s failed: %s", port_.c_str(), std::strerror(errno));
+      return false;
+    }
+    written += count;
+  }
+
+  bytes_written_ += written;
+  return true;
+}
+
+/*
+ * Dispatches a complete frame from the parser. User topics are looked up by
+ * direct index, so the hot path is a bounds check and a deserialize.
+ */
+void SerialBridge::handleFrame()
+{
+  uint16_t topic_id = parser_.topicId();
+  last_frame_time_ = ros::WallTime::now();
+
+  if (topic_id >= Pheeno::USER_TOPIC_START)
+  {
+    std::size_t index = topic_id - Pheeno::USER_TOPIC_START;
+    if (index < publishers_.size() && publishers_[index])
+    {
+      BridgedTopic& topic = *publishers_[index];
+      if (topic.publish(parser_.data(), parser_.size()))
+      {
+        topic.stats_.messages++;
+        topic.stats_.bytes += parser_.size();
+      }
+    }
+    else
+    {
+      unknown_topic_frames_++;
+    }
+    return;
+  }
+
+  RosserialTopicInfo info;
+  switch (topic_id)
+  {
+    case Pheeno::ID_PUBLISHER:
+      if (decodeRosserialTopicInfo(parser_.data(), parser_.size(), info))
+      {
+        setupPublisher(info);
+      }
+      break;
+
+    case Pheeno::ID_SUBSCRIBER:
+      if (decodeRosserialTopicInfo(parser_.data(), parser_.size(), info))
+      {
+        setupSubscriber(info);
+      }
+      break;
+
+    case Pheeno::ID_TIME:
+      handleTimeRequest();
+      break;
+
+    case Pheeno::ID_PARAMETER_REQUEST:
+      handleParameterRequest();
+      break;
+
+    case Pheeno::ID_LOG:
+      handleLog(parser_.data(), parser_.size());
+      break;
+
+    case Pheeno::ID_TX_STOP:
+      ROS_WARN("Device requested a transmission stop.");
+      configured_ = false;
+      break;
+
+    default:
+      ROS_WARN("Ignoring frame for unsupported topic id %d.", topic_id);
+      break;
+  }
+}
+
+/*
+ * Dispatches a verified packed frame. Only sensor sweeps travel from the
+ * Teensy to the host; the payload is forwarded untouched so PheenoRobot can
+ * decode it in a single pass.
+ */
+void SerialBridge::handlePackedFrame()
+{
+  last_frame_time_ = ros::WallTime::now();
+  configured_ = true;
+
+  if (frame_reader_.type() != Pheeno::FRAME_SENSOR_SWEEP)
+  {
+    unknown_topic_frames_++;
+    return;
+  }
+
+  BridgedTopic& topic = *publishers_[0];
+  if (topic.publish(frame_reader_.data(), frame_reader_.size()))
+  {
+    topic.stats_.messages++;
+    topic.stats_.bytes += frame_reader_.size();
+  }
+}
+
+/*
+ * Asks the Teensy to (re)announce all of its publishers and subscribers.
+ */
+void SerialBridge::requestTopics()
+{
+  last_topic_request_ = ros::WallTime::now();
+  last_frame_time_ = last_topic_request_;
+  sendFrame(Pheeno::ID_PUBLISHER, NULL, 0);
+}
+
+/*
+ * Creates the ROS publisher for a topic announced by the Teensy.
+ */
+void SerialBridge::setupPublisher(const RosserialTopicInfo& info)
+{
+  configured_ = true;
+  if (info.topic_id < Pheeno::USER_TOPIC_START)
+  {
+    return;
+  }
+
+  std::size_t index = info.topic_id - Pheeno::USER_TOPIC_START;
+  if (index < publishers_.size() && publishers_[index] &&
+      publishers_[index]->info().topic_name == info.topic_name &&
+      publishers_[index]->info().message_type == info.message_type)
+  {
+    return;  // Renegotiation of an existing topic.
+  }
+
+  const MessageHandler* handler = findHandler(info.message_type);
+  if (handler == NULL)
+  {
+    ROS_ERROR("Unsupported message type %s on %s.", info.message_type.c_str(),
+              info.topic_name.c_str());
+    return;
+  }
+
+  if (info.md5sum != handler->md5sum)
+  {
+    ROS_ERROR("MD5 mismatch for %s (%s). Rebuild the firmware.",
+              info.topic_name.c_str(), info.message_type.c_str());
+    return;
+  }
+
+  if (index >= publishers_.size())
+  {
+    publishers_.resize(index + 1);
+  }
+
+  publishers_[index].reset(handler->makePublisher(nh_, info));
+  ROS_INFO("Setup publisher on %s [%s]", info.topic_name.c_str(), info.message_type.c_str());
+}
+
+/*
+ * Creates the ROS subscriber for a topic the Teensy listens to.
+ */
+void SerialBridge::setupSubscriber(const RosserialTopicInfo& info)
+{
+  configured_ = true;
+  for (std::size_t i = 0; i < subscribers_.size(); i++)
+  {
+    if (subscribers_[i]->info().topic_id == info.topic_id &&
+        subscribers_[i]->info().topic_name == info.topic_name)
+    {
+      return;  // Renegotiation of an existing topic.
+    }
+  }
+
+  const MessageHandler* handler = findHandler(info.message_type);
+  if (handler == NULL || info.md5sum != handler->md5sum)
+  {
+    ROS_ERROR("Unsupported or mismatched message type %s on %s.",
+              info.message_type.c_str(), info.topic_name.c_str());
+    return;
+  }
+
+  subscribers_.push_back(boost::shared_ptr<BridgedTopic>(
+      handler->makeSubscriber(nh_, info, this)));
+  ROS_INFO("Setup subscriber on %s [%s]", info.topic_name.c_str(), info.message_type.c_str());
+}
+
+/*
+ * Replies to a time synchronization request with the current ROS time.
+ */
+void SerialBridge::handleTimeRequest()
+{
+  ros::Time now = ros::Time::now();
+  uint8_t payload[8];
+  for (int i = 0; i < 4; i++)
+  {
+    payload[i] = static_cast<uint8_t>((now.sec >> (8 * i)) & 0xFF);
+    payload[4 + i] = static_cast<uint8_t>((now.nsec >> (8 * i)) & 0xFF);
+  }
+  sendFrame(Pheeno::ID_TIME, payload, sizeof(payload));
+}
+
+/*
+ * The Pheeno firmware does not use parameters, so every request receives an
+ * empty rosserial_msgs/RequestParamResponse (three zero length arrays).
+ */
+void SerialBridge::handleParameterRequest()
+{
+  uint8_t payload[12] = {0};
+  sendFrame(Pheeno::ID_PARAMETER_REQUEST, payload, sizeof(payload));
+}
+
+/*
+ * Forwards a rosserial_msgs/Log message from the Teensy to the ROS log.
+ */
+void SerialBridge::handleLog(const uint8_t* data, std::size_t length)
+{
+  if (length < 5)
+  {
+    return;
+  }
+
+  uint32_t size = static_cast<uint32_t>(data[1]) | (static_cast<uint32_t>(data[2]) << 8) |
+                  (static_cast<uint32_t>(data[3]) << 16) | (static_cast<uint32_t>(data[4]) << 24);
+  if (size > length - 5)
+  {
+    return;
+  }
+
+  std::string text(reinterpret_cast<const char*>(data + 5), size);
+  switch (data[0])
+  {
+    case 0: ROS_DEBUG("%s", text.c_str()); break;
+    case 1: ROS_INFO("%s", text.c_str()); break;
+    case 2: ROS_WARN("%s", text.c_str()); break;
+    default: ROS_ERROR("%s", text.c_str()); break;
+  }
+}
+
+/*
+ * Publishes link and per-topic throughput and error counters.
+ */
+void SerialBridge::publishDiagnostics()
+{
+  ros::WallTime now = ros::WallTime::now();
+  double elapsed = (now - last_diagnostics_time_).toSec();
+  last_diagnostics_time_ = now;
+
+  diagnostics_msg_.header.stamp = ros::Time::now();
+  diagnostics_msg_.status.clear();
+
+  diagnostic_msgs::DiagnosticStatus link;
+  link.name = "serial_bridge: " + port_;
+  link.hardware_id = port_;
+  link.level = (fd_ >= 0 && configured_) ? diagnostic_msgs::DiagnosticStatus::OK
+                                         : diagnostic_msgs::DiagnosticStatus::ERROR;
+  link.message = (fd_ < 0) ? "Disconnected" : (configured_ ? "Connected" : "Negotiating topics");
+  if (packed_)
+  {
+    addValue(link, "frames", frame_reader_.frameCount());
+    addValue(link, "framing errors", frame_reader_.framingErrorCount());
+    addValue(link, "crc errors", frame_reader_.crcErrorCount());
+  }
+  else
+  {
+    addValue(link, "frames", parser_.frameCount());
+    addValue(link, "length errors", parser_.lengthErrorCount());
+    addValue(link, "checksum errors", parser_.checksumErrorCount());
+  }
+  addValue(link, "unknown topic frames", unknown_topic_frames_);
+  addValue(link, "bytes read", bytes_read_);
+  addValue(link, "bytes written", bytes_written_);
+  diagnostics_msg_.status.push_back(link);
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    std::vector<boost::shared_ptr<BridgedTopic> >& topics = (pass == 0) ? publishers_ : subscribers_;
+    for (std::size_t i = 0; i < topics.size(); i++)
+    {
+      if (!topics[i])
+      {
+        continue;
+      }
+
+      BridgedTopicStats& stats = topics[i]->stats_;
+      diagnostic_msgs::DiagnosticStatus status;
+      status.name = "serial_bridge: " + topics[i]->info().topic_name;
+      status.hardware_id = port_;
+      status.level = (stats.checksum_errors + stats.decode_errors > 0)
+                       ? diagnostic_msgs::DiagnosticStatus::WARN
+                       : diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = (pass == 0) ? "device -> ros" : "ros -> device";
+      addValue(status, "messages", stats.messages);
+      addValue(status, "rate (Hz)", elapsed > 0 ? (stats.messages - stats.last_messages) / elapsed : 0.0);
+      addValue(status, "throughput (B/s)", elapsed > 0 ? (stats.bytes - stats.last_bytes) / elapsed : 0.0);
+      addValue(status, "checksum errors", stats.checksum_errors);
+      addValue(status, "decode errors", stats.decode_errors);
+      diagnostics_msg_.status.push_back(status);
+
+      stats.last_messages = stats.messages;
+      stats.last_bytes = stats.bytes;
+    }
+  }
+
+  pub_diagnostics_.publish(diagnostics_msg_);
+}
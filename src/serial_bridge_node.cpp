@@ -0,0 +1,35 @@
+#include "ros/ros.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/serial_bridge.h"
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char **argv)
+{
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+
+  // Serial device and baud rate. Defaults match rosserial_python.
+  std::string port = cml_parser("-p", "/dev/ttyACM0");
+  int baud = std::atoi(cml_parser("-b", "57600").c_str());
+
+  // Packed sensor frames instead of rosserial (firmware built with packed frames).
+  bool packed = cml_parser["-f"];
+
+  // Initializing ROS node
+  ros::init(argc, argv, "serial_node");
+
+  // Create SerialBridge object
+  SerialBridge bridge(port, baud, packed);
+  bridge.open();
+
+  while (ros::ok())
+  {
+    // Read and dispatch serial frames, then service ROS callbacks.
+    bridge.spinOnce();
+    ros::spinOnce();
+  }
+
+  bridge.close();
+  return 0;
+}
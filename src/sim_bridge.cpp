@@ -0,0 +1,366 @@
+//
+// Runs a swarm in the headless simulator (sim_world.h) in real time and
+// bridges every simulated robot to ROS with the topics of a real Pheeno, so
+// the unmodified behavior nodes drive it without Gazebo:
+//
+//   rosrun pheeno_ros sim_bridge -n 20 -x 5
+//   rosrun pheeno_ros obstacle_avoidance -n 01
+//
+// Robot k is /pheeno_<k> counting from -i, numbered like the hardware
+// ("01", "02", ...). Each publishes scan_*, encoder_*, magnetometer,
+// gyroscope, accelerometer and odom (ground truth pose, actual twist) at
+// -r Hz and follows its cmd_vel. With -f it instead publishes one
+// sensor_sweep per robot, the packed payload serial_bridge -f forwards.
+// -m adds the IR/IMU noise and latency models (sim_sensors.h).
+//
+// The odom poses are ground truth in one arena frame, so behaviors using
+// ORCA or flocking run with _fleet/shared_odom_frame:=true:
+//
+//   rosrun pheeno_ros flocking -n 01 _fleet/shared_odom_frame:=true
+//
+// Messages and publishers are created once; a topic nobody subscribes to
+// costs a counter check per publish, so one process serves a hundred
+// robots at sensor rate when only their behaviors' topics are wired up.
+//
+
+#include "ros/ros.h"
+#include "geometry_msgs/Twist.h"
+#include "geometry_msgs/Vector3.h"
+#include "nav_msgs/Odometry.h"
+#include "std_msgs/Float32.h"
+#include "std_msgs/Int16.h"
+#include "std_msgs/UInt8MultiArray.h"
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/sensor_frame.h"
+#include "pheeno_ros/sim_sensors.h"
+#include "pheeno_ros/sim_world.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Earth field as the Teensy's magnetometer reads it (gauss)
+  const double FIELD_HORIZONTAL = 0.2;
+  const double FIELD_VERTICAL = -0.4;
+
+  // Physics steps run per loop when the simulator falls behind the clock
+  const int MAX_CATCH_UP = 10;
+
+  /*
+   * Topics and reused messages of one simulated Pheeno.
+   */
+  struct BridgedPheeno
+  {
+    std::string name;
+    std::array<ros::Publisher, Pheeno::Hardware::IR_COUNT> pub_ir;
+    std::array<ros::Publisher, Pheeno::Hardware::ENCODER_COUNT> pub_encoder;
+    ros::Publisher pub_ir_bottom;
+    ros::Publisher pub_magnetometer;
+    ros::Publisher pub_gyroscope;
+    ros::Publisher pub_accelerometer;
+    ros::Publisher pub_odom;
+    ros::Publisher pub_sensor_sweep;
+    ros::Subscriber sub_cmd_vel;
+
+    SimWorld* world;
+    std::size_t index;
+    nav_msgs::Odometry odom_msg;
+    std_msgs::UInt8MultiArray sweep_msg;
+
+    void cmdVelCallback(const geometry_msgs::Twist::ConstPtr& msg)
+    {
+      world->setCommand(index, msg->linear.x, msg->angular.z);
+    }
+  };
+
+  template<class M>
+  void publishIfSubscribed(const ros::Publisher& pub, const M& msg)
+  {
+    if (pub.getNumSubscribers() > 0)
+    {
+      pub.publish(msg);
+    }
+  }
+
+  void placeBoxes(SimWorld& world, std::size_t count, std::mt19937& rng)
+  {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const SimWorld::Config& config = world.config();
+    for (std::size_t b = 0; b < count; b++)
+    {
+      double width = 0.1 + 0.2 * unit(rng);
+      double height = 0.1 + 0.2 * unit(rng);
+      double x = unit(rng) * (config.arena_width - width);
+      double y = unit(rng) * (config.arena_height - height);
+      SimBox box = {x, y, x + width, y + height};
+      world.addBox(box);
+    }
+  }
+
+  /*
+   * Magnetometer reading at a yaw, such that PheenoRobot's heading
+   * atan2(x, y) equals the yaw.
+   */
+  void magnetometerAt(double yaw, double* field)
+  {
+    field[0] = FIELD_HORIZONTAL * std::sin(yaw);
+    field[1] = FIELD_HORIZONTAL * std::cos(yaw);
+    field[2] = FIELD_VERTICAL;
+  }
+
+  void fillSweep(const SimRobot& robot, double now, uint16_t sequence, SensorSweep& sweep)
+  {
+    std::memset(&sweep, 0, sizeof(sweep));
+    sweep.sequence = sequence;
+    sweep.stamp_ms = static_cast<uint32_t>(now * 1000.0);
+    for (std::size_t i = 0; i < std::min(Pheeno::SENSOR_SWEEP_IR_COUNT, robot.ir.size()); i++)
+    {
+      sweep.ir[i] = static_cast<float>(robot.ir[i]);
+    }
+    sweep.ir_bottom = 2000;
+    for (std::size_t e = 0; e < std::min(Pheeno::SENSOR_SWEEP_ENCODER_COUNT, robot.encoders.size()); e++)
+    {
+      sweep.encoders[e] = static_cast<int16_t>(robot.encoders[e]);
+    }
+    double field[3];
+    magnetometerAt(robot.pose.theta, field);
+    for (int axis = 0; axis < 3; axis++)
+    {
+      sweep.magnetometer[axis] = static_cast<float>(field[axis]);
+      sweep.gyroscope[axis] = static_cast<float>(robot.gyroscope[axis]);
+      sweep.accelerometer[axis] = static_cast<float>(robot.accelerometer[axis]);
+    }
+  }
+
+  /*
+   * Publishes the readings of one robot on the individual topics.
+   */
+  void publishTopics(BridgedPheeno& pheeno, const SimRobot& robot)
+  {
+    std_msgs::Float32 range_msg;
+    for (std::size_t i = 0; i < pheeno.pub_ir.size(); i++)
+    {
+      range_msg.data = static_cast<float>(robot.ir[i]);
+      publishIfSubscribed(pheeno.pub_ir[i], range_msg);
+    }
+
+    std_msgs::Int16 count_msg;
+    count_msg.data = 2000;
+    publishIfSubscribed(pheeno.pub_ir_bottom, count_msg);
+    for (std::size_t e = 0; e < pheeno.pub_encoder.size(); e++)
+    {
+      count_msg.data = static_cast<int16_t>(robot.encoders[e]);
+      publishIfSubscribed(pheeno.pub_encoder[e], count_msg);
+    }
+
+    geometry_msgs::Vector3 vector_msg;
+    double field[3];
+    magnetometerAt(robot.pose.theta, field);
+    vector_msg.x = field[0];
+    vector_msg.y = field[1];
+    vector_msg.z = field[2];
+    publishIfSubscribed(pheeno.pub_magnetometer, vector_msg);
+    vector_msg.x = robot.gyroscope[0];
+    vector_msg.y = robot.gyroscope[1];
+    vector_msg.z = robot.gyroscope[2];
+    publishIfSubscribed(pheeno.pub_gyroscope, vector_msg);
+    vector_msg.x = robot.accelerometer[0];
+    vector_msg.y = robot.accelerometer[1];
+    vector_msg.z = robot.accelerometer[2];
+    publishIfSubscribed(pheeno.pub_accelerometer, vector_msg);
+  }
+
+  /*
+   * Publishes the packed sweep of one robot. The frame goes through the
+   * same reader as on the serial line, so the payload is exactly what
+   * serial_bridge forwards.
+   */
+  void publishSweep(BridgedPheeno& pheeno, const SimRobot& robot, double now, uint16_t sequence,
+                    SensorFrameReader& frame_reader)
+  {
+    if (pheeno.pub_sensor_sweep.getNumSubscribers() == 0)
+    {
+      return;
+    }
+
+    SensorSweep sweep;
+    uint8_t frame[Pheeno::SENSOR_FRAME_MAX_ENCODED];
+    fillSweep(robot, now, sequence, sweep);
+    std::size_t length = encodeSensorSweep(sweep, frame);
+    for (std::size_t b = 0; b < length; b++)
+    {
+      if (frame_reader.feed(frame[b]) == SensorFrameReader::FRAME_READY)
+      {
+        pheeno.sweep_msg.data.assign(frame_reader.data(), frame_reader.data() + frame_reader.size());
+        pheeno.pub_sensor_sweep.publish(pheeno.sweep_msg);
+      }
+    }
+  }
+
+  /*
+   * Ground truth pose and actual twist, as Gazebo's odometry.
+   */
+  void publishOdom(BridgedPheeno& pheeno, const SimRobot& robot, const ros::Time& stamp)
+  {
+    if (pheeno.pub_odom.getNumSubscribers() == 0)
+    {
+      return;
+    }
+
+    nav_msgs::Odometry& odom = pheeno.odom_msg;
+    odom.header.stamp = stamp;
+    odom.pose.pose.position.x = robot.pose.x;
+    odom.pose.pose.position.y = robot.pose.y;
+    odom.pose.pose.orientation.z = std::sin(0.5 * robot.pose.theta);
+    odom.pose.pose.orientation.w = std::cos(0.5 * robot.pose.theta);
+    odom.twist.twist.linear.x = robot.linear;
+    odom.twist.twist.angular.z = robot.angular;
+    pheeno.pub_odom.publish(odom);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse inputs
+  CommandLineParser cml_parser(argc, argv);
+  std::size_t robots = std::max(1, std::atoi(cml_parser("-n", "10").c_str()));
+  int first_id = std::max(0, std::atoi(cml_parser("-i", "1").c_str()));
+  std::size_t obstacles = std::max(0, std::atoi(cml_parser("-x", "0").c_str()));
+  uint32_t seed = static_cast<uint32_t>(std::strtoul(cml_parser("-s", "1").c_str(), NULL, 10));
+  unsigned int threads = std::max(0, std::atoi(cml_parser("-j", "1").c_str()));
+  double rate = std::atof(cml_parser("-r", "10").c_str());
+  if (rate <= 0)
+  {
+    rate = 10;
+  }
+  bool packed = cml_parser["-f"];
+
+  SimWorld::Config world_config;
+  world_config.arena_width = world_config.arena_height = std::max(0.5, std::atof(cml_parser("-w", "2").c_str()));
+
+  // Initializing ROS node
+  ros::init(argc, argv, "sim_bridge_node");
+  ros::NodeHandle nh;
+
+  SimWorld world(world_config, threads);
+  std::mt19937 rng(seed);
+  placeBoxes(world, obstacles, rng);
+
+  std::vector<Pose2D> poses;
+  if (!world.placeRandomly(robots, static_cast<uint32_t>(rng()), poses))
+  {
+    ROS_ERROR("Could not fit %lu Pheenos in the arena!", static_cast<unsigned long>(robots));
+    return 1;
+  }
+  for (std::size_t i = 0; i < poses.size(); i++)
+  {
+    world.addRobot(poses[i]);
+  }
+
+  SimSensorModel sensor_model;
+  if (cml_parser["-m"])
+  {
+    world.setSensorModel(&sensor_model, rng());
+  }
+
+  // Subscriber callbacks point into the vector; it is never resized.
+  std::vector<BridgedPheeno> pheenos(poses.size());
+  for (std::size_t i = 0; i < pheenos.size(); i++)
+  {
+    BridgedPheeno& pheeno = pheenos[i];
+    char number[16];
+    std::snprintf(number, sizeof(number), "%02d", first_id + static_cast<int>(i));
+    pheeno.name = std::string("/pheeno_") + number;
+    pheeno.world = &world;
+    pheeno.index = i;
+
+    if (packed)
+    {
+      pheeno.sweep_msg.data.reserve(Pheeno::SENSOR_FRAME_MAX_PAYLOAD);
+      pheeno.pub_sensor_sweep = nh.advertise<std_msgs::UInt8MultiArray>(pheeno.name + "/sensor_sweep", 1);
+    }
+    else
+    {
+      for (std::size_t s = 0; s < pheeno.pub_ir.size(); s++)
+      {
+        pheeno.pub_ir[s] = nh.advertise<std_msgs::Float32>(pheeno.name + "/" + Pheeno::Hardware::irTopic(s), 1);
+      }
+      for (std::size_t e = 0; e < pheeno.pub_encoder.size(); e++)
+      {
+        pheeno.pub_encoder[e] = nh.advertise<std_msgs::Int16>(pheeno.name + "/" + Pheeno::Hardware::encoderTopic(e), 1);
+      }
+      pheeno.pub_ir_bottom = nh.advertise<std_msgs::Int16>(pheeno.name + "/scan_bottom", 1);
+      pheeno.pub_magnetometer = nh.advertise<geometry_msgs::Vector3>(pheeno.name + "/magnetometer", 1);
+      pheeno.pub_gyroscope = nh.advertise<geometry_msgs::Vector3>(pheeno.name + "/gyroscope", 1);
+      pheeno.pub_accelerometer = nh.advertise<geometry_msgs::Vector3>(pheeno.name + "/accelerometer", 1);
+    }
+    pheeno.odom_msg.header.frame_id = "odom";
+    pheeno.odom_msg.child_frame_id = pheeno.name;
+    pheeno.pub_odom = nh.advertise<nav_msgs::Odometry>(pheeno.name + "/odom", 1);
+    pheeno.sub_cmd_vel = nh.subscribe(pheeno.name + "/cmd_vel", 1, &BridgedPheeno::cmdVelCallback, &pheeno);
+  }
+
+  ROS_INFO("Simulating %s to %s on %u threads", pheenos.front().name.c_str(), pheenos.back().name.c_str(),
+           world.threadCount());
+
+  // Variables before loop
+  SensorFrameReader frame_reader;
+  uint16_t sequence = 0;
+  double period = 1.0 / rate;
+  double next_publish = 0.0;
+  double start = ros::Time::now().toSec();
+  ros::Rate loop_rate(1.0 / world_config.dt);
+
+  while (ros::ok())
+  {
+    ros::spinOnce();
+
+    // Keep the simulated clock on the wall clock, dropping time it cannot
+    // make up.
+    double elapsed = ros::Time::now().toSec() - start;
+    int steps = 0;
+    while (world.time() < elapsed && steps < MAX_CATCH_UP)
+    {
+      world.step();
+      steps++;
+    }
+    if (world.time() < elapsed - MAX_CATCH_UP * world_config.dt)
+    {
+      ROS_WARN_THROTTLE(5.0, "Simulation runs %.2f s behind real time, skipping ahead.", elapsed - world.time());
+      start = ros::Time::now().toSec() - world.time();
+    }
+
+    if (world.time() >= next_publish)
+    {
+      next_publish = std::max(next_publish + period, world.time());
+      ros::Time stamp;
+      stamp.fromSec(start + world.time());
+      for (std::size_t i = 0; i < pheenos.size(); i++)
+      {
+        if (packed)
+        {
+          publishSweep(pheenos[i], world.robot(i), world.time(), sequence, frame_reader);
+        }
+        else
+        {
+          publishTopics(pheenos[i], world.robot(i));
+        }
+        publishOdom(pheenos[i], world.robot(i), stamp);
+      }
+      sequence++;
+    }
+
+    loop_rate.sleep();
+  }
+
+  return 0;
+}
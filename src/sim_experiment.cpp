@@ -0,0 +1,112 @@
+#include "pheeno_ros/sim_experiment.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+  // Drives a simulated robot with one of the node behaviors.
+  class BehaviorController : public SimWorld::Controller
+  {
+  public:
+    BehaviorController(Pheeno::BEHAVIOR behavior, const Pheeno::BehaviorParams& params, uint32_t seed)
+      : behavior_(behavior, params, seed) {}
+
+    void decide(double now, const SimRobot& robot, double& linear, double& angular)
+    {
+      behavior_.update(now, robot.ir, linear, angular);
+    }
+
+  private:
+    Pheeno::Behavior<Pheeno::Hardware> behavior_;
+  };
+
+  // splitmix64 finalizer
+  uint64_t mix(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+}
+
+/*
+ * Contructor for the SimExperiment Class.
+ */
+SimExperiment::SimExperiment(const Config& config)
+  : config_(config)
+{
+}
+
+/*
+ * Runs the experiment with the given seed.
+ */
+SimResult SimExperiment::run(uint32_t seed) const
+{
+  SimWorld world(config_.world, config_.threads);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  for (std::size_t b = 0; b < config_.obstacles; b++)
+  {
+    double width = 0.1 + 0.2 * unit(rng);
+    double height = 0.1 + 0.2 * unit(rng);
+    double x = unit(rng) * (config_.world.arena_width - width);
+    double y = unit(rng) * (config_.world.arena_height - height);
+    SimBox box = {x, y, x + width, y + height};
+    world.addBox(box);
+  }
+
+  std::vector<Pose2D> poses;
+  world.placeRandomly(config_.robots, static_cast<uint32_t>(rng()), poses);
+
+  std::vector<BehaviorController> controllers;
+  controllers.reserve(poses.size());
+  for (std::size_t i = 0; i < poses.size(); i++)
+  {
+    controllers.push_back(BehaviorController(config_.behavior, config_.params, static_cast<uint32_t>(rng())));
+  }
+  for (std::size_t i = 0; i < poses.size(); i++)
+  {
+    world.addRobot(poses[i], &controllers[i]);
+  }
+
+  SimSensorModel sensor_model(config_.sensors);
+  if (config_.sensor_errors)
+  {
+    world.setSensorModel(&sensor_model, rng());
+  }
+
+  SimResult result;
+  result.time_to_goal = -1.0;
+  while (world.time() < config_.duration - 0.5 * config_.world.dt)
+  {
+    world.step();
+    if (result.time_to_goal < 0.0 && world.coverage() >= config_.goal_coverage)
+    {
+      result.time_to_goal = world.time();
+    }
+  }
+
+  result.coverage = world.coverage();
+  result.coverage_rate = config_.duration > 0.0 ? result.coverage * 60.0 / config_.duration : 0.0;
+  result.collisions = world.collisions();
+  result.contact_time = 0.0;
+  result.stall_time = 0.0;
+  for (std::size_t i = 0; i < world.robotCount(); i++)
+  {
+    result.contact_time += world.robot(i).contact_time;
+    result.stall_time += world.robot(i).stall_time;
+  }
+  return result;
+}
+
+/*
+ * Decorrelated seeds for a series of runs, so runs of one series can be
+ * handed to threads in any order and still repeat.
+ */
+uint32_t SimExperiment::runSeed(uint32_t seed, uint64_t index)
+{
+  return static_cast<uint32_t>(mix(mix(seed) ^ index) >> 32);
+}
@@ -0,0 +1,262 @@
+#include "pheeno_ros/sim_sensors.h"
+#include "pheeno_ros/sim_world.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace
+{
+  const double ADC_REFERENCE = 5.0;  // V, Teensy analog reference of the IR board
+  const double ADJACENT_ANGLE = 0.9;  // rad, mounts closer than this see each other's light
+
+  // splitmix64
+  uint64_t mix(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+
+  double angleBetween(double a, double b)
+  {
+    return std::abs(std::atan2(std::sin(a - b), std::cos(a - b)));
+  }
+}
+
+/*
+ * Contructor for the SimSensorModel Class. Precomputes the tables.
+ */
+SimSensorModel::SimSensorModel(const Config& config)
+  : config_(config), ir_bin_(0.25)
+{
+  double max_range = Pheeno::Hardware::irMaxRange();
+
+  // Output voltage by true range, up to just past the maximum range
+  std::size_t bins = static_cast<std::size_t>(max_range / ir_bin_) + 2;
+  ir_voltage_.resize(bins);
+  for (std::size_t i = 0; i < bins; i++)
+  {
+    ir_voltage_[i] = irVoltage(i * ir_bin_);
+  }
+
+  // The firmware inverts the curve with its own (slightly off) scale
+  double scale = config_.ir_voltage_scale * (1.0 + config_.ir_calibration_error);
+  ir_range_.resize(ADC_CODES);
+  for (std::size_t code = 0; code < ADC_CODES; code++)
+  {
+    double voltage = code * ADC_REFERENCE / (ADC_CODES - 1);
+    double range = voltage > config_.ir_voltage_floor ?
+                   scale / (voltage - config_.ir_voltage_floor) - config_.ir_voltage_offset : max_range;
+    ir_range_[code] = std::max(0.0, std::min(range, max_range));
+  }
+
+  std::mt19937 rng(12345);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  normal_.resize(NORMAL_TABLE_SIZE);
+  for (std::size_t i = 0; i < NORMAL_TABLE_SIZE; i++)
+  {
+    normal_[i] = normal(rng);
+  }
+
+  ir_adjacent_.resize(Pheeno::Hardware::IR_COUNT);
+  for (std::size_t i = 0; i < Pheeno::Hardware::IR_COUNT; i++)
+  {
+    for (std::size_t j = 0; j < Pheeno::Hardware::IR_COUNT; j++)
+    {
+      if (i != j && angleBetween(Pheeno::Hardware::irMount(i).angle, Pheeno::Hardware::irMount(j).angle) < ADJACENT_ANGLE)
+      {
+        ir_adjacent_[i].push_back(j);
+      }
+    }
+  }
+}
+
+/*
+ * Starts a robot's sensors: its random stream, initial biases and empty
+ * channels.
+ */
+void SimSensorModel::reset(State& state, uint64_t seed) const
+{
+  state.stream = mix(seed);
+  state.counter = 0;
+  state.started = false;
+  state.bias_stamp = -1.0;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    state.gyro_bias[axis] = config_.gyro_bias * gaussian(state);
+    state.accel_bias[axis] = config_.accel_bias * gaussian(state);
+  }
+  for (int c = 0; c < Pheeno::SIM_CHANNEL_COUNT; c++)
+  {
+    state.channels[c].next_sample = 0.0;
+    state.channels[c].last_delivery = 0.0;
+    state.channels[c].head = 0;
+    state.channels[c].count = 0;
+  }
+}
+
+/*
+ * Takes the exact readings in robot at time now, samples each channel that
+ * is due, and replaces the readings with the latest ones delivered by now.
+ */
+void SimSensorModel::apply(State& state, double now, SimRobot& robot) const
+{
+  driftBiases(state, now);
+
+  for (int c = 0; c < Pheeno::SIM_CHANNEL_COUNT; c++)
+  {
+    State::Channel& channel = state.channels[c];
+    const SimChannelTiming& timing = config_.timing[c];
+
+    if (now >= channel.next_sample - 1e-9)
+    {
+      channel.next_sample = std::max(channel.next_sample + timing.period, now);
+      if (channel.count == QUEUE_SIZE)
+      {
+        // Nothing delivered for QUEUE_SIZE periods: the oldest is lost.
+        channel.head = (channel.head + 1) % QUEUE_SIZE;
+        channel.count--;
+      }
+
+      State::Sample& sample = channel.queue[(channel.head + channel.count) % QUEUE_SIZE];
+      channel.count++;
+      // In order, as on one serial line
+      sample.deliver_at = std::max(channel.last_delivery, now + timing.latency + timing.jitter * uniform(state));
+      channel.last_delivery = sample.deliver_at;
+
+      if (c == Pheeno::SIM_IR_CHANNEL)
+      {
+        sampleIr(state, robot, sample.values);
+      }
+      else if (c == Pheeno::SIM_ENCODER_CHANNEL)
+      {
+        std::copy(robot.encoders.begin(), robot.encoders.end(), sample.values);
+      }
+      else
+      {
+        sampleImu(state, robot, sample.values);
+      }
+
+      if (!state.started)
+      {
+        std::copy(sample.values, sample.values + MAX_VALUES, channel.delivered);
+      }
+    }
+
+    while (channel.count > 0 && channel.queue[channel.head].deliver_at <= now + 1e-9)
+    {
+      const State::Sample& sample = channel.queue[channel.head];
+      std::copy(sample.values, sample.values + MAX_VALUES, channel.delivered);
+      channel.head = (channel.head + 1) % QUEUE_SIZE;
+      channel.count--;
+    }
+  }
+  state.started = true;
+
+  const double* ir = state.channels[Pheeno::SIM_IR_CHANNEL].delivered;
+  std::copy(ir, ir + Pheeno::Hardware::IR_COUNT, robot.ir.begin());
+  const double* encoders = state.channels[Pheeno::SIM_ENCODER_CHANNEL].delivered;
+  for (std::size_t e = 0; e < Pheeno::Hardware::ENCODER_COUNT; e++)
+  {
+    robot.encoders[e] = static_cast<int>(encoders[e]);
+  }
+  const double* imu = state.channels[Pheeno::SIM_IMU_CHANNEL].delivered;
+  std::copy(imu, imu + 3, robot.gyroscope);
+  std::copy(imu + 3, imu + 6, robot.accelerometer);
+}
+
+uint64_t SimSensorModel::next(State& state) const
+{
+  return mix(state.stream + state.counter++);
+}
+
+// Uniform in [0, 1)
+double SimSensorModel::uniform(State& state) const
+{
+  return (next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double SimSensorModel::gaussian(State& state) const
+{
+  return normal_[next(state) & (NORMAL_TABLE_SIZE - 1)];
+}
+
+/*
+ * Sharp output voltage for an object at range (cm).
+ */
+double SimSensorModel::irVoltage(double range) const
+{
+  double peak = config_.ir_voltage_scale / (config_.ir_peak_range + config_.ir_voltage_offset) +
+                config_.ir_voltage_floor;
+  if (range < config_.ir_peak_range)
+  {
+    return peak * range / config_.ir_peak_range;
+  }
+  return config_.ir_voltage_scale / (range + config_.ir_voltage_offset) + config_.ir_voltage_floor;
+}
+
+void SimSensorModel::sampleIr(State& state, const SimRobot& robot, double* values) const
+{
+  double max_range = Pheeno::Hardware::irMaxRange();
+  double clean[MAX_VALUES];
+  double excess[MAX_VALUES];  // Over the voltage with nothing in view
+  for (std::size_t i = 0; i < Pheeno::Hardware::IR_COUNT; i++)
+  {
+    std::size_t bin = std::min(static_cast<std::size_t>(robot.ir[i] / ir_bin_ + 0.5), ir_voltage_.size() - 1);
+    clean[i] = ir_voltage_[bin];
+    excess[i] = std::max(0.0, clean[i] - ir_voltage_.back());
+  }
+
+  for (std::size_t i = 0; i < Pheeno::Hardware::IR_COUNT; i++)
+  {
+    double event = uniform(state);
+    if (event < config_.ir_dropout)
+    {
+      values[i] = max_range;
+      continue;
+    }
+    if (event < config_.ir_dropout + config_.ir_spike)
+    {
+      values[i] = uniform(state) * max_range;
+      continue;
+    }
+
+    double voltage = clean[i] + config_.ir_voltage_noise * gaussian(state);
+    for (std::size_t a = 0; a < ir_adjacent_[i].size(); a++)
+    {
+      voltage += config_.ir_crosstalk * excess[ir_adjacent_[i][a]];
+    }
+    long code = std::lround(voltage / ADC_REFERENCE * (ADC_CODES - 1));
+    values[i] = ir_range_[std::max(0L, std::min(code, static_cast<long>(ADC_CODES) - 1))];
+  }
+}
+
+void SimSensorModel::sampleImu(State& state, const SimRobot& robot, double* values) const
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    values[axis] = robot.gyroscope[axis] + state.gyro_bias[axis] + config_.gyro_noise * gaussian(state);
+    values[3 + axis] = robot.accelerometer[axis] + state.accel_bias[axis] + config_.accel_noise * gaussian(state);
+  }
+}
+
+/*
+ * Random walk of the IMU biases since the last call.
+ */
+void SimSensorModel::driftBiases(State& state, double now) const
+{
+  double dt = state.bias_stamp < 0.0 ? 0.0 : now - state.bias_stamp;
+  state.bias_stamp = now;
+  if (dt <= 0.0)
+  {
+    return;
+  }
+
+  double root_dt = std::sqrt(dt);
+  for (int axis = 0; axis < 3; axis++)
+  {
+    state.gyro_bias[axis] += config_.gyro_bias_walk * root_dt * gaussian(state);
+    state.accel_bias[axis] += config_.accel_bias_walk * root_dt * gaussian(state);
+  }
+}
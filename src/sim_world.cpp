@@ -0,0 +1,640 @@
+#include "pheeno_ros/sim_world.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  const double PI = 3.14159265358979;
+  const double GRAVITY = 9.81;
+
+  // Distance along the ray (x, y) + t (dx, dy) to the circle, or -1.
+  double rayCircle(double x, double y, double dx, double dy, double cx, double cy, double radius)
+  {
+    double ox = x - cx;
+    double oy = y - cy;
+    double b = ox * dx + oy * dy;
+    double c = ox * ox + oy * oy - radius * radius;
+    double discriminant = b * b - c;
+    if (discriminant < 0.0)
+    {
+      return -1.0;
+    }
+    double root = std::sqrt(discriminant);
+    double t = -b - root;
+    if (t < 0.0)
+    {
+      t = -b + root;  // Starting inside the circle
+    }
+    return t;
+  }
+
+  // Distance along the ray to the box (slab test), or -1.
+  double rayBox(double x, double y, double dx, double dy, const SimBox& box)
+  {
+    double t_near = -1e30;
+    double t_far = 1e30;
+    const double origin[2] = {x, y};
+    const double direction[2] = {dx, dy};
+    const double lower[2] = {box.min_x, box.min_y};
+    const double upper[2] = {box.max_x, box.max_y};
+    for (int axis = 0; axis < 2; axis++)
+    {
+      if (std::abs(direction[axis]) < 1e-12)
+      {
+        if (origin[axis] < lower[axis] || origin[axis] > upper[axis])
+        {
+          return -1.0;
+        }
+        continue;
+      }
+      double t1 = (lower[axis] - origin[axis]) / direction[axis];
+      double t2 = (upper[axis] - origin[axis]) / direction[axis];
+      t_near = std::max(t_near, std::min(t1, t2));
+      t_far = std::min(t_far, std::max(t1, t2));
+    }
+    if (t_near > t_far || t_far < 0.0)
+    {
+      return -1.0;
+    }
+    return std::max(t_near, 0.0);
+  }
+
+  int16_t wrapTicks(double ticks)
+  {
+    return static_cast<int16_t>(static_cast<long>(std::floor(ticks)) & 0xFFFF);
+  }
+}
+
+/*
+ * Contructor for the SimWorld Class. The arena starts empty.
+ */
+SimWorld::SimWorld(const Config& config, unsigned int threads)
+  : config_(config), time_(0.0), next_control_(0.0), sensor_model_(NULL), sensor_seed_(1), covered_count_(0), sense_hash_(0.5 * irReach()),
+    contact_hash_(2.0 * config.robot_radius)
+{
+  setThreads(threads);
+  coverage_columns_ = std::max(1, static_cast<int>(std::ceil(config_.arena_width / config_.coverage_cell)));
+  coverage_rows_ = std::max(1, static_cast<int>(std::ceil(config_.arena_height / config_.coverage_cell)));
+  covered_.assign(static_cast<std::size_t>(coverage_columns_) * coverage_rows_, 0);
+  free_cells_ = covered_.size();
+}
+
+/*
+ * Adds a robot at rest at pose. Returns its index.
+ */
+std::size_t SimWorld::addRobot(const Pose2D& pose, Controller* controller)
+{
+  SimRobot robot;
+  robot.pose = pose;
+  robot.linear = robot.angular = 0.0;
+  robot.command_linear = robot.command_angular = 0.0;
+  robot.wheel_linear = robot.wheel_angular = 0.0;
+  robot.left_travel = robot.right_travel = 0.0;
+  robot.ir.fill(Pheeno::Hardware::irMaxRange());
+  robot.encoders.fill(0);
+  for (int i = 0; i < 3; i++)
+  {
+    robot.gyroscope[i] = 0.0;
+    robot.accelerometer[i] = 0.0;
+  }
+  robot.accelerometer[2] = GRAVITY;
+  robot.in_contact = false;
+  robot.collisions = 0;
+  robot.contact_time = 0.0;
+  robot.stall_time = 0.0;
+
+  robots_.push_back(robot);
+  controllers_.push_back(controller);
+  previous_poses_.push_back(pose);
+  sensor_states_.resize(robots_.size());
+  if (sensor_model_ != NULL)
+  {
+    sensor_model_->reset(sensor_states_.back(), sensorSeed(robots_.size() - 1));
+  }
+  cover(robots_.size() - 1);
+  return robots_.size() - 1;
+}
+
+/*
+ * Adds a box obstacle. Coverage cells under it no longer count.
+ */
+void SimWorld::addBox(const SimBox& box)
+{
+  boxes_.push_back(box);
+
+  free_cells_ = 0;
+  for (int row = 0; row < coverage_rows_; row++)
+  {
+    for (int column = 0; column < coverage_columns_; column++)
+    {
+      double x = (column + 0.5) * config_.coverage_cell;
+      double y = (row + 0.5) * config_.coverage_cell;
+      if (freeAt(x, y, 0.0))
+      {
+        free_cells_++;
+      }
+    }
+  }
+}
+
+/*
+ * Draws count poses clear of the walls, the boxes and each other. Returns
+ * false if the arena is too crowded.
+ */
+bool SimWorld::placeRandomly(std::size_t count, uint32_t seed, std::vector<Pose2D>& poses) const
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  double clearance = config_.robot_radius * 1.5;
+
+  poses.clear();
+  for (int attempt = 0; poses.size() < count && attempt < 1000 * static_cast<int>(count + 1); attempt++)
+  {
+    Pose2D pose(unit(rng) * config_.arena_width, unit(rng) * config_.arena_height, (2.0 * unit(rng) - 1.0) * PI);
+    if (!freeAt(pose.x, pose.y, clearance))
+    {
+      continue;
+    }
+
+    bool clear = true;
+    for (std::size_t i = 0; i < poses.size() && clear; i++)
+    {
+      clear = std::hypot(poses[i].x - pose.x, poses[i].y - pose.y) >= 2.0 * clearance;
+    }
+    if (clear)
+    {
+      poses.push_back(pose);
+    }
+  }
+  return poses.size() == count;
+}
+
+/*
+ * Sets the command of a robot, clamped to the motor limits.
+ */
+void SimWorld::setCommand(std::size_t robot, double linear, double angular)
+{
+  robots_[robot].command_linear = std::max(-config_.max_linear, std::min(config_.max_linear, linear));
+  robots_[robot].command_angular = std::max(-config_.max_angular, std::min(config_.max_angular, angular));
+}
+
+/*
+ * Runs the readings of every robot through model from now on (NULL for
+ * exact readings). Each robot's errors are drawn from its own stream
+ * derived from seed.
+ */
+void SimWorld::setSensorModel(const SimSensorModel* model, uint64_t seed)
+{
+  sensor_model_ = model;
+  sensor_seed_ = seed;
+  for (std::size_t i = 0; i < robots_.size() && sensor_model_ != NULL; i++)
+  {
+    sensor_model_->reset(sensor_states_[i], sensorSeed(i));
+  }
+}
+
+/*
+ * Number of worker threads step() splits the phases over.
+ */
+void SimWorld::setThreads(unsigned int threads)
+{
+  team_.setThreads(threads);
+  neighbors_.resize(team_.threadCount());
+}
+
+/*
+ * Advances the world by dt: sense, decide (on control ticks), integrate,
+ * resolve contacts.
+ */
+void SimWorld::step()
+{
+  // Sense, decide and integrate run as one pass: rays see the other
+  // robots at the positions hashed before it, and each phase ends with
+  // the team waiting for its slowest thread.
+  bool control = time_ >= next_control_ - 1e-9;
+  if (control)
+  {
+    next_control_ += config_.control_period;
+  }
+  hashPositions(sense_hash_);
+  forEachRobot([this, control](unsigned int thread, std::size_t i)
+               {
+                 sense(thread, i);
+                 if (control)
+                 {
+                   decide(i);
+                 }
+                 integrate(i);
+               });
+  resolveContacts();
+
+  // Cheap next to the other phases (a few cells per robot), and the only
+  // one writing shared state.
+  for (std::size_t i = 0; i < robots_.size(); i++)
+  {
+    cover(i);
+  }
+  time_ += config_.dt;
+}
+
+/*
+ * Fraction of the free arena cells covered so far.
+ */
+double SimWorld::coverage() const
+{
+  return free_cells_ > 0 ? static_cast<double>(covered_count_) / free_cells_ : 0.0;
+}
+
+/*
+ * Contact onsets of all robots.
+ */
+unsigned long SimWorld::collisions() const
+{
+  unsigned long total = 0;
+  for (std::size_t i = 0; i < robots_.size(); i++)
+  {
+    total += robots_[i].collisions;
+  }
+  return total;
+}
+
+/*
+ * Calls fn(thread, i) for every robot, split over the worker threads.
+ */
+template <class Fn>
+void SimWorld::forEachRobot(Fn fn)
+{
+  team_.run(robots_.size(), BLOCK_SIZE,
+            [&](unsigned int thread, std::size_t begin, std::size_t end)
+            {
+              for (std::size_t i = begin; i < end; i++)
+              {
+                fn(thread, i);
+              }
+            });
+}
+
+/*
+ * Rebuilds hash over the current robot positions.
+ */
+void SimWorld::hashPositions(SpatialHash& hash)
+{
+  std::size_t count = robots_.size();
+  x_.resize(count);
+  y_.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    x_[i] = robots_[i].pose.x;
+    y_[i] = robots_[i].pose.y;
+  }
+  hash.build(count ? &x_[0] : NULL, count ? &y_[0] : NULL, count);
+}
+
+/*
+ * Fills a robot's IR ranges and encoder counts. Other robots come from
+ * sense_hash_.
+ */
+void SimWorld::sense(unsigned int thread, std::size_t i)
+{
+  SimRobot& robot = robots_[i];
+  std::vector<uint32_t>& neighbors = neighbors_[thread];
+  neighbors.clear();
+  sense_hash_.forEachNear(robot.pose.x, robot.pose.y, irReach() + config_.robot_radius,
+                          [&](uint32_t index, double, double, double)
+                          {
+                            if (index != i)
+                            {
+                              neighbors.push_back(index);
+                            }
+                          });
+
+  double cos_yaw = std::cos(robot.pose.theta);
+  double sin_yaw = std::sin(robot.pose.theta);
+  double max_range = Pheeno::Hardware::irMaxRange();
+  for (std::size_t s = 0; s < Pheeno::Hardware::IR_COUNT; s++)
+  {
+    const Pheeno::IrMount& mount = Pheeno::Hardware::irMount(s);
+    double x = robot.pose.x + cos_yaw * mount.x - sin_yaw * mount.y;
+    double y = robot.pose.y + sin_yaw * mount.x + cos_yaw * mount.y;
+    double angle = robot.pose.theta + mount.angle;
+    double range = castRay(neighbors, x, y, std::cos(angle), std::sin(angle), max_range / 100.0);
+    robot.ir[s] = std::min(range * 100.0, max_range);
+  }
+
+  const double ticks_per_meter = Pheeno::Hardware::encoderTicksPerRev() / (2.0 * PI * Pheeno::Hardware::wheelRadius());
+  int16_t left = wrapTicks(robot.left_travel * ticks_per_meter);
+  int16_t right = wrapTicks(robot.right_travel * ticks_per_meter);
+  for (std::size_t e = 0; e < Pheeno::Hardware::ENCODER_COUNT; e++)
+  {
+    robot.encoders[e] = ((Pheeno::Hardware::LEFT_ENCODER_MASK >> e) & 1u) ? left : right;
+  }
+
+  if (sensor_model_ != NULL)
+  {
+    sensor_model_->apply(sensor_states_[i], time_, robot);
+  }
+}
+
+/*
+ * Asks the robot's controller, if any, for a new command.
+ */
+void SimWorld::decide(std::size_t i)
+{
+  if (controllers_[i] == NULL)
+  {
+    return;
+  }
+
+  double linear = 0.0;
+  double angular = 0.0;
+  controllers_[i]->decide(time_, robots_[i], linear, angular);
+  setCommand(i, linear, angular);
+}
+
+/*
+ * Moves a robot by its wheel velocities, which follow the command with the
+ * motor lag.
+ */
+void SimWorld::integrate(std::size_t i)
+{
+  SimRobot& robot = robots_[i];
+  double dt = config_.dt;
+  double weight = dt / (config_.motor_time_constant + dt);
+  robot.wheel_linear += weight * (robot.command_linear - robot.wheel_linear);
+  robot.wheel_angular += weight * (robot.command_angular - robot.wheel_angular);
+
+  double half_base = Pheeno::Hardware::wheelBase() / 2.0;
+  robot.left_travel += (robot.wheel_linear - robot.wheel_angular * half_base) * dt;
+  robot.right_travel += (robot.wheel_linear + robot.wheel_angular * half_base) * dt;
+
+  previous_poses_[i] = robot.pose;
+  double heading = robot.pose.theta + 0.5 * robot.wheel_angular * dt;
+  robot.pose.x += robot.wheel_linear * std::cos(heading) * dt;
+  robot.pose.y += robot.wheel_linear * std::sin(heading) * dt;
+  robot.pose.theta = std::atan2(std::sin(robot.pose.theta + robot.wheel_angular * dt),
+                                std::cos(robot.pose.theta + robot.wheel_angular * dt));
+}
+
+/*
+ * Pushes robots out of each other, the boxes and the walls in two Jacobi
+ * passes, then derives each robot's actual velocity and IMU readings from
+ * how far it really moved.
+ */
+void SimWorld::resolveContacts()
+{
+  std::size_t count = robots_.size();
+  push_x_.resize(count);
+  push_y_.resize(count);
+  touching_.assign(count, 0);
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    bool last = (pass == 1);
+    hashPositions(contact_hash_);
+    forEachRobot([this](unsigned int, std::size_t i) { push(i); });
+    forEachRobot([this, last](unsigned int, std::size_t i)
+                 {
+                   robots_[i].pose.x += push_x_[i];
+                   robots_[i].pose.y += push_y_[i];
+                   pushOutOfObstacles(i);
+                   if (last)
+                   {
+                     finishStep(i);
+                   }
+                 });
+  }
+}
+
+/*
+ * Half the overlap with each touching robot, away from it. The other robot
+ * moves the other half when its own push is computed.
+ */
+void SimWorld::push(std::size_t i)
+{
+  double radius = config_.robot_radius;
+  double x = 0.0;
+  double y = 0.0;
+  contact_hash_.forEachNear(robots_[i].pose.x, robots_[i].pose.y, 2.0 * radius,
+                            [&](uint32_t index, double dx, double dy, double distance_squared)
+                            {
+                              if (index == i || distance_squared >= 4.0 * radius * radius)
+                              {
+                                return;
+                              }
+                              double distance = std::sqrt(distance_squared);
+                              if (distance < 1e-9)
+                              {
+                                // Coincident centers: the lower index goes -x.
+                                dx = index > i ? 1.0 : -1.0;
+                                dy = 0.0;
+                                distance = 1.0;
+                              }
+                              double push = 0.5 * (2.0 * radius - std::sqrt(distance_squared)) / distance;
+                              x -= dx * push;
+                              y -= dy * push;
+                              touching_[i] = 1;
+                            });
+  push_x_[i] = x;
+  push_y_[i] = y;
+}
+
+/*
+ * Moves a robot out of the boxes and inside the walls.
+ */
+void SimWorld::pushOutOfObstacles(std::size_t i)
+{
+  double radius = config_.robot_radius;
+  Pose2D& pose = robots_[i].pose;
+  for (std::size_t b = 0; b < boxes_.size(); b++)
+  {
+    const SimBox& box = boxes_[b];
+    double closest_x = std::max(box.min_x, std::min(pose.x, box.max_x));
+    double closest_y = std::max(box.min_y, std::min(pose.y, box.max_y));
+    double dx = pose.x - closest_x;
+    double dy = pose.y - closest_y;
+    double distance = std::hypot(dx, dy);
+    if (distance >= radius)
+    {
+      continue;
+    }
+    if (distance < 1e-9)
+    {
+      // Center inside the box: leave through the nearest side.
+      double exits[4] = {pose.x - box.min_x, box.max_x - pose.x, pose.y - box.min_y, box.max_y - pose.y};
+      int side = static_cast<int>(std::min_element(exits, exits + 4) - exits);
+      pose.x += (side == 0) ? -(exits[0] + radius) : (side == 1) ? exits[1] + radius : 0.0;
+      pose.y += (side == 2) ? -(exits[2] + radius) : (side == 3) ? exits[3] + radius : 0.0;
+    }
+    else
+    {
+      pose.x += dx / distance * (radius - distance);
+      pose.y += dy / distance * (radius - distance);
+    }
+    touching_[i] = 1;
+  }
+
+  double x = std::max(radius, std::min(pose.x, config_.arena_width - radius));
+  double y = std::max(radius, std::min(pose.y, config_.arena_height - radius));
+  if (x != pose.x || y != pose.y)
+  {
+    pose.x = x;
+    pose.y = y;
+    touching_[i] = 1;
+  }
+}
+
+/*
+ * Actual velocity, IMU readings and contact counters from the resolved
+ * motion of the step. Contact onsets count as collisions.
+ */
+void SimWorld::finishStep(std::size_t i)
+{
+  double dt = config_.dt;
+  SimRobot& robot = robots_[i];
+  const Pose2D& previous = previous_poses_[i];
+  double turn = std::atan2(std::sin(robot.pose.theta - previous.theta), std::cos(robot.pose.theta - previous.theta));
+  double heading = previous.theta + 0.5 * turn;
+  double linear = ((robot.pose.x - previous.x) * std::cos(heading) + (robot.pose.y - previous.y) * std::sin(heading)) / dt;
+  double lateral = (-(robot.pose.x - previous.x) * std::sin(heading) + (robot.pose.y - previous.y) * std::cos(heading)) / dt;
+
+  robot.accelerometer[0] = (linear - robot.linear) / dt;
+  robot.accelerometer[1] = linear * (turn / dt) + lateral / dt;
+  robot.accelerometer[2] = GRAVITY;
+  robot.linear = linear;
+  robot.angular = turn / dt;
+  robot.gyroscope[2] = robot.angular;
+
+  bool touching = touching_[i] != 0;
+  if (touching && !robot.in_contact)
+  {
+    robot.collisions++;
+  }
+  robot.in_contact = touching;
+  if (robot.in_contact)
+  {
+    robot.contact_time += dt;
+  }
+
+  // Pinned against an obstacle, or dithering between turn directions
+  bool commanded = std::abs(robot.command_linear) > config_.stall_speed ||
+                   std::abs(robot.command_angular) > config_.stall_yaw_rate;
+  if (commanded && std::abs(robot.linear) < config_.stall_speed && std::abs(robot.angular) < config_.stall_yaw_rate)
+  {
+    robot.stall_time += dt;
+  }
+}
+
+/*
+ * Marks the coverage cells under a robot.
+ */
+void SimWorld::cover(std::size_t i)
+{
+  const Pose2D& pose = robots_[i].pose;
+  double radius = config_.robot_radius;
+  double cell = config_.coverage_cell;
+  int column_begin = std::max(0, static_cast<int>(std::floor((pose.x - radius) / cell)));
+  int column_end = std::min(coverage_columns_ - 1, static_cast<int>(std::floor((pose.x + radius) / cell)));
+  int row_begin = std::max(0, static_cast<int>(std::floor((pose.y - radius) / cell)));
+  int row_end = std::min(coverage_rows_ - 1, static_cast<int>(std::floor((pose.y + radius) / cell)));
+
+  for (int row = row_begin; row <= row_end; row++)
+  {
+    for (int column = column_begin; column <= column_end; column++)
+    {
+      double dx = (column + 0.5) * cell - pose.x;
+      double dy = (row + 0.5) * cell - pose.y;
+      uint8_t& covered = covered_[static_cast<std::size_t>(row) * coverage_columns_ + column];
+      if (!covered && dx * dx + dy * dy <= radius * radius)
+      {
+        covered = 1;
+        covered_count_++;
+      }
+    }
+  }
+}
+
+/*
+ * Farthest an IR ray reaches from the robot center (m).
+ */
+double SimWorld::irReach() const
+{
+  double mount_offset = 0.0;
+  for (std::size_t s = 0; s < Pheeno::Hardware::IR_COUNT; s++)
+  {
+    const Pheeno::IrMount& mount = Pheeno::Hardware::irMount(s);
+    mount_offset = std::max(mount_offset, std::hypot(mount.x, mount.y));
+  }
+  return mount_offset + Pheeno::Hardware::irMaxRange() / 100.0;
+}
+
+/*
+ * Distance (m) from (x, y) along the unit direction (dx, dy) to the first
+ * wall, box or one of robots (at their hashed positions), up to max_range.
+ */
+double SimWorld::castRay(const std::vector<uint32_t>& robots, double x, double y, double dx, double dy,
+                         double max_range) const
+{
+  double range = max_range;
+
+  // Arena walls (the ray starts inside)
+  if (dx > 0.0)
+  {
+    range = std::min(range, (config_.arena_width - x) / dx);
+  }
+  else if (dx < 0.0)
+  {
+    range = std::min(range, -x / dx);
+  }
+  if (dy > 0.0)
+  {
+    range = std::min(range, (config_.arena_height - y) / dy);
+  }
+  else if (dy < 0.0)
+  {
+    range = std::min(range, -y / dy);
+  }
+
+  for (std::size_t b = 0; b < boxes_.size(); b++)
+  {
+    double t = rayBox(x, y, dx, dy, boxes_[b]);
+    if (t >= 0.0 && t < range)
+    {
+      range = t;
+    }
+  }
+
+  for (std::size_t n = 0; n < robots.size(); n++)
+  {
+    double t = rayCircle(x, y, dx, dy, x_[robots[n]], y_[robots[n]], config_.robot_radius);
+    if (t >= 0.0 && t < range)
+    {
+      range = t;
+    }
+  }
+  return std::max(range, 0.0);
+}
+
+/*
+ * True if a disc of clearance radius at (x, y) is inside the arena and off
+ * the boxes.
+ */
+bool SimWorld::freeAt(double x, double y, double clearance) const
+{
+  if (x < clearance || y < clearance || x > config_.arena_width - clearance || y > config_.arena_height - clearance)
+  {
+    return false;
+  }
+  for (std::size_t b = 0; b < boxes_.size(); b++)
+  {
+    double dx = x - std::max(boxes_[b].min_x, std::min(x, boxes_[b].max_x));
+    double dy = y - std::max(boxes_[b].min_y, std::min(y, boxes_[b].max_y));
+    if (dx * dx + dy * dy <= clearance * clearance)
+    {
+      return false;
+    }
+  }
+  return true;
+}
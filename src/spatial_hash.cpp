@@ -0,0 +1,75 @@
+#include "pheeno_ros/spatial_hash.h"
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Contructor for the SpatialHash Class. cell_size is best set to the query
+ * radius, so a query looks at 3x3 cells.
+ */
+SpatialHash::SpatialHash(double cell_size)
+  : cell_size_(1.0), inverse_cell_size_(1.0), bucket_mask_(0)
+{
+  setCellSize(cell_size);
+}
+
+/*
+ * Changes the cell size. Takes effect at the next build().
+ */
+void SpatialHash::setCellSize(double cell_size)
+{
+  cell_size_ = std::max(cell_size, 1e-6);
+  inverse_cell_size_ = 1.0 / cell_size_;
+}
+
+/*
+ * Buckets count points. The table has at least twice as many buckets as
+ * points, so buckets mostly hold one cell each. Storage only grows, so
+ * rebuilding every tick does not allocate once the point count settles.
+ */
+void SpatialHash::build(const double* x, const double* y, std::size_t count)
+{
+  std::size_t buckets = 16;
+  while (buckets < 2 * count)
+  {
+    buckets *= 2;
+  }
+  bucket_mask_ = static_cast<uint32_t>(buckets - 1);
+
+  start_.assign(buckets + 1, 0);
+  bucket_.resize(count);
+  index_.resize(count);
+  cell_x_.resize(count);
+  cell_y_.resize(count);
+  x_.resize(count);
+  y_.resize(count);
+
+  // Count points per bucket, then turn the counts into start offsets.
+  for (std::size_t i = 0; i < count; i++)
+  {
+    bucket_[i] = bucketOf(cellOf(x[i]), cellOf(y[i]));
+    start_[bucket_[i] + 1]++;
+  }
+  for (std::size_t b = 0; b < buckets; b++)
+  {
+    start_[b + 1] += start_[b];
+  }
+
+  // Scatter in input order (stable), using start_ as a running cursor and
+  // shifting it back afterwards.
+  for (std::size_t i = 0; i < count; i++)
+  {
+    uint32_t slot = start_[bucket_[i]]++;
+    index_[slot] = static_cast<uint32_t>(i);
+    cell_x_[slot] = cellOf(x[i]);
+    cell_y_[slot] = cellOf(y[i]);
+    x_[slot] = x[i];
+    y_[slot] = y[i];
+  }
+  for (std::size_t b = buckets; b > 0; b--)
+  {
+    start_[b] = start_[b - 1];
+  }
+  start_[0] = 0;
+}
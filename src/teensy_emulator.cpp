@@ -0,0 +1,432 @@
+//
+// Pseudo-terminal stand-in for the Pheeno Teensy.
+//
+// Speaks the device side of the rosserial protocol so serial_bridge can be
+// exercised on any Linux machine without hardware:
+//
+//   rosrun pheeno_ros teensy_emulator -l /tmp/ttyPHEENO -n 01
+//   rosrun pheeno_ros serial_bridge -p /tmp/ttyPHEENO
+//
+// With -f it instead streams packed sensor frames (sensor_frame.h) and
+// serves as the reference encoder for the host side decoder.
+//
+
+#include "pheeno_ros/command_line_parser.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/rosserial_protocol.h"
+#include "pheeno_ros/sensor_frame.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // md5sums of the message types the firmware uses.
+  const char* FLOAT32_MD5 = "73fcbf46b49191e672908e50842a83d4";
+  const char* INT16_MD5 = "8524586e34fbd7cb1c08c5f5f1ca0e57";
+  const char* VECTOR3_MD5 = "4a842b65f413084dc2b10fb484ea7f17";
+  const char* TWIST_MD5 = "9f195f881246fdfa2798d1d3eebca84a";
+
+  // rosserial_client numbers subscribers from 100 and publishers from 125.
+  const uint16_t SUBSCRIBER_START = 100;
+  const uint16_t PUBLISHER_START = 125;
+
+  enum EMULATED_TOPIC
+  {
+    SCAN_CENTER,
+    SCAN_BACK,
+    SCAN_RIGHT,
+    SCAN_LEFT,
+    SCAN_CR,
+    SCAN_CL,
+    SCAN_BOTTOM,
+    ENCODER_LL,
+    ENCODER_LR,
+    ENCODER_RL,
+    ENCODER_RR,
+    MAGNETOMETER,
+    GYROSCOPE,
+    ACCELEROMETER,
+    TOPIC_COUNT
+  };
+
+  struct EmulatedTopic
+  {
+    const char* name;
+    const char* type;
+    const char* md5sum;
+  };
+
+  const EmulatedTopic TOPICS[TOPIC_COUNT] = {
+    {"scan_center", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_back", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_right", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_left", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_cr", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_cl", "std_msgs/Float32", FLOAT32_MD5},
+    {"scan_bottom", "std_msgs/Int16", INT16_MD5},
+    {"encoder_LL", "std_msgs/Int16", INT16_MD5},
+    {"encoder_LR", "std_msgs/Int16", INT16_MD5},
+    {"encoder_RL", "std_msgs/Int16", INT16_MD5},
+    {"encoder_RR", "std_msgs/Int16", INT16_MD5},
+    {"magnetometer", "geometry_msgs/Vector3", VECTOR3_MD5},
+    {"gyroscope", "geometry_msgs/Vector3", VECTOR3_MD5},
+    {"accelerometer", "geometry_msgs/Vector3", VECTOR3_MD5}
+  };
+
+  volatile sig_atomic_t running = 1;
+
+  void handleSignal(int)
+  {
+    running = 0;
+  }
+
+  double monotonicSeconds()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+  }
+
+  // Little-endian serialization helpers (the Teensy and the Pi are both LE).
+  void appendFloat32(std::vector<uint8_t>& out, float value)
+  {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + 4);
+  }
+
+  void appendFloat64(std::vector<uint8_t>& out, double value)
+  {
+    uint8_t bytes[8];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + 8);
+  }
+
+  void appendInt16(std::vector<uint8_t>& out, int16_t value)
+  {
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+    out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+  }
+
+  bool writeAll(int fd, const std::vector<uint8_t>& buffer)
+  {
+    std::size_t written = 0;
+    while (written < buffer.size())
+    {
+      ssize_t count = write(fd, &buffer[written], buffer.size() - written);
+      if (count < 0)
+      {
+        return false;  // Nobody is draining the link; drop like a UART would.
+      }
+      written += count;
+    }
+    return true;
+  }
+
+  /*
+   * State of the emulated robot. Wheel motion follows the last cmd_vel and
+   * the IR ranges sweep slowly so behaviors see obstacles come and go.
+   */
+  struct EmulatedPheeno
+  {
+    EmulatedPheeno() : linear(0), angular(0), left_ticks(0), right_ticks(0) {}
+
+    double linear;
+    double angular;
+    double left_ticks;
+    double right_ticks;
+
+    void step(double dt)
+    {
+      const double wheel_base = Pheeno::Hardware::wheelBase();
+      const double ticks_per_meter = Pheeno::Hardware::encoderTicksPerRev() /
+                                     (2.0 * M_PI * Pheeno::Hardware::wheelRadius());
+      left_ticks += (linear - angular * wheel_base / 2.0) * ticks_per_meter * dt;
+      right_ticks += (linear + angular * wheel_base / 2.0) * ticks_per_meter * dt;
+    }
+  };
+
+  float emulatedRange(int sensor, double t)
+  {
+    return static_cast<float>(40.0 + 30.0 * std::sin(0.3 * t + sensor));
+  }
+
+  int16_t wrapTicks(double ticks)
+  {
+    return static_cast<int16_t>(static_cast<long>(ticks) & 0xFFFF);
+  }
+
+  void serializeTopic(int topic, const EmulatedPheeno& pheeno, double t,
+                      std::vector<uint8_t>& out)
+  {
+    switch (topic)
+    {
+      case SCAN_CENTER:
+      case SCAN_BACK:
+      case SCAN_RIGHT:
+      case SCAN_LEFT:
+      case SCAN_CR:
+      case SCAN_CL:
+        appendFloat32(out, emulatedRange(topic, t));
+        break;
+
+      case SCAN_BOTTOM:
+        appendInt16(out, 2000);
+        break;
+
+      case ENCODER_LL:
+      case ENCODER_LR:
+        appendInt16(out, wrapTicks(pheeno.left_ticks));
+        break;
+
+      case ENCODER_RL:
+      case ENCODER_RR:
+        appendInt16(out, wrapTicks(pheeno.right_ticks));
+        break;
+
+      case MAGNETOMETER:
+        appendFloat64(out, 0.2);
+        appendFloat64(out, 0.0);
+        appendFloat64(out, -0.4);
+        break;
+
+      case GYROSCOPE:
+        appendFloat64(out, 0.0);
+        appendFloat64(out, 0.0);
+        appendFloat64(out, pheeno.angular);
+        break;
+
+      case ACCELEROMETER:
+        appendFloat64(out, 0.0);
+        appendFloat64(out, 0.0);
+        appendFloat64(out, 9.81);
+        break;
+    }
+  }
+
+  /*
+   * Same readings as serializeTopic, packed into a single sweep.
+   */
+  void fillSweep(const EmulatedPheeno& pheeno, double t, uint16_t sequence, SensorSweep& sweep)
+  {
+    std::memset(&sweep, 0, sizeof(sweep));
+    sweep.sequence = sequence;
+    sweep.stamp_ms = static_cast<uint32_t>(t * 1000.0);
+    for (int i = 0; i < 6; i++)
+    {
+      sweep.ir[i] = emulatedRange(i, t);
+    }
+    sweep.ir_bottom = 2000;
+    sweep.encoders[0] = sweep.encoders[1] = wrapTicks(pheeno.left_ticks);
+    sweep.encoders[2] = sweep.encoders[3] = wrapTicks(pheeno.right_ticks);
+    sweep.magnetometer[0] = 0.2f;
+    sweep.magnetometer[2] = -0.4f;
+    sweep.gyroscope[2] = static_cast<float>(pheeno.angular);
+    sweep.accelerometer[2] = 9.81f;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cml_parser(argc, argv);
+  std::string prefix = cml_parser["-n"] ? "/pheeno_" + cml_parser("-n") + "/" : "";
+  std::string link_path = cml_parser("-l", "");
+  bool packed = cml_parser["-f"];
+  double rate = std::atof(cml_parser("-r", "10").c_str());
+  if (rate <= 0)
+  {
+    rate = 10;
+  }
+
+  // Create the pseudo-terminal. The slave side stays open here so the
+  // master never sees a hangup while the bridge reconnects.
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    std::perror("posix_openpt");
+    return 1;
+  }
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  std::string slave_path = ptsname(master);
+  int slave = open(slave_path.c_str(), O_RDWR | O_NOCTTY);
+  struct termios tty;
+  if (slave < 0 || tcgetattr(slave, &tty) != 0)
+  {
+    std::perror("open slave");
+    return 1;
+  }
+  cfmakeraw(&tty);
+  tcsetattr(slave, TCSANOW, &tty);
+
+  if (!link_path.empty())
+  {
+    unlink(link_path.c_str());
+    if (symlink(slave_path.c_str(), link_path.c_str()) != 0)
+    {
+      std::perror("symlink");
+      return 1;
+    }
+  }
+
+  std::printf("Emulating Pheeno Teensy on %s\n", link_path.empty() ? slave_path.c_str() : link_path.c_str());
+  std::fflush(stdout);
+
+  signal(SIGINT, handleSignal);
+  signal(SIGTERM, handleSignal);
+
+  RosserialFrameParser parser;
+  SensorFrameReader frame_reader;
+  SensorSweep sweep;
+  uint8_t sweep_frame[Pheeno::SENSOR_FRAME_MAX_ENCODED];
+  uint16_t sequence = 0;
+  EmulatedPheeno pheeno;
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> frames;
+  uint8_t read_buffer[256];
+  bool configured = packed;  // Packed frames need no negotiation.
+  double start = monotonicSeconds();
+  double next_publish = start;
+  double next_sync = start;
+  double last_step = start;
+
+  while (running)
+  {
+    struct pollfd pfd;
+    pfd.fd = master;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int timeout_ms = static_cast<int>(std::max(0.0, (next_publish - monotonicSeconds()) * 1000.0));
+
+    if (poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN))
+    {
+      ssize_t count = read(master, read_buffer, sizeof(read_buffer));
+      for (ssize_t i = 0; i < count && packed; i++)
+      {
+        float linear;
+        float angular;
+        if (frame_reader.feed(read_buffer[i]) == SensorFrameReader::FRAME_READY &&
+            decodeCommandFrame(frame_reader.data(), frame_reader.size(), linear, angular))
+        {
+          pheeno.linear = linear;
+          pheeno.angular = angular;
+          std::printf("cmd_vel: linear %.3f angular %.3f\n", pheeno.linear, pheeno.angular);
+          std::fflush(stdout);
+        }
+      }
+
+      for (ssize_t i = 0; i < count && !packed; i++)
+      {
+        if (parser.feed(read_buffer[i]) != RosserialFrameParser::FRAME_READY)
+        {
+          continue;
+        }
+
+        if (parser.topicId() == Pheeno::ID_PUBLISHER && parser.size() == 0)
+        {
+          // Topic request: announce every publisher and the cmd_vel subscriber.
+          frames.clear();
+          for (int topic = 0; topic < TOPIC_COUNT; topic++)
+          {
+            RosserialTopicInfo info;
+            info.topic_id = PUBLISHER_START + topic;
+            info.topic_name = prefix + TOPICS[topic].name;
+            info.message_type = TOPICS[topic].type;
+            info.md5sum = TOPICS[topic].md5sum;
+            info.buffer_size = 512;
+            payload.clear();
+            encodeRosserialTopicInfo(info, payload);
+            encodeRosserialFrame(Pheeno::ID_PUBLISHER, &payload[0], payload.size(), frames);
+          }
+
+          RosserialTopicInfo info;
+          info.topic_id = SUBSCRIBER_START;
+          info.topic_name = prefix + "cmd_vel";
+          info.message_type = "geometry_msgs/Twist";
+          info.md5sum = TWIST_MD5;
+          info.buffer_size = 512;
+          payload.clear();
+          encodeRosserialTopicInfo(info, payload);
+          encodeRosserialFrame(Pheeno::ID_SUBSCRIBER, &payload[0], payload.size(), frames);
+          writeAll(master, frames);
+          configured = true;
+          std::printf("Topics requested by host.\n");
+        }
+        else if (parser.topicId() == SUBSCRIBER_START && parser.size() == 48)
+        {
+          std::memcpy(&pheeno.linear, parser.data(), sizeof(double));
+          std::memcpy(&pheeno.angular, parser.data() + 40, sizeof(double));
+          std::printf("cmd_vel: linear %.3f angular %.3f\n", pheeno.linear, pheeno.angular);
+        }
+        else if (parser.topicId() == Pheeno::ID_TX_STOP)
+        {
+          configured = false;
+          std::printf("Host stopped transmission.\n");
+        }
+        std::fflush(stdout);
+      }
+    }
+
+    double now = monotonicSeconds();
+    pheeno.step(now - last_step);
+    last_step = now;
+
+    if (now < next_publish)
+    {
+      continue;
+    }
+    next_publish += 1.0 / rate;
+
+    if (!configured)
+    {
+      continue;
+    }
+
+    if (packed)
+    {
+      // One frame for the whole sweep.
+      fillSweep(pheeno, now - start, sequence++, sweep);
+      std::size_t length = encodeSensorSweep(sweep, sweep_frame);
+      frames.assign(sweep_frame, sweep_frame + length);
+      writeAll(master, frames);
+      continue;
+    }
+
+    // One frame per topic, as the real firmware does.
+    frames.clear();
+    for (int topic = 0; topic < TOPIC_COUNT; topic++)
+    {
+      payload.clear();
+      serializeTopic(topic, pheeno, now - start, payload);
+      encodeRosserialFrame(PUBLISHER_START + topic, &payload[0], payload.size(), frames);
+    }
+
+    if (now >= next_sync)
+    {
+      encodeRosserialFrame(Pheeno::ID_TIME, NULL, 0, frames);
+      next_sync = now + 5.0;
+    }
+
+    writeAll(master, frames);
+  }
+
+  if (!link_path.empty())
+  {
+    unlink(link_path.c_str());
+  }
+  close(slave);
+  close(master);
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include "pheeno_ros/work_stealing_pool.h"
+#include <algorithm>
+
+namespace
+{
+  // Set in each worker thread
+  thread_local const WorkStealingPool* current_pool = NULL;
+  thread_local int current_worker = -1;
+}
+
+/*
+ * Contructor for the WorkStealingPool Class. Starts the workers.
+ */
+WorkStealingPool::WorkStealingPool(unsigned int threads)
+  : next_queue_(0), queued_(0), pending_(0), stopping_(false)
+{
+  if (threads == 0)
+  {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (unsigned int i = 0; i < threads; i++)
+  {
+    queues_.push_back(new Queue());
+  }
+  for (unsigned int i = 0; i < threads; i++)
+  {
+    workers_.push_back(std::thread(&WorkStealingPool::work, this, i));
+  }
+}
+
+/*
+ * Finishes the submitted tasks and stops the workers.
+ */
+WorkStealingPool::~WorkStealingPool()
+{
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (std::size_t i = 0; i < workers_.size(); i++)
+  {
+    workers_[i].join();
+  }
+  for (std::size_t i = 0; i < queues_.size(); i++)
+  {
+    delete queues_[i];
+  }
+}
+
+/*
+ * Queues a task.
+ */
+void WorkStealingPool::submit(const Task& task)
+{
+  int worker = currentWorker();
+  std::size_t index = worker >= 0 ? static_cast<std::size_t>(worker) : next_queue_++ % queues_.size();
+  // Counted before it is queued, so taking it never underflows queued_.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_++;
+    pending_++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(task);
+  }
+  work_available_.notify_one();
+}
+
+/*
+ * Blocks until every submitted task has finished. Must not be called from
+ * a task.
+ */
+void WorkStealingPool::wait()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+int WorkStealingPool::currentWorker() const
+{
+  return current_pool == this ? current_worker : -1;
+}
+
+void WorkStealingPool::work(unsigned int index)
+{
+  current_pool = this;
+  current_worker = static_cast<int>(index);
+
+  Task task;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+      if (queued_ == 0)
+      {
+        return;
+      }
+    }
+
+    // Another worker may get to the task first; then this one waits again.
+    if (!take(index, task))
+    {
+      continue;
+    }
+    task();
+    task = Task();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0)
+    {
+      idle_.notify_all();
+    }
+  }
+}
+
+/*
+ * The newest task of the worker's own deque, else the oldest of the first
+ * other deque that has one.
+ */
+bool WorkStealingPool::take(unsigned int index, Task& task)
+{
+  {
+    Queue& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty())
+    {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      taken();
+      return true;
+    }
+  }
+
+  for (std::size_t offset = 1; offset < queues_.size(); offset++)
+  {
+    Queue& victim = *queues_[(index + offset) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      taken();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::taken()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  queued_--;
+}
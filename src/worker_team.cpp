@@ -0,0 +1,167 @@
+#include "pheeno_ros/worker_team.h"
+#include <algorithm>
+
+namespace
+{
+  // Yields before a waiting thread goes to sleep, when spinning at all
+  const int SPIN_LIMIT = 4000;
+}
+
+/*
+ * Contructor for the WorkerTeam Class. Starts threads - 1 workers; the
+ * thread calling run() is the last member of the team.
+ */
+WorkerTeam::WorkerTeam(unsigned int threads)
+  : spin_(false), call_(NULL), fn_(NULL), count_(0), block_size_(1), blocks_(0), next_block_(0), running_(0),
+    generation_(0), sleeping_(0), stopping_(false)
+{
+  setThreads(threads);
+}
+
+/*
+ * Stops the workers. Must not be called during run().
+ */
+WorkerTeam::~WorkerTeam()
+{
+  stop();
+}
+
+/*
+ * Restarts the team with threads threads (0 for every hardware thread).
+ * Must not be called during run().
+ */
+void WorkerTeam::setThreads(unsigned int threads)
+{
+  unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+  if (threads == 0)
+  {
+    threads = cores;
+  }
+  if (threads == threadCount())
+  {
+    return;
+  }
+
+  stop();
+  stopping_ = false;
+  spin_ = threads <= cores;
+  // A worker may start after the first phase has begun, so it is told
+  // which generation it starts from.
+  unsigned long generation = generation_.load(std::memory_order_relaxed);
+  for (unsigned int t = 1; t < threads; t++)
+  {
+    workers_.push_back(std::thread(&WorkerTeam::work, this, t, generation));
+  }
+}
+
+/*
+ * One phase: hands the blocks to the workers, takes its share as thread
+ * 0 and waits for the workers to leave the phase.
+ */
+void WorkerTeam::runBlocks(std::size_t count, std::size_t block_size, Call call, void* fn)
+{
+  std::size_t blocks = (count + block_size - 1) / block_size;
+  if (workers_.empty() || blocks <= 1)
+  {
+    if (count > 0)
+    {
+      call(fn, 0u, 0, count);
+    }
+    return;
+  }
+
+  call_ = call;
+  fn_ = fn;
+  count_ = count;
+  block_size_ = block_size;
+  blocks_ = blocks;
+  next_block_.store(0, std::memory_order_relaxed);
+  running_.store(workers_.size(), std::memory_order_relaxed);
+  bool sleepers;
+  {
+    // Advanced under the lock, so a worker about to sleep cannot miss it
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_.fetch_add(1, std::memory_order_release);
+    sleepers = sleeping_ > 0;
+  }
+  if (sleepers)
+  {
+    wake_.notify_all();
+  }
+
+  workBlocks(0);
+
+  for (int i = 0; spin_ && i < SPIN_LIMIT && running_.load(std::memory_order_acquire) != 0; i++)
+  {
+    std::this_thread::yield();
+  }
+  if (running_.load(std::memory_order_acquire) != 0)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return running_.load(std::memory_order_acquire) == 0; });
+  }
+}
+
+/*
+ * Worker loop: waits for the next phase, works on it, reports back.
+ */
+void WorkerTeam::work(unsigned int thread, unsigned long seen)
+{
+  for (;;)
+  {
+    for (int i = 0; spin_ && i < SPIN_LIMIT && generation_.load(std::memory_order_acquire) == seen; i++)
+    {
+      std::this_thread::yield();
+    }
+    if (generation_.load(std::memory_order_acquire) == seen)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      sleeping_++;
+      wake_.wait(lock, [this, seen]() { return stopping_ || generation_.load(std::memory_order_acquire) != seen; });
+      sleeping_--;
+      if (stopping_)
+      {
+        return;
+      }
+    }
+    seen = generation_.load(std::memory_order_acquire);
+
+    workBlocks(thread);
+    if (running_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      // Notified under the lock, so run() cannot miss it between its
+      // check and its wait.
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_one();
+    }
+  }
+}
+
+/*
+ * Claims and runs blocks of the current phase until none are left.
+ */
+void WorkerTeam::workBlocks(unsigned int thread)
+{
+  for (std::size_t block = next_block_++; block < blocks_; block = next_block_++)
+  {
+    std::size_t begin = block * block_size_;
+    call_(fn_, thread, begin, std::min(count_, begin + block_size_));
+  }
+}
+
+/*
+ * Wakes and joins the workers.
+ */
+void WorkerTeam::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::size_t t = 0; t < workers_.size(); t++)
+  {
+    workers_[t].join();
+  }
+  workers_.clear();
+}
@@ -0,0 +1,178 @@
+#include "pheeno_ros/flock_rules.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  FlockMember member(double x, double y, double vx, double vy)
+  {
+    FlockMember m = {x, y, vx, vy};
+    return m;
+  }
+
+  // Pairs of members closer than distance, and the closest pair's distance
+  int closePairs(const std::vector<FlockMember>& members, double distance, double& closest)
+  {
+    int pairs = 0;
+    closest = 1e9;
+    for (std::size_t i = 0; i < members.size(); i++)
+    {
+      for (std::size_t j = i + 1; j < members.size(); j++)
+      {
+        double d = std::hypot(members[i].x - members[j].x, members[i].y - members[j].y);
+        closest = std::min(closest, d);
+        if (d < distance)
+        {
+          pairs++;
+        }
+      }
+    }
+    return pairs;
+  }
+}
+
+TEST(FlockRules, ParsesModes)
+{
+  Pheeno::FLOCK_MODE mode = Pheeno::FLOCK_FLOCK;
+  EXPECT_TRUE(FlockRules::parseMode("aggregate", mode));
+  EXPECT_EQ(Pheeno::FLOCK_AGGREGATE, mode);
+  EXPECT_TRUE(FlockRules::parseMode("disperse", mode));
+  EXPECT_EQ(Pheeno::FLOCK_DISPERSE, mode);
+  EXPECT_TRUE(FlockRules::parseMode("flock", mode));
+  EXPECT_EQ(Pheeno::FLOCK_FLOCK, mode);
+  EXPECT_FALSE(FlockRules::parseMode("swarm", mode));
+  EXPECT_EQ(Pheeno::FLOCK_FLOCK, mode);
+}
+
+TEST(FlockRules, KeepsSpeedWithinLimitsWhenAlone)
+{
+  FlockRules rules;
+  double vx = 0.0;
+  double vy = 0.0;
+  rules.steer(member(0.0, 0.0, 0.05, 0.0), NULL, 0, vx, vy);
+  EXPECT_DOUBLE_EQ(0.05, vx);
+  EXPECT_DOUBLE_EQ(0.0, vy);
+
+  rules.steer(member(0.0, 0.0, 0.0, 0.01), NULL, 0, vx, vy);
+  EXPECT_NEAR(rules.config().min_speed, vy, 1e-12);
+
+  rules.steer(member(0.0, 0.0, 0.3, -0.4), NULL, 0, vx, vy);
+  EXPECT_NEAR(rules.config().max_speed, std::hypot(vx, vy), 1e-12);
+
+  // A stopped robot stays stopped rather than picking a direction.
+  rules.steer(member(0.0, 0.0, 0.0, 0.0), NULL, 0, vx, vy);
+  EXPECT_EQ(0.0, vx);
+  EXPECT_EQ(0.0, vy);
+}
+
+TEST(FlockRules, SeparatesFromCloseNeighbors)
+{
+  FlockRules rules(FlockRules::preset(Pheeno::FLOCK_DISPERSE));
+  FlockMember neighbors[] = {member(0.1, 0.0, 0.0, 0.0), member(0.0, 2.0, 0.0, 0.0)};
+  double vx = 0.0;
+  double vy = 0.0;
+  rules.steer(member(0.0, 0.0, 0.0, 0.0), neighbors, 2, vx, vy);
+  EXPECT_EQ(1u, rules.neighborCount());  // The second one is out of range
+  EXPECT_LT(vx, 0.0);
+  EXPECT_NEAR(0.0, vy, 1e-12);
+}
+
+TEST(FlockRules, AlignsWithNeighbors)
+{
+  FlockRules rules(FlockRules::preset(Pheeno::FLOCK_FLOCK));
+  FlockMember neighbors[] = {member(0.0, 0.5, 0.0, 0.08), member(0.0, -0.5, 0.0, 0.08)};
+  double vx = 0.0;
+  double vy = 0.0;
+  rules.steer(member(0.0, 0.0, 0.08, 0.0), neighbors, 2, vx, vy);
+  EXPECT_GT(vy, 0.0);
+  EXPECT_LT(vx, 0.08);
+  EXPECT_LE(std::hypot(vx, vy), rules.config().max_speed + 1e-12);
+}
+
+TEST(FlockRules, AggregationGathersScatteredRobots)
+{
+  FlockBatch batch(FlockRules::preset(Pheeno::FLOCK_AGGREGATE), 1);
+  std::mt19937 rng(29);
+  std::uniform_real_distribution<double> position(-1.5, 1.5);
+  std::vector<FlockMember> members;
+  for (int i = 0; i < 20; i++)
+  {
+    members.push_back(member(position(rng), position(rng), 0.0, 0.0));
+  }
+
+  double closest = 0.0;
+  int before = closePairs(members, 0.3, closest);
+  std::vector<double> vx;
+  std::vector<double> vy;
+  for (int step = 0; step < 300; step++)
+  {
+    batch.step(members, vx, vy);
+    for (std::size_t i = 0; i < members.size(); i++)
+    {
+      members[i].vx = vx[i];
+      members[i].vy = vy[i];
+      members[i].x += vx[i] * 0.1;
+      members[i].y += vy[i] * 0.1;
+    }
+  }
+  // Clustered, but separation keeps the robots from piling up.
+  EXPECT_GE(closePairs(members, 0.3, closest), 3 * before);
+  EXPECT_GT(closest, 0.1);
+}
+
+// Enough members for several blocks, so the threads really split the work.
+TEST(FlockRules, BatchIsIndependentOfThreadCount)
+{
+  std::mt19937 rng(31);
+  std::uniform_real_distribution<double> position(0.0, 12.0);
+  std::uniform_real_distribution<double> velocity(-0.1, 0.1);
+  std::vector<FlockMember> members;
+  for (int i = 0; i < 4000; i++)
+  {
+    members.push_back(member(position(rng), position(rng), velocity(rng), velocity(rng)));
+  }
+
+  FlockBatch single(FlockRules::Config(), 1);
+  FlockBatch several(FlockRules::Config(), 4);
+  std::vector<double> vx1, vy1, vx4, vy4;
+  single.step(members, vx1, vy1);
+  several.step(members, vx4, vy4);
+  ASSERT_EQ(members.size(), vx4.size());
+
+  // Same as steering against the brute-force neighbor list, up to the
+  // order the sums are taken in.
+  FlockRules rules;
+  std::vector<FlockMember> others;
+  for (std::size_t i = 0; i < members.size(); i++)
+  {
+    EXPECT_EQ(vx1[i], vx4[i]) << i;
+    EXPECT_EQ(vy1[i], vy4[i]) << i;
+
+    if (i % 10 == 0)
+    {
+      others.clear();
+      for (std::size_t j = 0; j < members.size(); j++)
+      {
+        if (j != i)
+        {
+          others.push_back(members[j]);
+        }
+      }
+      double vx = 0.0;
+      double vy = 0.0;
+      rules.steer(members[i], &others[0], others.size(), vx, vy);
+      EXPECT_NEAR(vx, vx1[i], 1e-9) << i;
+      EXPECT_NEAR(vy, vy1[i], 1e-9) << i;
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+#include "pheeno_ros/frontier_tracker.h"
+#include "pheeno_ros/occupancy_grid.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+  TiledOccupancyGrid::Config mapConfig()
+  {
+    TiledOccupancyGrid::Config config;
+    config.resolution = 0.05;
+    config.width = 48;
+    config.height = 48;
+    config.origin_x = 0.0;
+    config.origin_y = 0.0;
+    return config;
+  }
+
+  void fill(TiledOccupancyGrid& map, int x0, int y0, int x1, int y1, int8_t value)
+  {
+    for (int y = y0; y < y1; y++)
+    {
+      for (int x = x0; x < x1; x++)
+      {
+        map.setLogOdds(x, y, value);
+      }
+    }
+  }
+
+  void expectMatchesFullScan(FrontierTracker& tracker, const TiledOccupancyGrid& map)
+  {
+    FrontierTracker fresh;
+    fresh.reset(map);
+    ASSERT_EQ(fresh.frontierCount(), tracker.frontierCount());
+    for (int y = 0; y < map.height(); y++)
+    {
+      for (int x = 0; x < map.width(); x++)
+      {
+        ASSERT_EQ(fresh.isFrontier(x, y), tracker.isFrontier(x, y)) << x << ", " << y;
+      }
+    }
+  }
+}
+
+TEST(FrontierTracker, FindsFreeCellsNextToUnknown)
+{
+  TiledOccupancyGrid map(mapConfig());
+  fill(map, 10, 10, 20, 20, Pheeno::FREE_LOG_ODDS);
+
+  FrontierTracker tracker;
+  tracker.reset(map);
+  EXPECT_EQ(36u, tracker.frontierCount());  // The square's border
+  EXPECT_TRUE(tracker.isFrontier(10, 15));
+  EXPECT_TRUE(tracker.isFrontier(19, 19));
+  EXPECT_FALSE(tracker.isFrontier(15, 15));
+  EXPECT_FALSE(tracker.isFrontier(9, 15));
+  EXPECT_TRUE(tracker.isFrontierAt(10 * 0.05 + 0.01, 15 * 0.05 + 0.01));
+}
+
+TEST(FrontierTracker, IncrementalUpdateMatchesFullScan)
+{
+  TiledOccupancyGrid map(mapConfig());
+  map.setChangeTracking(true);
+  FrontierTracker tracker;
+  tracker.reset(map);
+
+  std::mt19937 rng(17);
+  std::uniform_int_distribution<int> coordinate(0, 47);
+  std::uniform_int_distribution<int> size(1, 8);
+  const int8_t values[] = {0, Pheeno::FREE_LOG_ODDS, Pheeno::OCCUPIED_LOG_ODDS};
+  std::vector<uint32_t> changes;
+  for (int round = 0; round < 200; round++)
+  {
+    int x = coordinate(rng);
+    int y = coordinate(rng);
+    fill(map, x, y, std::min(48, x + size(rng)), std::min(48, y + size(rng)), values[round % 3]);
+    map.takeClassChanges(changes);
+    tracker.update(map, changes);
+    expectMatchesFullScan(tracker, map);
+  }
+
+  // Cells that left and rejoined the frontier leave stale and duplicate
+  // list entries; clustering must count each frontier cell once.
+  std::vector<FrontierTracker::Cluster> clusters;
+  tracker.cluster(1, clusters);
+  std::size_t clustered = 0;
+  for (std::size_t c = 0; c < clusters.size(); c++)
+  {
+    clustered += clusters[c].size;
+  }
+  EXPECT_EQ(tracker.frontierCount(), clustered);
+}
+
+TEST(FrontierTracker, ClustersEightConnectedCells)
+{
+  TiledOccupancyGrid map(mapConfig());
+  fill(map, 2, 2, 8, 8, Pheeno::FREE_LOG_ODDS);      // 20 frontier cells
+  fill(map, 30, 30, 33, 33, Pheeno::FREE_LOG_ODDS);  // 8 frontier cells
+  map.setLogOdds(40, 5, Pheeno::FREE_LOG_ODDS);      // 1 frontier cell
+
+  FrontierTracker tracker;
+  tracker.reset(map);
+  std::vector<FrontierTracker::Cluster> clusters;
+  tracker.cluster(2, clusters);
+  ASSERT_EQ(2u, clusters.size());
+
+  std::size_t sizes[2] = {clusters[0].size, clusters[1].size};
+  std::sort(sizes, sizes + 2);
+  EXPECT_EQ(8u, sizes[0]);
+  EXPECT_EQ(20u, sizes[1]);
+
+  // Each target is a frontier cell of its cluster.
+  for (std::size_t c = 0; c < clusters.size(); c++)
+  {
+    EXPECT_TRUE(tracker.isFrontierAt(clusters[c].target_x, clusters[c].target_y));
+  }
+
+  tracker.cluster(1, clusters);
+  EXPECT_EQ(3u, clusters.size());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,146 @@
+#include "pheeno_ros/grid_planner.h"
+#include "pheeno_ros/occupancy_grid.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+namespace
+{
+  const double RESOLUTION = 0.05;
+
+  TiledOccupancyGrid::Config mapConfig()
+  {
+    TiledOccupancyGrid::Config config;
+    config.resolution = RESOLUTION;
+    config.width = 96;
+    config.height = 96;
+    config.origin_x = 0.0;
+    config.origin_y = 0.0;
+    return config;
+  }
+
+  double cellCenter(int cell)
+  {
+    return (cell + 0.5) * RESOLUTION;
+  }
+
+  void setOccupied(TiledOccupancyGrid& map, int x, int y, bool occupied)
+  {
+    map.setLogOdds(x, y, occupied ? 100 : -100);
+  }
+
+  /*
+   * Start cost of a search from scratch on the map as it is now.
+   */
+  int32_t freshCost(const TiledOccupancyGrid& map, double sx, double sy, double gx, double gy)
+  {
+    GridPlanner planner;
+    planner.reset(map);
+    planner.setGoal(gx, gy);
+    planner.setStart(sx, sy);
+    planner.plan();
+    return planner.startCost();
+  }
+}
+
+/*
+ * A wall across the arena with a gap: the repaired cost follows the gap as
+ * it closes and reopens.
+ */
+TEST(GridPlanner, RepairsWallChanges)
+{
+  TiledOccupancyGrid map(mapConfig());
+  map.setChangeTracking(true);
+  GridPlanner planner;
+  planner.reset(map);
+  ASSERT_TRUE(planner.setGoal(cellCenter(48), cellCenter(90)));
+  ASSERT_TRUE(planner.setStart(cellCenter(48), cellCenter(5)));
+  ASSERT_TRUE(planner.plan());
+  int32_t open_cost = planner.startCost();
+
+  std::vector<uint32_t> changes;
+  for (int x = 0; x < map.width(); x++)
+  {
+    setOccupied(map, x, 48, x < 60 || x > 90);
+  }
+  map.takeClassChanges(changes);
+  planner.mapChanged(map, changes);
+  ASSERT_TRUE(planner.plan());
+  EXPECT_GT(planner.startCost(), open_cost);
+  EXPECT_EQ(freshCost(map, cellCenter(48), cellCenter(5), cellCenter(48), cellCenter(90)), planner.startCost());
+
+  for (int x = 60; x <= 90; x++)
+  {
+    setOccupied(map, x, 48, true);
+  }
+  map.takeClassChanges(changes);
+  planner.mapChanged(map, changes);
+  EXPECT_FALSE(planner.plan());
+  EXPECT_GE(planner.startCost(), Pheeno::PLAN_INFINITY);
+
+  for (int x = 0; x < map.width(); x++)
+  {
+    setOccupied(map, x, 48, false);
+  }
+  map.takeClassChanges(changes);
+  planner.mapChanged(map, changes);
+  ASSERT_TRUE(planner.plan());
+  EXPECT_EQ(open_cost, planner.startCost());
+}
+
+/*
+ * Random cell flips and start moves: after every repair the start cost
+ * equals that of a fresh search on the same map.
+ */
+TEST(GridPlanner, RepairMatchesFreshSearch)
+{
+  TiledOccupancyGrid map(mapConfig());
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> coordinate(0, map.width() - 1);
+  for (int i = 0; i < 60; i++)
+  {
+    setOccupied(map, coordinate(rng), coordinate(rng), true);
+  }
+  map.setChangeTracking(true);
+
+  double gx = cellCenter(80);
+  double gy = cellCenter(80);
+  double sx = cellCenter(10);
+  double sy = cellCenter(10);
+  GridPlanner planner;
+  planner.reset(map);
+  ASSERT_TRUE(planner.setGoal(gx, gy));
+  ASSERT_TRUE(planner.setStart(sx, sy));
+  planner.plan();
+
+  std::vector<uint32_t> changes;
+  std::uniform_int_distribution<int> flips(1, 12);
+  for (int round = 0; round < 300; round++)
+  {
+    for (int f = flips(rng); f > 0; f--)
+    {
+      int x = coordinate(rng);
+      int y = coordinate(rng);
+      setOccupied(map, x, y, map.cellClass(x, y) != Pheeno::CELL_OCCUPIED);
+    }
+    if (round % 10 == 9)
+    {
+      // The robot moved along
+      sx = cellCenter(coordinate(rng));
+      sy = cellCenter(coordinate(rng));
+      ASSERT_TRUE(planner.setStart(sx, sy));
+    }
+
+    map.takeClassChanges(changes);
+    planner.mapChanged(map, changes);
+    planner.plan();
+    ASSERT_EQ(freshCost(map, sx, sy, gx, gy), planner.startCost()) << "round " << round;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
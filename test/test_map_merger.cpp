@@ -0,0 +1,106 @@
+#include "pheeno_ros/map_merger.h"
+#include "pheeno_ros/occupancy_grid.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <vector>
+
+namespace
+{
+  TiledOccupancyGrid::Config mapConfig()
+  {
+    TiledOccupancyGrid::Config config;
+    config.resolution = 0.05;
+    config.width = 64;
+    config.height = 64;
+    config.origin_x = 0.0;
+    config.origin_y = 0.0;
+    return config;
+  }
+
+  std::vector<uint8_t> delta(TiledOccupancyGrid& map, int8_t value)
+  {
+    map.setLogOdds(10, 10, value);
+    std::vector<uint8_t> out;
+    map.encodeDelta(out);
+    return out;
+  }
+
+  int8_t mergedCell(MapMerger& merger, const std::vector<uint8_t>& data)
+  {
+    EXPECT_TRUE(merger.applyDelta(0, &data[0], data.size()));
+    merger.update();
+    return merger.map().logOdds(10, 10);
+  }
+}
+
+/*
+ * Within a session, a late delta does not overwrite a newer tile.
+ */
+TEST(MapMerger, IgnoresLateDeltas)
+{
+  MapMerger merger(mapConfig());
+  merger.addSource();
+  TiledOccupancyGrid robot(mapConfig());
+
+  std::vector<uint8_t> first = delta(robot, 50);
+  std::vector<uint8_t> second = delta(robot, -50);
+  EXPECT_EQ(-50, mergedCell(merger, second));
+  EXPECT_EQ(-50, mergedCell(merger, first));
+}
+
+/*
+ * A sender that restarts a few deltas in has a lower sequence but a new
+ * session: its tiles replace the old ones right away, and late deltas from
+ * before the restart are ignored.
+ */
+TEST(MapMerger, ResetsRestartedSource)
+{
+  MapMerger merger(mapConfig());
+  merger.addSource();
+
+  TiledOccupancyGrid before(mapConfig());
+  before.setDeltaSession(1);
+  std::vector<uint8_t> late;
+  for (int i = 0; i < 5; i++)
+  {
+    std::vector<uint8_t> data = delta(before, 60);
+    if (i == 3)
+    {
+      late = data;
+      continue;
+    }
+    EXPECT_EQ(60, mergedCell(merger, data));
+  }
+
+  TiledOccupancyGrid after(mapConfig());
+  after.setDeltaSession(2);
+  EXPECT_EQ(-40, mergedCell(merger, delta(after, -40)));
+  EXPECT_EQ(-40, mergedCell(merger, late));
+  EXPECT_EQ(30, mergedCell(merger, delta(after, 30)));
+}
+
+/*
+ * A restart forgets tiles the new session has not sent yet.
+ */
+TEST(MapMerger, RestartDropsOldTiles)
+{
+  MapMerger merger(mapConfig());
+  merger.addSource();
+
+  TiledOccupancyGrid before(mapConfig());
+  before.setDeltaSession(1);
+  before.setLogOdds(40, 40, 70);
+  EXPECT_EQ(70, mergedCell(merger, delta(before, 70)));
+  EXPECT_EQ(70, merger.map().logOdds(40, 40));
+
+  TiledOccupancyGrid after(mapConfig());
+  after.setDeltaSession(2);
+  EXPECT_EQ(20, mergedCell(merger, delta(after, 20)));
+  EXPECT_EQ(0, merger.map().logOdds(40, 40));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+#include "pheeno_ros/motion_monitor.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace
+{
+  const double DT = 0.01;  // 100 Hz sensors
+
+  /*
+   * Feeds a MotionMonitor a robot whose wheels, gyroscope and
+   * accelerometer agree, up to constant IMU biases and noise.
+   */
+  struct Robot
+  {
+    MotionMonitor monitor;
+    double stamp;
+    double speed;  // m/s, from the wheels
+    double gyro_bias;
+    double accel_bias;
+    std::mt19937 rng;
+    std::normal_distribution<double> noise;
+    unsigned int raised;
+
+    Robot() : stamp(0.0), speed(0.0), gyro_bias(0.03), accel_bias(0.15), rng(3), noise(0.0, 1.0), raised(0) {}
+
+    // One sample period: wheels at (linear, angular), the IMU measuring
+    // true_acceleration and true_yaw_rate.
+    void step(double command_linear, double command_angular, double linear, double angular,
+              double true_acceleration, double true_yaw_rate)
+    {
+      stamp += DT;
+      speed = linear;
+      monitor.command(stamp, command_linear, command_angular);
+      raised |= monitor.wheels(stamp, linear, angular);
+      raised |= monitor.gyroscope(stamp, true_yaw_rate + gyro_bias + 0.01 * noise(rng));
+      raised |= monitor.accelerometer(stamp, true_acceleration + accel_bias + 0.05 * noise(rng),
+                                      0.05 * noise(rng));
+    }
+
+    // Drives at (linear, angular) with everything agreeing, ramping the
+    // speed over ramp seconds.
+    void drive(double linear, double angular, double seconds, double ramp = 0.5)
+    {
+      double start = speed;
+      for (double t = 0.0; t < seconds; t += DT)
+      {
+        double previous = speed;
+        double next = start + (linear - start) * std::min(1.0, (t + DT) / ramp);
+        step(linear, angular, next, angular, (next - previous) / DT, angular);
+      }
+    }
+  };
+}
+
+TEST(MotionMonitor, QuietWhileWheelsAndImuAgree)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 3.0);  // Learn the biases standing still
+  robot.drive(0.08, 0.0, 3.0);
+  robot.drive(0.05, 0.8, 2.0);
+  robot.drive(-0.06, 0.0, 2.0);
+  robot.drive(0.0, 0.0, 1.0);
+
+  EXPECT_EQ(0u, robot.raised);
+  EXPECT_EQ(0u, robot.monitor.events(robot.stamp));
+  EXPECT_LT(std::abs(robot.monitor.yawRateResidual()), 0.1);
+  EXPECT_LT(std::abs(robot.monitor.speedResidual()), 0.02);
+}
+
+TEST(MotionMonitor, StallRaisedOnceAndHeld)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 1.0);
+
+  // Commanded backward, wheels not turning
+  unsigned int first = 0;
+  for (int i = 0; i < 50; i++)
+  {
+    robot.step(-0.08, 0.0, 0.0, 0.0, 0.0, 0.0);
+    if (robot.raised && !first)
+    {
+      first = i + 1;
+    }
+  }
+  EXPECT_EQ(static_cast<unsigned int>(Pheeno::MOTION_STALL), robot.raised);
+  EXPECT_NEAR(robot.monitor.config().stall_time / DT, first, 2.0);
+  EXPECT_EQ(1u, robot.monitor.eventCount(Pheeno::MOTION_STALL));
+
+  double direction = 0.0;
+  ASSERT_TRUE(robot.monitor.obstacle(robot.stamp, direction));
+  EXPECT_NEAR(M_PI, direction, 1e-6);  // Behind
+
+  // Stopping the command lets the event expire after hold_time.
+  robot.drive(0.0, 0.0, robot.monitor.config().hold_time + 0.1);
+  EXPECT_EQ(0u, robot.monitor.events(robot.stamp));
+  EXPECT_FALSE(robot.monitor.obstacle(robot.stamp, direction));
+}
+
+TEST(MotionMonitor, WheelsTurningAgainstObstacleIsYawSlip)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 3.0);
+
+  // The wheels report a turn the gyroscope does not see.
+  int samples = 0;
+  while (!(robot.raised & Pheeno::MOTION_SLIP) && samples < 100)
+  {
+    robot.step(0.0, 1.0, 0.0, 1.0, 0.0, 0.0);
+    samples++;
+  }
+  EXPECT_LE(samples, 10);
+  EXPECT_EQ(0u, robot.raised & Pheeno::MOTION_STALL);  // The wheels are turning
+  EXPECT_LT(robot.monitor.yawRateResidual(), -robot.monitor.config().slip_yaw_rate);
+}
+
+TEST(MotionMonitor, SuddenStopIsSpeedSlipAndImpactAhead)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 1.0);
+  robot.drive(0.08, 0.0, 3.0);
+  ASSERT_EQ(0u, robot.raised);
+
+  // The robot stops within two samples, its wheels spinning on.
+  robot.step(0.08, 0.0, 0.08, 0.0, -4.0, 0.0);
+  robot.step(0.08, 0.0, 0.08, 0.0, -4.0, 0.0);
+  for (int i = 0; i < 5; i++)
+  {
+    robot.step(0.08, 0.0, 0.08, 0.0, 0.0, 0.0);
+  }
+
+  EXPECT_TRUE(robot.raised & Pheeno::MOTION_IMPACT);
+  EXPECT_TRUE(robot.raised & Pheeno::MOTION_SLIP);
+  EXPECT_GT(robot.monitor.speedResidual(), robot.monitor.config().slip_speed);
+  double direction = 1.0;
+  ASSERT_TRUE(robot.monitor.obstacle(robot.stamp, direction));
+  EXPECT_NEAR(0.0, direction, 1e-6);
+}
+
+TEST(MotionMonitor, SideImpactPointsAtObstacle)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 3.0);
+
+  // Pushed to the left, so hit from the right.
+  robot.stamp += DT;
+  unsigned int raised = robot.monitor.accelerometer(robot.stamp, robot.accel_bias, 5.0);
+  EXPECT_EQ(static_cast<unsigned int>(Pheeno::MOTION_IMPACT), raised);
+  double direction = 0.0;
+  ASSERT_TRUE(robot.monitor.obstacle(robot.stamp, direction));
+  EXPECT_NEAR(-M_PI / 2.0, direction, 0.05);
+}
+
+TEST(MotionMonitor, InputGapRestartsResiduals)
+{
+  Robot robot;
+  robot.drive(0.0, 0.0, 3.0);
+  robot.step(0.0, 1.0, 0.0, 1.0, 0.0, 0.0);
+  EXPECT_NE(0.0, robot.monitor.yawRateResidual());
+
+  robot.stamp += robot.monitor.config().max_gap + 0.1;
+  robot.monitor.gyroscope(robot.stamp, robot.gyro_bias);
+  robot.monitor.accelerometer(robot.stamp, robot.accel_bias, 0.0);
+  EXPECT_EQ(0.0, robot.monitor.yawRateResidual());
+  EXPECT_EQ(0.0, robot.monitor.speedResidual());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,209 @@
+#include "pheeno_ros/occupancy_grid.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+  TiledOccupancyGrid::Config mapConfig()
+  {
+    TiledOccupancyGrid::Config config;
+    config.resolution = 0.05;
+    config.width = 80;
+    config.height = 64;
+    config.origin_x = -2.0;
+    config.origin_y = -1.6;
+    return config;
+  }
+
+  int8_t saturatingAdd(int8_t value, int delta)
+  {
+    return static_cast<int8_t>(std::min(127, std::max(-128, value + delta)));
+  }
+
+  // Plain per-cell Bresenham the tiled, run-merged insertBeam must match.
+  void referenceBeam(const TiledOccupancyGrid::Config& config, std::vector<int8_t>& cells,
+                     double sx, double sy, double ex, double ey, bool hit)
+  {
+    int x0 = static_cast<int>(std::floor((sx - config.origin_x) / config.resolution));
+    int y0 = static_cast<int>(std::floor((sy - config.origin_y) / config.resolution));
+    int x1 = static_cast<int>(std::floor((ex - config.origin_x) / config.resolution));
+    int y1 = static_cast<int>(std::floor((ey - config.origin_y) / config.resolution));
+
+    int dx = std::abs(x1 - x0);
+    int dy = -std::abs(y1 - y0);
+    int error = dx + dy;
+    int x = x0;
+    int y = y0;
+    while (x != x1 || y != y1)
+    {
+      if (x >= 0 && y >= 0 && x < config.width && y < config.height)
+      {
+        cells[y * config.width + x] = saturatingAdd(cells[y * config.width + x], config.miss);
+      }
+      int error2 = 2 * error;
+      if (error2 >= dy)
+      {
+        error += dy;
+        x += x0 < x1 ? 1 : -1;
+      }
+      if (error2 <= dx)
+      {
+        error += dx;
+        y += y0 < y1 ? 1 : -1;
+      }
+    }
+    if (x1 >= 0 && y1 >= 0 && x1 < config.width && y1 < config.height)
+    {
+      cells[y1 * config.width + x1] = saturatingAdd(cells[y1 * config.width + x1], hit ? config.hit : config.miss);
+    }
+  }
+
+  void expectSameCells(const TiledOccupancyGrid& a, const TiledOccupancyGrid& b)
+  {
+    for (int y = 0; y < a.height(); y++)
+    {
+      for (int x = 0; x < a.width(); x++)
+      {
+        ASSERT_EQ(a.logOdds(x, y), b.logOdds(x, y)) << x << ", " << y;
+      }
+    }
+  }
+}
+
+TEST(OccupancyGrid, BeamsMatchPerCellReference)
+{
+  TiledOccupancyGrid::Config config = mapConfig();
+  TiledOccupancyGrid map(config);
+  std::vector<int8_t> reference(config.width * config.height, 0);
+
+  // Beams start inside and may end outside, so runs get clipped too.
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> inside_x(-1.9, 1.9);
+  std::uniform_real_distribution<double> inside_y(-1.5, 1.5);
+  std::uniform_real_distribution<double> end_x(-2.5, 2.5);
+  std::uniform_real_distribution<double> end_y(-2.1, 2.1);
+  for (int i = 0; i < 2000; i++)
+  {
+    double sx = inside_x(rng);
+    double sy = inside_y(rng);
+    double ex = end_x(rng);
+    double ey = end_y(rng);
+    bool hit = (i % 3) != 0;
+    map.insertBeam(sx, sy, ex, ey, hit);
+    referenceBeam(config, reference, sx, sy, ex, ey, hit);
+  }
+
+  for (int y = 0; y < config.height; y++)
+  {
+    for (int x = 0; x < config.width; x++)
+    {
+      ASSERT_EQ(reference[y * config.width + x], map.logOdds(x, y)) << x << ", " << y;
+    }
+  }
+}
+
+TEST(OccupancyGrid, DeltaReplaysRleAndRawTiles)
+{
+  TiledOccupancyGrid map(mapConfig());
+  TiledOccupancyGrid copy(mapConfig());
+
+  // One tile of noise (raw), a few beams (runs) and one saturated cell.
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> noise(-128, 127);
+  for (int y = 16; y < 32; y++)
+  {
+    for (int x = 32; x < 48; x++)
+    {
+      map.setLogOdds(x, y, static_cast<int8_t>(noise(rng)));
+    }
+  }
+  map.insertBeam(-1.5, -1.0, 1.5, 1.2, true);
+  map.insertBeam(0.3, 1.4, -1.8, -1.4, false);
+  map.setLogOdds(79, 63, 127);
+
+  std::vector<uint8_t> delta;
+  map.encodeDelta(delta);
+  EXPECT_EQ(0u, map.dirtyTileCount());
+  ASSERT_TRUE(copy.applyDelta(&delta[0], delta.size()));
+  expectSameCells(map, copy);
+
+  // The noise tile cannot be run-length encoded, the others can.
+  MapDeltaReader reader(&delta[0], delta.size());
+  ASSERT_TRUE(reader.valid());
+  EXPECT_LT(delta.size(), static_cast<std::size_t>(reader.tileCount()) * Pheeno::MAP_TILE_CELLS);
+}
+
+TEST(OccupancyGrid, DeltaSplitsAtMaxBytes)
+{
+  TiledOccupancyGrid map(mapConfig());
+  TiledOccupancyGrid copy(mapConfig());
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> noise(-128, 127);
+  for (int y = 0; y < map.height(); y += 3)
+  {
+    for (int x = 0; x < map.width(); x += 2)
+    {
+      map.setLogOdds(x, y, static_cast<int8_t>(noise(rng)));
+    }
+  }
+
+  std::size_t deltas = 0;
+  while (map.dirtyTileCount() > 0)
+  {
+    std::vector<uint8_t> delta;
+    map.encodeDelta(delta, 700);
+    ASSERT_LE(delta.size(), 700u);
+    ASSERT_TRUE(copy.applyDelta(&delta[0], delta.size()));
+    deltas++;
+  }
+  EXPECT_GT(deltas, 1u);
+  expectSameCells(map, copy);
+}
+
+TEST(OccupancyGrid, RejectsTruncatedAndMismatchedDeltas)
+{
+  TiledOccupancyGrid map(mapConfig());
+  map.insertBeam(-1.5, -1.0, 1.5, 1.2, true);
+  std::vector<uint8_t> delta;
+  map.encodeDelta(delta);
+
+  for (std::size_t length = 0; length < delta.size(); length++)
+  {
+    TiledOccupancyGrid copy(mapConfig());
+    EXPECT_FALSE(copy.applyDelta(&delta[0], length)) << length;
+  }
+
+  TiledOccupancyGrid::Config other = mapConfig();
+  other.width = 96;
+  TiledOccupancyGrid wider(other);
+  EXPECT_FALSE(wider.applyDelta(&delta[0], delta.size()));
+}
+
+TEST(OccupancyGrid, JournalsClassChanges)
+{
+  TiledOccupancyGrid map(mapConfig());
+  map.setChangeTracking(true);
+
+  map.setLogOdds(3, 4, Pheeno::OCCUPIED_LOG_ODDS);
+  map.setLogOdds(3, 4, Pheeno::OCCUPIED_LOG_ODDS + 10);  // Still occupied
+  map.setLogOdds(5, 6, Pheeno::FREE_LOG_ODDS + 1);        // Still unknown
+
+  std::vector<uint32_t> changes;
+  map.takeClassChanges(changes);
+  ASSERT_EQ(1u, changes.size());
+  EXPECT_EQ(static_cast<uint32_t>(4 * map.width() + 3), changes[0]);
+
+  map.takeClassChanges(changes);
+  EXPECT_TRUE(changes.empty());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
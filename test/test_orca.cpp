@@ -0,0 +1,205 @@
+#include "pheeno_ros/orca.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  const double RADIUS = 0.06;
+  const double MAX_SPEED = 0.15;
+  const double DT = 0.1;
+
+  OrcaAgent agent(double x, double y, double pref_vx, double pref_vy)
+  {
+    OrcaAgent a;
+    a.x = x;
+    a.y = y;
+    a.vx = pref_vx;
+    a.vy = pref_vy;
+    a.pref_vx = pref_vx;
+    a.pref_vy = pref_vy;
+    a.radius = RADIUS;
+    a.max_speed = MAX_SPEED;
+    return a;
+  }
+
+  // Smallest center distance between any two agents
+  double closestPair(const std::vector<OrcaAgent>& agents)
+  {
+    double closest = 1e9;
+    for (std::size_t i = 0; i < agents.size(); i++)
+    {
+      for (std::size_t j = i + 1; j < agents.size(); j++)
+      {
+        closest = std::min(closest, std::hypot(agents[i].x - agents[j].x, agents[i].y - agents[j].y));
+      }
+    }
+    return closest;
+  }
+
+  // Steps every agent towards its goal for steps control periods
+  void simulate(OrcaBatch& batch, std::vector<OrcaAgent>& agents, const std::vector<double>& goal_x,
+                const std::vector<double>& goal_y, int steps, double& closest)
+  {
+    std::vector<double> vx;
+    std::vector<double> vy;
+    closest = closestPair(agents);
+    for (int step = 0; step < steps; step++)
+    {
+      for (std::size_t i = 0; i < agents.size(); i++)
+      {
+        double dx = goal_x[i] - agents[i].x;
+        double dy = goal_y[i] - agents[i].y;
+        double distance = std::hypot(dx, dy);
+        double speed = std::min(MAX_SPEED, distance / DT);
+        agents[i].pref_vx = distance > 0.0 ? dx / distance * speed : 0.0;
+        agents[i].pref_vy = distance > 0.0 ? dy / distance * speed : 0.0;
+      }
+      batch.solve(agents, DT, vx, vy);
+      for (std::size_t i = 0; i < agents.size(); i++)
+      {
+        agents[i].vx = vx[i];
+        agents[i].vy = vy[i];
+        agents[i].x += vx[i] * DT;
+        agents[i].y += vy[i] * DT;
+      }
+      closest = std::min(closest, closestPair(agents));
+    }
+  }
+}
+
+TEST(Orca, KeepsPreferredVelocityWhenAlone)
+{
+  OrcaSolver solver;
+  OrcaAgent a = agent(0.0, 0.0, 0.1, -0.05);
+  OrcaAgent far = agent(2.0, 0.0, -0.1, 0.0);
+
+  double vx = 0.0;
+  double vy = 0.0;
+  EXPECT_TRUE(solver.solve(a, NULL, 0, DT, vx, vy));
+  EXPECT_NEAR(0.1, vx, 1e-9);
+  EXPECT_NEAR(-0.05, vy, 1e-9);
+
+  // Out of neighbor_distance, so ignored
+  EXPECT_TRUE(solver.solve(a, &far, 1, DT, vx, vy));
+  EXPECT_NEAR(0.1, vx, 1e-9);
+  EXPECT_NEAR(-0.05, vy, 1e-9);
+}
+
+TEST(Orca, ClampsToMaxSpeed)
+{
+  OrcaSolver solver;
+  OrcaAgent a = agent(0.0, 0.0, 1.0, 1.0);
+  OrcaAgent b = agent(0.3, 0.05, -1.0, 0.0);
+
+  double vx = 0.0;
+  double vy = 0.0;
+  solver.solve(a, NULL, 0, DT, vx, vy);
+  EXPECT_NEAR(MAX_SPEED, std::hypot(vx, vy), 1e-9);
+  EXPECT_NEAR(vx, vy, 1e-9);  // Same direction as preferred
+
+  solver.solve(a, &b, 1, DT, vx, vy);
+  EXPECT_LE(std::hypot(vx, vy), MAX_SPEED + 1e-9);
+}
+
+TEST(Orca, HeadOnPairPassesWithoutContact)
+{
+  OrcaBatch batch(OrcaSolver::Config(), 1);
+  std::vector<OrcaAgent> agents;
+  // Slightly off-axis: a perfectly symmetric pair deadlocks, as with any
+  // reciprocal scheme, and real robots never line up exactly.
+  agents.push_back(agent(-0.5, 0.005, MAX_SPEED, 0.0));
+  agents.push_back(agent(0.5, -0.005, -MAX_SPEED, 0.0));
+  std::vector<double> goal_x(1, 0.5);
+  goal_x.push_back(-0.5);
+  std::vector<double> goal_y(1, 0.005);
+  goal_y.push_back(-0.005);
+
+  double closest = 0.0;
+  simulate(batch, agents, goal_x, goal_y, 150, closest);
+  EXPECT_GE(closest, 2.0 * RADIUS - 1e-3);
+  for (std::size_t i = 0; i < agents.size(); i++)
+  {
+    EXPECT_NEAR(goal_x[i], agents[i].x, 0.02);
+    EXPECT_NEAR(goal_y[i], agents[i].y, 0.02);
+  }
+}
+
+TEST(Orca, CrossingStreamsPassWithoutContact)
+{
+  OrcaBatch batch(OrcaSolver::Config(), 2);
+  std::vector<OrcaAgent> agents;
+  std::vector<double> goal_x;
+  std::vector<double> goal_y;
+  for (int i = 0; i < 5; i++)
+  {
+    // One row heading +x, one column heading +y, through the same square
+    double offset = -0.4 + 0.2 * i;
+    agents.push_back(agent(-1.0, offset + 0.05, 0.0, 0.0));
+    goal_x.push_back(1.0);
+    goal_y.push_back(offset + 0.05);
+    agents.push_back(agent(offset, -1.0, 0.0, 0.0));
+    goal_x.push_back(offset);
+    goal_y.push_back(1.0);
+  }
+
+  double closest = 0.0;
+  simulate(batch, agents, goal_x, goal_y, 300, closest);
+  EXPECT_GE(closest, 2.0 * RADIUS - 1e-3);
+  for (std::size_t i = 0; i < agents.size(); i++)
+  {
+    EXPECT_NEAR(goal_x[i], agents[i].x, 0.02) << i;
+    EXPECT_NEAR(goal_y[i], agents[i].y, 0.02) << i;
+  }
+}
+
+// Enough agents for several blocks, so the threads really split the work.
+TEST(Orca, BatchIsIndependentOfThreadCount)
+{
+  std::mt19937 rng(23);
+  std::uniform_real_distribution<double> position(0.0, 4.0);
+  std::uniform_real_distribution<double> velocity(-MAX_SPEED, MAX_SPEED);
+  std::vector<OrcaAgent> agents;
+  for (int i = 0; i < 1200; i++)
+  {
+    agents.push_back(agent(position(rng), position(rng), velocity(rng), velocity(rng)));
+  }
+
+  OrcaBatch single(OrcaSolver::Config(), 1);
+  OrcaBatch several(OrcaSolver::Config(), 4);
+  std::vector<double> vx1, vy1, vx4, vy4;
+  single.solve(agents, DT, vx1, vy1);
+  several.solve(agents, DT, vx4, vy4);
+  ASSERT_EQ(agents.size(), vx4.size());
+
+  OrcaSolver solver;
+  for (std::size_t i = 0; i < agents.size(); i++)
+  {
+    EXPECT_EQ(vx1[i], vx4[i]) << i;
+    EXPECT_EQ(vy1[i], vy4[i]) << i;
+
+    // Same as solving against the brute-force neighbor list
+    std::vector<OrcaAgent> neighbors;
+    for (std::size_t j = 0; j < agents.size(); j++)
+    {
+      if (j != i)
+      {
+        neighbors.push_back(agents[j]);
+      }
+    }
+    double vx = 0.0;
+    double vy = 0.0;
+    solver.solve(agents[i], &neighbors[0], neighbors.size(), DT, vx, vy);
+    EXPECT_NEAR(vx, vx1[i], 1e-12) << i;
+    EXPECT_NEAR(vy, vy1[i], 1e-12) << i;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,166 @@
+#include "pheeno_ros/particle_filter.h"
+#include "pheeno_ros/pheeno_hardware.h"
+#include "pheeno_ros/pose2d.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  typedef Pheeno::StandardHardware HW;
+
+  const double RESOLUTION = 0.02;
+  const int WIDTH = 60;   // 1.2 m
+  const int HEIGHT = 40;  // 0.8 m
+
+  /*
+   * A walled 1.2 x 0.8 m arena with an off-center box, so no two poses
+   * see the same ranges.
+   */
+  struct Arena
+  {
+    std::vector<int8_t> occupancy;
+
+    Arena() : occupancy(WIDTH * HEIGHT, 0)
+    {
+      for (int y = 0; y < HEIGHT; y++)
+      {
+        for (int x = 0; x < WIDTH; x++)
+        {
+          bool wall = x == 0 || y == 0 || x == WIDTH - 1 || y == HEIGHT - 1;
+          bool box = x >= 40 && x < 48 && y >= 24 && y < 34;
+          occupancy[y * WIDTH + x] = (wall || box) ? 100 : 0;
+        }
+      }
+    }
+
+    bool occupied(double wx, double wy) const
+    {
+      int x = static_cast<int>(std::floor(wx / RESOLUTION));
+      int y = static_cast<int>(std::floor(wy / RESOLUTION));
+      return x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT || occupancy[y * WIDTH + x] > 50;
+    }
+
+    // Ray-marched IR ranges (cm) of a robot at pose
+    Pheeno::IrRanges<HW> ranges(const Pose2D& pose) const
+    {
+      Pheeno::IrRanges<HW> ir;
+      for (std::size_t i = 0; i < HW::IR_COUNT; i++)
+      {
+        const Pheeno::IrMount& mount = HW::irMount(i);
+        double sx = pose.x + mount.x * std::cos(pose.theta) - mount.y * std::sin(pose.theta);
+        double sy = pose.y + mount.x * std::sin(pose.theta) + mount.y * std::cos(pose.theta);
+        double angle = pose.theta + mount.angle;
+        double range = 0.0;
+        while (range < HW::irMaxRange() / 100.0 &&
+               !occupied(sx + range * std::cos(angle), sy + range * std::sin(angle)))
+        {
+          range += 0.002;
+        }
+        ir[i] = std::min(range, HW::irMaxRange() / 100.0) * 100.0;
+      }
+      return ir;
+    }
+  };
+
+  // A loop around the free part of the arena
+  Pose2D pathPose(int step)
+  {
+    double t = step * 0.08;
+    return Pose2D(0.45 + 0.25 * std::cos(t), 0.4 + 0.2 * std::sin(t), t + M_PI / 2.0);
+  }
+
+  double headingError(double a, double b)
+  {
+    return std::abs(std::atan2(std::sin(a - b), std::cos(a - b)));
+  }
+
+  void step(ParticleFilter& filter, const Arena& arena, int i)
+  {
+    filter.predict(pathPose(i - 1), pathPose(i));
+    filter.correct<HW>(arena.ranges(pathPose(i)));
+    filter.resample();
+  }
+}
+
+TEST(ParticleFilter, TracksFromKnownStart)
+{
+  Arena arena;
+  ParticleFilter filter;
+  ASSERT_TRUE(filter.setMap(&arena.occupancy[0], WIDTH, HEIGHT, RESOLUTION, 0.0, 0.0));
+
+  filter.initialize(Pose2D(pathPose(0).x + 0.05, pathPose(0).y - 0.04, pathPose(0).theta + 0.1), 0.08, 0.2);
+  EXPECT_FALSE(filter.converged());
+  for (int i = 1; i <= 60; i++)
+  {
+    step(filter, arena, i);
+  }
+  EXPECT_TRUE(filter.converged());
+
+  Pose2D truth = pathPose(60);
+  EXPECT_NEAR(truth.x, filter.estimate().x, 0.03);
+  EXPECT_NEAR(truth.y, filter.estimate().y, 0.03);
+  EXPECT_LT(headingError(truth.theta, filter.estimate().theta), 0.1);
+}
+
+TEST(ParticleFilter, GlobalLocalizationConverges)
+{
+  Arena arena;
+  ParticleFilter::Config config;
+  config.max_particles = 5000;
+  config.seed = 11;
+  ParticleFilter filter(config);
+  ASSERT_TRUE(filter.setMap(&arena.occupancy[0], WIDTH, HEIGHT, RESOLUTION, 0.0, 0.0));
+
+  filter.initializeUniform();
+  EXPECT_FALSE(filter.converged());
+  for (int i = 1; i <= 120; i++)
+  {
+    step(filter, arena, i);
+  }
+  EXPECT_TRUE(filter.converged());
+
+  Pose2D truth = pathPose(120);
+  EXPECT_NEAR(truth.x, filter.estimate().x, 0.05);
+  EXPECT_NEAR(truth.y, filter.estimate().y, 0.05);
+  EXPECT_LT(headingError(truth.theta, filter.estimate().theta), 0.15);
+}
+
+TEST(ParticleFilter, KldShrinksConvergedFilter)
+{
+  Arena arena;
+  ParticleFilter::Config config;
+  config.max_particles = 3000;
+  ParticleFilter filter(config);
+  ASSERT_TRUE(filter.setMap(&arena.occupancy[0], WIDTH, HEIGHT, RESOLUTION, 0.0, 0.0));
+
+  filter.initializeUniform();
+  filter.correct<HW>(arena.ranges(pathPose(0)));
+  filter.resample();
+  std::size_t spread = filter.size();
+
+  filter.initialize(pathPose(0), 0.01, 0.02);
+  for (int i = 1; i <= 20; i++)
+  {
+    step(filter, arena, i);
+  }
+  EXPECT_LT(filter.size(), spread);
+  EXPECT_LE(filter.size(), static_cast<std::size_t>(config.max_particles));
+  EXPECT_GE(filter.size(), static_cast<std::size_t>(config.min_particles));
+}
+
+TEST(ParticleFilter, RejectsEmptyMap)
+{
+  ParticleFilter filter;
+  std::vector<int8_t> occupancy(1, 0);
+  EXPECT_FALSE(filter.setMap(&occupancy[0], 0, 0, RESOLUTION, 0.0, 0.0));
+  EXPECT_FALSE(filter.hasMap());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+#include "pheeno_ros/path_follower.h"
+#include "pheeno_ros/pose2d.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const double DT = 0.05;
+
+  // Unicycle step of pose under (linear, angular) for DT
+  void drive(Pose2D& pose, double linear, double angular)
+  {
+    pose.x += linear * std::cos(pose.theta) * DT;
+    pose.y += linear * std::sin(pose.theta) * DT;
+    pose.theta += angular * DT;
+  }
+
+  struct FollowRun
+  {
+    int steps;
+    double worst_cross_track;  // m, once settled on the path
+    bool monotonic;            // Progress and closest segment never moved back
+  };
+
+  // Follows until done or max_steps, with the cross track error measured
+  // after the first settle_steps.
+  FollowRun follow(PathFollower& follower, Pose2D& pose, int max_steps, int settle_steps)
+  {
+    FollowRun run = {0, 0.0, true};
+    double progress = 0.0;
+    std::size_t closest = 0;
+    double linear = 0.0;
+    double angular = 0.0;
+    while (run.steps < max_steps && follower.update(pose, linear, angular))
+    {
+      EXPECT_LE(std::abs(angular), follower.config().max_angular + 1e-9);
+      EXPECT_LE(linear, follower.config().linear_velocity + 1e-9);
+      if (follower.progress() < progress - 1e-9 || follower.closestSegment() < closest)
+      {
+        run.monotonic = false;
+      }
+      progress = follower.progress();
+      closest = follower.closestSegment();
+      if (run.steps >= settle_steps)
+      {
+        run.worst_cross_track = std::max(run.worst_cross_track, std::abs(follower.crossTrackError()));
+      }
+      drive(pose, linear, angular);
+      run.steps++;
+    }
+    return run;
+  }
+}
+
+TEST(PathFollower, DropsRepeatedPoints)
+{
+  std::vector<Pose2D> points;
+  points.push_back(Pose2D(0.0, 0.0, 0.0));
+  points.push_back(Pose2D(0.3, 0.0, 0.0));
+  points.push_back(Pose2D(0.3, 0.0, 1.0));
+  points.push_back(Pose2D(0.3, 0.4, 0.0));
+
+  PathFollower follower;
+  follower.setPath(points);
+  EXPECT_EQ(3u, follower.pointCount());
+  EXPECT_NEAR(0.7, follower.length(), 1e-12);
+
+  follower.clear();
+  EXPECT_FALSE(follower.hasPath());
+  double linear = 1.0;
+  double angular = 1.0;
+  EXPECT_FALSE(follower.update(Pose2D(0.0, 0.0, 0.0), linear, angular));
+  EXPECT_EQ(0.0, linear);
+  EXPECT_EQ(0.0, angular);
+}
+
+TEST(PathFollower, TurnsInPlaceTowardTargetBehind)
+{
+  std::vector<Pose2D> points;
+  points.push_back(Pose2D(0.0, 0.0, 0.0));
+  points.push_back(Pose2D(1.0, 0.0, 0.0));
+
+  PathFollower follower;
+  follower.setPath(points);
+  double linear = 0.0;
+  double angular = 0.0;
+  EXPECT_TRUE(follower.update(Pose2D(0.0, 0.01, M_PI), linear, angular));
+  EXPECT_EQ(0.0, linear);
+  EXPECT_EQ(follower.config().max_angular, angular);  // Target on the left
+}
+
+TEST(PathFollower, PurePursuitSettlesOntoLine)
+{
+  std::vector<Pose2D> points;
+  points.push_back(Pose2D(0.0, 0.0, 0.0));
+  points.push_back(Pose2D(1.5, 0.0, 0.0));
+
+  PathFollower follower;
+  follower.setPath(points);
+  Pose2D pose(0.0, 0.1, 0.3);
+  FollowRun run = follow(follower, pose, 1000, 200);
+  EXPECT_TRUE(follower.done());
+  EXPECT_TRUE(run.monotonic);
+  EXPECT_LT(run.worst_cross_track, 0.01);
+  EXPECT_LE(std::hypot(pose.x - 1.5, pose.y), follower.config().goal_tolerance);
+}
+
+TEST(PathFollower, StanleyFollowsCorner)
+{
+  std::vector<Pose2D> points;
+  points.push_back(Pose2D(0.0, 0.0, 0.0));
+  points.push_back(Pose2D(0.8, 0.0, 0.0));
+  points.push_back(Pose2D(0.8, 0.8, 0.0));
+
+  PathFollower::Config config;
+  config.mode = Pheeno::FOLLOW_STANLEY;
+  PathFollower follower(config);
+  follower.setPath(points);
+  Pose2D pose(0.0, -0.05, 0.0);
+  FollowRun run = follow(follower, pose, 1000, 100);
+  EXPECT_TRUE(follower.done());
+  EXPECT_TRUE(run.monotonic);
+  EXPECT_LT(run.worst_cross_track, 0.08);  // Cutting the corner
+  EXPECT_LE(std::hypot(pose.x - 0.8, pose.y - 0.8), config.goal_tolerance);
+}
+
+// A figure eight crosses itself; the closest point search must stay on the
+// current pass instead of jumping to the other one.
+TEST(PathFollower, SplineThroughCrossingIsFollowedInOrder)
+{
+  std::vector<Pose2D> control;
+  control.push_back(Pose2D(0.0, 0.0, 0.0));
+  control.push_back(Pose2D(0.4, 0.3, 0.0));
+  control.push_back(Pose2D(0.8, 0.0, 0.0));
+  control.push_back(Pose2D(0.4, -0.3, 0.0));
+  control.push_back(Pose2D(0.0, 0.0, 0.0));
+  control.push_back(Pose2D(-0.4, 0.3, 0.0));
+  control.push_back(Pose2D(-0.8, 0.0, 0.0));
+  control.push_back(Pose2D(-0.4, -0.3, 0.0));
+  control.push_back(Pose2D(0.0, 0.0, 0.0));
+
+  PathFollower follower;
+  follower.setSpline(control, 10);
+  EXPECT_EQ(81u, follower.pointCount());
+
+  Pose2D pose(0.0, 0.0, std::atan2(0.3, 0.4));
+  FollowRun run = follow(follower, pose, 4000, 0);
+  EXPECT_TRUE(follower.done());
+  EXPECT_TRUE(run.monotonic);
+  EXPECT_LT(run.worst_cross_track, 0.03);
+  EXPECT_NEAR(follower.length(), follower.progress(), follower.config().lookahead);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
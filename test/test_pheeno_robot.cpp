@@ -0,0 +1,50 @@
+#include "ros/ros.h"
+#include "std_msgs/Int16.h"
+#include "pheeno_ros/pheeno_robot.h"
+#include <gtest/gtest.h>
+
+namespace
+{
+  const std::string PHEENO_NAME = "/pheeno_test";
+
+  // Spins until the first encoder reads value or timeout seconds pass
+  bool waitForEncoder(PheenoRobot& pheeno, ros::Publisher& pub, int value, double timeout)
+  {
+    std_msgs::Int16 msg;
+    msg.data = static_cast<int16_t>(value);
+    ros::Time end = ros::Time::now() + ros::Duration(timeout);
+    while (ros::ok() && ros::Time::now() < end)
+    {
+      pub.publish(msg);
+      ros::spinOnce();
+      if (pheeno.encoder_vals_[0] == value)
+      {
+        return true;
+      }
+      ros::Duration(0.01).sleep();
+    }
+    return false;
+  }
+}
+
+// The behavior nodes enable SENSOR_SWEEP whether or not the bridge runs in
+// packed mode. With an unpacked bridge no sweep ever arrives, so a method
+// needing the encoders must still subscribe to their topics.
+TEST(PheenoRobot, EncodersFlowWithSweepEnabledAndUnpackedSource)
+{
+  ros::NodeHandle nh;
+  PheenoRobot pheeno(PHEENO_NAME, Pheeno::IR_SENSORS | Pheeno::SENSOR_SWEEP);
+  pheeno.setWheelControl(true);
+  EXPECT_TRUE(pheeno.enabledSensors() & Pheeno::ENCODERS);
+
+  ros::Publisher pub = nh.advertise<std_msgs::Int16>(PHEENO_NAME + "/" + Pheeno::Hardware::encoderTopic(0), 1);
+  EXPECT_TRUE(waitForEncoder(pheeno, pub, 42, 5.0));
+  EXPECT_EQ(0u, pheeno.sensor_sweep_count_);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_pheeno_robot");
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include "pheeno_ros/pose_ekf.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace
+{
+  const double PERIOD = 0.0025;  // 400 Hz wheel odometry
+
+  double wheelStamp(int k)
+  {
+    return k * PERIOD;
+  }
+
+  void feedWheels(PoseEkf& ekf, int begin, int end)
+  {
+    for (int k = begin; k < end; k++)
+    {
+      ekf.wheelOdometry(wheelStamp(k), 0.1 + 0.02 * std::sin(k * 0.05), 0.5 * std::cos(k * 0.03));
+    }
+  }
+
+  void expectSameEstimate(const PoseEkf& expected, const PoseEkf& actual)
+  {
+    EXPECT_DOUBLE_EQ(expected.stamp(), actual.stamp());
+    for (int i = 0; i < PoseEkf::STATE_SIZE; i++)
+    {
+      PoseEkf::STATE row = static_cast<PoseEkf::STATE>(i);
+      EXPECT_NEAR(expected.state(row), actual.state(row), 1e-12) << "state " << i;
+      for (int j = 0; j < PoseEkf::STATE_SIZE; j++)
+      {
+        PoseEkf::STATE column = static_cast<PoseEkf::STATE>(j);
+        EXPECT_NEAR(expected.covariance(row, column), actual.covariance(row, column), 1e-15)
+          << "covariance " << i << ", " << j;
+      }
+    }
+  }
+
+  /*
+   * Wheel odometry 0 .. count - 1 with a gyroscope reading between wheel
+   * measurements after and after + 1, fed once in order and once with the
+   * gyroscope last. Both filters must end in the same estimate.
+   */
+  void compareLateGyroscope(int count, int after)
+  {
+    double gyro_stamp = wheelStamp(after) + 0.5 * PERIOD;
+
+    PoseEkf in_order;
+    feedWheels(in_order, 0, after + 1);
+    ASSERT_TRUE(in_order.gyroscope(gyro_stamp, 0.45));
+    feedWheels(in_order, after + 1, count);
+
+    PoseEkf late;
+    feedWheels(late, 0, count);
+    ASSERT_TRUE(late.gyroscope(gyro_stamp, 0.45));
+    EXPECT_EQ(1u, late.measurements() - static_cast<unsigned long>(count));
+    EXPECT_GT(late.replayed(), 0u);
+
+    expectSameEstimate(in_order, late);
+  }
+}
+
+TEST(PoseEkf, LateMeasurementInPartlyFilledHistory)
+{
+  compareLateGyroscope(50, 10);
+}
+
+TEST(PoseEkf, LateMeasurementAfterOldestOfPartlyFilledHistory)
+{
+  compareLateGyroscope(50, 0);
+}
+
+/*
+ * With a full ring, a measurement that belongs right after the oldest
+ * entry lands at the front once that entry is forgotten; it must start
+ * from the forgotten entry's estimate.
+ */
+TEST(PoseEkf, LateMeasurementAtFrontOfFullHistory)
+{
+  int count = 200;
+  compareLateGyroscope(count, count - static_cast<int>(PoseEkf::HISTORY_SIZE));
+}
+
+TEST(PoseEkf, LateMeasurementInFullHistory)
+{
+  int count = 200;
+  compareLateGyroscope(count, count - static_cast<int>(PoseEkf::HISTORY_SIZE) + 40);
+}
+
+/*
+ * A measurement older than the whole history is dropped and leaves the
+ * estimate alone.
+ */
+TEST(PoseEkf, DropsMeasurementOlderThanHistory)
+{
+  int count = 200;
+  PoseEkf reference;
+  feedWheels(reference, 0, count);
+
+  PoseEkf late;
+  feedWheels(late, 0, count);
+  double gyro_stamp = wheelStamp(count - static_cast<int>(PoseEkf::HISTORY_SIZE) - 1) + 0.5 * PERIOD;
+  EXPECT_FALSE(late.gyroscope(gyro_stamp, 0.45));
+  EXPECT_EQ(1u, late.late());
+  expectSameEstimate(reference, late);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
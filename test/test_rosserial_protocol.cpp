@@ -0,0 +1,97 @@
+#include "pheeno_ros/rosserial_protocol.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  RosserialTopicInfo topicInfo()
+  {
+    RosserialTopicInfo info;
+    info.topic_id = 125;
+    info.topic_name = "/pheeno_01/scan_center";
+    info.message_type = "std_msgs/Float32";
+    info.md5sum = "73fcbf46b49191e672908e50842a83d4";
+    info.buffer_size = 512;
+    return info;
+  }
+
+  // Overwrites the little-endian uint32 at offset
+  void setLength(std::vector<uint8_t>& data, std::size_t offset, uint32_t value)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      data[offset + i] = static_cast<uint8_t>((value >> (8 * i)) & 0xFF);
+    }
+  }
+}
+
+TEST(RosserialProtocol, TopicInfoRoundTrip)
+{
+  std::vector<uint8_t> data;
+  encodeRosserialTopicInfo(topicInfo(), data);
+
+  RosserialTopicInfo info;
+  ASSERT_TRUE(decodeRosserialTopicInfo(&data[0], data.size(), info));
+  EXPECT_EQ(125, info.topic_id);
+  EXPECT_EQ("/pheeno_01/scan_center", info.topic_name);
+  EXPECT_EQ("std_msgs/Float32", info.message_type);
+  EXPECT_EQ("73fcbf46b49191e672908e50842a83d4", info.md5sum);
+  EXPECT_EQ(512, info.buffer_size);
+}
+
+TEST(RosserialProtocol, RejectsMalformedStringLengths)
+{
+  std::vector<uint8_t> data;
+  encodeRosserialTopicInfo(topicInfo(), data);
+
+  // The topic name length follows the 2 byte topic id. Lengths near 2^32
+  // would wrap offset + size on a 32-bit target.
+  const uint32_t lengths[] = {0xFFFFFFFFu, 0xFFFFFFFEu, 0xFFFFFFFFu - 5u, 0x80000000u,
+                              static_cast<uint32_t>(data.size())};
+  for (std::size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+  {
+    std::vector<uint8_t> corrupt(data);
+    setLength(corrupt, 2, lengths[i]);
+    RosserialTopicInfo info;
+    EXPECT_FALSE(decodeRosserialTopicInfo(&corrupt[0], corrupt.size(), info)) << lengths[i];
+  }
+}
+
+TEST(RosserialProtocol, RejectsTruncatedTopicInfo)
+{
+  std::vector<uint8_t> data;
+  encodeRosserialTopicInfo(topicInfo(), data);
+
+  for (std::size_t length = 0; length < data.size(); length++)
+  {
+    RosserialTopicInfo info;
+    EXPECT_FALSE(decodeRosserialTopicInfo(&data[0], length, info)) << length;
+  }
+}
+
+TEST(RosserialProtocol, ParsesEncodedFrame)
+{
+  std::vector<uint8_t> payload;
+  encodeRosserialTopicInfo(topicInfo(), payload);
+  std::vector<uint8_t> frame;
+  encodeRosserialFrame(0, &payload[0], payload.size(), frame);
+
+  RosserialFrameParser parser;
+  RosserialFrameParser::Result result = RosserialFrameParser::NEED_MORE;
+  for (std::size_t i = 0; i < frame.size(); i++)
+  {
+    result = parser.feed(frame[i]);
+  }
+  ASSERT_EQ(RosserialFrameParser::FRAME_READY, result);
+  EXPECT_EQ(0, parser.topicId());
+  ASSERT_EQ(payload.size(), parser.size());
+  EXPECT_TRUE(std::equal(payload.begin(), payload.end(), parser.data()));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,71 @@
+#include "pheeno_ros/sim_experiment.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+namespace
+{
+  SimExperiment::Config experimentConfig(Pheeno::BEHAVIOR behavior, bool sensor_errors)
+  {
+    SimExperiment::Config config;
+    // Enough robots for several SimWorld::BLOCK_SIZE blocks, so four
+    // threads really split the steps
+    config.world.arena_width = 8.0;
+    config.world.arena_height = 8.0;
+    config.behavior = behavior;
+    config.robots = 300;
+    config.duration = 5.0;
+    config.obstacles = 16;
+    config.sensor_errors = sensor_errors;
+    return config;
+  }
+
+  // Runs one seeded experiment with one step thread and with four; the
+  // results must match exactly, not just closely.
+  void compareThreads(Pheeno::BEHAVIOR behavior, bool sensor_errors, uint32_t seed)
+  {
+    SimExperiment::Config config = experimentConfig(behavior, sensor_errors);
+    config.threads = 1;
+    SimResult single = SimExperiment(config).run(seed);
+    config.threads = 4;
+    SimResult multi = SimExperiment(config).run(seed);
+
+    EXPECT_EQ(single.coverage, multi.coverage);
+    EXPECT_EQ(single.coverage_rate, multi.coverage_rate);
+    EXPECT_EQ(single.collisions, multi.collisions);
+    EXPECT_EQ(single.contact_time, multi.contact_time);
+    EXPECT_EQ(single.stall_time, multi.stall_time);
+    EXPECT_EQ(single.time_to_goal, multi.time_to_goal);
+    EXPECT_GT(single.coverage, 0.0);
+  }
+}
+
+TEST(SimExperiment, ThreadCountDoesNotChangeAvoidance)
+{
+  compareThreads(Pheeno::BEHAVIOR_OBSTACLE_AVOIDANCE, false, 7);
+}
+
+TEST(SimExperiment, ThreadCountDoesNotChangeRandomWalk)
+{
+  compareThreads(Pheeno::BEHAVIOR_RANDOM_WALK, false, 11);
+}
+
+TEST(SimExperiment, ThreadCountDoesNotChangeSensorErrors)
+{
+  compareThreads(Pheeno::BEHAVIOR_OBSTACLE_AVOIDANCE, true, 13);
+}
+
+TEST(SimExperiment, RepeatsWithSameSeed)
+{
+  SimExperiment experiment(experimentConfig(Pheeno::BEHAVIOR_OBSTACLE_AVOIDANCE, true));
+  SimResult first = experiment.run(5);
+  SimResult second = experiment.run(5);
+  EXPECT_EQ(first.coverage, second.coverage);
+  EXPECT_EQ(first.collisions, second.collisions);
+  EXPECT_EQ(first.stall_time, second.stall_time);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,64 @@
+#include "pheeno_ros/worker_team.h"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace
+{
+  // Runs phases of count items on team, checking every item is visited
+  // exactly once per phase by a valid thread.
+  void expectEachItemOnce(WorkerTeam& team, std::size_t count, std::size_t block_size, int phases)
+  {
+    std::vector<int> visits(count, 0);
+    std::atomic<bool> bad_thread(false);
+    for (int phase = 0; phase < phases; phase++)
+    {
+      team.run(count, block_size,
+               [&](unsigned int thread, std::size_t begin, std::size_t end)
+               {
+                 if (thread >= team.threadCount())
+                 {
+                   bad_thread = true;
+                 }
+                 for (std::size_t i = begin; i < end; i++)
+                 {
+                   visits[i]++;
+                 }
+               });
+    }
+    EXPECT_FALSE(bad_thread);
+    for (std::size_t i = 0; i < count; i++)
+    {
+      ASSERT_EQ(phases, visits[i]) << i;
+    }
+  }
+}
+
+TEST(WorkerTeam, VisitsEachItemOncePerPhase)
+{
+  WorkerTeam team(4);
+  EXPECT_EQ(4u, team.threadCount());
+  expectEachItemOnce(team, 1000, 16, 500);
+  expectEachItemOnce(team, 17, 16, 100);  // Fewer blocks than threads
+  expectEachItemOnce(team, 5, 16, 10);    // One block, run by the caller
+  expectEachItemOnce(team, 0, 16, 10);
+}
+
+TEST(WorkerTeam, ResizesBetweenPhases)
+{
+  WorkerTeam team(1);
+  expectEachItemOnce(team, 300, 8, 20);
+  team.setThreads(3);
+  EXPECT_EQ(3u, team.threadCount());
+  expectEachItemOnce(team, 300, 8, 20);
+  team.setThreads(1);
+  EXPECT_EQ(1u, team.threadCount());
+  expectEachItemOnce(team, 300, 8, 20);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}